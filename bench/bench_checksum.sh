@@ -0,0 +1,6 @@
+#!/bin/bash
+#
+# Measures the copyin/copyout overhead of CRC32C block checksums.
+# Usage: bench/bench_checksum.sh   (run from the top of the repository)
+
+exec $(dirname $0)/bench_copy.sh plain checksum encrypt encrypt,checksum
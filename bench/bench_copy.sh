@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Compares copyin/copyout throughput of images formatted with different features.
+# Usage: bench/bench_copy.sh <mode>...   (run from the top of the repository)
+#
+# A mode is "plain" or a feature list as accepted by format, e.g. "encrypt,checksum".
+# FILES (default 4) files of 4 MB are copied in and out PASSES (default 8)
+# times per session, the best of ROUNDS (default 3) sessions counts; the first mode is the baseline the overhead of
+# the others is reported against.
+#
+# Each pass runs in its own sfssh session; the time of a session that only
+# mounts is subtracted, so e.g. the password derivation is not counted.
+
+FILES=${FILES:-4}
+ROUNDS=${ROUNDS:-3}
+PASSES=${PASSES:-8}
+SIZE=4000000
+BLOCKS=$((FILES * 1100 + 1000))
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+for i in $(seq $FILES); do
+    head -c $SIZE /dev/urandom > $SCRATCH/file$i
+done
+
+now() {
+    date +%s.%N
+}
+
+# session <image> <password or empty> <commands...>
+session() {
+    IMAGE=$1
+    PASSWORD=$2
+    shift 2
+    {
+	echo mount
+	[ -n "$PASSWORD" ] && echo $PASSWORD
+	for command in "$@"; do
+	    echo $command
+	done
+    } | ./bin/sfssh $IMAGE $BLOCKS > /dev/null 2>&1
+}
+
+elapsed() {
+    BEST=
+    for round in $(seq $ROUNDS); do
+	START=$(now)
+	session "$@"
+	BEST=$(awk "BEGIN {t = $(now) - $START; print (\"$BEST\" == \"\" || t < $BEST+0) ? t : $BEST+0}")
+    done
+    echo $BEST
+}
+
+throughput() {
+    awk "BEGIN {printf \"%.1f\", $PASSES * $FILES * $SIZE / 1000000 / ($1 - $2)}"
+}
+
+overhead() {
+    [ -z "$2" ] && { echo "-"; return; }
+    awk "BEGIN {printf \"%+.1f%%\", ($2 / $1 - 1) * 100}"
+}
+
+printf "%-18s %12s %9s %12s %9s\n" mode "copyin MB/s" overhead "copyout MB/s" overhead
+BASE_IN=
+BASE_OUT=
+for MODE in "$@"; do
+    IMAGE=$SCRATCH/image.$MODE
+    PASSWORD=
+    case $MODE in
+	*encrypt*) PASSWORD=bench ;;
+    esac
+    {
+	[ $MODE = plain ] && echo format || echo format $MODE
+	[ -n "$PASSWORD" ] && echo $PASSWORD
+    } | ./bin/sfssh $IMAGE $BLOCKS > /dev/null 2>&1
+
+    COPYIN=()
+    COPYOUT=()
+    for pass in $(seq $PASSES); do
+	for i in $(seq $FILES); do
+	    COPYIN+=("copyin $SCRATCH/file$i file$i")
+	    COPYOUT+=("copyout file$i $SCRATCH/out$i")
+	done
+    done
+
+    MOUNT=$(elapsed $IMAGE "$PASSWORD")
+    IN=$(throughput $(elapsed $IMAGE "$PASSWORD" "${COPYIN[@]}") $MOUNT)
+    OUT=$(throughput $(elapsed $IMAGE "$PASSWORD" "${COPYOUT[@]}") $MOUNT)
+
+    for i in $(seq $FILES); do
+	cmp -s $SCRATCH/file$i $SCRATCH/out$i || echo "$MODE: file$i differs" >&2
+	rm -f $SCRATCH/out$i
+    done
+
+    # the overhead is the extra time per byte compared to the first mode
+    printf "%-18s %12s %9s %12s %9s\n" $MODE $IN $(overhead $IN $BASE_IN) $OUT $(overhead $OUT $BASE_OUT)
+    BASE_IN=${BASE_IN:-$IN}
+    BASE_OUT=${BASE_OUT:-$OUT}
+    rm -f $IMAGE
+done
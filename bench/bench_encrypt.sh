@@ -0,0 +1,6 @@
+#!/bin/bash
+#
+# Compares copyin/copyout throughput of a plaintext and an encrypted image.
+# Usage: bench/bench_encrypt.sh   (run from the top of the repository)
+
+exec $(dirname $0)/bench_copy.sh plain encrypt
@@ -0,0 +1,65 @@
+/**
+ * @file aes.h
+ * @brief Interface for the AES-128-XTS cipher used by encrypted disks.
+ * @date 2026-10-18
+ *
+ * @details XTS (IEEE 1619) encrypts every block independently with the block
+ * number as tweak, so blocks can be read and written in any order and equal
+ * plaintext blocks do not produce equal ciphertext.
+ * Uses AES-NI when the CPU has it, a portable implementation otherwise.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief XTS class
+ * AES-128-XTS with a 256 bit key: the first half encrypts data, the second half the tweak.
+ * Used by the Disk to encrypt blocks at rest.
+ */
+class XTS {
+public:
+    const static size_t KEY_SIZE  = 32;                             /** Bytes of key: two AES-128 keys @hideinitializer*/
+    const static size_t UNIT_SIZE = 16;                             /** Bytes of one AES block @hideinitializer*/
+
+    /**
+     * @brief constructor of XTS class; expands both keys
+     * @param key KEY_SIZE bytes of key
+     */
+    XTS(const uint8_t key[KEY_SIZE]);
+
+    /**
+     * @brief encrypts one sector
+     * @param sector sector number used as tweak
+     * @param in plaintext
+     * @param out ciphertext; may be the same buffer as in
+     * @param length number of bytes, a multiple of UNIT_SIZE
+     */
+    void    encrypt(uint64_t sector, const char *in, char *out, size_t length) const;
+
+    /**
+     * @brief decrypts one sector
+     * @param sector sector number used as tweak
+     * @param in ciphertext
+     * @param out plaintext; may be the same buffer as in
+     * @param length number of bytes, a multiple of UNIT_SIZE
+     */
+    void    decrypt(uint64_t sector, const char *in, char *out, size_t length) const;
+
+    /**
+     * @brief name of the code path in use
+     * @return "aes-ni" or "portable"
+     */
+    static const char *implementation();
+
+private:
+    const static int ROUNDS = 10;                                   /** AES-128 rounds @hideinitializer*/
+
+    uint8_t DataKeys[ROUNDS + 1][UNIT_SIZE];                        /** Encryption round keys of the data key @hideinitializer*/
+    uint8_t DataDecKeys[ROUNDS + 1][UNIT_SIZE];                     /** Decryption round keys of the data key, in the order AES-NI uses @hideinitializer*/
+    uint8_t TweakKeys[ROUNDS + 1][UNIT_SIZE];                       /** Encryption round keys of the tweak key @hideinitializer*/
+
+    void    crypt(uint64_t sector, const char *in, char *out, size_t length, bool decrypting) const;
+};
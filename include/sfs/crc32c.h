@@ -0,0 +1,36 @@
+/**
+ * @file crc32c.h
+ * @brief Interface for the CRC32C (Castagnoli) checksum used by checksummed disks.
+ * @date 2026-10-18
+ *
+ * @details Uses the SSE4.2 crc32 instruction when the CPU has it and a table
+ * driven implementation otherwise; both produce the same values.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief CRC32C class
+ * Stateless CRC32C computation.
+ * Used by the Disk to verify blocks on read.
+ */
+class CRC32C {
+public:
+    /**
+     * @brief computes the CRC32C of a buffer
+     * @param data the buffer
+     * @param length number of bytes in data
+     * @param crc CRC32C of the preceding data, to checksum in pieces
+     * @return CRC32C of the preceding data followed by data
+     */
+    static uint32_t compute(const char *data, size_t length, uint32_t crc = 0);
+
+    /**
+     * @brief name of the code path in use
+     * @return "sse4.2" or "portable"
+     */
+    static const char *implementation();
+};
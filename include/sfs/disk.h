@@ -8,20 +8,91 @@
 
 #pragma once
 
+#include "sfs/iotrace.h"
+
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class XTS;
 
 /**
  * @brief Disk class
  * Implements Disk abstraction that enables emulation of a disk image.
  * Used by file system to access and make changes to the disk.
+ * Reads and writes of different blocks may run on several threads at once.
  */
 class Disk {
 private:
     int	    FileDescriptor;                                         /** File descriptor of disk image @hideinitializer*/
     size_t  Blocks;	                                                /** Number of blocks in disk image @hideinitializer*/
-    size_t  Reads;	                                                /** Number of reads performed @hideinitializer*/
-    size_t  Writes;	                                                /** Number of writes performed @hideinitializer*/
+    std::atomic<size_t> Reads;                                      /** Number of reads performed @hideinitializer*/
+    std::atomic<size_t> Writes;                                     /** Number of writes performed @hideinitializer*/
     size_t  Mounts;	                                                /** Number of mounts @hideinitializer*/
+    XTS    *Cipher;                                                 /** Cipher of an encrypted disk; NULL for plaintext @hideinitializer*/
+    size_t  ChecksumStart;                                          /** First block of the checksum table @hideinitializer*/
+    size_t  ChecksumBlocks;                                         /** Blocks of the checksum table; 0 if checksums are off @hideinitializer*/
+    std::atomic<size_t> Verified;                                   /** Number of reads whose checksum was verified @hideinitializer*/
+    size_t  Discarded;                                              /** Number of blocks given back to the host @hideinitializer*/
+    std::vector<uint32_t> Checksums;                                /** CRC32C of every block as stored; 0 if unknown @hideinitializer*/
+    std::vector<bool>     ChecksumDirty;                            /** Table blocks that changed since they were written @hideinitializer*/
+    std::mutex            ChecksumLock;                             /** Serializes updates of ChecksumDirty by concurrent writes @hideinitializer*/
+    std::atomic<size_t> RegionReads[IO_REGIONS];                    /** Number of blocks read, by IoRegion @hideinitializer*/
+    std::atomic<size_t> RegionWrites[IO_REGIONS];                   /** Number of blocks written, by IoRegion @hideinitializer*/
+    size_t  LayoutEnds[IO_REGIONS];                                 /** First block past each region, by IoRegion; all 0 if no layout @hideinitializer*/
+    FILE   *TraceFile;                                              /** Block trace being recorded; NULL when not tracing @hideinitializer*/
+    uint64_t TraceEpoch;                                            /** Monotonic time the trace started, in nanoseconds @hideinitializer*/
+    std::vector<IoRecord> TraceBuffer;                              /** Records not yet written to TraceFile @hideinitializer*/
+    std::mutex            TraceLock;                                /** Serializes the records of concurrent I/O @hideinitializer*/
+    static thread_local uint8_t CallerTag;                          /** TraceOp of the operation running on this thread @hideinitializer*/
+    bool    Quiet;                                                  /** Close without printing the counters @hideinitializer*/
+
+    /**
+     * @brief region of a block, by the layout
+     * @param blocknum index of the block
+     * @return the IoRegion; REGION_UNKNOWN if no layout was set
+     */
+    uint8_t region(size_t blocknum) const;
+
+    /**
+     * @brief appends a record to the block trace
+     * @param op IoOp
+     * @param blocknum first block
+     * @param count blocks in the run
+     * @param region IoRegion of the first block
+     * @param start monotonic time the I/O started, in nanoseconds
+     */
+    void    trace(uint8_t op, size_t blocknum, size_t count, uint8_t region, uint64_t start);
+
+    /**
+     * @brief counts blocks read or written by region, and traces the I/O when tracing
+     * @param op IoOp
+     * @param blocknum first block
+     * @param count blocks in the run
+     * @param known IoRegion the caller knows the block belongs to; REGION_UNKNOWN to use the layout
+     * @param start monotonic time the I/O started, in nanoseconds; 0 if not tracing
+     */
+    void    account(uint8_t op, size_t blocknum, size_t count, uint8_t known, uint64_t start) {
+        uint8_t r = known ? known : region(blocknum);
+        if (op == IO_READ) RegionReads[r] += count;
+        else if (op == IO_WRITE) RegionWrites[r] += count;
+        if (TraceFile) trace(op, blocknum, count, r, start);
+    }
+
+    /**
+     * @brief check if a block is covered by a checksum
+     * @param blocknum index of the block
+     * @return true unless checksums are off, or blocknum is the superblock or part of the table
+     */
+    bool    checksummed(int blocknum) const {
+        return ChecksumBlocks && blocknum > 0 &&
+               ((size_t)blocknum < ChecksumStart || (size_t)blocknum >= ChecksumStart + ChecksumBlocks);
+    }
 
     /** 
      * @brief check if the block is within valid range
@@ -38,7 +109,10 @@ public:
      * @brief constructor of Disk class
      * @return an instance of Disk class
      */
-    Disk() : FileDescriptor(0), Blocks(0), Reads(0), Writes(0), Mounts(0) {}
+    Disk() : FileDescriptor(0), Blocks(0), Reads(0), Writes(0), Mounts(0), Cipher(NULL),
+             ChecksumStart(0), ChecksumBlocks(0), Verified(0), Discarded(0), LayoutEnds(), TraceFile(NULL), TraceEpoch(0), Quiet(false) {
+        for (size_t r = 0; r < IO_REGIONS; r++) RegionReads[r] = RegionWrites[r] = 0;
+    }
     
     /**
      * @brief destructor of Disk class
@@ -54,12 +128,51 @@ public:
      */
     void    open(const char *path, size_t nblocks);
 
+    /**
+     * @brief drops the content of every block; the image becomes a sparse file of zeros
+     * Checksums in use are forgotten, so the dropped blocks are not verified.
+     * @return void function; returns nothing. throws runtime_error exception on error.
+     */
+    void    clear();
+
     /**
      * @brief check size of disk
      * @return size of disk in terms of blocks
      */
     size_t  size() const { return Blocks; }
 
+    /**
+     * @brief number of blocks read
+     * @return count since the disk was opened
+     */
+    size_t  reads() const { return Reads; }
+
+    /**
+     * @brief number of blocks written
+     * @return count since the disk was opened
+     */
+    size_t  writes() const { return Writes; }
+
+    /**
+     * @brief number of blocks read from a region
+     * @param region IoRegion
+     * @return count since the disk was opened
+     */
+    size_t  region_reads(uint8_t region) const { return region < IO_REGIONS ? RegionReads[region].load() : 0; }
+
+    /**
+     * @brief number of blocks written to a region
+     * @param region IoRegion
+     * @return count since the disk was opened
+     */
+    size_t  region_writes(uint8_t region) const { return region < IO_REGIONS ? RegionWrites[region].load() : 0; }
+
+    /**
+     * @brief keeps the destructor from printing the read and write counters, for programs that embed the library
+     * @param quiet true to close silently
+     */
+    void    set_quiet(bool quiet) { Quiet = quiet; }
+
     /**
      * @brief check if the disk has been mounted
      * @return true if the disk has been mounted; false otherwise
@@ -78,17 +191,143 @@ public:
      */
     void    unmount() { if (Mounts > 0) Mounts--; }
 
+    /**
+     * @brief sets the key used to encrypt every block except the superblock
+     * @param key XTS::KEY_SIZE bytes of key; NULL stores blocks in plaintext again
+     */
+    void    set_key(const uint8_t *key);
+
+    /**
+     * @brief check if blocks are encrypted
+     * @return true if a key is set; false otherwise
+     */
+    bool    encrypted() const { return Cipher != NULL; }
+
+    /**
+     * @brief turns on CRC32C checksums of every block except the superblock and the table itself
+     * Checksums are kept in memory and written back by flush_checksums(), or when they are turned off.
+     * @param start first block of the checksum table
+     * @param count number of table blocks, 1024 checksums each; 0 writes back the table and turns checksums off
+     * @param fresh true to start with an empty table instead of loading it (used by format)
+     */
+    void    set_checksums(size_t start, size_t count, bool fresh);
+
+    /**
+     * @brief writes back the table blocks that changed
+     */
+    void    flush_checksums();
+
+    /**
+     * @brief computes the checksum of every covered block again from what is stored, without verifying it
+     * For a table left stale by a crash; corruption that happened before cannot be detected afterwards.
+     */
+    void    rebuild_checksums();
+
+    /**
+     * @brief number of reads whose checksum was verified
+     * @return count since the disk was opened
+     */
+    size_t  verified() const { return Verified; }
+
+    /**
+     * @brief gives a run of unused blocks back to the host by punching a hole into the image
+     * The blocks read as zeros afterwards and their checksums are forgotten.
+     * @param blocknum first block of the run
+     * @param count number of blocks
+     * @return true if the hole was punched; false if the host file system cannot punch holes.
+     * throws runtime_error exception on other errors.
+     */
+    bool    discard(int blocknum, size_t count);
+
+    /**
+     * @brief number of blocks given back to the host
+     * @return count since the disk was opened
+     */
+    size_t  discarded() const { return Discarded; }
+
+    /**
+     * @brief copies blocks from a host file into the disk, inside the kernel when it can (copy_file_range)
+     * Only disks that store blocks as they are, without key and checksums, can be copied to this way.
+     * @param fd host file open for reading
+     * @param offset position of the data in the host file
+     * @param blocknum first block of the run
+     * @param count number of blocks in the run
+     * @return void function; returns nothing. throws invalid_argument if blocks are encrypted or checksummed,
+     * runtime_error if the host file ends early or on I/O errors.
+     */
+    void    copy_in(int fd, off_t offset, int blocknum, size_t count);
+
+    /**
+     * @brief copies the start of a run of blocks to a host file, inside the kernel when it can (copy_file_range)
+     * Only disks that store blocks as they are, without key and checksums, can be copied from this way.
+     * @param blocknum first block of the run
+     * @param length number of bytes to copy
+     * @param fd host file open for writing; one that cannot seek, like a pipe, is written in order
+     * @param offset position in the host file
+     * @return void function; returns nothing. throws invalid_argument if blocks are encrypted or checksummed,
+     * runtime_error on I/O errors.
+     */
+    void    copy_out(int blocknum, size_t length, int fd, off_t offset);
+
+    /**
+     * @brief sets the regions blocks are classified in by the block trace; the data region fills the gap
+     * @param inode_blocks blocks of the inode table, after the superblock
+     * @param index_blocks blocks of the fingerprint index, after the inode table
+     * @param table_blocks blocks of the checksum table, after the fingerprint index
+     * @param dir_blocks blocks of directories, at the end of the disk
+     */
+    void    set_layout(size_t inode_blocks, size_t index_blocks, size_t table_blocks, size_t dir_blocks);
+
+    /**
+     * @brief starts recording every block I/O into a block trace that sfsiostat can analyze
+     * @param path host file receiving the trace; replaced if it exists
+     * @return void function; returns nothing. throws runtime_error exception on error.
+     */
+    void    start_trace(const char *path);
+
+    /**
+     * @brief writes out the records left and closes the block trace; does nothing when not tracing
+     */
+    void    stop_trace();
+
+    /**
+     * @brief check if block I/O is being traced
+     * @return true while a block trace is being recorded
+     */
+    bool    tracing() const { return TraceFile != NULL; }
+
+    /**
+     * @brief Tags the block I/O of the current thread with the operation issuing it.
+     * The outermost tag wins, so an operation calling another keeps its own tag.
+     */
+    class Caller {
+    public:
+        Caller(uint8_t tag) : Saved(CallerTag) { if (!Saved) CallerTag = tag; }
+        ~Caller() { CallerTag = Saved; }
+    private:
+        uint8_t Saved;                                              /** Tag of the enclosing operation @hideinitializer*/
+    };
+
+    /**
+     * @brief tag of the operation running on the current thread, for handing on to worker threads
+     * @return the tag; 0 if none
+     */
+    static uint8_t caller() { return CallerTag; }
+
     /**
      * @brief read from disk
      * @param blocknum block to read from
      * @param data data buffer to write into
+     * @param region IoRegion the caller knows the block belongs to, for the block trace; REGION_UNKNOWN to use the layout
+     * @return void function; returns nothing. throws runtime_error if the block does not match its checksum
      */
-    void    read(int blocknum, char *data);
+    void    read(int blocknum, char *data, uint8_t region = REGION_UNKNOWN);
     
     /**
      * @brief write to disk
      * @param blocknum block to write into
      * @param data data buffer to read from
+     * @param region IoRegion the caller knows the block belongs to, for the block trace; REGION_UNKNOWN to use the layout
      */
-    void    write(int blocknum, char *data);
+    void    write(int blocknum, char *data, uint8_t region = REGION_UNKNOWN);
 };
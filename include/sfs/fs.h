@@ -43,14 +43,19 @@
  * - The maximum number of directories per block and entries per directory is an implementation choice. It can be changed by modifying the corresponding value in the code.
  * 
  *-# <b> Implemented 10 Linux shell commands.</b>
- * - ls - list the contents of the directory
+ * - ls - list the contents of the directory; ls -l adds sizes and block counts
  * - cd - change directory
  * - mkdir - create a new directory
  * - rmdir -  remove a directory
  * - stat - display information of all directories
+ * - du - display the bytes and blocks used by a file or a directory tree
  * - touch - create an empty file
  * - copyin - import a file into the file system
  * - copyout - export a file from the file system 
+ * - pcopyin - import a large file with several threads writing its blocks at once
+ * - import - import a host directory tree, with metadata written in bulk
+ * - tar-in / tar-out - stream a tar archive into or out of the file system
+ * - batch - create, remove and rename many entries at once, all or nothing
  * - rm - remove a file or directory
  * - Three password protection commands - change, set, and remove
  * 
@@ -59,6 +64,16 @@
  * - The user password is hashed using this function to prevent password leaks, if any.
  * - The hashed password is stored right in the superblock as most of the space in this block is left unutilised.
  * - Upon mounting the disk, the user is prompted to enter the password. Only after logging in can the user access the disk and make use of the user functions.
+ * - SHA256 uses SHA-NI, or AVX2 to hash eight buffers at once, when the CPU has them. hash prints the digest of a file and of its blocks.
+ *
+ *-# <b> Optional features chosen at format time.</b>
+ * - format takes a comma separated list of features, stored as a bitmask in the superblock.
+ * - compress - file data is stored LZ4 compressed in clusters of 4 blocks. Clusters that do not shrink by a block are stored raw.
+ * - dedup - data blocks are fingerprinted with SHA256 and identical blocks are stored once, shared through reference counts.
+ * - checksum - every block is checksummed with CRC32C (SSE4.2 when available) in a table after the inode blocks, and verified on every read.
+ * - lazy - format only writes the superblock, the root directory and allocation metadata, over a sparse image. Groups of inode and directory blocks are flagged uninitialized in the superblock and written on first use.
+ * - discard - data blocks freed by rm or by overwrites are coalesced into runs and punched out of the image file, so the image shrinks on the host.
+ * - encrypt - every block but the superblock is AES-128-XTS encrypted (AES-NI when available) with a random key, wrapped in the superblock with a PBKDF2 key derived from the password.
  *
  * @section Future-Aspects
  *-# <b> Extend support to devices. </b>
@@ -116,9 +131,16 @@
 #pragma once
 
 #include "sfs/disk.h"
+#include "sfs/histogram.h"
+#include "sfs/timeline.h"
+#include "sfs/trace.h"
 #include <cstring>
+#include <map>
+#include <set>
+#include <string>
 #include <vector>
 #include <stdint.h>
+#include <stdio.h>
 #include <vector>
 
 using namespace std;
@@ -137,6 +159,127 @@ public:
     const static uint32_t NAMESIZE           = 16;              //    Max Name size for files/directories   @hideinitializer
     const static uint32_t ENTRIES_PER_DIR    = 7;              //    Number of Files/Directory entries within a Directory   @hideinitializer
     const static uint32_t DIR_PER_BLOCK      = 8;               //    Number of Directories per 4KB block   @hideinitializer
+    const static uint32_t CLUSTER_BLOCKS     = 4;               //    Number of logical blocks compressed together  @hideinitializer
+    const static uint32_t FINGERPRINTS_PER_BLOCK = 102;         //    Number of fingerprint index entries in a 4KB block  @hideinitializer
+    const static uint32_t DEDUP_RATIO        = 64;              //    Disk blocks per block of fingerprint index  @hideinitializer
+    const static uint32_t DEDUP_BATCH        = 8;               //    Number of blocks fingerprinted together  @hideinitializer
+    const static uint32_t HASH_BATCH         = 16;              //    Number of blocks read and hashed together by hash  @hideinitializer
+
+    const static uint32_t FEATURE_COMPRESS   = 0x1;             //    File data is stored LZ4 compressed in clusters  @hideinitializer
+    const static uint32_t FEATURE_DEDUP      = 0x2;             //    Identical data blocks are stored once and shared  @hideinitializer
+    const static uint32_t FEATURE_ENCRYPT    = 0x4;             //    Every block but the superblock is AES-XTS encrypted  @hideinitializer
+    const static uint32_t FEATURE_CHECKSUM   = 0x8;             //    Every block is verified against a CRC32C on read  @hideinitializer
+    const static uint32_t FEATURE_LAZY       = 0x10;            //    Inode and directory blocks are written on first use  @hideinitializer
+    const static uint32_t FEATURE_DISCARD    = 0x20;            //    Freed data blocks are punched out of the image file  @hideinitializer
+    const static uint32_t FEATURE_USAGE      = 0x40;            //    Directories keep the byte and block totals of their subtree; set by every format  @hideinitializer
+
+    const static uint32_t CHECKSUMS_PER_BLOCK = 1024;           //    Number of CRC32C values in a block of the checksum table  @hideinitializer
+    const static uint32_t LAZY_GROUP_BLOCKS  = 16;              //    Minimum number of inode or directory blocks initialized together  @hideinitializer
+    const static uint32_t UNINIT_WORDS       = 512;             //    Words of the uninitialized group bitmap in the superblock  @hideinitializer
+    const static uint32_t DISCARD_BATCH      = 4096;            //    Freed blocks queued before their runs are discarded  @hideinitializer
+    const static uint32_t COPY_BLOCKS        = 256;             //    Blocks moved per call by copyin and copyout when they buffer  @hideinitializer
+    const static uint32_t COPY_THREADS       = 8;               //    Worker threads of pcopyin unless told otherwise  @hideinitializer
+    const static uint32_t THREAD_BLOCKS      = 64;              //    Minimum number of blocks handed to a pcopyin worker  @hideinitializer
+
+    const static uint32_t KDF_ROUNDS         = 100000;          //    PBKDF2 iterations deriving the key that wraps the disk key  @hideinitializer
+
+    /**
+     * @brief Compression counters.
+     * Accumulated since mount by the compressed read and write paths.
+     */
+    struct CompressionStats {
+        uint64_t Clusters;          /** Number of clusters encoded @hideinitializer*/
+        uint64_t LogicalBytes;      /** Bytes handed to the compressor @hideinitializer*/
+        uint64_t StoredBytes;       /** Bytes of disk blocks used to store them @hideinitializer*/
+        uint64_t CompressNanos;     /** CPU time spent compressing @hideinitializer*/
+        uint64_t DecompressNanos;   /** CPU time spent decompressing @hideinitializer*/
+    };
+
+    /**
+     * @brief Deduplication counters.
+     * Accumulated since mount by the deduplicating write path.
+     */
+    struct DedupStats {
+        uint64_t Blocks;            /** Data blocks fingerprinted @hideinitializer*/
+        uint64_t Duplicates;        /** Blocks shared with an existing copy instead of written @hideinitializer*/
+        uint64_t FilterSkips;       /** Lookups answered by the pre-filter without an index probe @hideinitializer*/
+        uint64_t Probes;            /** Index blocks examined by lookups @hideinitializer*/
+        uint64_t IndexHits;         /** Index blocks found already loaded by the operation @hideinitializer*/
+        uint64_t IndexMisses;       /** Index blocks read from the disk @hideinitializer*/
+    };
+
+    /**
+     * @brief Directory entry with the attributes of its inode.
+     * Filled in by FileSystem::readdir_plus(); directories have no inode and report 0 for Size and Blocks.
+     */
+    struct EntryAttr {
+        char     Name[NAMESIZE];    /** File/Directory Name @hideinitializer*/
+        uint8_t  type;              /** type = 1 for file, type = 0 for directory @hideinitializer*/
+        uint32_t inum;              /** inum for Inodes or offset for dir @hideinitializer*/
+        uint32_t Size;              /** Size of file in bytes @hideinitializer*/
+        uint32_t Blocks;            /** Data blocks and indirect block allocated to the file @hideinitializer*/
+    };
+
+    /**
+     * @brief Byte and block totals of a file or a subtree.
+     * Kept for every directory in the tail of its dirblock, as FileSystem::du() returns them.
+     */
+    struct DiskUsage {
+        uint64_t Bytes;             /** Sum of the file sizes @hideinitializer*/
+        uint64_t Blocks;            /** Data blocks and indirect blocks allocated to the files @hideinitializer*/
+    };
+
+    /**
+     * @brief Snapshot of the counters of a mounted file system.
+     * Filled in by FileSystem::metrics().
+     */
+    struct Metrics {
+        Histogram Latency[TRACE_OPS];       /** Nanoseconds of the public operations since mount, by TraceOp @hideinitializer*/
+        uint64_t  RegionReads[IO_REGIONS];  /** Blocks read since the disk was opened, by IoRegion @hideinitializer*/
+        uint64_t  RegionWrites[IO_REGIONS]; /** Blocks written since the disk was opened, by IoRegion @hideinitializer*/
+        uint64_t  IndexHits;                /** Fingerprint index blocks found already loaded @hideinitializer*/
+        uint64_t  IndexMisses;              /** Fingerprint index blocks read from the disk @hideinitializer*/
+        uint64_t  FilterSkips;              /** Index lookups answered by the dedup pre-filter @hideinitializer*/
+        uint64_t  Probes;                   /** Index blocks examined by lookups @hideinitializer*/
+        uint32_t  Blocks;                   /** Blocks of the disk @hideinitializer*/
+        uint32_t  DataBlocks;               /** Blocks of the data region @hideinitializer*/
+        uint32_t  FreeBlocks;               /** Free blocks of the data region @hideinitializer*/
+        uint32_t  FreeHint;                 /** Where the allocator looks first; no block below it is free @hideinitializer*/
+        uint32_t  DiscardPending;           /** Freed blocks waiting to be given back to the host @hideinitializer*/
+        uint32_t  Inodes;                   /** Inodes of the disk @hideinitializer*/
+        uint32_t  FreeInodes;               /** Free inodes @hideinitializer*/
+        uint32_t  Directories;              /** Directories the directory blocks hold @hideinitializer*/
+        uint32_t  FreeDirectories;          /** Free directories @hideinitializer*/
+    };
+
+    /**
+     * @brief Transaction builder.
+     * Collects creations, removals and renames of entries, by paths relative to the curr_dir.
+     * FileSystem::commit() applies all of them, or none if one fails.
+     */
+    class Transaction {
+    public:
+        void    touch(const string &path)                       { add('t', path, ""); }   /** Creates an empty file */
+        void    mkdir(const string &path)                       { add('d', path, ""); }   /** Creates an empty directory */
+        void    rm(const string &path)                          { add('r', path, ""); }   /** Removes a file or an empty directory */
+        void    rename(const string &from, const string &to)    { add('m', from, to); }   /** Moves an entry, possibly into another directory */
+        size_t  size() const                                    { return Ops.size(); }
+
+    private:
+        friend class FileSystem;
+
+        struct Op {
+            char   Type;            /** 't'ouch, 'd'irectory, 'r'emove or 'm'ove @hideinitializer*/
+            string Path;            /** Entry the operation applies to @hideinitializer*/
+            string Target;          /** New path of a move @hideinitializer*/
+        };
+        vector<Op> Ops;             /** Operations in the order they were added @hideinitializer*/
+
+        void    add(char type, const string &path, const string &target) {
+            Op op = {type, path, target};
+            Ops.push_back(op);
+        }
+    };
 
 private:
     /** 
@@ -153,6 +296,16 @@ private:
     	uint32_t Inodes;	    /**  Number of inodes in file system @hideinitializer*/
         uint32_t Protected;     /**  Field to check if the disk is password protected @hideinitializer*/
         char PasswordHash[257]; /**  Password hash which is used to facilitate password checking @hideinitializer*/
+        uint32_t Features;      /**  Bitmask of FEATURE_* flags chosen at format time @hideinitializer*/
+        uint32_t DedupBlocks;   /**  Number of blocks reserved for the fingerprint index @hideinitializer*/
+        uint32_t KdfRounds;     /**  PBKDF2 iterations used for the password of an encrypted disk @hideinitializer*/
+        uint8_t  KeySalt[16];   /**  PBKDF2 salt @hideinitializer*/
+        uint8_t  WrappedKey[32];/**  Disk key, encrypted with the key derived from the password @hideinitializer*/
+        uint8_t  KeyCheck[16];  /**  Start of the SHA256 of the disk key; detects a wrong password @hideinitializer*/
+        uint32_t ChecksumBlocks;/**  Number of blocks reserved for the checksum table, after the fingerprint index @hideinitializer*/
+        uint32_t GroupBlocks;   /**  Inode or directory blocks per lazily initialized group @hideinitializer*/
+        uint32_t Uninit[UNINIT_WORDS]; /**  Bit set for every group not written yet: inode groups, then directory groups @hideinitializer*/
+        uint32_t Dirty;         /**  Set while a disk with FEATURE_CHECKSUM is mounted; its table is stale if a mount finds it set @hideinitializer*/
     };
 
     /**
@@ -194,6 +347,26 @@ private:
     	uint32_t Indirect;	                                            /** Indirect pointer @hideinitializer*/
     };
 
+    /**
+     * @brief Fingerprint index entry.
+     * Maps the SHA256 of a data block to the block and counts its references.
+     * Entries with Refs = 0 are free.
+    */
+    struct Fingerprint {
+        uint8_t  Hash[32];      /** SHA256 of the block content @hideinitializer*/
+        uint32_t Block;         /** Block holding the content @hideinitializer*/
+        uint32_t Refs;          /** Number of pointers to the block @hideinitializer*/
+    };
+
+    /**
+     * @brief Directory block.
+     * The directories followed by the totals of their subtrees, in space the directories leave unused.
+     */
+    struct DirBlock {
+        Directory Directories[DIR_PER_BLOCK];   /** Same as Block::Directories @hideinitializer*/
+        DiskUsage Usage[DIR_PER_BLOCK];         /** Usage of the subtree of each directory; zero for free slots @hideinitializer*/
+    };
+
     /**
      * @brief Block Union
      * Corresponds to one block of disk of size Disk::BLOCKSIZE.
@@ -205,56 +378,88 @@ private:
     	uint32_t            Pointers[FileSystem::POINTERS_PER_BLOCK];   /**  Contains indexes of Direct Blocks. 0 if null.ck @hideinitializer*/
     	char	            Data[Disk::BLOCK_SIZE];	                    /**  Data block @hideinitializer*/
         struct Directory    Directories[FileSystem::DIR_PER_BLOCK];      /**  Directory blocks @hideinitializer*/
+        struct Fingerprint  Fingerprints[FileSystem::FINGERPRINTS_PER_BLOCK]; /**  Fingerprint index blocks @hideinitializer*/
+        struct DirBlock     Dirs;                                       /**  Directory blocks with the usage of their directories @hideinitializer*/
     };
 
     // Internal member variables
     Disk* fs_disk;                      /**  Stores disk pointer after successful mounting */
     vector<bool> free_blocks;           /**  Stores whether a block is free or not */
+    uint32_t free_hint;                 /**  No data block below it is free; allocate_block() starts there */
     vector<int> inode_counter;          /**  Stores the number of Inode contained in an Inode Block */
     vector<uint32_t> dir_counter;       /**  Stores the number of Directory contianed in a Directory Block */
     struct SuperBlock MetaData;         //  Caches the SuperBlock to save a disk-read @hideinitializer
     bool mounted;                       //  Boolean to check if the disk is mounted and saved @hideinitializer
+    CompressionStats compression;       //  Counters of the compressed data path @hideinitializer
+    vector<uint32_t> dedup_refs;        /**  Reference count of every block in the fingerprint index */
+    vector<uint32_t> dedup_bucket;      /**  Index block holding the fingerprint of every indexed block */
+    vector<bool> dedup_spill;           /**  Stores whether inserts overflowed past an index block */
+    vector<uint64_t> dedup_filter;      /**  Bloom filter over the fingerprints in the index */
+    map<uint32_t, Block> dedup_cache;   /**  Index blocks loaded by the current operation */
+    set<uint32_t> dedup_dirty;          /**  Index blocks changed by the current operation */
+    DedupStats dedup;                   //  Counters of the deduplicating data path @hideinitializer
+    set<uint32_t> discard_pending;      /**  Freed blocks not yet given back to the host */
+    FILE *trace_out;                    /**  Trace being recorded; NULL when not tracing */
+    uint32_t trace_depth;               /**  Traced operations running; only the outermost one is recorded */
+    uint64_t trace_epoch;               /**  Monotonic time the trace started, in nanoseconds */
+
+    Histogram op_latency[TRACE_OPS];    //  Latency of the public operations since mount, by TraceOp @hideinitializer
+    string metrics_path;                /**  File metrics are exported to; empty when not exporting */
+    uint64_t metrics_period;            /**  Nanoseconds between two exports */
+    uint64_t metrics_next;              /**  Monotonic time of the next export, in nanoseconds */
 
-    // Layer 1 Core Functions
-    /**
-     * @brief creates a new inode
-     * @return the inumber of the newly created inode 
-    */
-    ssize_t     create();
-    
-    /**
-     * @brief removes the inode
-     * @param inumber index into the inode table of the inode to be removed
-     * @return true if the remove operation was successful; false otherwise
-    */
-    bool        remove(size_t inumber);
-    
     /**
-     * @brief check size of an inode
-     * @param inumber index into the inode table of inode whose size is to be determined
-     * @return size of the inode; -1 if the inode is invalid
-    */
-    ssize_t     stat(size_t inumber);
-    
+     * @brief Times one public operation, and records it into the trace when it goes out of scope.
+     * Declared first in every traced function; the operations it calls are part of it.
+     * It also tags the block I/O with the operation; when no trace is being recorded that and the clock are all it costs.
+     */
+    class TraceScope {
+    public:
+        TraceScope(FileSystem *fs, uint8_t op, const char *first = NULL, const char *second = NULL,
+                   uint64_t arg = 0, uint64_t offset = 0, uint32_t length = 0)
+            : Fs(fs), Outer(fs->trace_depth++ == 0), Recording(false), Tag(op) {
+            if(Outer) begin(op, first, second, arg, offset, length);
+#ifdef SFS_TRACING
+            else {
+                Record.Op = op;
+                Start = Timeline::active() ? Timeline::now() : 0;
+            }
+#endif
+        }
+        ~TraceScope() {
+            Fs->trace_depth--;
+            if(Outer) end();
+#ifdef SFS_TRACING
+            else if(Start) Timeline::emit(trace_op_name(Record.Op), "fs", Start, Timeline::now());
+#endif
+        }
+        bool recording() const { return Recording; }    /** True if this operation goes into the trace */
+
+        TraceRecord Record;             /**  The record; operations set the results they learn late @hideinitializer*/
+        std::string Strings;            /**  Names and paths, each ending with a zero byte @hideinitializer*/
+
+    private:
+        FileSystem *Fs;                 /**  File system the operation runs on @hideinitializer*/
+        bool        Outer;              /**  Not called by another operation, so it is timed and recorded @hideinitializer*/
+        bool        Recording;          /**  A trace was being recorded when the operation started @hideinitializer*/
+        uint64_t    Start;              /**  Monotonic time the operation started, in nanoseconds @hideinitializer*/
+        Disk::Caller Tag;               /**  Tags the block I/O of the operation for the block trace @hideinitializer*/
+
+        void begin(uint8_t op, const char *first, const char *second, uint64_t arg, uint64_t offset, uint32_t length);
+        void end();
+    };
+
     /**
-     * @brief read from disk
-     * @param inumber index into the inode table of the corresponding inode
-     * @param data data buffer
-     * @param length bytes to be read from disk
-     * @param offset start point of the read operation
-     * @return bytes read from disk; -1 in case of an error
-    */
-    ssize_t     read(size_t inumber, char *data, int length, size_t offset);
-    
+     * @brief monotonic clock of traces and metrics
+     * @return nanoseconds
+     */
+    static uint64_t clock_ns();
+
     /**
-     * @brief write to the disk
-     * @param inumber index into the inode table of the corresponding inode
-     * @param data data buffer
-     * @param length bytes to be written to disk
-     * @param offset start point of the write operation
-     * @return bytes written to disk; -1 in case of an error
-    */
-    ssize_t     write(size_t inumber, char *data, int length, size_t offset);
+     * @brief writes the metrics to metrics_path, through a temporary file so readers never see half of them
+     * @param now clock_ns() of the export; the next one is due a period later
+     */
+    void        export_metrics_now(uint64_t now);
 
     //  Helper functions for Layer 1
     /**
@@ -292,33 +497,58 @@ private:
     ssize_t     write_ret(size_t inumber, Inode* node, int ret);
     
     /**
-     * @brief reads from buffer and writes to a block in the disk 
-     * @param offset starts writing at index = offset
-     * @param read bytes read from buffer so far
-     * @param length bytes to be written to the disk
-     * @param data data buffer
-     * @param blocknum index of block in free block bitmap
-     * @return  void function; returns nothing
+     * @brief allocates the first free block from free block bitmap
+     * @return block number of the block allocated; 0 if no block is available
     */
-    void        read_buffer(int offset, int *read, int length, char *data, uint32_t blocknum);
-    
+    uint32_t    allocate_block();
+
     /**
-     * @brief allocates a block if required; if no block is available in the disk; returns false
-     * @param node used to set the size of inode in case allocation fails
-     * @param read bytes read from buffer so far
-     * @param orig_offset offset passed to write() function call
-     * @param blocknum index of block in the free block bitmap
-     * @param write_indirect true if the block is an indirect node
-     * @param indirect the indirect node if required
-     * @return true if allocation is successful; false otherwise
+     * @brief frees a data block; shared blocks only lose a reference
+     * @param blocknum block to be released; 0 is ignored
+     * @return void function; returns nothing
     */
-    bool        check_allocation(Inode *node, int read, int orig_offset, uint32_t &blocknum, bool write_indirect, Block indirect);
-    
+    void        release_block(uint32_t blocknum);
+
     /**
-     * @brief allocates the first free block from free block bitmap
-     * @return block number of the block allocated; 0 if no block is available
+     * @brief frees the data blocks and the indirect block of an inode and clears its pointers
+     * @param node the inode
+     * @return void function; returns nothing
     */
-    uint32_t    allocate_block();
+    void        release_inode(Inode *node);
+
+    /**
+     * @brief marks a data block free and queues it to be discarded on disks with FEATURE_DISCARD
+     * @param blocknum block to be freed
+     * @return void function; returns nothing
+    */
+    void        free_block(uint32_t blocknum);
+
+    /**
+     * @brief discards the queued blocks, one hole per run of consecutive blocks
+     * @return void function; returns nothing
+    */
+    void        discard_flush();
+
+    /**
+     * @brief returns the block stored at a logical pointer slot of an inode
+     * @param node the inode
+     * @param indirect the loaded indirect block of the inode
+     * @param slot index into Direct pointers followed by indirect Pointers
+     * @return block number; 0 if the slot is empty
+    */
+    uint32_t    get_slot(Inode *node, Block *indirect, uint32_t slot);
+
+    /**
+     * @brief stores a block number at a logical pointer slot of an inode
+     * The indirect block must already be allocated for slots past the Direct pointers.
+     * @param node the inode
+     * @param indirect the loaded indirect block of the inode
+     * @param indirect_dirty set to true when indirect has to be written back
+     * @param slot index into Direct pointers followed by indirect Pointers
+     * @param blocknum block number to be stored
+     * @return void function; returns nothing
+    */
+    void        set_slot(Inode *node, Block *indirect, bool *indirect_dirty, uint32_t slot, uint32_t blocknum);
 
     
     /**  Caches curr dir to save a disk-read */
@@ -377,8 +607,367 @@ private:
      */
     Directory      rm_helper(Directory parent, char name[]);
 
+    /**
+     * @brief Copies the data regions of a host file into an empty file; holes stay holes.
+     * 
+     * @param fd Host file open for reading
+     * @param inum Inode of the file
+     * @param size Bytes of the host file
+     * @return true if successful
+     * @return false if the host file could not be read or the disk is full
+     */
+    bool           copyin_file(int fd, uint32_t inum, off_t size);
+
+    /**
+     * @brief Copies a host file that cannot seek, like a pipe, into an empty file, reading until its end.
+     * 
+     * @param fd Host file open for reading
+     * @param inum Inode of the file
+     * @return bytes copied, or -1 if the host file could not be read or the disk is full
+     */
+    ssize_t        copyin_stream(int fd, uint32_t inum);
+
+    /**
+     * @brief Copies a file into a host file; into regular files zero blocks are skipped so holes stay holes,
+     * other files, like pipes, get every byte in order.
+     * 
+     * @param inum Inode of the file
+     * @param fd Host file open for writing, empty
+     * @param path Name of the host file, for messages
+     * @return bytes of the file, or -1 if the file could not be read or the host file written
+     */
+    ssize_t        copyout_file(uint32_t inum, int fd, const char *path);
+
+    //  Compression functions
+    /**
+     * @brief number of logical blocks of a cluster that lie within the file
+     * @param size size of the file in bytes
+     * @param cluster index of the cluster in the file
+     * @return number of blocks (0 to CLUSTER_BLOCKS)
+    */
+    uint32_t    cluster_blocks(uint32_t size, uint32_t cluster);
+
+    /**
+     * @brief decodes a cluster of an inode into buffer
+     * @param node the inode
+     * @param indirect the loaded indirect block of the inode
+     * @param cluster index of the cluster in the file
+     * @param size file size used to determine the blocks in the cluster
+     * @param buffer output of CLUSTER_BLOCKS * Disk::BLOCK_SIZE bytes
+     * @return true if successful; false if the stored cluster is corrupt
+    */
+    bool        load_cluster(Inode *node, Block *indirect, uint32_t cluster, uint32_t size, char *buffer);
+
+    /**
+     * @brief encodes buffer and stores it as a cluster of an inode
+     * Reuses the blocks already held by the cluster and frees the ones no longer needed.
+     * @param node the inode
+     * @param indirect the loaded indirect block of the inode
+     * @param indirect_dirty set to true when indirect has to be written back
+     * @param cluster index of the cluster in the file
+     * @param size file size used to determine the blocks in the cluster
+     * @param buffer data of CLUSTER_BLOCKS * Disk::BLOCK_SIZE bytes
+     * @return true if successful; false if the disk is full
+    */
+    bool        store_cluster(Inode *node, Block *indirect, bool *indirect_dirty, uint32_t cluster, uint32_t size, char *buffer);
+
+    /**
+     * @brief read() for disks formatted with FEATURE_COMPRESS
+     * @param inumber index into the inode table of the corresponding inode
+     * @param data data buffer
+     * @param length bytes to be read
+     * @param offset start point of the read operation
+     * @return bytes read; -1 in case of an error
+    */
+    ssize_t     read_compressed(size_t inumber, char *data, int length, size_t offset);
+
+    /**
+     * @brief write() for disks formatted with FEATURE_COMPRESS
+     * @param inumber index into the inode table of the corresponding inode
+     * @param data data buffer
+     * @param length bytes to be written
+     * @param offset start point of the write operation
+     * @return bytes written; -1 in case of an error
+    */
+    ssize_t     write_compressed(size_t inumber, char *data, int length, size_t offset);
+
+    //  Deduplication functions
+    /**
+     * @brief reserves the fingerprint index and loads reference counts and the pre-filter
+     * @return void function; returns nothing
+    */
+    void        dedup_mount();
+
+    /**
+     * @brief returns an index block, reading it on first use in this operation
+     * @param bucket index of the block within the fingerprint index
+     * @return pointer to the cached block
+    */
+    Block*      dedup_index_block(uint32_t bucket);
+
+    /**
+     * @brief writes back the index blocks changed by the current operation
+     * @return void function; returns nothing
+    */
+    void        dedup_flush();
+
+    /**
+     * @brief finds a block with the given content
+     * @param hash SHA256 of the content
+     * @return block number; 0 if no such block is indexed
+    */
+    uint32_t    dedup_lookup(const uint8_t *hash);
+
+    /**
+     * @brief adds a freshly written block to the fingerprint index with one reference
+     * @param hash SHA256 of the block content
+     * @param blocknum the block
+     * @return void function; returns nothing. The block stays unshared if the index is full
+    */
+    void        dedup_insert(const uint8_t *hash, uint32_t blocknum);
+
+    /**
+     * @brief changes the reference count of an indexed block; frees it at 0
+     * @param blocknum the block
+     * @param delta change of the reference count
+     * @return void function; returns nothing
+    */
+    void        dedup_adjust(uint32_t blocknum, int delta);
+
+    /**
+     * @brief stores one logical block of an inode, sharing an existing copy when possible
+     * @param node the inode
+     * @param indirect the loaded indirect block of the inode
+     * @param indirect_dirty set to true when indirect has to be written back
+     * @param slot logical block index within the file
+     * @param data the block content
+     * @param hash SHA256 of data
+     * @return true if successful; false if the disk is full
+    */
+    bool        dedup_store(Inode *node, Block *indirect, bool *indirect_dirty, uint32_t slot, char *data, const uint8_t *hash);
+
+    /**
+     * @brief write() for disks formatted with FEATURE_DEDUP
+     * @param inumber index into the inode table of the corresponding inode
+     * @param data data buffer
+     * @param length bytes to be written
+     * @param offset start point of the write operation
+     * @return bytes written; -1 in case of an error
+    */
+    ssize_t     write_dedup(size_t inumber, char *data, int length, size_t offset);
+
+    // Lazy format functions (fs_lazy.cpp)
+
+    /**
+     * @brief writes empty inode, data and directory blocks, as format() leaves them
+     * @param disk the disk
+     * @param super superblock of the disk
+     * @param from first block to write
+     * @param to block after the last one to write
+     * @return void function; returns nothing
+    */
+    static void clear_blocks(Disk *disk, const SuperBlock &super, uint32_t from, uint32_t to);
+
+    /**
+     * @brief finds the lazily initialized group of a block
+     * @param super superblock of the disk
+     * @param blocknum the block
+     * @param from set to the first block of the group, if not NULL
+     * @param to set to the block after the last one of the group, if not NULL
+     * @return index of the group; -1 if the block is not in one or the disk is not lazy
+    */
+    static ssize_t lazy_group(const SuperBlock &super, uint32_t blocknum, uint32_t *from = NULL, uint32_t *to = NULL);
+
+    /**
+     * @brief checks whether a block belongs to a group that was never written
+     * @param super superblock of the disk
+     * @param blocknum the block
+     * @return true if the block is uninitialized and reads as an empty block
+    */
+    static bool uninitialized(const SuperBlock &super, uint32_t blocknum);
+
+    /**
+     * @brief sizes the groups and flags every group uninitialized, except the one of the root directory
+     * @param super superblock of the disk being formatted
+     * @return void function; returns nothing
+    */
+    static void lazy_groups(SuperBlock *super);
+
+    /**
+     * @brief writes the group of a block if it is still uninitialized and records that in the superblock
+     * @param blocknum an inode or directory block about to be read
+     * @return void function; returns nothing
+    */
+    void        init_group(uint32_t blocknum);
+
+    // Copy functions (fs_copy.cpp)
+
+    /**
+     * @brief copies a file to a host file, one run of consecutive blocks at a time; holes are skipped
+     * Only for disks without FEATURE_COMPRESS, FEATURE_ENCRYPT and FEATURE_CHECKSUM.
+     * @param inumber index into the inode table of the file
+     * @param fd regular host file open for writing
+     * @return size of the file; -1 if the inode is invalid or the host file is not regular
+    */
+    ssize_t     export_blocks(size_t inumber, int fd);
+
+    /**
+     * @brief stores whole blocks of a host file into a file at the same offset, one run of consecutive blocks at a time
+     * Only for disks without FEATURE_COMPRESS, FEATURE_DEDUP, FEATURE_ENCRYPT and FEATURE_CHECKSUM.
+     * @param inumber index into the inode table of the file
+     * @param fd host file open for reading
+     * @param offset start of the data, in the host file and in the file; a multiple of Disk::BLOCK_SIZE
+     * @param length bytes to copy; a multiple of Disk::BLOCK_SIZE
+     * @return bytes stored, less than length if the disk is full; -1 in case of an error
+    */
+    ssize_t     import_blocks(size_t inumber, int fd, size_t offset, size_t length);
+
+    /**
+     * @brief allocates count data blocks, as one run of consecutive blocks if there is one
+     * @param count number of blocks wanted
+     * @param blocks receives the allocated blocks in order
+     * @return void function; returns nothing. Fewer blocks are returned if the disk is full
+    */
+    void        reserve_extent(uint32_t count, vector<uint32_t> *blocks);
+
+    /**
+     * @brief takes a free inode, like create(), but in a block kept in memory until the caller writes it
+     * @param inodes inode blocks read so far, by block number
+     * @return the inumber; -1 if there is no free inode
+    */
+    ssize_t     claim_inode(map<uint32_t, Block> *inodes);
+
+    /**
+     * @brief takes a free directory, like mkdir(), but in a block kept in memory until the caller writes it
+     * The directory is only marked valid; the caller fills it in.
+     * @param dirs directory blocks read so far, by block number
+     * @return the inum of the directory; -1 if there is no free directory
+    */
+    ssize_t     claim_dir(map<uint32_t, Block> *dirs);
+
+    // Batch functions (fs_batch.cpp)
+
+    /**
+     * @brief returns a directory of a batch, reading its dirblock on first use
+     * @param dirs dirblocks read so far, by block number
+     * @param inum inum of the directory
+     * @return pointer to the directory within the cached block
+    */
+    Directory*  batch_dir(map<uint32_t, Block> *dirs, uint32_t inum);
+
+    /**
+     * @brief returns an inode of a batch, reading its inode block on first use
+     * @param inodes inode blocks read so far, by block number
+     * @param inumber index into the inode table
+     * @return pointer to the inode within the cached block
+    */
+    Inode*      batch_inode(map<uint32_t, Block> *inodes, uint32_t inumber);
+
+    /**
+     * @brief finds the directory holding the last component of a path relative to the curr_dir
+     * @param dirs dirblocks read so far, by block number
+     * @param path the path
+     * @param name receives the last component
+     * @return the directory; NULL if a directory on the way does not exist or the name is too long
+    */
+    Directory*  batch_parent(map<uint32_t, Block> *dirs, const string &path, string *name);
+
+    // Usage functions (fs_usage.cpp)
+
+    /**
+     * @brief counts the bytes and the allocated blocks of an inode, reading its indirect block if it has one
+     * @param node the inode
+     * @param usage receives the totals; zero for invalid inodes
+     * @return void function; returns nothing
+    */
+    void        count_usage(Inode *node, DiskUsage *usage);
+
+    /**
+     * @brief count_usage() of an inode loaded by its inumber
+     * @param inumber index into the inode table
+     * @param usage receives the totals; zero for invalid inodes
+     * @return void function; returns nothing
+    */
+    void        inode_usage(size_t inumber, DiskUsage *usage);
+
+    /**
+     * @brief adds to the usage of a directory and of every directory above it, in dirblocks kept in memory
+     * Does nothing on disks without FEATURE_USAGE.
+     * @param dirs dirblocks read so far, by block number
+     * @param inum inum of the directory the change happened in
+     * @param bytes bytes added; negative when removed
+     * @param blocks blocks added; negative when freed
+     * @return void function; returns nothing
+    */
+    void        charge_dirs(map<uint32_t, Block> *dirs, uint32_t inum, int64_t bytes, int64_t blocks);
+
+    /**
+     * @brief charge_dirs() writing the changed dirblocks back
+     * @param inum inum of the directory the change happened in
+     * @param before usage of the file before the change
+     * @param after usage of the file after the change
+     * @return void function; returns nothing
+    */
+    void        charge(uint32_t inum, const DiskUsage &before, const DiskUsage &after);
+
+    // Tar functions (fs_tar.cpp)
+
+    /**
+     * @brief reads a directory from its dirblock
+     * @param inum inum of the directory
+     * @return the directory as stored on disk
+    */
+    Directory   load_dir(uint32_t inum);
+
+    // Encryption functions (fs_crypt.cpp)
+
+    /**
+     * @brief prompts for a password on stdin
+     * @param prompt text printed before reading
+     * @param pass buffer of at least 1000 bytes receiving the password
+     * @return true if a password was read; false on end of input
+    */
+    static bool read_password(const char *prompt, char *pass);
+
+    /**
+     * @brief chooses a random disk key and wraps it with the password
+     * @param super superblock receiving the wrapped key
+     * @param pass the password
+     * @param key buffer of XTS::KEY_SIZE bytes receiving the disk key
+     * @return true if successful; false if no random key could be generated
+    */
+    static bool create_key(SuperBlock *super, const char *pass, uint8_t *key);
+
+    /**
+     * @brief wraps the disk key with a key derived from the password, using a fresh salt
+     * @param super superblock receiving KdfRounds, KeySalt, WrappedKey and KeyCheck
+     * @param pass the password
+     * @param key the disk key, XTS::KEY_SIZE bytes
+     * @return true if successful; false if no random salt could be generated
+    */
+    static bool wrap_key(SuperBlock *super, const char *pass, const uint8_t *key);
+
+    /**
+     * @brief recovers the disk key from the superblock
+     * @param super superblock of an encrypted disk
+     * @param pass the password
+     * @param key buffer of XTS::KEY_SIZE bytes receiving the disk key
+     * @return true if the password is correct; false otherwise
+    */
+    static bool unwrap_key(const SuperBlock *super, const char *pass, uint8_t *key);
+
+    /**
+     * @brief change_password() for encrypted disks; rewraps the disk key, data stays as it is
+     * @return true if successful; false otherwise
+    */
+    bool        change_key();
+
 public:
 
+    FileSystem() : fs_disk(NULL), mounted(false), trace_out(NULL), trace_depth(0), trace_epoch(0),
+                   metrics_period(0), metrics_next(0) {}
+    ~FileSystem();
+
     /**
      * @brief prints the basic outline of the disk
      * @param disk the disk to be debugged
@@ -389,9 +978,10 @@ public:
     /**
      * @brief formats the entire disk
      * @param disk the disk to be formatted
+     * @param features bitmask of FEATURE_* flags to enable on the disk
      * @return true if the formatting was successful; false otherwise
     */
-    static bool format(Disk *disk);
+    static bool format(Disk *disk, uint32_t features = 0);
 
 
     /**
@@ -401,7 +991,62 @@ public:
     */
     bool        mount(Disk *disk);
 
+    /**
+     * @brief checks if mounting the disk would ask for a password
+     * @param disk the disk, not mounted
+     * @return true if the superblock is password protected
+    */
+    static bool protected_disk(Disk *disk);
+
+    
+    // Layer 1 Core Functions
+    /**
+     * @brief creates a new inode
+     * @return the inumber of the newly created inode 
+    */
+    ssize_t     create();
+    
+    /**
+     * @brief removes the inode
+     * @param inumber index into the inode table of the inode to be removed
+     * @return true if the remove operation was successful; false otherwise
+    */
+    bool        remove(size_t inumber);
+
+    /**
+     * @brief empties a file; the inode stays valid and its freed blocks are discarded with the next flush
+     * @param inumber index into the inode table of the inode to be emptied
+     * @return true if the inode was emptied; false if it is invalid
+    */
+    bool        truncate(size_t inumber);
     
+    /**
+     * @brief check size of an inode
+     * @param inumber index into the inode table of inode whose size is to be determined
+     * @return size of the inode; -1 if the inode is invalid
+    */
+    ssize_t     stat(size_t inumber);
+    
+    /**
+     * @brief read from disk; holes read as zeros
+     * @param inumber index into the inode table of the corresponding inode
+     * @param data data buffer
+     * @param length bytes to be read from disk
+     * @param offset start point of the read operation
+     * @return bytes read from disk; -1 in case of an error
+    */
+    ssize_t     read(size_t inumber, char *data, int length, size_t offset);
+    
+    /**
+     * @brief write to the disk; writing past the end leaves the blocks in between as holes
+     * @param inumber index into the inode table of the corresponding inode
+     * @param data data buffer
+     * @param length bytes to be written to disk
+     * @param offset start point of the write operation
+     * @return bytes written to disk; -1 in case of an error
+    */
+    ssize_t     write(size_t inumber, char *data, int length, size_t offset);
+
     //  Security Functions
 
     /**
@@ -424,6 +1069,7 @@ public:
 
     /**
      * @brief Removes password from the mounted disk (fs_disk).
+     * Refused for encrypted disks, whose key depends on the password.
      * 
      * @return true if password removed
      * @return false incase of error
@@ -473,6 +1119,31 @@ public:
      */
     bool    cd(char name[]);
 
+    /**
+     * @brief Returns the number of the curr_dir, which set_cwd() takes back.
+     * Servers keep one for each client and switch to it before every request.
+     *
+     * @return the directory number; 0 for the root
+     */
+    uint32_t cwd() const { return curr_dir.inum; }
+
+    /**
+     * @brief Makes the directory with the given number the curr_dir, reading it from its dirblock.
+     *
+     * @param dirnum a number cwd() returned
+     * @return true if successful
+     * @return false if not mounted, or if the directory was removed since.
+     */
+    bool    set_cwd(uint32_t dirnum);
+
+    /**
+     * @brief Finds a file in the curr_dir, for the layer 1 functions that take an inumber.
+     *
+     * @param name Name of the file
+     * @return the inumber of the file; -1 if there is no such file
+     */
+    ssize_t lookup(char name[]);
+
     /**
      * @brief List all the curr_dir Dirent.
      * 
@@ -514,6 +1185,95 @@ public:
      */
     bool    copyin(const char *path, char name[]);
 
+    /**
+     * @brief Copies the file with path provided to the curr_dir, several threads at once.
+     * The blocks are reserved first, as one extent if possible. Each thread then copies
+     * its own range of the file, and the inode is written once at the end.
+     * Compressed and deduplicated disks, and sparse files, are copied by copyin.
+     *
+     * @param path Path of the file outside.
+     * @param name Name of the file to be copied in
+     * @param threads Number of threads; 0 for COPY_THREADS
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    copyin_parallel(const char *path, char name[], unsigned threads = 0);
+
+    /**
+     * @brief Copies a host directory tree into a new directory of the curr_dir.
+     * Inodes and directories are allocated in bulk and every block of them is written once.
+     * Each file gets its blocks as one extent if possible, and several threads copy the files.
+     * Entries that do not fit (long names, full directories, other file types) are skipped.
+     *
+     * @param path Path of the directory outside.
+     * @param name Name of the new directory
+     * @return true if successful
+     * @return false incase of error; nothing is added then.
+     */
+    bool    import(const char *path, char name[]);
+
+    /**
+     * @brief Applies a transaction; each inode block and dirblock involved is read and written once.
+     * Operations see the effects of the ones before them. Data blocks of removed files are freed last.
+     *
+     * @param batch the operations
+     * @return true if successful
+     * @return false if an operation failed; nothing is changed then.
+     */
+    bool    commit(const Transaction &batch);
+
+    /**
+     * @brief Creates empty files, as one transaction.
+     *
+     * @param paths Paths of the files, relative to the curr_dir
+     * @return true if successful
+     * @return false incase of error; no file is created then.
+     */
+    bool    touch_many(const vector<string> &paths);
+
+    /**
+     * @brief Removes files and empty directories, as one transaction.
+     *
+     * @param paths Paths of the entries, relative to the curr_dir
+     * @return true if successful
+     * @return false incase of error; nothing is removed then.
+     */
+    bool    rm_many(const vector<string> &paths);
+
+    /**
+     * @brief Extracts a tar archive into the curr_dir, streaming it without a copy on the host.
+     * Missing directories are created and existing files are overwritten.
+     * Only files and directories are extracted; entries that do not fit are skipped.
+     *
+     * @param path Path of the archive outside; "-" reads it from stdin
+     * @return true if successful
+     * @return false if the archive could not be read or is damaged.
+     */
+    bool    tar_in(const char *path);
+
+    /**
+     * @brief Writes a file or directory tree of the curr_dir as a tar archive.
+     * Prints amount of bytes archived, unless the archive goes to stdout.
+     *
+     * @param name Name of the file or directory to be archived
+     * @param path Path of the archive outside; "-" writes it to stdout
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    tar_out(char name[], const char *path);
+
+    /**
+     * @brief Prints the SHA256 of the file in curr_dir, like sha256sum.
+     * The file is streamed through the hardware accelerated hash when available.
+     * Optionally prints the fingerprint of every block, zero padded to Disk::BLOCK_SIZE.
+     *
+     * @param name Name of the file to be hashed
+     * @param blocks Print the fingerprint of every block too
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    hash(char name[], bool blocks);
+
     /**
      * @brief List the Directory given by the name.
      * Called by ls to print curr_dir.
@@ -525,12 +1285,83 @@ public:
      */
     bool    ls_dir(char name[]);
 
+    /**
+     * @brief Returns the bytes and blocks used by a file or by the subtree of a directory in the curr_dir.
+     * Directories read their totals from their dirblock, kept up to date by the layer 2 functions,
+     * so no tree is walked. Writes made by inumber through the layer 1 functions are not counted.
+     *
+     * @param name Name of the file or directory; "." for the curr_dir
+     * @param usage receives the totals
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    du(char name[], DiskUsage *usage);
+
+    /**
+     * @brief Lists the Directory given by the name together with the attributes of every entry.
+     * Entries are sorted by inode block, so every inode block is read once for all its entries.
+     *
+     * @param name Name of the directory to be listed
+     * @param entries Filled with the valid entries, "." and ".." included
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    readdir_plus(char name[], vector<EntryAttr> *entries);
+
+    /**
+     * @brief Looks up a name in the curr_dir and returns its attributes, printing nothing.
+     * Only a file costs disk reads, of its inode and of its indirect block.
+     *
+     * @param name Name of the file or directory; "." and ".." included
+     * @param attr receives the attributes
+     * @return true if the name exists
+     * @return false if it does not, or if not mounted.
+     */
+    bool    entry(char name[], EntryAttr *attr);
+
+    /**
+     * @brief Writes to a file by its inode, as write() does, and charges the change in its usage to its directory.
+     * For callers that keep files open by inode, while the curr_dir may change in between.
+     *
+     * @param dirnum number of the directory holding the file, as cwd() returned it
+     * @param inumber index into the inode table of the file
+     * @param data data buffer
+     * @param length bytes to be written
+     * @param offset start point of the write
+     * @return bytes written; -1 in case of an error
+     */
+    ssize_t write_charged(uint32_t dirnum, size_t inumber, char *data, int length, size_t offset);
+
+    /**
+     * @brief List the Directory given by the name with sizes and block counts, like ls -l.
+     *
+     * @param name Name of the directory to be listed
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    ls_long(char name[]);
+
     /**
      * @brief Unmounts the disk and resets pointer.
      * 
      */
     void    exit();
 
+    /**
+     * @brief Starts recording every public operation into a trace that sfsreplay can replay.
+     * Names, paths and sizes are recorded; file contents are not.
+     *
+     * @param path Host file receiving the trace; replaced if it exists
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    trace_start(const char *path);
+
+    /**
+     * @brief Stops recording the trace and closes it. Does nothing when no trace is being recorded.
+     */
+    void    trace_stop();
+
     /**
      * @brief Returns the stat of the disk.
      * The stat contains information like number of directories,
@@ -540,6 +1371,50 @@ public:
      * @return false incase of error
      */
     void stat();
+
+    /**
+     * @brief Returns the compression counters since mount.
+     *
+     * @return CompressionStats, all zero unless the disk uses FEATURE_COMPRESS
+     */
+    CompressionStats compression_stats() const { return compression; }
+
+    /**
+     * @brief Takes a snapshot of the operation latencies, block I/O by region, caches and allocator.
+     *
+     * @param metrics Filled with the counters
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    metrics(Metrics *metrics) const;
+
+    /**
+     * @brief Prints the metrics as tables, or in the Prometheus text exposition format.
+     *
+     * @param out Stream to print to
+     * @param prometheus true for the Prometheus format
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    print_metrics(FILE *out, bool prometheus) const;
+
+    /**
+     * @brief Exports the metrics in the Prometheus format to a file now, and again by the end of an
+     * operation once every period; the file is replaced at once, as textfile collectors expect.
+     *
+     * @param path File to export to; NULL stops exporting
+     * @param seconds Period of the exports
+     * @return true if successful
+     * @return false incase of error.
+     */
+    bool    export_metrics(const char *path, unsigned seconds);
+
+    /**
+     * @brief Returns the deduplication counters since mount.
+     *
+     * @return DedupStats, all zero unless the disk uses FEATURE_DEDUP
+     */
+    DedupStats dedup_stats() const { return dedup; }
 };
 
 /**  NOTE: For now, Path's are not valid for creating files or directories  */
\ No newline at end of file
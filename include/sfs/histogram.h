@@ -0,0 +1,100 @@
+/**
+ * @file histogram.h
+ * @brief Latency histogram shared by FileSystem::metrics() and the tools.
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief HDR-style log-linear histogram of nanoseconds.
+ * Exact below 32, then 32 buckets per power of two, so percentiles are
+ * within 3% whatever the range. The buckets are allocated by the first record.
+ */
+class Histogram {
+public:
+    const static size_t SUB_BUCKETS = 32;                           /** Buckets per power of two */
+    const static size_t BUCKETS     = SUB_BUCKETS + 59 * SUB_BUCKETS;   /** Buckets up to 2^64 */
+
+    Histogram() : Count(0), Sum(0), Max(0) {}
+
+    /**
+     * @brief records one value
+     * @param value nanoseconds
+     */
+    void record(uint64_t value) {
+        if (Counts.empty()) Counts.assign(BUCKETS, 0);
+        Counts[index(value)]++;
+        Count++;
+        Sum += value;
+        Max = std::max(Max, value);
+    }
+
+    /**
+     * @brief adds the values of another histogram
+     * @param other histogram to add
+     */
+    void merge(const Histogram &other) {
+        if (other.Counts.empty()) return;
+        if (Counts.empty()) Counts.assign(BUCKETS, 0);
+        for (size_t i = 0; i < BUCKETS; i++) Counts[i] += other.Counts[i];
+        Count += other.Count;
+        Sum += other.Sum;
+        Max = std::max(Max, other.Max);
+    }
+
+    uint64_t count() const { return Count; }                        /** Values recorded */
+    uint64_t sum() const { return Sum; }                            /** Sum of the values recorded */
+    uint64_t max() const { return Max; }                            /** Largest value recorded */
+
+    /**
+     * @brief value below which a share of the values fall
+     * @param p percentage, 0 to 100
+     * @return the middle of the bucket holding the percentile, at most max()
+     */
+    uint64_t percentile(double p) const {
+        uint64_t rank = (uint64_t)(p / 100 * Count + 0.999999), seen = 0;
+        for (size_t i = 0; i < Counts.size() && rank; i++) {
+            seen += Counts[i];
+            if (seen >= rank) return std::min(middle(i), Max);
+        }
+        return Max;
+    }
+
+    /**
+     * @brief number of values up to a bound, as cumulative buckets of exporters need
+     * @param bound nanoseconds
+     * @return values in the buckets that end at or below bound; exact for powers of two
+     */
+    uint64_t count_below(uint64_t bound) const {
+        if (Counts.empty()) return 0;
+        if (bound >= Max) return Count;
+        uint64_t seen = 0;
+        for (size_t i = 0, end = index(bound + 1); i < end; i++) seen += Counts[i];
+        return seen;
+    }
+
+private:
+    std::vector<uint64_t> Counts;
+    uint64_t              Count;
+    uint64_t              Sum;
+    uint64_t              Max;
+
+    static size_t index(uint64_t value) {
+        if (value < SUB_BUCKETS) return value;
+        int exponent = 63 - __builtin_clzll(value);
+        return SUB_BUCKETS + (exponent - 5) * SUB_BUCKETS + ((value >> (exponent - 5)) - SUB_BUCKETS);
+    }
+
+    static uint64_t middle(size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+        uint64_t low = (SUB_BUCKETS + (index % SUB_BUCKETS)) << shift;
+        return low + ((1ULL << shift) >> 1);
+    }
+};
@@ -0,0 +1,72 @@
+/**
+ * @file iotrace.h
+ * @brief Binary format of the block I/O traces recorded by Disk::start_trace() and analyzed by sfsiostat.
+ * @date 2026-10-18
+ *
+ * @details A block trace is an IoTraceHeader followed by one IoRecord per
+ * block I/O, or per run of blocks the kernel copies or discards in one go.
+ * Every record carries the region of the disk the block belongs to and the
+ * caller tag: the TraceOp of the public FileSystem operation that issued it,
+ * or 0 for mount, format and the other operations that are not traced.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Kinds of block I/O
+ */
+enum IoOp {
+    IO_READ = 0,
+    IO_WRITE,
+    IO_DISCARD,
+    IO_OPS              /** Number of kinds */
+};
+
+/**
+ * @brief Regions of the disk, by the layout of the superblock
+ */
+enum IoRegion {
+    REGION_UNKNOWN = 0, /** No layout was set, as before mount */
+    REGION_SUPER,       /** Block 0 */
+    REGION_INODE,       /** Inode table */
+    REGION_INDEX,       /** Fingerprint index of dedup disks */
+    REGION_TABLE,       /** Checksum table */
+    REGION_DATA,        /** Data blocks */
+    REGION_INDIRECT,    /** Data blocks used as indirect blocks; only the caller knows */
+    REGION_DIR,         /** Directory blocks at the end of the disk */
+    IO_REGIONS          /** Number of regions */
+};
+
+/**
+ * @brief Start of a block trace
+ */
+struct IoTraceHeader {
+    char     Magic[8];      /** "SFSIOTRC" @hideinitializer*/
+    uint32_t Version;       /** IOTRACE_VERSION @hideinitializer*/
+    uint32_t Blocks;        /** Blocks of the disk @hideinitializer*/
+};
+
+/**
+ * @brief One block I/O
+ */
+struct IoRecord {
+    uint64_t Time;          /** Nanoseconds from the start of the trace to the start of the I/O @hideinitializer*/
+    uint32_t Block;         /** First block @hideinitializer*/
+    uint32_t Count;         /** Blocks in the run; 1 for reads and writes @hideinitializer*/
+    uint32_t Latency;       /** Nanoseconds the I/O took; saturates at 4.29 s @hideinitializer*/
+    uint8_t  Op;            /** IoOp @hideinitializer*/
+    uint8_t  Region;        /** IoRegion of the first block @hideinitializer*/
+    uint8_t  Caller;        /** TraceOp of the FileSystem operation; 0 if none @hideinitializer*/
+    uint8_t  Reserved;      /** Zero @hideinitializer*/
+};
+
+const uint32_t IOTRACE_VERSION = 1;
+
+/**
+ * @brief name of a region, as sfsiostat prints it
+ * @param region the IoRegion
+ * @return its name; "unknown" for values out of range
+ */
+const char *io_region_name(uint8_t region);
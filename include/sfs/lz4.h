@@ -0,0 +1,48 @@
+/**
+ * @file lz4.h
+ * @brief Interface for the LZ4 block codec used by compressed file systems.
+ * @date 2026-10-18
+ *
+ * @details Implements the LZ4 block format (no frame header or checksums).
+ * The codec is only used on clusters of a few blocks, so the match window
+ * never exceeds the 64 KB that the format allows.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief LZ4 class
+ * Stateless LZ4 block compressor and decompressor.
+ * Used by the FileSystem to store file clusters compressed.
+ */
+class LZ4 {
+public:
+    /**
+     * @brief worst case size of compressed data
+     * @param size number of bytes to be compressed
+     * @return number of bytes the output buffer must hold to never fail
+     */
+    static int  bound(int size) { return size + size / 255 + 16; }
+
+    /**
+     * @brief compresses a buffer into the LZ4 block format
+     * @param src data to be compressed
+     * @param size number of bytes in src
+     * @param dst output buffer
+     * @param capacity number of bytes available in dst
+     * @return compressed size; 0 if the output does not fit into capacity
+     */
+    static int  compress(const char *src, int size, char *dst, int capacity);
+
+    /**
+     * @brief decompresses a buffer stored in the LZ4 block format
+     * @param src compressed data
+     * @param size number of compressed bytes in src
+     * @param dst output buffer
+     * @param capacity number of bytes available in dst
+     * @return decompressed size; -1 if the input is malformed
+     */
+    static int  decompress(const char *src, int size, char *dst, int capacity);
+};
@@ -0,0 +1,261 @@
+/**
+ * @file sfs.h
+ * @brief C interface to the simple file system, for programs that embed it through libsfs.so or libsfs.a.
+ * @date 2026-10-18
+ *
+ * @details Every function returns SFS_OK or a count on success and a negative
+ * sfs_error on failure; sfs_strerror() names the error. A handle owns one disk
+ * image and the FileSystem mounted on it, and its files are numbered like file
+ * descriptors. Names are single path components resolved in the current
+ * directory, which sfs_chdir() changes, as in sfssh. A handle must be used by
+ * one thread at a time; separate handles on separate images are independent.
+ *
+ * Password protected disks are not supported, since unlocking them prompts
+ * on the terminal, and neither is formatting with SFS_FEATURE_ENCRYPT.
+ * The library itself still prints a line on stdout for some failures found
+ * deeper down.
+ *
+ * SFS_API_VERSION changes only when a declaration here changes incompatibly.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SFS_API_VERSION     1
+
+/** Handle of a disk image and its file system */
+typedef struct sfs sfs_t;
+
+/** Error codes, returned negated */
+enum sfs_error {
+    SFS_OK          = 0,
+    SFS_EINVAL      = -1,       /** Bad argument, or a name too long or with a '/' */
+    SFS_ENOENT      = -2,       /** No such file or directory */
+    SFS_EEXIST      = -3,       /** The name is taken */
+    SFS_ENOTDIR     = -4,       /** A file where a directory is needed */
+    SFS_EISDIR      = -5,       /** A directory where a file is needed */
+    SFS_ENOSPC      = -6,       /** No free block, inode, directory or directory entry */
+    SFS_EFBIG       = -7,       /** Past the largest file the inode can map */
+    SFS_EBADF       = -8,       /** Not an open file */
+    SFS_EMFILE      = -9,       /** Too many open files */
+    SFS_EIO         = -10,      /** The disk image failed, or a block failed its checksum */
+    SFS_ENOTMOUNTED = -11,      /** The file system is not mounted */
+    SFS_EBUSY       = -12,      /** The file system is mounted, or the file is open */
+    SFS_EPERM       = -13,      /** Not possible through this interface, like unlocking a protected disk */
+    SFS_ENOMEM      = -14       /** Out of memory */
+};
+
+/** Features chosen by sfs_format(), the same bits as FileSystem::FEATURE_* */
+#define SFS_FEATURE_COMPRESS    0x1
+#define SFS_FEATURE_DEDUP       0x2
+#define SFS_FEATURE_ENCRYPT     0x4
+#define SFS_FEATURE_CHECKSUM    0x8
+#define SFS_FEATURE_LAZY        0x10
+#define SFS_FEATURE_DISCARD     0x20
+
+/** Flags of sfs_open() */
+#define SFS_O_CREAT     0x1     /** Create the file if it does not exist */
+#define SFS_O_EXCL      0x2     /** With SFS_O_CREAT, fail with SFS_EEXIST if it does */
+
+/** Origins of sfs_seek() */
+#define SFS_SEEK_SET    0
+#define SFS_SEEK_CUR    1
+#define SFS_SEEK_END    2
+
+/** Entry types */
+#define SFS_TYPE_DIR    0
+#define SFS_TYPE_FILE   1
+
+/** Longest name, not counting the terminating zero */
+#define SFS_NAME_MAX    15
+
+/** Attributes of a file or directory */
+struct sfs_stat {
+    uint32_t inumber;           /** Inode of a file, or number of a directory */
+    uint8_t  type;              /** SFS_TYPE_DIR or SFS_TYPE_FILE */
+    uint64_t size;              /** Bytes of a file; 0 for directories */
+    uint64_t blocks;            /** Data and indirect blocks of a file; 0 for directories */
+};
+
+/** One entry of a directory */
+struct sfs_dirent {
+    char            name[SFS_NAME_MAX + 1];
+    struct sfs_stat stat;
+};
+
+/**
+ * @brief version of the interface the library implements
+ * @return SFS_API_VERSION of the library
+ */
+int sfs_api_version(void);
+
+/**
+ * @brief name of an error
+ * @param error a return value of this interface
+ * @return a static string
+ */
+const char *sfs_strerror(int error);
+
+/**
+ * @brief opens a disk image, creating it if needed
+ * @param path file of the image
+ * @param blocks blocks of the image
+ * @param fs receives the handle
+ * @return SFS_OK, or SFS_EIO if the image cannot be opened
+ */
+int sfs_open_disk(const char *path, size_t blocks, sfs_t **fs);
+
+/**
+ * @brief unmounts the file system if mounted, closes its files and the image and frees the handle
+ * @param fs handle; NULL does nothing
+ * @return SFS_OK, or the error of unmounting; the handle is freed either way
+ */
+int sfs_close_disk(sfs_t *fs);
+
+/**
+ * @brief formats the image, erasing it
+ * @param fs handle, not mounted
+ * @param features SFS_FEATURE_* bits
+ * @return SFS_OK or an error
+ */
+int sfs_format(sfs_t *fs, uint32_t features);
+
+/**
+ * @brief mounts the file system of the image, in its root directory
+ * @param fs handle
+ * @return SFS_OK or an error
+ */
+int sfs_mount(sfs_t *fs);
+
+/**
+ * @brief unmounts the file system, closing its files
+ * @param fs handle
+ * @return SFS_OK or an error
+ */
+int sfs_unmount(sfs_t *fs);
+
+/**
+ * @brief creates a directory in the current directory
+ * @param fs handle
+ * @param name name of the directory
+ * @return SFS_OK or an error
+ */
+int sfs_mkdir(sfs_t *fs, const char *name);
+
+/**
+ * @brief removes a directory of the current directory, and everything in it
+ * @param fs handle
+ * @param name name of the directory
+ * @return SFS_OK or an error; SFS_EBUSY if a file in it is open
+ */
+int sfs_rmdir(sfs_t *fs, const char *name);
+
+/**
+ * @brief changes the current directory
+ * @param fs handle
+ * @param name a directory of the current directory, ".." included
+ * @return SFS_OK or an error
+ */
+int sfs_chdir(sfs_t *fs, const char *name);
+
+/**
+ * @brief gives the number of the current directory, which sfs_setcwd() takes back
+ * @param fs handle
+ * @param dir receives the number; 0 is the root
+ * @return SFS_OK or an error
+ */
+int sfs_getcwd(sfs_t *fs, uint32_t *dir);
+
+/**
+ * @brief makes a directory the current one by its number, so servers can keep one for each client
+ * @param fs handle
+ * @param dir a number sfs_getcwd() gave
+ * @return SFS_OK, or SFS_ENOENT if the directory was removed since
+ */
+int sfs_setcwd(sfs_t *fs, uint32_t dir);
+
+/**
+ * @brief removes a file of the current directory
+ * @param fs handle
+ * @param name name of the file
+ * @return SFS_OK or an error; SFS_EBUSY if the file is open
+ */
+int sfs_unlink(sfs_t *fs, const char *name);
+
+/**
+ * @brief reads the attributes of a file or directory of the current directory
+ * @param fs handle
+ * @param name name of the entry; "." for the current directory
+ * @param st receives the attributes
+ * @return SFS_OK or an error
+ */
+int sfs_stat(sfs_t *fs, const char *name, struct sfs_stat *st);
+
+/**
+ * @brief lists a directory of the current directory
+ * @param fs handle
+ * @param name name of the directory; "." for the current directory
+ * @param entries receives up to count entries, "." and ".." included
+ * @param count room in entries
+ * @return the number of entries of the directory, which may be more than count, or an error
+ */
+ssize_t sfs_readdir(sfs_t *fs, const char *name, struct sfs_dirent *entries, size_t count);
+
+/**
+ * @brief opens a file of the current directory for reading and writing, at offset 0
+ * @param fs handle
+ * @param name name of the file
+ * @param flags SFS_O_* bits
+ * @return a file number of zero or more, or an error
+ */
+int sfs_open(sfs_t *fs, const char *name, int flags);
+
+/**
+ * @brief closes a file
+ * @param fs handle
+ * @param file file number
+ * @return SFS_OK or SFS_EBADF
+ */
+int sfs_close(sfs_t *fs, int file);
+
+/**
+ * @brief reads from the offset of a file, and moves the offset past the bytes read
+ * @param fs handle
+ * @param file file number
+ * @param data receives the bytes
+ * @param length bytes wanted
+ * @return bytes read, 0 at the end of the file, or an error
+ */
+ssize_t sfs_read(sfs_t *fs, int file, void *data, size_t length);
+
+/**
+ * @brief writes at the offset of a file, and moves the offset past the bytes written;
+ * what the file grows by is charged to the directory it was opened in, as sfssh du shows
+ * @param fs handle
+ * @param file file number
+ * @param data the bytes
+ * @param length bytes to write
+ * @return bytes written, fewer than length if the disk filled up, or an error
+ */
+ssize_t sfs_write(sfs_t *fs, int file, const void *data, size_t length);
+
+/**
+ * @brief moves the offset of a file
+ * @param fs handle
+ * @param file file number
+ * @param offset bytes from the origin
+ * @param whence SFS_SEEK_SET, SFS_SEEK_CUR or SFS_SEEK_END
+ * @return the new offset, or an error
+ */
+off_t sfs_seek(sfs_t *fs, int file, off_t offset, int whence);
+
+#ifdef __cplusplus
+}
+#endif
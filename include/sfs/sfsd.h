@@ -0,0 +1,94 @@
+/**
+ * @file sfsd.h
+ * @brief Binary protocol of sfsd, the daemon that serves one mounted image to many clients over a Unix domain socket.
+ * @date 2026-10-18
+ *
+ * @details A client sends an SfsdRequest followed by Length bytes of payload
+ * and gets an SfsdResponse followed by Length bytes of payload for it, in
+ * order; it may send the next request before the answer comes. All fields
+ * are in host byte order, since both ends run on the same machine. Names in
+ * payloads end with a zero byte. Status is SFS_OK or a negative sfs_error of
+ * sfs.h. Every connection is a session with a current directory of its own,
+ * the root when it connects.
+ *
+ *  Op              Payload in          Value out           Payload out
+ *  SFSD_PING       -                   SFSD_VERSION        -
+ *  SFSD_MKDIR      name                -                   -
+ *  SFSD_RMDIR      name                -                   -
+ *  SFSD_CD         name                directory number    -
+ *  SFSD_STAT       name                -                   SfsdStat
+ *  SFSD_READDIR    name                entries             SfsdEntry for each
+ *  SFSD_CREATE     name                inumber             -
+ *  SFSD_REMOVE     name                -                   -
+ *  SFSD_READ       name                bytes read          the bytes
+ *  SFSD_WRITE      name, the bytes     bytes written       -
+ *
+ * SFSD_READ reads up to Count bytes of a file from Offset, SFSD_WRITE writes
+ * the bytes after the name there; SFSD_CREATE leaves a file that exists alone.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Operations
+ */
+enum SfsdOp {
+    SFSD_PING = 0,
+    SFSD_MKDIR,
+    SFSD_RMDIR,
+    SFSD_CD,
+    SFSD_STAT,
+    SFSD_READDIR,
+    SFSD_CREATE,
+    SFSD_REMOVE,
+    SFSD_READ,
+    SFSD_WRITE,
+    SFSD_OPS            /** Number of operations */
+};
+
+/**
+ * @brief Header of a request
+ */
+struct SfsdRequest {
+    uint32_t Length;        /** Bytes of payload that follow @hideinitializer*/
+    uint32_t Id;            /** Echoed in the response @hideinitializer*/
+    uint8_t  Op;            /** SfsdOp @hideinitializer*/
+    uint8_t  Reserved[3];   /** Zero @hideinitializer*/
+    uint32_t Count;         /** Bytes SFSD_READ reads; at most SFSD_MAX_PAYLOAD @hideinitializer*/
+    uint64_t Offset;        /** Byte of the file SFSD_READ and SFSD_WRITE start at @hideinitializer*/
+};
+
+/**
+ * @brief Header of a response
+ */
+struct SfsdResponse {
+    uint32_t Length;        /** Bytes of payload that follow @hideinitializer*/
+    uint32_t Id;            /** Id of the request @hideinitializer*/
+    int32_t  Status;        /** SFS_OK or a negative sfs_error @hideinitializer*/
+    uint32_t Pad;           /** Zero @hideinitializer*/
+    uint64_t Value;         /** Result of the operation, by the table above @hideinitializer*/
+};
+
+/**
+ * @brief Attributes of a file or directory, as SFSD_STAT and SFSD_READDIR return them
+ */
+struct SfsdStat {
+    uint32_t Inumber;       /** Inode of a file, or number of a directory @hideinitializer*/
+    uint8_t  Type;          /** SFS_TYPE_DIR or SFS_TYPE_FILE @hideinitializer*/
+    uint8_t  Reserved[3];   /** Zero @hideinitializer*/
+    uint64_t Size;          /** Bytes of a file @hideinitializer*/
+    uint64_t Blocks;        /** Data and indirect blocks of a file @hideinitializer*/
+};
+
+/**
+ * @brief One entry of SFSD_READDIR
+ */
+struct SfsdEntry {
+    char     Name[16];      /** Name, ending with a zero byte @hideinitializer*/
+    SfsdStat Stat;          /** Its attributes @hideinitializer*/
+};
+
+const uint32_t SFSD_VERSION = 1;
+const uint32_t SFSD_MAX_PAYLOAD = 1 << 20;     /** Largest payload either way; a longer request closes the connection */
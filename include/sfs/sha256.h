@@ -33,6 +33,17 @@ typedef unsigned __int64 uint64_t;
     while (more data available)
       sha256.add(pointer to fresh data, number of new bytes);
     std::string myHash3 = sha256.getHash();
+
+    // or many equally sized buffers at once:
+
+    const void* buffers[3] = { block0, block1, block2 };
+    unsigned char hashes[3][SHA256::HashBytes];
+    SHA256::hashMany(buffers, 4096, 3, hashes);
+
+    Full blocks go through SHA-NI when the CPU has it, hashMany() runs eight
+    buffers side by side in AVX2 registers when it does not. The code path is
+    picked once via CPUID; SFS_SHA256=portable|avx2|sha-ni in the environment
+    restricts it (e.g. to compare implementations).
   */
 class SHA256 //: public Hash
 {
@@ -59,6 +70,12 @@ public:
   /// restart
   void reset();
 
+  /// compute SHA256 of count buffers of numBytes each, hashes[i] belongs to data[i]
+  static void hashMany(const void* const data[], size_t numBytes, size_t count, unsigned char hashes[][HashBytes]);
+
+  /// name of the code path used for full blocks: "sha-ni", "avx2" or "portable"
+  static const char* implementation();
+
 private:
   /// process 64 bytes
   void processBlock(const void* data);
@@ -0,0 +1,103 @@
+/**
+ * @file timeline.h
+ * @brief Interface for the timeline of spans written in the Chrome trace-event format.
+ * @date 2026-10-18
+ *
+ * @details Built only with make TRACING=1, which defines SFS_TRACING. Without
+ * it, SFS_TRACE_SPAN expands to nothing and the Timeline class does not exist,
+ * so the instrumentation costs neither time nor code. With it, every public
+ * FileSystem operation, the internal steps named by SFS_TRACE_SPAN and every
+ * Disk read and write become complete ("X") events of a JSON array that
+ * chrome://tracing and ui.perfetto.dev open directly; spans of the same thread
+ * nest by their times, so a slow copyin shows which of its steps took the time.
+ * The shell starts it with the timeline command; any program linked with the
+ * library starts it at startup when SFS_TIMELINE names a file. Library and
+ * programs must be built with the same setting.
+ */
+
+#pragma once
+
+#ifdef SFS_TRACING
+
+#include <stdint.h>
+
+/**
+ * @brief Timeline class
+ * Process-wide timeline of spans, written while started.
+ */
+class Timeline {
+public:
+    /**
+     * @brief starts writing spans to a file, replacing a timeline already being written
+     * @param path file to write the JSON array to
+     * @return true if the file could be created
+     */
+    static bool start(const char *path);
+
+    /**
+     * @brief closes the JSON array and the file; does nothing if not started
+     */
+    static void stop();
+
+    /**
+     * @brief checks if spans are being written
+     * @return true between start() and stop()
+     */
+    static bool active();
+
+    /**
+     * @brief monotonic clock of the spans
+     * @return nanoseconds
+     */
+    static uint64_t now();
+
+    /**
+     * @brief writes one complete event
+     * @param name name of the span; a string literal
+     * @param category category of the span; a string literal
+     * @param start now() when the span started
+     * @param end now() when the span ended
+     * @param arg block number shown with the span; negative for none
+     */
+    static void emit(const char *name, const char *category, uint64_t start, uint64_t end, int64_t arg = -1);
+
+    /**
+     * @brief Span class
+     * Emits a span from its construction to its destruction, if the timeline was active at the start.
+     */
+    class Span {
+    public:
+        Span(const char *name, const char *category, int64_t arg = -1)
+            : Name(name), Category(category), Arg(arg), Start(active() ? now() : 0) {}
+        ~Span() {
+            if(Start) emit(Name, Category, Start, now(), Arg);
+        }
+
+    private:
+        const char *Name;       /**  Name of the span @hideinitializer*/
+        const char *Category;   /**  Category of the span @hideinitializer*/
+        int64_t     Arg;        /**  Block number, or negative @hideinitializer*/
+        uint64_t    Start;      /**  now() at construction; 0 if the timeline was not active @hideinitializer*/
+
+        Span(const Span &);
+        Span &operator=(const Span &);
+    };
+};
+
+#define SFS_SPAN_CONCAT2(a, b)  a##b
+#define SFS_SPAN_CONCAT(a, b)   SFS_SPAN_CONCAT2(a, b)
+
+/** Spans the rest of the enclosing scope */
+#define SFS_TRACE_SPAN(name, category) \
+    Timeline::Span SFS_SPAN_CONCAT(sfs_span_, __LINE__)(name, category)
+
+/** Spans the rest of the enclosing scope, showing a block number */
+#define SFS_TRACE_SPAN_BLOCK(name, category, block) \
+    Timeline::Span SFS_SPAN_CONCAT(sfs_span_, __LINE__)(name, category, (int64_t)(block))
+
+#else
+
+#define SFS_TRACE_SPAN(name, category)
+#define SFS_TRACE_SPAN_BLOCK(name, category, block)
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file trace.h
+ * @brief Binary format of the operation traces recorded by FileSystem::trace_start() and replayed by sfsreplay.
+ * @date 2026-10-18
+ *
+ * @details A trace is a TraceHeader followed by one TraceRecord per public
+ * operation, each followed by its Strings bytes: the names and paths of the
+ * operation, every one ending with a zero byte. Data is not recorded, only
+ * the sizes, so traces stay small and hold no file contents.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Operations found in a trace
+ */
+enum TraceOp {
+    TRACE_CREATE = 1,   /** Arg = inumber created */
+    TRACE_REMOVE,       /** Arg = inumber */
+    TRACE_STAT,         /** Arg = inumber */
+    TRACE_READ,         /** Arg = inumber, Offset, Length */
+    TRACE_WRITE,        /** Arg = inumber, Offset, Length */
+    TRACE_LOOKUP,       /** name; Arg = inumber found, -1 if none */
+    TRACE_TOUCH,        /** name */
+    TRACE_MKDIR,        /** name */
+    TRACE_RMDIR,        /** name */
+    TRACE_CD,           /** name */
+    TRACE_RM,           /** name */
+    TRACE_LS,           /** name */
+    TRACE_READDIR,      /** name */
+    TRACE_DU,           /** name */
+    TRACE_HASH,         /** name; Arg = 1 if every block was hashed */
+    TRACE_COPYIN,       /** host path, name; Arg = bytes of the host file */
+    TRACE_PCOPYIN,      /** host path, name; Arg = bytes of the host file, Length = threads */
+    TRACE_COPYOUT,      /** name, host path */
+    TRACE_IMPORT,       /** host path, name */
+    TRACE_TAR_IN,       /** archive path */
+    TRACE_TAR_OUT,      /** name, archive path */
+    TRACE_COMMIT,       /** one string per operation: its type ('t', 'd', 'r' or 'm') then its path; moves add the target */
+    TRACE_OPS           /** Number of operations + 1 */
+};
+
+/**
+ * @brief Start of a trace
+ */
+struct TraceHeader {
+    char     Magic[8];      /** "SFSTRACE" @hideinitializer*/
+    uint32_t Version;       /** TRACE_VERSION @hideinitializer*/
+    uint32_t Blocks;        /** Blocks of the traced disk @hideinitializer*/
+    uint32_t Features;      /** Features of the traced disk @hideinitializer*/
+    uint32_t Reserved;      /** Zero @hideinitializer*/
+};
+
+/**
+ * @brief One operation of a trace
+ */
+struct TraceRecord {
+    uint8_t  Op;            /** TraceOp @hideinitializer*/
+    uint8_t  Reserved;      /** Zero @hideinitializer*/
+    uint16_t Strings;       /** Bytes of strings following the record @hideinitializer*/
+    uint32_t Duration;      /** Nanoseconds the operation took; saturates at 4.29 s @hideinitializer*/
+    uint64_t Time;          /** Nanoseconds from the start of the trace to the start of the operation @hideinitializer*/
+    uint64_t Arg;           /** Inumber, size or flag, by operation @hideinitializer*/
+    uint64_t Offset;        /** Offset of reads and writes @hideinitializer*/
+    uint32_t Length;        /** Length of reads and writes @hideinitializer*/
+    uint32_t Pad;           /** Zero @hideinitializer*/
+};
+
+const uint32_t TRACE_VERSION = 1;
+
+/**
+ * @brief name of an operation, as sfsreplay prints it
+ * @param op the TraceOp
+ * @return its name; "unknown" for values out of range
+ */
+const char *trace_op_name(uint8_t op);
@@ -0,0 +1,444 @@
+// sfsbench.cpp: Simple file system micro-benchmarks
+
+#include "sfs/disk.h"
+#include "sfs/fs.h"
+
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Macros
+
+#define streq(a, b) (strcmp((a), (b)) == 0)
+
+// Format features; encrypt is left out, it prompts for a password
+
+struct Feature {
+    const char *name;
+    uint32_t    flag;
+};
+
+const Feature FEATURES[] = {
+    {"compress", FileSystem::FEATURE_COMPRESS},
+    {"dedup",    FileSystem::FEATURE_DEDUP},
+    {"checksum", FileSystem::FEATURE_CHECKSUM},
+    {"lazy",     FileSystem::FEATURE_LAZY},
+    {"discard",  FileSystem::FEATURE_DISCARD},
+};
+
+// Benchmark parameters
+
+const size_t   DISK_BLOCKS = 20000;                 // Blocks of the benchmark image
+const size_t   FILE_SIZE   = 1024 * Disk::BLOCK_SIZE;   // Bytes of the files read and written; below the largest file
+const size_t   IO_SIZES[]  = {4096, 65536, 1048576};    // Bytes per read and write call
+const size_t   MIN_OPS     = 32;                    // Calls timed at least per data benchmark
+const size_t   META_OPS    = 400;                   // Files and directories created by the metadata benchmarks
+const size_t   REPEATS     = 5;                     // Runs of format, mount, copyin and copyout
+const uint32_t PER_DIR     = FileSystem::ENTRIES_PER_DIR - 3;   // Files per directory; one entry is left for a subdirectory
+
+// Measurements
+
+struct Result {
+    std::string           name;         // Benchmark name
+    size_t                bytes;        // Bytes moved per operation; 0 for metadata operations
+    std::vector<uint64_t> latencies;    // Nanoseconds of every operation
+    size_t                reads;        // Disk block reads during the operations
+    size_t                writes;       // Disk block writes during the operations
+
+    uint64_t              started;      // Start of the running operation
+    size_t                reads_at;     // Disk reads when it started
+    size_t                writes_at;    // Disk writes when it started
+};
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Result make_result(const char *name, size_t bytes) {
+    Result result;
+    result.name = name;
+    result.bytes = bytes;
+    result.reads = result.writes = 0;
+    return result;
+}
+
+void start(Result &result, Disk &disk) {
+    result.reads_at = disk.reads();
+    result.writes_at = disk.writes();
+    result.started = now_ns();
+}
+
+void stop(Result &result, Disk &disk) {
+    result.latencies.push_back(now_ns() - result.started);
+    result.reads += disk.reads() - result.reads_at;
+    result.writes += disk.writes() - result.writes_at;
+}
+
+// Benchmarks
+
+void bench_format(Disk &disk, uint32_t features, std::vector<Result> &results);
+void bench_mount(Disk &disk, FileSystem &fs, std::vector<Result> &results);
+void bench_metadata(Disk &disk, FileSystem &fs, std::vector<Result> &results);
+void bench_data(Disk &disk, FileSystem &fs, std::vector<Result> &results);
+void bench_copy(Disk &disk, FileSystem &fs, const char *host, std::vector<Result> &results);
+
+// Output
+
+bool parse_features(char *list, uint32_t *features);
+void print_json(FILE *out, size_t blocks, const char *features, std::vector<Result> &results);
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-b blocks] [-f feature,...] [-o output.json] [image]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    size_t   blocks = DISK_BLOCKS;
+    uint32_t features = 0;
+    char     feature_list[BUFSIZ] = "none";
+    const char *output = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "b:f:o:h")) != -1) {
+	switch (option) {
+	    case 'b': blocks = strtoul(optarg, NULL, 10); break;
+	    case 'f':
+		snprintf(feature_list, sizeof(feature_list), "%s", optarg);
+		if (!parse_features(optarg, &features)) return EXIT_FAILURE;
+		break;
+	    case 'o': output = optarg; break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind + 1 < argc || blocks < 2 * FILE_SIZE / Disk::BLOCK_SIZE) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    /* Scratch image and host file; the image is kept when it was named */
+    char image[] = "/tmp/sfsbench.image.XXXXXX";
+    char host[]  = "/tmp/sfsbench.host.XXXXXX";
+    int image_fd = (optind < argc) ? -1 : mkstemp(image);
+    int host_fd  = mkstemp(host);
+    if ((optind == argc && image_fd < 0) || host_fd < 0) {
+	perror("mkstemp");
+	return EXIT_FAILURE;
+    }
+    const char *image_path = (optind < argc) ? argv[optind] : image;
+    if (image_fd >= 0) close(image_fd);
+
+    std::vector<char> data(FILE_SIZE);
+    srand(1);
+    for (size_t i = 0; i < data.size(); i++) data[i] = rand();
+    if (write(host_fd, data.data(), data.size()) != (ssize_t)data.size()) {
+	perror("write");
+	return EXIT_FAILURE;
+    }
+    close(host_fd);
+
+    /* The library reports on stdout; keep it for the JSON and silence the rest */
+    FILE *json = output ? fopen(output, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (!json) {
+	perror(output ? output : "stdout");
+	return EXIT_FAILURE;
+    }
+    if (!freopen("/dev/null", "w", stdout)) {
+	perror("/dev/null");
+	return EXIT_FAILURE;
+    }
+
+    std::vector<Result> results;
+    int status = EXIT_SUCCESS;
+    try {
+	Disk disk;
+	FileSystem fs;
+	disk.open(image_path, blocks);
+
+	bench_format(disk, features, results);
+	bench_mount(disk, fs, results);
+	if (!fs.mount(&disk)) throw std::runtime_error("mount failed");
+	bench_metadata(disk, fs, results);
+	bench_data(disk, fs, results);
+	bench_copy(disk, fs, host, results);
+	fs.exit();
+    } catch (std::runtime_error &e) {
+	fprintf(stderr, "Benchmark failed: %s\n", e.what());
+	status = EXIT_FAILURE;
+    }
+
+    print_json(json, blocks, feature_list, results);
+    fclose(json);
+    unlink(host);
+    if (image_fd >= 0) unlink(image);
+    return status;
+}
+
+// Benchmark functions
+
+void bench_format(Disk &disk, uint32_t features, std::vector<Result> &results) {
+    Result format = make_result("format", 0);
+    for (size_t i = 0; i < REPEATS; i++) {
+	start(format, disk);
+	bool done = FileSystem::format(&disk, features);
+	stop(format, disk);
+	if (!done) throw std::runtime_error("format failed");
+    }
+    results.push_back(format);
+}
+
+void bench_mount(Disk &disk, FileSystem &fs, std::vector<Result> &results) {
+    Result mount = make_result("mount", 0);
+    for (size_t i = 0; i < REPEATS; i++) {
+	start(mount, disk);
+	bool done = fs.mount(&disk);
+	stop(mount, disk);
+	if (!done) throw std::runtime_error("mount failed");
+	fs.exit();
+    }
+    results.push_back(mount);
+}
+
+void bench_metadata(Disk &disk, FileSystem &fs, std::vector<Result> &results) {
+    Result create = make_result("create", 0), remove = make_result("remove", 0);
+    Result mkdir = make_result("mkdir", 0), touch = make_result("touch", 0);
+    Result lookup = make_result("lookup", 0), stat = make_result("stat", 0), rm = make_result("rm", 0);
+    char name[FileSystem::NAMESIZE], dirs[] = "dirs", files[] = "files", next[] = "next", up[] = "..";
+
+    /* Inodes alone, by the layer 1 functions */
+    std::vector<ssize_t> inodes;
+    for (size_t i = 0; i < META_OPS; i++) {
+	start(create, disk);
+	inodes.push_back(fs.create());
+	stop(create, disk);
+	if (inodes.back() < 0) throw std::runtime_error("create failed");
+    }
+    for (size_t i = 0; i < inodes.size(); i++) {
+	start(remove, disk);
+	fs.remove(inodes[i]);
+	stop(remove, disk);
+    }
+
+    /* Directories hold few entries: each level gets its share and a "next" level below */
+    if (!fs.mkdir(dirs) || !fs.cd(dirs)) throw std::runtime_error("mkdir failed");
+    size_t depth = 0;
+    for (size_t i = 0; i < META_OPS; i++) {
+	snprintf(name, sizeof(name), "d%lu", (unsigned long)i);
+	start(mkdir, disk);
+	bool done = fs.mkdir(name);
+	stop(mkdir, disk);
+	if (!done) throw std::runtime_error("mkdir failed");
+	if (i % PER_DIR == PER_DIR - 1) {
+	    if (!fs.mkdir(next) || !fs.cd(next)) throw std::runtime_error("mkdir failed");
+	    depth++;
+	}
+    }
+    for (; depth > 0; depth--) fs.cd(up);
+    fs.cd(up);
+
+    /* Files: touch them level by level, then look them up, stat and remove them the same way */
+    if (!fs.mkdir(files) || !fs.cd(files)) throw std::runtime_error("mkdir failed");
+    size_t levels = (META_OPS + PER_DIR - 1) / PER_DIR;
+    for (size_t level = 0; level < levels; level++) {
+	for (size_t i = 0; i < PER_DIR; i++) {
+	    snprintf(name, sizeof(name), "f%lu", (unsigned long)i);
+	    start(touch, disk);
+	    bool done = fs.touch(name);
+	    stop(touch, disk);
+	    if (!done) throw std::runtime_error("touch failed");
+	}
+	if (!fs.mkdir(next) || !fs.cd(next)) throw std::runtime_error("mkdir failed");
+    }
+    for (size_t level = 0; level < levels; level++) fs.cd(up);
+
+    for (size_t level = 0; level < levels; level++) {
+	for (size_t i = 0; i < PER_DIR; i++) {
+	    snprintf(name, sizeof(name), "f%lu", (unsigned long)i);
+	    start(lookup, disk);
+	    ssize_t inumber = fs.lookup(name);
+	    stop(lookup, disk);
+	    start(stat, disk);
+	    ssize_t size = fs.stat(inumber);
+	    stop(stat, disk);
+	    if (inumber < 0 || size < 0) throw std::runtime_error("lookup failed");
+	}
+	fs.cd(next);
+    }
+    for (size_t level = 0; level < levels; level++) fs.cd(up);
+
+    for (size_t level = 0; level < levels; level++) {
+	for (size_t i = 0; i < PER_DIR; i++) {
+	    snprintf(name, sizeof(name), "f%lu", (unsigned long)i);
+	    start(rm, disk);
+	    bool done = fs.rm(name);
+	    stop(rm, disk);
+	    if (!done) throw std::runtime_error("rm failed");
+	}
+	fs.cd(next);
+    }
+    for (size_t level = 0; level <= levels; level++) fs.cd(up);
+
+    results.push_back(create);
+    results.push_back(remove);
+    results.push_back(mkdir);
+    results.push_back(touch);
+    results.push_back(lookup);
+    results.push_back(stat);
+    results.push_back(rm);
+}
+
+void bench_data(Disk &disk, FileSystem &fs, std::vector<Result> &results) {
+    char dir[] = "data", file[] = "file", up[] = "..";
+    std::vector<char> buffer(FILE_SIZE);
+    srand(2);
+    for (size_t i = 0; i < buffer.size(); i++) buffer[i] = rand();
+    if (!fs.mkdir(dir) || !fs.cd(dir)) throw std::runtime_error("mkdir failed");
+
+    for (size_t s = 0; s < sizeof(IO_SIZES) / sizeof(IO_SIZES[0]); s++) {
+	size_t size = IO_SIZES[s], calls = FILE_SIZE / size;
+	size_t passes = std::max((size_t)1, MIN_OPS / calls);
+	Result seq_write = make_result("seq_write", size), seq_read = make_result("seq_read", size);
+	Result rand_write = make_result("rand_write", size), rand_read = make_result("rand_read", size);
+
+	/* Sequential writes fill a new file every pass, so every pass allocates its blocks */
+	ssize_t inumber = -1;
+	for (size_t pass = 0; pass < passes; pass++) {
+	    fs.rm(file);
+	    if (!fs.touch(file) || (inumber = fs.lookup(file)) < 0) throw std::runtime_error("touch failed");
+	    for (size_t i = 0; i < calls; i++) {
+		start(seq_write, disk);
+		ssize_t done = fs.write(inumber, buffer.data() + i * size, size, i * size);
+		stop(seq_write, disk);
+		if (done != (ssize_t)size) throw std::runtime_error("write failed");
+	    }
+	}
+
+	for (size_t pass = 0; pass < passes; pass++) {
+	    for (size_t i = 0; i < calls; i++) {
+		start(seq_read, disk);
+		ssize_t done = fs.read(inumber, buffer.data() + i * size, size, i * size);
+		stop(seq_read, disk);
+		if (done != (ssize_t)size) throw std::runtime_error("read failed");
+	    }
+	}
+
+	/* Random calls go to aligned offsets of the written file */
+	srand(3);
+	for (size_t i = 0; i < calls * passes; i++) {
+	    size_t offset = (rand() % calls) * size;
+	    start(rand_read, disk);
+	    ssize_t done = fs.read(inumber, buffer.data() + offset, size, offset);
+	    stop(rand_read, disk);
+	    if (done != (ssize_t)size) throw std::runtime_error("read failed");
+	}
+	for (size_t i = 0; i < calls * passes; i++) {
+	    size_t offset = (rand() % calls) * size;
+	    start(rand_write, disk);
+	    ssize_t done = fs.write(inumber, buffer.data() + offset, size, offset);
+	    stop(rand_write, disk);
+	    if (done != (ssize_t)size) throw std::runtime_error("write failed");
+	}
+
+	results.push_back(seq_write);
+	results.push_back(seq_read);
+	results.push_back(rand_write);
+	results.push_back(rand_read);
+    }
+
+    fs.rm(file);
+    fs.cd(up);
+}
+
+void bench_copy(Disk &disk, FileSystem &fs, const char *host, std::vector<Result> &results) {
+    char dir[] = "copy", file[] = "file", up[] = "..";
+    std::string copy = std::string(host) + ".out";
+    Result copyin = make_result("copyin", FILE_SIZE), copyout = make_result("copyout", FILE_SIZE);
+    if (!fs.mkdir(dir) || !fs.cd(dir)) throw std::runtime_error("mkdir failed");
+
+    for (size_t i = 0; i < REPEATS; i++) {
+	fs.rm(file);
+	start(copyin, disk);
+	bool done = fs.copyin(host, file);
+	stop(copyin, disk);
+	if (!done) throw std::runtime_error("copyin failed");
+    }
+    for (size_t i = 0; i < REPEATS; i++) {
+	start(copyout, disk);
+	bool done = fs.copyout(file, copy.c_str());
+	stop(copyout, disk);
+	if (!done) throw std::runtime_error("copyout failed");
+    }
+
+    unlink(copy.c_str());
+    fs.rm(file);
+    fs.cd(up);
+    results.push_back(copyin);
+    results.push_back(copyout);
+}
+
+// Output functions
+
+bool parse_features(char *list, uint32_t *features) {
+    *features = 0;
+    if (streq(list, "none")) return true;
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+	size_t i = 0;
+	for (; i < sizeof(FEATURES) / sizeof(FEATURES[0]); i++) {
+	    if (streq(name, FEATURES[i].name)) break;
+	}
+	if (i == sizeof(FEATURES) / sizeof(FEATURES[0])) {
+	    fprintf(stderr, "Unknown feature: %s\n", name);
+	    return false;
+	}
+	*features |= FEATURES[i].flag;
+    }
+    return true;
+}
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p / 100 * sorted.size() + 0.999999);
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+void print_json(FILE *out, size_t blocks, const char *features, std::vector<Result> &results) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"sfsbench\",\n");
+    fprintf(out, "  \"blocks\": %lu,\n", (unsigned long)blocks);
+    fprintf(out, "  \"block_size\": %lu,\n", (unsigned long)Disk::BLOCK_SIZE);
+    fprintf(out, "  \"features\": \"%s\",\n", features);
+    fprintf(out, "  \"results\": [");
+
+    for (size_t r = 0; r < results.size(); r++) {
+	Result &result = results[r];
+	std::vector<uint64_t> sorted = result.latencies;
+	std::sort(sorted.begin(), sorted.end());
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < sorted.size(); i++) total += sorted[i];
+	size_t ops = sorted.size();
+	double seconds = total / 1e9;
+	double per_op = ops ? 1.0 / ops : 0;
+
+	fprintf(out, "%s\n    {\"name\": \"%s\", \"bytes\": %lu, \"ops\": %lu, \"seconds\": %.6f,",
+		r ? "," : "", result.name.c_str(), (unsigned long)result.bytes, (unsigned long)ops, seconds);
+	fprintf(out, " \"ops_per_sec\": %.1f, \"mb_per_sec\": %.1f,",
+		seconds > 0 ? ops / seconds : 0, seconds > 0 ? result.bytes * ops / seconds / 1e6 : 0);
+	fprintf(out, " \"latency_ns\": {\"min\": %lu, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu},",
+		(unsigned long)(ops ? sorted.front() : 0), (unsigned long)percentile(sorted, 50),
+		(unsigned long)percentile(sorted, 90), (unsigned long)percentile(sorted, 99),
+		(unsigned long)(ops ? sorted.back() : 0));
+	fprintf(out, " \"reads_per_op\": %.2f, \"writes_per_op\": %.2f}",
+		result.reads * per_op, result.writes * per_op);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+}
@@ -0,0 +1,414 @@
+// sfscachesim.cpp: Simple file system buffer cache simulator
+
+#include "sfs/disk.h"
+#include "sfs/iotrace.h"
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Policies
+
+/**
+ * Replacement policy of a cache of a fixed number of blocks.
+ */
+class Policy {
+public:
+    virtual ~Policy() {}
+    virtual bool access(uint32_t block) = 0;    // Returns true on a hit; a miss brings the block in
+    virtual void remove(uint32_t block) = 0;    // Drops a discarded block, and anything remembered of it
+};
+
+/**
+ * Ordered set of blocks with O(1) move to front and removal.
+ */
+class Queue {
+public:
+    size_t size() const { return Order.size(); }
+    bool   contains(uint32_t block) const { return Where.count(block); }
+    uint32_t back() const { return Order.back(); }
+
+    void push_front(uint32_t block) {
+	Order.push_front(block);
+	Where[block] = Order.begin();
+    }
+    void erase(uint32_t block) {
+	unordered_map<uint32_t, list<uint32_t>::iterator>::iterator it = Where.find(block);
+	if (it == Where.end()) return;
+	Order.erase(it->second);
+	Where.erase(it);
+    }
+    uint32_t pop_back() {
+	uint32_t block = Order.back();
+	erase(block);
+	return block;
+    }
+
+private:
+    list<uint32_t> Order;                                           // Most recent first
+    unordered_map<uint32_t, list<uint32_t>::iterator> Where;
+};
+
+/**
+ * CLOCK: a ring of frames with reference bits; the hand clears bits until it finds an unreferenced frame.
+ */
+class Clock : public Policy {
+public:
+    Clock(size_t size) : Blocks(size, EMPTY), Referenced(size, false), Hand(0), Used(0) {}
+
+    bool access(uint32_t block) {
+	unordered_map<uint32_t, size_t>::iterator it = Frames.find(block);
+	if (it != Frames.end()) {
+	    Referenced[it->second] = true;
+	    return true;
+	}
+
+	size_t frame;
+	if (Used < Blocks.size()) {
+	    frame = Used++;
+	} else {
+	    while (Referenced[Hand]) {
+		Referenced[Hand] = false;
+		Hand = (Hand + 1) % Blocks.size();
+	    }
+	    frame = Hand;
+	    Hand = (Hand + 1) % Blocks.size();
+	    if (Blocks[frame] != EMPTY) Frames.erase(Blocks[frame]);
+	}
+	Blocks[frame] = block;
+	Referenced[frame] = true;
+	Frames[block] = frame;
+	return false;
+    }
+
+    void remove(uint32_t block) {
+	unordered_map<uint32_t, size_t>::iterator it = Frames.find(block);
+	if (it == Frames.end()) return;
+	Blocks[it->second] = EMPTY;
+	Referenced[it->second] = false;
+	Frames.erase(it);
+    }
+
+private:
+    const static uint32_t EMPTY = UINT32_MAX;
+    vector<uint32_t> Blocks;
+    vector<bool>     Referenced;
+    unordered_map<uint32_t, size_t> Frames;
+    size_t Hand;
+    size_t Used;
+};
+
+const uint32_t Clock::EMPTY;
+
+/**
+ * 2Q (Johnson and Shasha): new blocks wait in a FIFO, A1in; blocks seen again after leaving it,
+ * which A1out remembers, go to the LRU queue Am. A1in holds a quarter of the cache, A1out half.
+ */
+class TwoQ : public Policy {
+public:
+    TwoQ(size_t size) : Size(size), Kin(max<size_t>(1, size / 4)), Kout(max<size_t>(1, size / 2)) {}
+
+    bool access(uint32_t block) {
+	if (Am.contains(block)) {
+	    Am.erase(block);
+	    Am.push_front(block);
+	    return true;
+	}
+	if (A1in.contains(block)) return true;
+
+	reclaim();
+	if (A1out.contains(block)) {
+	    A1out.erase(block);
+	    Am.push_front(block);
+	} else {
+	    A1in.push_front(block);
+	}
+	return false;
+    }
+
+    void remove(uint32_t block) {
+	Am.erase(block);
+	A1in.erase(block);
+	A1out.erase(block);
+    }
+
+private:
+    void reclaim() {
+	if (A1in.size() + Am.size() < Size) return;
+	if (A1in.size() > Kin || !Am.size()) {
+	    A1out.push_front(A1in.pop_back());
+	    if (A1out.size() > Kout) A1out.pop_back();
+	} else {
+	    Am.pop_back();
+	}
+    }
+
+    size_t Size, Kin, Kout;
+    Queue  A1in, A1out, Am;
+};
+
+/**
+ * ARC (Megiddo and Modha): T1 holds blocks seen once, T2 blocks seen again; the ghosts B1 and B2
+ * remember what they evicted and move the target size of T1, P, towards the side that misses.
+ */
+class Arc : public Policy {
+public:
+    Arc(size_t size) : C(size), P(0) {}
+
+    bool access(uint32_t block) {
+	if (T1.contains(block) || T2.contains(block)) {
+	    T1.erase(block);
+	    T2.erase(block);
+	    T2.push_front(block);
+	    return true;
+	}
+
+	if (B1.contains(block)) {
+	    P = min(C, P + max<size_t>(B2.size() / B1.size(), 1));
+	    replace(false);
+	    B1.erase(block);
+	    T2.push_front(block);
+	    return false;
+	}
+	if (B2.contains(block)) {
+	    P -= min(P, max<size_t>(B1.size() / B2.size(), 1));
+	    replace(true);
+	    B2.erase(block);
+	    T2.push_front(block);
+	    return false;
+	}
+
+	size_t l1 = T1.size() + B1.size(), total = l1 + T2.size() + B2.size();
+	if (l1 == C) {
+	    if (T1.size() < C) {
+		B1.pop_back();
+		replace(false);
+	    } else {
+		T1.pop_back();
+	    }
+	} else if (total >= C) {
+	    if (total == 2 * C && B2.size()) B2.pop_back();
+	    replace(false);
+	}
+	T1.push_front(block);
+	return false;
+    }
+
+    void remove(uint32_t block) {
+	T1.erase(block);
+	T2.erase(block);
+	B1.erase(block);
+	B2.erase(block);
+    }
+
+private:
+    void replace(bool in_b2) {
+	if (T1.size() && (T1.size() > P || (in_b2 && T1.size() == P))) {
+	    B1.push_front(T1.pop_back());
+	} else if (T2.size()) {
+	    B2.push_front(T2.pop_back());
+	}
+    }
+
+    size_t C, P;
+    Queue  T1, T2, B1, B2;
+};
+
+/**
+ * LRU of every size at once (Mattson): the stack distance of an access is the number of other
+ * blocks touched since the last access to its block, counted with a Fenwick tree over time.
+ * It hits in every LRU cache larger than its distance.
+ */
+class StackDistance {
+public:
+    const static uint64_t COLD = UINT64_MAX;
+
+    StackDistance(size_t accesses) : Tree(accesses + 1, 0), Now(0) {}
+
+    uint64_t access(uint32_t block) {
+	uint64_t distance = COLD;
+	unordered_map<uint32_t, size_t>::iterator it = Last.find(block);
+	if (it != Last.end()) {
+	    distance = sum(Now) - sum(it->second);
+	    add(it->second, -1);
+	}
+	Now++;
+	add(Now, 1);
+	Last[block] = Now;
+	return distance;
+    }
+
+    void remove(uint32_t block) {
+	unordered_map<uint32_t, size_t>::iterator it = Last.find(block);
+	if (it == Last.end()) return;
+	add(it->second, -1);
+	Last.erase(it);
+    }
+
+private:
+    void add(size_t i, int delta) {
+	for (; i < Tree.size(); i += i & -i) Tree[i] += delta;
+    }
+    uint64_t sum(size_t i) const {
+	uint64_t total = 0;
+	for (; i > 0; i -= i & -i) total += Tree[i];
+	return total;
+    }
+
+    vector<int32_t> Tree;                       // Marks the latest access of every block
+    unordered_map<uint32_t, size_t> Last;       // Time of the latest access of every block
+    size_t Now;
+};
+
+// Functions
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-r] [-s sizes] <blocktrace>\n", program);
+    fprintf(stderr, "    -r    count the misses of reads only; writes still bring blocks in\n");
+    fprintf(stderr, "    -s    comma separated cache sizes in blocks (default powers of two up to the blocks touched)\n");
+}
+
+bool read_trace(const char *path, IoTraceHeader *header, vector<IoRecord> *records) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+	return false;
+    }
+
+    if (fread(header, sizeof(IoTraceHeader), 1, in) != 1 || memcmp(header->Magic, "SFSIOTRC", sizeof(header->Magic)) ||
+	header->Version != IOTRACE_VERSION) {
+	fprintf(stderr, "%s is not a block trace\n", path);
+	fclose(in);
+	return false;
+    }
+
+    IoRecord record;
+    while (fread(&record, sizeof(record), 1, in) == 1) records->push_back(record);
+    fclose(in);
+    return true;
+}
+
+bool parse_sizes(const char *text, vector<size_t> *sizes) {
+    string list(text);
+    size_t start = 0;
+    while (start <= list.size()) {
+	size_t comma = list.find(',', start);
+	if (comma == string::npos) comma = list.size();
+	char *end;
+	unsigned long size = strtoul(list.c_str() + start, &end, 10);
+	if (!size || end != list.c_str() + comma) return false;
+	sizes->push_back(size);
+	start = comma + 1;
+    }
+    sort(sizes->begin(), sizes->end());
+    sizes->erase(unique(sizes->begin(), sizes->end()), sizes->end());
+    return true;
+}
+
+// Main execution
+
+int main(int argc, char *argv[]) {
+    bool reads_only = false;
+    vector<size_t> sizes;
+
+    int option;
+    while ((option = getopt(argc, argv, "rs:h")) != -1) {
+	switch (option) {
+	    case 'r': reads_only = true; break;
+	    case 's':
+		if (!parse_sizes(optarg, &sizes)) {
+		    fprintf(stderr, "Bad cache sizes: %s\n", optarg);
+		    return EXIT_FAILURE;
+		}
+		break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind + 1 != argc) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    IoTraceHeader header;
+    vector<IoRecord> records;
+    if (!read_trace(argv[optind], &header, &records)) return EXIT_FAILURE;
+
+    /* Runs are accessed block by block */
+    size_t accesses = 0;
+    unordered_map<uint32_t, bool> touched;
+    for (size_t i = 0; i < records.size(); i++) {
+	if (records[i].Op == IO_DISCARD) continue;
+	accesses += records[i].Count;
+	for (uint32_t b = records[i].Block; b < records[i].Block + records[i].Count; b++) touched[b] = true;
+    }
+    if (sizes.empty()) {
+	for (size_t size = 1; ; size *= 2) {
+	    sizes.push_back(size);
+	    if (size >= touched.size()) break;
+	}
+    }
+
+    /* One pass: LRU by stack distance for every size, the others simulated side by side */
+    StackDistance lru(accesses);
+    vector<uint64_t> distances;                 // Counted accesses by stack distance; COLD ones apart
+    uint64_t cold = 0, counted = 0;
+    vector<Policy *> policies;
+    for (size_t s = 0; s < sizes.size(); s++) {
+	policies.push_back(new Clock(sizes[s]));
+	policies.push_back(new Arc(sizes[s]));
+	policies.push_back(new TwoQ(sizes[s]));
+    }
+    vector<uint64_t> misses(policies.size(), 0);
+
+    for (size_t i = 0; i < records.size(); i++) {
+	const IoRecord &record = records[i];
+	for (uint32_t b = record.Block; b < record.Block + record.Count; b++) {
+	    if (record.Op == IO_DISCARD) {
+		lru.remove(b);
+		for (size_t p = 0; p < policies.size(); p++) policies[p]->remove(b);
+		continue;
+	    }
+
+	    bool count = !reads_only || record.Op == IO_READ;
+	    uint64_t distance = lru.access(b);
+	    if (count) {
+		counted++;
+		if (distance == StackDistance::COLD) cold++;
+		else {
+		    if (distance >= distances.size()) distances.resize(distance + 1, 0);
+		    distances[distance]++;
+		}
+	    }
+	    for (size_t p = 0; p < policies.size(); p++) {
+		if (!policies[p]->access(b) && count) misses[p]++;
+	    }
+	}
+    }
+
+    printf("%lu block accesses, %lu counted, %lu blocks touched, %lu cold misses\n", (unsigned long)accesses,
+	   (unsigned long)counted, (unsigned long)touched.size(), (unsigned long)cold);
+    printf("%10s %10s %8s %8s %8s %8s\n", "blocks", "KiB", "lru", "clock", "arc", "2q");
+
+    /* An access at distance d hits every LRU cache of more than d blocks */
+    uint64_t lru_misses = counted;
+    size_t d = 0;
+    for (size_t s = 0; s < sizes.size(); s++) {
+	for (; d < sizes[s] && d < distances.size(); d++) lru_misses -= distances[d];
+	double total = counted ? counted : 1;
+	printf("%10lu %10lu %8.4f %8.4f %8.4f %8.4f\n", (unsigned long)sizes[s], (unsigned long)(sizes[s] * Disk::BLOCK_SIZE / 1024),
+	       lru_misses / total, misses[3 * s] / total, misses[3 * s + 1] / total, misses[3 * s + 2] / total);
+    }
+
+    for (size_t p = 0; p < policies.size(); p++) delete policies[p];
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+// sfsc.cpp: Simple file system client of sfsd
+
+#include "sfs/sfs.h"
+#include "sfs/sfsd.h"
+
+#include <string>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Macros
+
+#define streq(a, b) (strcmp((a), (b)) == 0)
+
+// Protocol
+
+/* Room for the name and its zero byte in front of the data of SFSD_WRITE */
+const size_t CHUNK = SFSD_MAX_PAYLOAD - 16;
+
+uint32_t NextId = 0;
+
+bool send_all(int fd, const char *data, size_t length) {
+    while (length) {
+	ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+	if (sent < 0 && errno == EINTR) continue;
+	if (sent <= 0) return false;
+	data += sent;
+	length -= sent;
+    }
+    return true;
+}
+
+bool receive_all(int fd, char *data, size_t length) {
+    while (length) {
+	ssize_t received = recv(fd, data, length, 0);
+	if (received < 0 && errno == EINTR) continue;
+	if (received <= 0) return false;
+	data += received;
+	length -= received;
+    }
+    return true;
+}
+
+/* Sends a request and waits for its response; exits if the daemon is gone */
+int32_t call(int fd, uint8_t op, const string &payload, uint64_t offset, uint32_t count, uint64_t *value, string *reply) {
+    SfsdRequest request;
+    memset(&request, 0, sizeof(request));
+    request.Length = payload.size();
+    request.Id = NextId++;
+    request.Op = op;
+    request.Count = count;
+    request.Offset = offset;
+
+    SfsdResponse response;
+    if (!send_all(fd, (const char *)&request, sizeof(request)) || !send_all(fd, payload.data(), payload.size()) ||
+	!receive_all(fd, (char *)&response, sizeof(response))) {
+	fprintf(stderr, "Lost the connection to sfsd\n");
+	exit(EXIT_FAILURE);
+    }
+
+    string body(response.Length, '\0');
+    if (response.Length && !receive_all(fd, &body[0], body.size())) {
+	fprintf(stderr, "Lost the connection to sfsd\n");
+	exit(EXIT_FAILURE);
+    }
+    if (value) *value = response.Value;
+    if (reply) reply->swap(body);
+    return response.Status;
+}
+
+string named(const char *name) {
+    return string(name, strlen(name) + 1);
+}
+
+// Commands
+
+void do_put(int fd, const char *path, const char *name) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+	printf("Unable to open %s: %s\n", path, strerror(errno));
+	return;
+    }
+
+    int32_t status = call(fd, SFSD_CREATE, named(name), 0, 0, NULL, NULL);
+    uint64_t offset = 0, written;
+    string payload = named(name);
+    size_t header = payload.size();
+    payload.resize(header + CHUNK);
+    size_t length;
+    while (status == SFS_OK && (length = fread(&payload[header], 1, CHUNK, in)) > 0) {
+	status = call(fd, SFSD_WRITE, payload.substr(0, header + length), offset, 0, &written, NULL);
+	offset += status == SFS_OK ? written : 0;
+	if (status == SFS_OK && written < length) status = SFS_ENOSPC;
+    }
+    fclose(in);
+
+    if (status == SFS_OK) printf("%lu bytes copied\n", (unsigned long)offset);
+    else printf("put %s: %s\n", name, sfs_strerror(status));
+}
+
+void do_get(int fd, const char *name, const char *path) {
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+	printf("Unable to open %s: %s\n", path, strerror(errno));
+	return;
+    }
+
+    uint64_t offset = 0, read;
+    string data;
+    int32_t status;
+    while ((status = call(fd, SFSD_READ, named(name), offset, CHUNK, &read, &data)) == SFS_OK && read) {
+	fwrite(data.data(), 1, data.size(), out);
+	offset += read;
+    }
+    fclose(out);
+
+    if (status == SFS_OK) printf("%lu bytes copied\n", (unsigned long)offset);
+    else printf("get %s: %s\n", name, sfs_strerror(status));
+}
+
+void do_ls(int fd, const char *name) {
+    uint64_t entries;
+    string reply;
+    int32_t status = call(fd, SFSD_READDIR, named(name), 0, 0, &entries, &reply);
+    if (status != SFS_OK) {
+	printf("ls %s: %s\n", name, sfs_strerror(status));
+	return;
+    }
+
+    printf("   inum    |       name       | type |   size\n");
+    for (uint64_t i = 0; i < entries && (i + 1) * sizeof(SfsdEntry) <= reply.size(); i++) {
+	SfsdEntry entry;
+	memcpy(&entry, reply.data() + i * sizeof(SfsdEntry), sizeof(entry));
+	printf("%-10u | %-16s | %-4s | %lu\n", entry.Stat.Inumber, entry.Name,
+	       entry.Stat.Type == SFS_TYPE_DIR ? "dir" : "file", (unsigned long)entry.Stat.Size);
+    }
+}
+
+void do_stat(int fd, const char *name) {
+    string reply;
+    int32_t status = call(fd, SFSD_STAT, named(name), 0, 0, NULL, &reply);
+    SfsdStat st;
+    if (status != SFS_OK || reply.size() != sizeof(st)) {
+	printf("stat %s: %s\n", name, sfs_strerror(status));
+	return;
+    }
+    memcpy(&st, reply.data(), sizeof(st));
+    printf("%s: %s, inum %u, %lu bytes, %lu blocks\n", name, st.Type == SFS_TYPE_DIR ? "dir" : "file",
+	   st.Inumber, (unsigned long)st.Size, (unsigned long)st.Blocks);
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s <socket>\n", program);
+    fprintf(stderr, "Reads commands from stdin, one per line:\n");
+    fprintf(stderr, "    ping\n");
+    fprintf(stderr, "    mkdir | rmdir | cd | touch | rm | stat <name>\n");
+    fprintf(stderr, "    ls [name]\n");
+    fprintf(stderr, "    put <path> <name>\n");
+    fprintf(stderr, "    get <name> <path>\n");
+}
+
+// Main execution
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+	fprintf(stderr, "Unable to connect to %s: %s\n", argv[1], strerror(errno));
+	return EXIT_FAILURE;
+    }
+
+    char line[BUFSIZ], cmd[BUFSIZ], arg1[BUFSIZ], arg2[BUFSIZ];
+    while (fgets(line, BUFSIZ, stdin) != NULL) {
+	int args = sscanf(line, "%s %s %s", cmd, arg1, arg2);
+	if (args <= 0) continue;
+
+	static const struct { const char *name; uint8_t op; } SIMPLE[] = {
+	    {"mkdir", SFSD_MKDIR}, {"rmdir", SFSD_RMDIR}, {"cd", SFSD_CD}, {"touch", SFSD_CREATE}, {"rm", SFSD_REMOVE},
+	};
+	size_t simple = 0;
+	while (simple < sizeof(SIMPLE) / sizeof(SIMPLE[0]) && !streq(cmd, SIMPLE[simple].name)) simple++;
+
+	if (streq(cmd, "ping") && args == 1) {
+	    uint64_t version;
+	    call(fd, SFSD_PING, string(), 0, 0, &version, NULL);
+	    printf("sfsd protocol %lu\n", (unsigned long)version);
+	} else if (simple < sizeof(SIMPLE) / sizeof(SIMPLE[0]) && args == 2) {
+	    int32_t status = call(fd, SIMPLE[simple].op, named(arg1), 0, 0, NULL, NULL);
+	    if (status == SFS_OK) printf("%s %s\n", cmd, arg1);
+	    else printf("%s %s: %s\n", cmd, arg1, sfs_strerror(status));
+	} else if (streq(cmd, "stat") && args == 2) {
+	    do_stat(fd, arg1);
+	} else if (streq(cmd, "ls") && args <= 2) {
+	    do_ls(fd, args == 2 ? arg1 : ".");
+	} else if (streq(cmd, "put") && args == 3) {
+	    do_put(fd, arg1, arg2);
+	} else if (streq(cmd, "get") && args == 3) {
+	    do_get(fd, arg1, arg2);
+	} else {
+	    printf("Unknown command: %s", line);
+	}
+	fflush(stdout);
+    }
+
+    close(fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,410 @@
+// sfsd.cpp: Simple file system daemon
+
+#include "sfs/sfs.h"
+#include "sfs/sfsd.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/file.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Sessions
+
+struct Session {
+    int      fd;            // Connection, or the listening socket or the signalfd
+    uint32_t cwd;           // Current directory of the client
+    string   in;            // Bytes received and not served yet
+};
+
+// Server
+
+struct Server {
+    sfs_t               *fs;            // The mounted image
+    mutex                fs_lock;       // The file system runs one request at a time
+    int                  epoll;
+    mutex                queue_lock;
+    condition_variable   queue_ready;
+    deque<Session *>     queue;         // Sessions with a whole request buffered, for the workers
+    bool                 stopping;
+};
+
+const size_t LIST_ENTRIES = 64;        // Entries sfs_readdir() is asked for first
+const int    SEND_TIMEOUT = 5000;      // Milliseconds a full socket buffer is waited out before the client is hung up on
+
+// Functions
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-t threads] <diskfile> <nblocks> <socket>\n", program);
+    fprintf(stderr, "    -t    worker threads (default 4)\n");
+}
+
+/* Length of the first request in the buffer, or 0 if it is not all there yet */
+size_t whole_request(const string &in) {
+    if (in.size() < sizeof(SfsdRequest)) return 0;
+    SfsdRequest request;
+    memcpy(&request, in.data(), sizeof(request));
+    size_t length = sizeof(SfsdRequest) + request.Length;
+    return in.size() >= length ? length : 0;
+}
+
+/* Waits out a full socket buffer instead of queueing the response; false if it stays full for SEND_TIMEOUT */
+bool send_all(int fd, const char *data, size_t length) {
+    while (length) {
+	ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+	if (sent < 0) {
+	    if (errno == EINTR) continue;
+	    if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+	    struct pollfd writable = {fd, POLLOUT, 0};
+	    int ready = poll(&writable, 1, SEND_TIMEOUT);
+	    if (ready == 0 || (ready < 0 && errno != EINTR)) return false;
+	    continue;
+	}
+	data += sent;
+	length -= sent;
+    }
+    return true;
+}
+
+int rearm(Server *server, Session *session) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = session;
+    return epoll_ctl(server->epoll, EPOLL_CTL_MOD, session->fd, &event);
+}
+
+void fill_stat(const struct sfs_stat &st, SfsdStat *out) {
+    memset(out, 0, sizeof(SfsdStat));
+    out->Inumber = st.inumber;
+    out->Type = st.type;
+    out->Size = st.size;
+    out->Blocks = st.blocks;
+}
+
+/* Opens a file, runs an operation on it at an offset and closes it */
+template <typename Operation>
+ssize_t with_file(sfs_t *fs, const char *name, int flags, uint64_t offset, Operation operation) {
+    int file = sfs_open(fs, name, flags);
+    if (file < 0) return file;
+    off_t at = sfs_seek(fs, file, offset, SFS_SEEK_SET);
+    ssize_t result = at < 0 ? at : operation(file);
+    sfs_close(fs, file);
+    return result;
+}
+
+/* Runs one request in the directory of the session; the caller holds fs_lock */
+int32_t handle(sfs_t *fs, Session *session, const SfsdRequest &request, const char *payload,
+	       string *reply, uint64_t *value) {
+    if (request.Op == SFSD_PING) {
+	*value = SFSD_VERSION;
+	return SFS_OK;
+    }
+    if (request.Op >= SFSD_OPS) return SFS_EINVAL;
+
+    /* Every other request starts with a name */
+    const char *name = payload;
+    size_t length = strnlen(payload, request.Length);
+    if (length == request.Length) return SFS_EINVAL;
+    const char *data = payload + length + 1;
+    size_t data_length = request.Length - length - 1;
+
+    /* A directory removed under the session takes it back to the root */
+    if (sfs_setcwd(fs, session->cwd) != SFS_OK) {
+	session->cwd = 0;
+	sfs_setcwd(fs, 0);
+	return SFS_ENOENT;
+    }
+
+    struct sfs_stat st;
+    ssize_t result;
+    switch (request.Op) {
+	case SFSD_MKDIR:  return sfs_mkdir(fs, name);
+	case SFSD_RMDIR:  return sfs_rmdir(fs, name);
+	case SFSD_REMOVE: return sfs_unlink(fs, name);
+
+	case SFSD_CD:
+	    result = sfs_chdir(fs, name);
+	    if (result == SFS_OK) sfs_getcwd(fs, &session->cwd);
+	    *value = session->cwd;
+	    return result;
+
+	case SFSD_STAT: {
+	    result = sfs_stat(fs, name, &st);
+	    if (result != SFS_OK) return result;
+	    SfsdStat out;
+	    fill_stat(st, &out);
+	    reply->assign((const char *)&out, sizeof(out));
+	    return SFS_OK;
+	}
+
+	case SFSD_READDIR: {
+	    vector<struct sfs_dirent> entries(LIST_ENTRIES);
+	    result = sfs_readdir(fs, name, entries.data(), entries.size());
+	    if (result > (ssize_t)entries.size()) {
+		entries.resize(result);
+		result = sfs_readdir(fs, name, entries.data(), entries.size());
+	    }
+	    if (result < 0) return result;
+	    for (ssize_t i = 0; i < result; i++) {
+		SfsdEntry out;
+		memset(&out, 0, sizeof(out));
+		memcpy(out.Name, entries[i].name, sizeof(out.Name));
+		fill_stat(entries[i].stat, &out.Stat);
+		reply->append((const char *)&out, sizeof(out));
+	    }
+	    *value = result;
+	    return SFS_OK;
+	}
+
+	case SFSD_CREATE:
+	    result = with_file(fs, name, SFS_O_CREAT, 0, [](int) -> ssize_t { return SFS_OK; });
+	    if (result == SFS_OK) result = sfs_stat(fs, name, &st);
+	    if (result == SFS_OK) *value = st.inumber;
+	    return result;
+
+	case SFSD_READ:
+	    if (request.Count > SFSD_MAX_PAYLOAD) return SFS_EINVAL;
+	    reply->resize(request.Count);
+	    result = with_file(fs, name, 0, request.Offset, [&](int file) -> ssize_t {
+		return request.Count ? sfs_read(fs, file, &(*reply)[0], request.Count) : 0;
+	    });
+	    reply->resize(result > 0 ? result : 0);
+	    if (result < 0) return result;
+	    *value = result;
+	    return SFS_OK;
+
+	case SFSD_WRITE:
+	    result = with_file(fs, name, 0, request.Offset, [&](int file) -> ssize_t {
+		return sfs_write(fs, file, data, data_length);
+	    });
+	    if (result < 0) return result;
+	    *value = result;
+	    return SFS_OK;
+    }
+    return SFS_EINVAL;
+}
+
+/* Serves the requests buffered for a session, then hands it back to the event loop */
+void serve(Server *server, Session *session) {
+    bool healthy = true;
+    size_t length;
+    while (healthy && (length = whole_request(session->in))) {
+	SfsdRequest request;
+	memcpy(&request, session->in.data(), sizeof(request));
+
+	SfsdResponse response;
+	memset(&response, 0, sizeof(response));
+	response.Id = request.Id;
+	string reply;
+	{
+	    lock_guard<mutex> guard(server->fs_lock);
+	    response.Status = handle(server->fs, session, request, session->in.data() + sizeof(request), &reply, &response.Value);
+	}
+	response.Length = reply.size();
+
+	healthy = send_all(session->fd, (const char *)&response, sizeof(response)) &&
+		  send_all(session->fd, reply.data(), reply.size());
+	session->in.erase(0, length);
+    }
+
+    /* A client that stopped reading is hung up on; the event loop sees it and closes the session */
+    if (!healthy) shutdown(session->fd, SHUT_RDWR);
+    rearm(server, session);
+}
+
+void work(Server *server) {
+    while (true) {
+	Session *session;
+	{
+	    unique_lock<mutex> lock(server->queue_lock);
+	    server->queue_ready.wait(lock, [server]() { return server->stopping || !server->queue.empty(); });
+	    if (server->queue.empty()) return;
+	    session = server->queue.front();
+	    server->queue.pop_front();
+	}
+	serve(server, session);
+    }
+}
+
+/* Reads what a session sent; false if it broke the protocol, or hung up with no whole request left to serve */
+bool receive(Session *session) {
+    char buffer[65536];
+    while (true) {
+	ssize_t received = recv(session->fd, buffer, sizeof(buffer), 0);
+	if (received > 0) {
+	    session->in.append(buffer, received);
+	    continue;
+	}
+	if (received < 0 && errno == EINTR) continue;
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+	if (received < 0 || !whole_request(session->in)) return false;
+	break;
+    }
+
+    if (session->in.size() < sizeof(SfsdRequest)) return true;
+    SfsdRequest request;
+    memcpy(&request, session->in.data(), sizeof(request));
+    return request.Length <= SFSD_MAX_PAYLOAD;
+}
+
+int listen_on(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+	fprintf(stderr, "Socket path %s is too long\n", path);
+	return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+	fprintf(stderr, "Unable to create socket: %s\n", strerror(errno));
+	return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+	fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+// Main execution
+
+int main(int argc, char *argv[]) {
+    unsigned threads = 4;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:h")) != -1) {
+	switch (option) {
+	    case 't': threads = strtoul(optarg, NULL, 10); break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind + 3 != argc || threads == 0) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+    const char *image = argv[optind], *path = argv[optind + 2];
+
+    /* One daemon per image: a second one would mount it again behind the back of the first */
+    int lock = open(image, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock < 0 || flock(lock, LOCK_EX | LOCK_NB) < 0) {
+	fprintf(stderr, "Unable to lock %s: %s\n", image, strerror(errno));
+	return EXIT_FAILURE;
+    }
+
+    Server server;
+    server.stopping = false;
+    int result = sfs_open_disk(image, strtoul(argv[optind + 1], NULL, 10), &server.fs);
+    if (result == SFS_OK) result = sfs_mount(server.fs);
+    if (result != SFS_OK) {
+	fprintf(stderr, "Unable to mount %s: %s\n", image, sfs_strerror(result));
+	sfs_close_disk(server.fs);
+	return EXIT_FAILURE;
+    }
+
+    /* Signals arrive through the event loop, so the workers never see them */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+
+    Session listener = {listen_on(path), 0, string()};
+    Session stopper = {signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC), 0, string()};
+    server.epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (listener.fd < 0 || stopper.fd < 0 || server.epoll < 0) {
+	sfs_close_disk(server.fs);
+	return EXIT_FAILURE;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &listener;
+    epoll_ctl(server.epoll, EPOLL_CTL_ADD, listener.fd, &event);
+    event.data.ptr = &stopper;
+    epoll_ctl(server.epoll, EPOLL_CTL_ADD, stopper.fd, &event);
+
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) workers.push_back(thread(work, &server));
+    fprintf(stderr, "serving %s on %s with %u workers\n", image, path, threads);
+
+    /* Sessions are armed one shot at a time: a session is either waited on here or served by one worker */
+    set<Session *> sessions;
+    bool running = true;
+    while (running) {
+	struct epoll_event events[64];
+	int ready = epoll_wait(server.epoll, events, 64, -1);
+	if (ready < 0 && errno != EINTR) break;
+
+	for (int i = 0; i < ready; i++) {
+	    Session *session = (Session *)events[i].data.ptr;
+	    if (session == &stopper) {
+		running = false;
+	    } else if (session == &listener) {
+		int fd;
+		while ((fd = accept4(listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		    Session *client = new Session;
+		    client->fd = fd;
+		    client->cwd = 0;
+		    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		    event.data.ptr = client;
+		    epoll_ctl(server.epoll, EPOLL_CTL_ADD, fd, &event);
+		    sessions.insert(client);
+		}
+	    } else if ((events[i].events & EPOLLERR) || !receive(session)) {
+		sessions.erase(session);
+		close(session->fd);
+		delete session;
+	    } else if (whole_request(session->in)) {
+		lock_guard<mutex> guard(server.queue_lock);
+		server.queue.push_back(session);
+		server.queue_ready.notify_one();
+	    } else {
+		rearm(&server, session);
+	    }
+	}
+    }
+
+    /* Finish the requests under way, then unmount */
+    {
+	lock_guard<mutex> guard(server.queue_lock);
+	server.stopping = true;
+	server.queue.clear();
+	server.queue_ready.notify_all();
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    for (set<Session *>::iterator it = sessions.begin(); it != sessions.end(); it++) {
+	close((*it)->fd);
+	delete *it;
+    }
+
+    close(server.epoll);
+    close(listener.fd);
+    close(stopper.fd);
+    unlink(path);
+    result = sfs_close_disk(server.fs);
+    fprintf(stderr, "stopped\n");
+    return result == SFS_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,195 @@
+// sfsiostat.cpp: Simple file system block trace analyzer
+
+#include "sfs/iotrace.h"
+#include "sfs/trace.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Totals
+
+struct Totals {
+    uint64_t ios[IO_OPS];       // I/Os by IoOp
+    uint64_t blocks[IO_OPS];    // Blocks by IoOp
+    uint64_t latency;           // Nanoseconds of the reads and writes
+};
+
+struct Heat {
+    uint32_t block;
+    uint8_t  region;
+    uint64_t reads;
+    uint64_t writes;
+};
+
+struct Seeks {
+    uint64_t         sequential;    // I/Os starting where the one before ended
+    vector<uint64_t> distances;     // Blocks between the end of one I/O and the start of the next
+};
+
+// Functions
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-n hot] <blocktrace>\n", program);
+    fprintf(stderr, "    -n    number of hot blocks to list (default 10)\n");
+}
+
+bool read_trace(const char *path, IoTraceHeader *header, vector<IoRecord> *records) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+	return false;
+    }
+
+    if (fread(header, sizeof(IoTraceHeader), 1, in) != 1 || memcmp(header->Magic, "SFSIOTRC", sizeof(header->Magic)) ||
+	header->Version != IOTRACE_VERSION) {
+	fprintf(stderr, "%s is not a block trace\n", path);
+	fclose(in);
+	return false;
+    }
+
+    IoRecord record;
+    while (fread(&record, sizeof(record), 1, in) == 1) records->push_back(record);
+    fclose(in);
+    return true;
+}
+
+void add(Totals *totals, const IoRecord &record) {
+    uint8_t op = record.Op < IO_OPS ? record.Op : IO_READ;
+    totals->ios[op]++;
+    totals->blocks[op] += record.Count;
+    if (op != IO_DISCARD) totals->latency += record.Latency;
+}
+
+uint64_t percentile(const vector<uint64_t> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+void print_share(const char *name, const Totals &totals, uint64_t all) {
+    uint64_t blocks = totals.blocks[IO_READ] + totals.blocks[IO_WRITE];
+    uint64_t ios = totals.ios[IO_READ] + totals.ios[IO_WRITE];
+    printf("%-12s %10lu %10lu %10lu %7.1f%% %10.1f\n", name,
+	   (unsigned long)totals.blocks[IO_READ], (unsigned long)totals.blocks[IO_WRITE], (unsigned long)totals.blocks[IO_DISCARD],
+	   all ? 100.0 * blocks / all : 0.0, ios ? totals.latency / 1e3 / ios : 0.0);
+}
+
+void print_seeks(const char *name, Seeks &seeks) {
+    vector<uint64_t> &distances = seeks.distances;
+    if (distances.empty()) return;
+    sort(distances.begin(), distances.end());
+    double mean = 0;
+    for (size_t i = 0; i < distances.size(); i++) mean += distances[i];
+    mean /= distances.size();
+    printf("%-12s %10lu %10.1f%% %10.1f %10lu %10lu %10lu\n", name, (unsigned long)distances.size(),
+	   100.0 * seeks.sequential / distances.size(), mean, (unsigned long)percentile(distances, 0.5),
+	   (unsigned long)percentile(distances, 0.9), (unsigned long)distances.back());
+}
+
+// Main execution
+
+int main(int argc, char *argv[]) {
+    size_t hot = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:h")) != -1) {
+	switch (option) {
+	    case 'n': hot = strtoul(optarg, NULL, 10); break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind + 1 != argc) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    IoTraceHeader header;
+    vector<IoRecord> records;
+    if (!read_trace(argv[optind], &header, &records)) return EXIT_FAILURE;
+
+    /* Tally by region, by caller and by block; seeks are measured between reads and writes in the order they ran */
+    Totals all, regions[IO_REGIONS];
+    map<uint8_t, Totals> callers;
+    map<uint32_t, Heat> heat;
+    Seeks seeks[IO_DISCARD + 1];
+    memset(&all, 0, sizeof(all));
+    memset(regions, 0, sizeof(regions));
+
+    const IoRecord *last[IO_DISCARD + 1] = {NULL, NULL, NULL};
+    uint64_t end = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+	const IoRecord &record = records[i];
+	add(&all, record);
+	add(&regions[record.Region < IO_REGIONS ? record.Region : REGION_UNKNOWN], record);
+	if (!callers.count(record.Caller)) memset(&callers[record.Caller], 0, sizeof(Totals));
+	add(&callers[record.Caller], record);
+	end = max(end, record.Time + record.Latency);
+	if (record.Op == IO_DISCARD) continue;
+
+	for (uint32_t b = record.Block; b < record.Block + record.Count; b++) {
+	    Heat &h = heat[b];
+	    h.block = b;
+	    h.region = record.Region;
+	    if (record.Op == IO_READ) h.reads++;
+	    else h.writes++;
+	}
+
+	/* Slot IO_DISCARD holds the reads and writes together */
+	const uint8_t streams[2] = {record.Op, IO_DISCARD};
+	for (size_t s = 0; s < 2; s++) {
+	    const IoRecord *before = last[streams[s]];
+	    if (before) {
+		uint64_t next = (uint64_t)before->Block + before->Count;
+		uint64_t distance = record.Block > next ? record.Block - next : next - record.Block;
+		seeks[streams[s]].distances.push_back(distance);
+		if (!distance) seeks[streams[s]].sequential++;
+	    }
+	    last[streams[s]] = &record;
+	}
+    }
+
+    printf("%lu block I/Os over %.3f ms on a disk of %u blocks\n", (unsigned long)records.size(), end / 1e6, header.Blocks);
+    printf("%lu blocks read, %lu written, %lu discarded\n\n", (unsigned long)all.blocks[IO_READ],
+	   (unsigned long)all.blocks[IO_WRITE], (unsigned long)all.blocks[IO_DISCARD]);
+
+    uint64_t moved = all.blocks[IO_READ] + all.blocks[IO_WRITE];
+    printf("%-12s %10s %10s %10s %8s %10s\n", "region", "reads", "writes", "discards", "share", "mean us");
+    for (uint8_t r = 0; r < IO_REGIONS; r++) {
+	if (regions[r].ios[IO_READ] || regions[r].ios[IO_WRITE] || regions[r].ios[IO_DISCARD]) {
+	    print_share(io_region_name(r), regions[r], moved);
+	}
+    }
+
+    printf("\n%-12s %10s %10s %10s %8s %10s\n", "caller", "reads", "writes", "discards", "share", "mean us");
+    for (map<uint8_t, Totals>::iterator it = callers.begin(); it != callers.end(); it++) {
+	print_share(it->first ? trace_op_name(it->first) : "other", it->second, moved);
+    }
+
+    printf("\n%-12s %10s %11s %10s %10s %10s %10s\n", "seeks", "count", "sequential", "mean", "p50", "p90", "max");
+    print_seeks("all", seeks[IO_DISCARD]);
+    print_seeks("read", seeks[IO_READ]);
+    print_seeks("write", seeks[IO_WRITE]);
+
+    /* Hottest first; ties go to the lower block */
+    vector<Heat> blocks;
+    for (map<uint32_t, Heat>::iterator it = heat.begin(); it != heat.end(); it++) blocks.push_back(it->second);
+    size_t shown = min(hot, blocks.size());
+    partial_sort(blocks.begin(), blocks.begin() + shown, blocks.end(), [](const Heat &a, const Heat &b) {
+	uint64_t ta = a.reads + a.writes, tb = b.reads + b.writes;
+	return ta != tb ? ta > tb : a.block < b.block;
+    });
+    if (shown) printf("\n%-12s %10s %10s %10s\n", "hot block", "region", "reads", "writes");
+    for (size_t i = 0; i < shown; i++) {
+	printf("%-12u %10s %10lu %10lu\n", blocks[i].block, io_region_name(blocks[i].region),
+	       (unsigned long)blocks[i].reads, (unsigned long)blocks[i].writes);
+    }
+    return EXIT_SUCCESS;
+}
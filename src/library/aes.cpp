@@ -0,0 +1,284 @@
+/**
+ * @file aes.cpp
+ * @brief Implementation of aes.h functions
+ * @date 2026-10-18
+ *
+ * @details The portable code works on bytes with S-box tables built at start
+ * up. The AES-NI code keeps eight AES blocks in flight so the latency of the
+ * aesenc/aesdec instructions is hidden. Either path is chosen once through
+ * CPUID; SFS_AES=portable in the environment forces the portable code.
+ */
+
+#include "sfs/aes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+    const int ROUNDS = 10;
+    const int UNITS_IN_FLIGHT = 8;                      /** AES blocks interleaved by the AES-NI code */
+
+    /**- S-box and inverse S-box, generated from the multiplicative inverse in GF(2^8) */
+    struct Tables {
+        uint8_t Sbox[256];
+        uint8_t InvSbox[256];
+
+        Tables() {
+            uint8_t p = 1, q = 1;
+            do {
+                /**- p runs through all non-zero elements, q is its inverse */
+                p = p ^ (uint8_t)(p << 1) ^ ((p & 0x80) ? 0x1b : 0);
+                q ^= q << 1;
+                q ^= q << 2;
+                q ^= q << 4;
+                if(q & 0x80) q ^= 0x09;
+
+                uint8_t x = q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4);
+                Sbox[p] = x ^ 0x63;
+            } while(p != 1);
+            Sbox[0] = 0x63;
+
+            for(int i = 0; i < 256; i++) InvSbox[Sbox[i]] = (uint8_t)i;
+        }
+
+        static uint8_t rotl(uint8_t x, int shift) {
+            return (uint8_t)((x << shift) | (x >> (8 - shift)));
+        }
+    };
+
+    const Tables &tables() {
+        static const Tables t;
+        return t;
+    }
+
+    inline uint8_t xtime(uint8_t b) {
+        return (uint8_t)((b << 1) ^ ((b >> 7) * 0x1b));
+    }
+
+    /**- AES-128 key schedule, round key r is keys[r] */
+    void expand_key(const uint8_t key[16], uint8_t keys[ROUNDS + 1][16]) {
+        const uint8_t *sbox = tables().Sbox;
+        uint8_t rcon = 1;
+
+        memcpy(keys[0], key, 16);
+        for(int r = 1; r <= ROUNDS; r++) {
+            const uint8_t *prev = keys[r - 1];
+            uint8_t temp[4] = {
+                (uint8_t)(sbox[prev[13]] ^ rcon), sbox[prev[14]], sbox[prev[15]], sbox[prev[12]]
+            };
+            for(int i = 0; i < 16; i++) {
+                keys[r][i] = prev[i] ^ (i < 4 ? temp[i] : keys[r][i - 4]);
+            }
+            rcon = xtime(rcon);
+        }
+    }
+
+    /**- one block with the portable code; state is column major as in FIPS-197 */
+    void encrypt_block(const uint8_t keys[ROUNDS + 1][16], uint8_t s[16]) {
+        const uint8_t *sbox = tables().Sbox;
+        uint8_t t[16];
+
+        for(int i = 0; i < 16; i++) s[i] ^= keys[0][i];
+        for(int r = 1; r <= ROUNDS; r++) {
+            /**- SubBytes and ShiftRows */
+            for(int c = 0; c < 4; c++) {
+                for(int row = 0; row < 4; row++) t[row + 4 * c] = sbox[s[row + 4 * ((c + row) & 3)]];
+            }
+            /**- MixColumns, except in the last round */
+            for(int c = 0; c < 4 && r < ROUNDS; c++) {
+                uint8_t *a = t + 4 * c;
+                uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3], a0 = a[0];
+                a[0] ^= all ^ xtime(a[0] ^ a[1]);
+                a[1] ^= all ^ xtime(a[1] ^ a[2]);
+                a[2] ^= all ^ xtime(a[2] ^ a[3]);
+                a[3] ^= all ^ xtime(a[3] ^ a0);
+            }
+            for(int i = 0; i < 16; i++) s[i] = t[i] ^ keys[r][i];
+        }
+    }
+
+    void decrypt_block(const uint8_t keys[ROUNDS + 1][16], uint8_t s[16]) {
+        const uint8_t *inv = tables().InvSbox;
+        uint8_t t[16];
+
+        for(int i = 0; i < 16; i++) s[i] ^= keys[ROUNDS][i];
+        for(int r = ROUNDS - 1; r >= 0; r--) {
+            /**- InvShiftRows and InvSubBytes */
+            for(int c = 0; c < 4; c++) {
+                for(int row = 0; row < 4; row++) t[row + 4 * ((c + row) & 3)] = inv[s[row + 4 * c]];
+            }
+            for(int i = 0; i < 16; i++) t[i] ^= keys[r][i];
+            /**- InvMixColumns, except after the last round: premultiply, then MixColumns */
+            for(int c = 0; c < 4 && r > 0; c++) {
+                uint8_t *a = t + 4 * c;
+                uint8_t u = xtime(xtime(a[0] ^ a[2])), v = xtime(xtime(a[1] ^ a[3]));
+                a[0] ^= u; a[1] ^= v; a[2] ^= u; a[3] ^= v;
+                uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3], a0 = a[0];
+                a[0] ^= all ^ xtime(a[0] ^ a[1]);
+                a[1] ^= all ^ xtime(a[1] ^ a[2]);
+                a[2] ^= all ^ xtime(a[2] ^ a[3]);
+                a[3] ^= all ^ xtime(a[3] ^ a0);
+            }
+            memcpy(s, t, 16);
+        }
+    }
+
+    /**- multiply the tweak by x in GF(2^128), little endian as in IEEE 1619 */
+    void next_tweak(uint8_t t[16]) {
+        uint8_t carry = 0;
+        for(int i = 0; i < 16; i++) {
+            uint8_t next = t[i] >> 7;
+            t[i] = (uint8_t)((t[i] << 1) | carry);
+            carry = next;
+        }
+        if(carry) t[0] ^= 0x87;
+    }
+
+#ifdef AES_X86
+    __attribute__((target("sse2")))
+    inline __m128i next_tweak(__m128i t) {
+        __m128i carry = _mm_and_si128(_mm_srai_epi32(t, 31), _mm_set_epi32(0x87, 1, 1, 1));
+        return _mm_xor_si128(_mm_slli_epi32(t, 1), _mm_shuffle_epi32(carry, 0x93));
+    }
+
+    template <bool Decrypt>
+    __attribute__((target("aes,sse2")))
+    inline __m128i round(__m128i x, __m128i key) {
+        return Decrypt ? _mm_aesdec_si128(x, key) : _mm_aesenc_si128(x, key);
+    }
+
+    template <bool Decrypt>
+    __attribute__((target("aes,sse2")))
+    inline __m128i last_round(__m128i x, __m128i key) {
+        return Decrypt ? _mm_aesdeclast_si128(x, key) : _mm_aesenclast_si128(x, key);
+    }
+
+    /**- XTS with AES-NI, UNITS_IN_FLIGHT blocks per iteration */
+    template <bool Decrypt>
+    __attribute__((target("aes,sse2")))
+    void crypt_aesni(const uint8_t data_keys[ROUNDS + 1][16], const uint8_t tweak_keys[ROUNDS + 1][16],
+                     uint64_t sector, const char *in, char *out, size_t length) {
+        __m128i k[ROUNDS + 1];
+        for(int r = 0; r <= ROUNDS; r++) k[r] = _mm_loadu_si128((const __m128i *)data_keys[r]);
+
+        /**- encrypt the sector number with the tweak key */
+        __m128i tweak = _mm_xor_si128(_mm_set_epi64x(0, (long long)sector), _mm_loadu_si128((const __m128i *)tweak_keys[0]));
+        for(int r = 1; r < ROUNDS; r++) tweak = _mm_aesenc_si128(tweak, _mm_loadu_si128((const __m128i *)tweak_keys[r]));
+        tweak = _mm_aesenclast_si128(tweak, _mm_loadu_si128((const __m128i *)tweak_keys[ROUNDS]));
+
+        size_t units = length / XTS::UNIT_SIZE, i = 0;
+        for(; i + UNITS_IN_FLIGHT <= units; i += UNITS_IN_FLIGHT) {
+            __m128i t[UNITS_IN_FLIGHT], x[UNITS_IN_FLIGHT];
+            #pragma GCC unroll 8
+            for(int j = 0; j < UNITS_IN_FLIGHT; j++) {
+                t[j] = tweak;
+                tweak = next_tweak(tweak);
+                x[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + (i + j) * XTS::UNIT_SIZE)), _mm_xor_si128(t[j], k[0]));
+            }
+            for(int r = 1; r < ROUNDS; r++) {
+                #pragma GCC unroll 8
+                for(int j = 0; j < UNITS_IN_FLIGHT; j++) x[j] = round<Decrypt>(x[j], k[r]);
+            }
+            #pragma GCC unroll 8
+            for(int j = 0; j < UNITS_IN_FLIGHT; j++) {
+                x[j] = _mm_xor_si128(last_round<Decrypt>(x[j], k[ROUNDS]), t[j]);
+                _mm_storeu_si128((__m128i *)(out + (i + j) * XTS::UNIT_SIZE), x[j]);
+            }
+        }
+        for(; i < units; i++) {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i * XTS::UNIT_SIZE)), _mm_xor_si128(tweak, k[0]));
+            for(int r = 1; r < ROUNDS; r++) x = round<Decrypt>(x, k[r]);
+            _mm_storeu_si128((__m128i *)(out + i * XTS::UNIT_SIZE), _mm_xor_si128(last_round<Decrypt>(x, k[ROUNDS]), tweak));
+            tweak = next_tweak(tweak);
+        }
+    }
+
+    /**- round keys for aesdec: reversed, with InvMixColumns applied to the inner ones */
+    __attribute__((target("aes,sse2")))
+    void decryption_keys(const uint8_t keys[ROUNDS + 1][16], uint8_t dec[ROUNDS + 1][16]) {
+        memcpy(dec[0], keys[ROUNDS], 16);
+        for(int r = 1; r < ROUNDS; r++) {
+            _mm_storeu_si128((__m128i *)dec[r], _mm_aesimc_si128(_mm_loadu_si128((const __m128i *)keys[ROUNDS - r])));
+        }
+        memcpy(dec[ROUNDS], keys[0], 16);
+    }
+#endif
+
+    bool detect_aesni() {
+#ifdef AES_X86
+        const char *wanted = getenv("SFS_AES");
+        if(wanted && strcmp(wanted, "portable") == 0) return false;
+
+        unsigned int eax, ebx, ecx, edx;
+        if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        return (ecx & bit_AES) && (edx & bit_SSE2);
+#else
+        return false;
+#endif
+    }
+
+    bool aesni() {
+        static const bool available = detect_aesni();
+        return available;
+    }
+}
+
+XTS::XTS(const uint8_t key[KEY_SIZE]) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    expand_key(key, DataKeys);
+    expand_key(key + KEY_SIZE / 2, TweakKeys);
+
+#ifdef AES_X86
+    if(aesni()) decryption_keys(DataKeys, DataDecKeys);
+#endif
+}
+
+void XTS::encrypt(uint64_t sector, const char *in, char *out, size_t length) const {
+    crypt(sector, in, out, length, false);
+}
+
+void XTS::decrypt(uint64_t sector, const char *in, char *out, size_t length) const {
+    crypt(sector, in, out, length, true);
+}
+
+const char *XTS::implementation() {
+    return aesni() ? "aes-ni" : "portable";
+}
+
+void XTS::crypt(uint64_t sector, const char *in, char *out, size_t length, bool decrypting) const {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+#ifdef AES_X86
+    if(aesni()) {
+        if(decrypting) crypt_aesni<true>(DataDecKeys, TweakKeys, sector, in, out, length);
+        else crypt_aesni<false>(DataKeys, TweakKeys, sector, in, out, length);
+        return;
+    }
+#endif
+
+    /**- the tweak is the little endian sector number encrypted with the tweak key */
+    uint8_t tweak[UNIT_SIZE] = {0};
+    for(int i = 0; i < 8; i++) tweak[i] = (uint8_t)(sector >> (8 * i));
+    encrypt_block(TweakKeys, tweak);
+
+    /**- C = E(P ^ T) ^ T, T multiplied by x for every unit */
+    uint8_t unit[UNIT_SIZE];
+    for(size_t offset = 0; offset + UNIT_SIZE <= length; offset += UNIT_SIZE) {
+        for(size_t i = 0; i < UNIT_SIZE; i++) unit[i] = (uint8_t)in[offset + i] ^ tweak[i];
+        if(decrypting) decrypt_block(DataKeys, unit);
+        else encrypt_block(DataKeys, unit);
+        for(size_t i = 0; i < UNIT_SIZE; i++) out[offset + i] = (char)(unit[i] ^ tweak[i]);
+        next_tweak(tweak);
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * @file crc32c.cpp
+ * @brief Implementation of crc32c.h functions
+ * @date 2026-10-18
+ *
+ * @details The SSE4.2 path runs three independent crc32 streams over
+ * adjacent pieces of the buffer, 8 bytes per instruction, so the latency of
+ * the instruction is hidden; the three CRCs are then combined with tables
+ * that append a piece worth of zeros to a CRC (after Mark Adler's crc32c.c).
+ * The portable path uses a 256 entry table of the reflected polynomial. The
+ * path is chosen once through CPUID; SFS_CRC32C=portable forces the
+ * portable code.
+ */
+
+#include "sfs/crc32c.h"
+
+#if defined(__x86_64__)
+#define CRC32C_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+    const uint32_t POLYNOMIAL = 0x82f63b78;             /** Castagnoli polynomial, bit reversed */
+
+    struct Table {
+        uint32_t Entries[256];
+
+        Table() {
+            for(uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+                Entries[i] = crc;
+            }
+        }
+    };
+
+    uint32_t compute_portable(const unsigned char *data, size_t length, uint32_t crc) {
+        static const Table table;
+        for(size_t i = 0; i < length; i++) crc = (crc >> 8) ^ table.Entries[(crc ^ data[i]) & 0xff];
+        return crc;
+    }
+
+#ifdef CRC32C_X86
+    const size_t LONG_PIECE  = 1024;                    /** Bytes per stream for long buffers, a power of two */
+    const size_t SHORT_PIECE = 256;                     /** Bytes per stream for the rest, a power of two */
+
+    /**- multiply the GF(2) 32x32 matrix mat by vec */
+    uint32_t matrix_times(const uint32_t *mat, uint32_t vec) {
+        uint32_t sum = 0;
+        for(; vec; vec >>= 1, mat++) {
+            if(vec & 1) sum ^= *mat;
+        }
+        return sum;
+    }
+
+    void matrix_square(uint32_t *square, const uint32_t *mat) {
+        for(int n = 0; n < 32; n++) square[n] = matrix_times(mat, mat[n]);
+    }
+
+    /**- tables that advance a raw CRC register over length zero bytes, length a power of two */
+    struct Shift {
+        uint32_t Entries[4][256];
+
+        Shift(size_t length) {
+            uint32_t even[32], odd[32];
+
+            /**- operator for one zero bit, squared to two, four and then eight bits */
+            odd[0] = POLYNOMIAL;
+            for(int n = 1; n < 32; n++) odd[n] = 1U << (n - 1);
+            matrix_square(even, odd);
+            matrix_square(odd, even);
+
+            /**- keep squaring until the operator covers length bytes */
+            uint32_t *op = odd;
+            for(size_t bytes = 1; bytes <= length; bytes <<= 1) {
+                uint32_t *next = (op == odd) ? even : odd;
+                matrix_square(next, op);
+                op = next;
+            }
+
+            for(uint32_t n = 0; n < 256; n++) {
+                for(int byte = 0; byte < 4; byte++) Entries[byte][n] = matrix_times(op, n << (8 * byte));
+            }
+        }
+
+        uint32_t apply(uint32_t crc) const {
+            return Entries[0][crc & 0xff] ^ Entries[1][(crc >> 8) & 0xff] ^
+                   Entries[2][(crc >> 16) & 0xff] ^ Entries[3][crc >> 24];
+        }
+    };
+
+    __attribute__((target("sse4.2")))
+    inline uint64_t crc_word(uint64_t crc, const unsigned char *data) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        return _mm_crc32_u64(crc, word);
+    }
+
+    /**- three streams over pieces of size bytes as long as the buffer holds three of them */
+    __attribute__((target("sse4.2")))
+    inline uint32_t three_way(const unsigned char *&data, size_t &length, uint32_t crc, size_t size, const Shift &shift) {
+        while(length >= 3 * size) {
+            uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+            for(const unsigned char *end = data + size; data < end; data += 8) {
+                crc0 = crc_word(crc0, data);
+                crc1 = crc_word(crc1, data + size);
+                crc2 = crc_word(crc2, data + 2 * size);
+            }
+            crc = shift.apply(shift.apply((uint32_t)crc0) ^ (uint32_t)crc1) ^ (uint32_t)crc2;
+            data += 2 * size;
+            length -= 3 * size;
+        }
+        return crc;
+    }
+
+    __attribute__((target("sse4.2")))
+    uint32_t compute_sse42(const unsigned char *data, size_t length, uint32_t crc) {
+        static const Shift long_shift(LONG_PIECE), short_shift(SHORT_PIECE);
+
+        crc = three_way(data, length, crc, LONG_PIECE, long_shift);
+        crc = three_way(data, length, crc, SHORT_PIECE, short_shift);
+
+        uint64_t crc64 = crc;
+        for(; length >= 8; length -= 8, data += 8) crc64 = crc_word(crc64, data);
+        crc = (uint32_t)crc64;
+        for(; length > 0; length--, data++) crc = _mm_crc32_u8(crc, *data);
+        return crc;
+    }
+#endif
+
+    bool detect_sse42() {
+#ifdef CRC32C_X86
+        const char *wanted = getenv("SFS_CRC32C");
+        if(wanted && strcmp(wanted, "portable") == 0) return false;
+
+        unsigned int eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+#else
+        return false;
+#endif
+    }
+
+    bool sse42() {
+        static const bool available = detect_sse42();
+        return available;
+    }
+}
+
+uint32_t CRC32C::compute(const char *data, size_t length, uint32_t crc) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    const unsigned char *bytes = (const unsigned char *)data;
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if(sse42()) return ~compute_sse42(bytes, length, crc);
+#endif
+    return ~compute_portable(bytes, length, crc);
+}
+
+const char *CRC32C::implementation() {
+    return sse42() ? "sse4.2" : "portable";
+}
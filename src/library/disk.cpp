@@ -7,14 +7,91 @@
  */
 
 #include "sfs/disk.h"
+#include "sfs/aes.h"
+#include "sfs/crc32c.h"
+#include "sfs/timeline.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+namespace {
+    const size_t CHECKSUMS_PER_BLOCK = Disk::BLOCK_SIZE / sizeof(uint32_t);
+
+    /**- checksum of a stored block; 0 means unknown, so a CRC of 0 is stored as 1 */
+    uint32_t block_checksum(const char *data) {
+        uint32_t crc = CRC32C::compute(data, Disk::BLOCK_SIZE);
+        return crc ? crc : 1;
+    }
+
+    const size_t TRACE_BUFFER = 4096;               /** Records kept before they are written to the block trace */
+
+    /**- monotonic clock in nanoseconds */
+    uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    const size_t COPY_BUFFER = 1 << 20;             /** Bytes moved per pread/pwrite when the kernel cannot copy */
+
+    /**- copies length bytes between two files; false if the source ends early or on errors, with errno set.
+     * A file that cannot seek, like a pipe, is read or written in order and its offset is not used */
+    bool transfer(int from, off_t from_offset, int to, off_t to_offset, size_t length) {
+        bool from_seeks = lseek(from, 0, SEEK_CUR) >= 0;
+        bool to_seeks = lseek(to, 0, SEEK_CUR) >= 0;
+
+        /**- the kernel copies, or even shares the extents, without the data passing through user space */
+        while (length > 0 && from_seeks && to_seeks) {
+            ssize_t copied = copy_file_range(from, &from_offset, to, &to_offset, length, 0);
+            if (copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) break;
+            if (copied < 0) return false;
+            if (copied == 0) {
+                errno = EIO;
+                return false;
+            }
+            length -= copied;
+        }
+
+        /**- otherwise through a large buffer, so there are few system calls */
+        std::vector<char> buffer(std::min(length, COPY_BUFFER));
+        while (length > 0) {
+            size_t want = std::min(length, buffer.size());
+            ssize_t got = from_seeks ? pread(from, buffer.data(), want, from_offset) : ::read(from, buffer.data(), want);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                if (got == 0) errno = EIO;
+                return false;
+            }
+            for (ssize_t done = 0; done < got; ) {
+                ssize_t put = to_seeks ? pwrite(to, buffer.data() + done, got - done, to_offset + done)
+                                       : ::write(to, buffer.data() + done, got - done);
+                if (put < 0 && errno == EINTR) continue;
+                if (put <= 0) return false;
+                done += put;
+            }
+            from_offset += got;
+            to_offset += got;
+            length -= got;
+        }
+        return true;
+    }
+}
+
+thread_local uint8_t Disk::CallerTag = 0;
+
+const char *io_region_name(uint8_t region) {
+    static const char *names[IO_REGIONS] = {
+        "unknown", "superblock", "inode", "index", "checksum", "data", "indirect", "directory"
+    };
+    return region < IO_REGIONS ? names[region] : names[0];
+}
+
 void Disk::open(const char *path, size_t nblocks) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
@@ -43,6 +120,23 @@ void Disk::open(const char *path, size_t nblocks) {
     Writes = 0;
 }
 
+void Disk::clear() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- truncating to nothing and back leaves a hole that reads as zeros */
+    if (ftruncate(FileDescriptor, 0) < 0 || ftruncate(FileDescriptor, Blocks*BLOCK_SIZE) < 0) {
+    	char what[BUFSIZ];
+    	snprintf(what, BUFSIZ, "Unable to clear disk: %s", strerror(errno));
+    	throw std::runtime_error(what);
+    }
+
+    /**- zeros were never written, so there is nothing to verify */
+    std::fill(Checksums.begin(), Checksums.end(), 0);
+    std::fill(ChecksumDirty.begin(), ChecksumDirty.end(), true);
+}
+
 Disk::~Disk() {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
@@ -50,12 +144,279 @@ Disk::~Disk() {
 
     /**- Check if FileDescriptor is set */
     if (FileDescriptor > 0) {
+        /**- Write back checksums that are still cached */
+        try {
+            flush_checksums();
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "%s\n", e.what());
+        }
+
+        /**- Write out the block trace */
+        stop_trace();
+
         /**- If set, print the required information and close. */
-    	printf("%lu disk block reads\n", Reads);
-    	printf("%lu disk block writes\n", Writes);
+        if (!Quiet) {
+    	    printf("%lu disk block reads\n", Reads.load());
+    	    printf("%lu disk block writes\n", Writes.load());
+        }
     	close(FileDescriptor);
     	FileDescriptor = 0;
     }
+
+    /**- Forget the key */
+    delete Cipher;
+}
+
+void Disk::set_key(const uint8_t *key) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    delete Cipher;
+    Cipher = key ? new XTS(key) : NULL;
+}
+
+void Disk::set_checksums(size_t start, size_t count, bool fresh) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- the table must cover every block */
+    if (count && count * CHECKSUMS_PER_BLOCK < Blocks) {
+    	char what[BUFSIZ];
+    	snprintf(what, BUFSIZ, "checksum table of %lu blocks is too small!", count);
+    	throw std::invalid_argument(what);
+    }
+
+    /**- write back the table that is in use */
+    flush_checksums();
+    ChecksumStart = start;
+    ChecksumBlocks = count;
+    Checksums.assign(count * CHECKSUMS_PER_BLOCK, 0);
+    ChecksumDirty.assign(count, fresh);
+
+    /**- the table blocks are not checksummed themselves, so they are read as usual */
+    for (size_t i = 0; i < count && !fresh; i++) {
+    	read(start + i, (char *)&Checksums[i * CHECKSUMS_PER_BLOCK]);
+    }
+}
+
+void Disk::flush_checksums() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    for (size_t i = 0; i < ChecksumBlocks; i++) {
+    	if (ChecksumDirty[i]) {
+    	    write(ChecksumStart + i, (char *)&Checksums[i * CHECKSUMS_PER_BLOCK]);
+    	    ChecksumDirty[i] = false;
+    	}
+    }
+}
+
+void Disk::rebuild_checksums() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("disk_rebuild_checksums", "disk");
+
+    /**- read the image in large runs; blocks are checksummed as stored, so no key is needed */
+    std::vector<char> buffer(COPY_BUFFER);
+    size_t per_run = COPY_BUFFER / BLOCK_SIZE;
+    for (size_t first = 0; first < Blocks; first += per_run) {
+    	size_t count = std::min(per_run, Blocks - first);
+    	if (pread(FileDescriptor, buffer.data(), count*BLOCK_SIZE, (off_t)first*BLOCK_SIZE) != (ssize_t)(count*BLOCK_SIZE)) {
+    	    char what[BUFSIZ];
+    	    snprintf(what, BUFSIZ, "Unable to read %lu: %s", first, strerror(errno));
+    	    throw std::runtime_error(what);
+    	}
+    	for (size_t i = 0; i < count; i++) {
+    	    if (checksummed(first + i)) Checksums[first + i] = block_checksum(&buffer[i * BLOCK_SIZE]);
+    	}
+    	Reads += count;
+    }
+    std::fill(ChecksumDirty.begin(), ChecksumDirty.end(), true);
+}
+
+void Disk::set_layout(size_t inode_blocks, size_t index_blocks, size_t table_blocks, size_t dir_blocks) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    LayoutEnds[REGION_UNKNOWN] = 0;
+    LayoutEnds[REGION_SUPER] = 1;
+    LayoutEnds[REGION_INODE] = LayoutEnds[REGION_SUPER] + inode_blocks;
+    LayoutEnds[REGION_INDEX] = LayoutEnds[REGION_INODE] + index_blocks;
+    LayoutEnds[REGION_TABLE] = LayoutEnds[REGION_INDEX] + table_blocks;
+    LayoutEnds[REGION_DATA] = Blocks - dir_blocks;
+    LayoutEnds[REGION_INDIRECT] = LayoutEnds[REGION_DATA];
+    LayoutEnds[REGION_DIR] = Blocks;
+}
+
+uint8_t Disk::region(size_t blocknum) const {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if (blocknum == 0) return REGION_SUPER;
+    if (!LayoutEnds[REGION_DIR]) return REGION_UNKNOWN;
+
+    /**- indirect blocks end with the data region, so they are never found here */
+    for (uint8_t r = REGION_INODE; r < IO_REGIONS; r++) {
+    	if (blocknum < LayoutEnds[r]) return r;
+    }
+    return REGION_UNKNOWN;
+}
+
+void Disk::start_trace(const char *path) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    stop_trace();
+
+    FILE *file = fopen(path, "wb");
+    IoTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, "SFSIOTRC", sizeof(header.Magic));
+    header.Version = IOTRACE_VERSION;
+    header.Blocks = Blocks;
+    if (!file || fwrite(&header, sizeof(header), 1, file) != 1) {
+    	char what[BUFSIZ];
+    	snprintf(what, BUFSIZ, "Unable to trace to %s: %s", path, strerror(errno));
+    	if (file) fclose(file);
+    	throw std::runtime_error(what);
+    }
+
+    TraceBuffer.clear();
+    TraceBuffer.reserve(TRACE_BUFFER);
+    TraceEpoch = now();
+    TraceFile = file;
+}
+
+void Disk::stop_trace() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    std::lock_guard<std::mutex> guard(TraceLock);
+    if (!TraceFile) return;
+    fwrite(TraceBuffer.data(), sizeof(IoRecord), TraceBuffer.size(), TraceFile);
+    fclose(TraceFile);
+    TraceFile = NULL;
+    TraceBuffer.clear();
+}
+
+void Disk::trace(uint8_t op, size_t blocknum, size_t count, uint8_t region, uint64_t start) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint64_t latency = now() - start;
+    IoRecord record;
+    record.Time = start - TraceEpoch;
+    record.Block = blocknum;
+    record.Count = count;
+    record.Latency = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+    record.Op = op;
+    record.Region = region;
+    record.Caller = CallerTag;
+    record.Reserved = 0;
+
+    /**- records are written in batches, so tracing costs few system calls */
+    std::lock_guard<std::mutex> guard(TraceLock);
+    if (!TraceFile) return;
+    TraceBuffer.push_back(record);
+    if (TraceBuffer.size() == TRACE_BUFFER) {
+    	fwrite(TraceBuffer.data(), sizeof(IoRecord), TraceBuffer.size(), TraceFile);
+    	TraceBuffer.clear();
+    }
+}
+
+bool Disk::discard(int blocknum, size_t count) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN_BLOCK("disk_discard", "disk", blocknum);
+
+    /**- sanity_check both ends of the run */
+    char scratch;
+    sanity_check(blocknum, &scratch);
+    sanity_check(blocknum + count - 1, &scratch);
+
+    /**- keep the size, so the image does not shrink at its end */
+    uint64_t start = TraceFile ? now() : 0;
+    if (fallocate(FileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)blocknum*BLOCK_SIZE, (off_t)count*BLOCK_SIZE) < 0) {
+    	if (errno == EOPNOTSUPP) return false;
+    	char what[BUFSIZ];
+    	snprintf(what, BUFSIZ, "Unable to discard %d: %s", blocknum, strerror(errno));
+    	throw std::runtime_error(what);
+    }
+
+    /**- the hole reads as zeros, which were never checksummed */
+    for (size_t i = blocknum; i < blocknum + count; i++) {
+    	if (checksummed(i) && Checksums[i]) {
+    	    Checksums[i] = 0;
+    	    ChecksumDirty[i / CHECKSUMS_PER_BLOCK] = true;
+    	}
+    }
+
+    Discarded += count;
+    account(IO_DISCARD, blocknum, count, REGION_UNKNOWN, start);
+    return true;
+}
+
+void Disk::copy_in(int fd, off_t offset, int blocknum, size_t count) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN_BLOCK("disk_copy_in", "disk", blocknum);
+
+    /**- sanity_check both ends of the run; the blocks must be stored as they are */
+    char scratch;
+    sanity_check(blocknum, &scratch);
+    sanity_check(blocknum + count - 1, &scratch);
+    if (Cipher || ChecksumBlocks) {
+    	throw std::invalid_argument("blocks are encrypted or checksummed!");
+    }
+
+    uint64_t start = TraceFile ? now() : 0;
+    if (!transfer(fd, offset, FileDescriptor, (off_t)blocknum*BLOCK_SIZE, count*BLOCK_SIZE)) {
+    	char what[BUFSIZ];
+    	snprintf(what, BUFSIZ, "Unable to copy into %d: %s", blocknum, strerror(errno));
+    	throw std::runtime_error(what);
+    }
+
+    /**- Increment writes */
+    Writes += count;
+    account(IO_WRITE, blocknum, count, REGION_UNKNOWN, start);
+}
+
+void Disk::copy_out(int blocknum, size_t length, int fd, off_t offset) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN_BLOCK("disk_copy_out", "disk", blocknum);
+
+    /**- sanity_check both ends of the run; the blocks must be stored as they are */
+    char scratch;
+    size_t count = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    sanity_check(blocknum, &scratch);
+    sanity_check(blocknum + count - 1, &scratch);
+    if (Cipher || ChecksumBlocks) {
+    	throw std::invalid_argument("blocks are encrypted or checksummed!");
+    }
+
+    uint64_t start = TraceFile ? now() : 0;
+    if (!transfer(FileDescriptor, (off_t)blocknum*BLOCK_SIZE, fd, offset, length)) {
+    	char what[BUFSIZ];
+    	snprintf(what, BUFSIZ, "Unable to copy from %d: %s", blocknum, strerror(errno));
+    	throw std::runtime_error(what);
+    }
+
+    /**- Increment reads */
+    Reads += count;
+    account(IO_READ, blocknum, count, REGION_UNKNOWN, start);
 }
 
 void Disk::sanity_check(int blocknum, char *data) {
@@ -83,54 +444,75 @@ void Disk::sanity_check(int blocknum, char *data) {
     }
 }
 
-void Disk::read(int blocknum, char *data) {
+void Disk::read(int blocknum, char *data, uint8_t region) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN_BLOCK("disk_read", "disk", blocknum);
 
     /**- sanity_check blocknum and data */
     sanity_check(blocknum, data);
+    uint64_t start = TraceFile ? now() : 0;
 
-    /**- reposition read/write file offset and check validity */
-    if (lseek(FileDescriptor, blocknum*BLOCK_SIZE, SEEK_SET) < 0) {
+    /**- read BLOCK_SIZE at the offset of the block; pread needs no separate lseek */
+    if (pread(FileDescriptor, data, BLOCK_SIZE, (off_t)blocknum*BLOCK_SIZE) != BLOCK_SIZE) {
     	char what[BUFSIZ];
-    	snprintf(what, BUFSIZ, "Unable to lseek %d: %s", blocknum, strerror(errno));
+    	snprintf(what, BUFSIZ, "Unable to read %d: %s", blocknum, strerror(errno));
     	throw std::runtime_error(what);
     }
 
-    /**- read the FileDescriptor for BLOCK_SIZE */
-    if (::read(FileDescriptor, data, BLOCK_SIZE) != BLOCK_SIZE) {
-    	char what[BUFSIZ];
-    	snprintf(what, BUFSIZ, "Unable to read %d: %s", blocknum, strerror(errno));
-    	throw std::runtime_error(what);
+    /**- verify the block as stored, before it is decrypted */
+    if (checksummed(blocknum) && Checksums[blocknum]) {
+    	if (block_checksum(data) != Checksums[blocknum]) {
+    	    char what[BUFSIZ];
+    	    snprintf(what, BUFSIZ, "Checksum mismatch in block %d", blocknum);
+    	    throw std::runtime_error(what);
+    	}
+    	Verified++;
+    }
+
+    /**- decrypt in place; the superblock is never encrypted */
+    if (Cipher && blocknum > 0) {
+    	Cipher->decrypt(blocknum, data, data, BLOCK_SIZE);
     }
 
     /**- Increment reads */
     Reads++;
+    account(IO_READ, blocknum, 1, region, start);
 }
 
-void Disk::write(int blocknum, char *data) {
+void Disk::write(int blocknum, char *data, uint8_t region) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN_BLOCK("disk_write", "disk", blocknum);
 
     /**- sanity_check blocknum and data */
     sanity_check(blocknum, data);
+    uint64_t start = TraceFile ? now() : 0;
 
-    /**- reposition read/write file offset and check validity */
-    if (lseek(FileDescriptor, blocknum*BLOCK_SIZE, SEEK_SET) < 0) {
-    	char what[BUFSIZ];
-    	snprintf(what, BUFSIZ, "Unable to lseek %d: %s", blocknum, strerror(errno));
-    	throw std::runtime_error(what);
+    /**- encrypt into a scratch block so the caller's data stays plaintext */
+    char sealed[BLOCK_SIZE];
+    if (Cipher && blocknum > 0) {
+    	Cipher->encrypt(blocknum, data, sealed, BLOCK_SIZE);
+    	data = sealed;
     }
 
-    /**- write the BLOCK_SIZE data to the FileDescriptor  */
-    if (::write(FileDescriptor, data, BLOCK_SIZE) != BLOCK_SIZE) {
+    /**- write the BLOCK_SIZE data at the offset of the block */
+    if (pwrite(FileDescriptor, data, BLOCK_SIZE, (off_t)blocknum*BLOCK_SIZE) != BLOCK_SIZE) {
     	char what[BUFSIZ];
     	snprintf(what, BUFSIZ, "Unable to write %d: %s", blocknum, strerror(errno));
     	throw std::runtime_error(what);
     }
 
+    /**- remember the checksum of what was stored; dirty flags share words, so they are set under the lock */
+    if (checksummed(blocknum)) {
+    	Checksums[blocknum] = block_checksum(data);
+    	std::lock_guard<std::mutex> guard(ChecksumLock);
+    	ChecksumDirty[blocknum / CHECKSUMS_PER_BLOCK] = true;
+    }
+
     /**- increment writes */
     Writes++;
+    account(IO_WRITE, blocknum, 1, region, start);
 }
@@ -0,0 +1,261 @@
+/**
+ * @file fs_batch.cpp
+ * @brief Implementation of fs.h batch functions
+ * @date 2026-10-18
+ *
+ * @details commit() applies a Transaction to inode blocks and dirblocks kept
+ * in memory. Every block is read when the first operation needs it and
+ * written once after the last one, so a batch of many entries in a few
+ * directories costs a few block I/Os instead of several per entry. The
+ * in-memory counters are saved first and put back if an operation fails,
+ * and data blocks of removed files are only freed once the new metadata is
+ * on disk, so a failed batch leaves no trace.
+ */
+
+#include "sfs/fs.h"
+
+#include <string.h>
+
+using namespace std;
+
+FileSystem::Directory* FileSystem::batch_dir(map<uint32_t, Block> *dirs, uint32_t inum) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint32_t blocknum = MetaData.Blocks - 1 - inum / DIR_PER_BLOCK;
+    if(!dirs->count(blocknum)) fs_disk->read(blocknum, (*dirs)[blocknum].Data);
+    return &(*dirs)[blocknum].Directories[inum % DIR_PER_BLOCK];
+}
+
+FileSystem::Inode* FileSystem::batch_inode(map<uint32_t, Block> *inodes, uint32_t inumber) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint32_t blocknum = inumber / INODES_PER_BLOCK + 1;
+    if(!inodes->count(blocknum)) fs_disk->read(blocknum, (*inodes)[blocknum].Data);
+    return &(*inodes)[blocknum].Inodes[inumber % INODES_PER_BLOCK];
+}
+
+FileSystem::Directory* FileSystem::batch_parent(map<uint32_t, Block> *dirs, const string &path, string *name) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- follow every component but the last; "." and ".." are entries like any other */
+    Directory *dir = batch_dir(dirs, curr_dir.inum);
+    size_t start = 0, slash;
+    while((slash = path.find('/', start)) != string::npos) {
+        string part = path.substr(start, slash - start);
+        start = slash + 1;
+        if(part.empty()) continue;
+
+        int offset = dir_lookup(*dir, (char *)part.c_str());
+        if(offset == -1 || dir->Table[offset].type != 0) return NULL;
+        dir = batch_dir(dirs, dir->Table[offset].inum);
+    }
+
+    *name = path.substr(start);
+    if(name->empty() || name->size() >= NAMESIZE) return NULL;
+    return dir;
+}
+
+bool FileSystem::commit(const Transaction &batch) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_COMMIT);
+    if(trace.recording()) {
+        for(size_t i = 0; i < batch.Ops.size(); i++) {
+            const Transaction::Op &op = batch.Ops[i];
+            trace.Strings += op.Type + op.Path + '\0';
+            if(op.Type == 'm') trace.Strings += op.Target + '\0';
+        }
+    }
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+
+    /**- Save the counters, so a failed batch can be undone */
+    vector<int> saved_inodes = inode_counter;
+    vector<uint32_t> saved_dirs = dir_counter;
+    vector<bool> saved_free = free_blocks;
+
+    map<uint32_t, Block> dirs, inodes;
+    vector<Inode> removed;
+    const char *error = NULL;
+    size_t i = 0;
+
+    for(; i < batch.Ops.size() && !error; i++) {
+        const Transaction::Op &op = batch.Ops[i];
+        string name;
+        Directory *parent = batch_parent(&dirs, op.Path, &name);
+        if(!parent) {
+            error = "no such directory, or name too long";
+            break;
+        }
+        int offset = dir_lookup(*parent, (char *)name.c_str());
+
+        if(op.Type == 't' || op.Type == 'd') {
+            if(offset != -1) {
+                error = "already exists";
+                break;
+            }
+
+            /**- Claim an inode or a directory, then add its entry */
+            ssize_t inum;
+            if(op.Type == 't') inum = claim_inode(&inodes);
+            else inum = claim_dir(&dirs);
+            if(inum < 0) {
+                error = (op.Type == 't') ? "no free inode" : "directory limit reached";
+                break;
+            }
+
+            Directory temp = add_dir_entry(*parent, inum, op.Type == 't' ? 1 : 0, (char *)name.c_str());
+            if(temp.Valid == 0) {
+                error = "directory full";
+                break;
+            }
+            *parent = temp;
+
+            /**- A new directory gets "." and ".." */
+            if(op.Type == 'd') {
+                char dot[] = ".", dotdot[] = "..";
+                Directory *dir = batch_dir(&dirs, inum);
+                memset(dir, 0, sizeof(Directory));
+                dir->inum = inum;
+                dir->Valid = 1;
+                strcpy(dir->Name, name.c_str());
+                *dir = add_dir_entry(*dir, inum, 0, dot);
+                *dir = add_dir_entry(*dir, parent->inum, 0, dotdot);
+            }
+            continue;
+        }
+
+        if(offset == -1 || name == "." || name == "..") {
+            error = "no such file or directory";
+            break;
+        }
+        Dirent entry = parent->Table[offset];
+
+        if(op.Type == 'r') {
+            /**- Files give up their inode; their blocks are freed after the commit */
+            if(entry.type == 1) {
+                Inode *node = batch_inode(&inodes, entry.inum);
+                DiskUsage usage;
+                count_usage(node, &usage);
+                charge_dirs(&dirs, parent->inum, -(int64_t)usage.Bytes, -(int64_t)usage.Blocks);
+                removed.push_back(*node);
+                memset(node, 0, sizeof(Inode));
+                if(!(--inode_counter[entry.inum / INODES_PER_BLOCK])) {
+                    free_blocks[entry.inum / INODES_PER_BLOCK + 1] = false;
+                }
+            }
+            /**- Directories must be empty */
+            else {
+                Directory *dir = batch_dir(&dirs, entry.inum);
+                for(uint32_t j = 2; j < ENTRIES_PER_DIR; j++) {
+                    if(dir->Table[j].valid) error = "directory not empty";
+                }
+                if(error || entry.inum == curr_dir.inum) {
+                    error = error ? error : "current directory";
+                    break;
+                }
+                memset(dir, 0, sizeof(Directory));
+                dir_counter[entry.inum / DIR_PER_BLOCK]--;
+            }
+            parent->Table[offset].valid = 0;
+            continue;
+        }
+
+        /**- Moves: the target must be free and a directory must not move below itself */
+        string target;
+        Directory *to = batch_parent(&dirs, op.Target, &target);
+        if(!to) {
+            error = "no such target directory, or name too long";
+            break;
+        }
+        if(dir_lookup(*to, (char *)target.c_str()) != -1) {
+            error = "target already exists";
+            break;
+        }
+        for(Directory *up = to; entry.type == 0; up = batch_dir(&dirs, up->Table[1].inum)) {
+            if(up->inum == entry.inum) error = "cannot move a directory below itself";
+            if(error || up->inum == 0) break;
+        }
+        if(error) break;
+
+        /**- The usage of what moves goes from the directories above it to the ones above the target */
+        DiskUsage usage;
+        if(entry.type == 1) count_usage(batch_inode(&inodes, entry.inum), &usage);
+        else {
+            batch_dir(&dirs, entry.inum);
+            usage = dirs[MetaData.Blocks - 1 - entry.inum / DIR_PER_BLOCK].Dirs.Usage[entry.inum % DIR_PER_BLOCK];
+        }
+
+        parent->Table[offset].valid = 0;
+        Directory temp = add_dir_entry(*to, entry.inum, entry.type, (char *)target.c_str());
+        if(temp.Valid == 0) {
+            error = "target directory full";
+            break;
+        }
+        *to = temp;
+
+        /**- A moved directory takes the new name and points back to its new parent */
+        if(entry.type == 0) {
+            Directory *dir = batch_dir(&dirs, entry.inum);
+            strcpy(dir->Name, target.c_str());
+            dir->Table[1].inum = to->inum;
+        }
+        charge_dirs(&dirs, parent->inum, -(int64_t)usage.Bytes, -(int64_t)usage.Blocks);
+        charge_dirs(&dirs, to->inum, usage.Bytes, usage.Blocks);
+    }
+
+    /**- On errors put the counters back; nothing was written */
+    if(error) {
+        const Transaction::Op &op = batch.Ops[i];
+        printf("batch operation %lu (%c %s) failed: %s\n", (unsigned long)i + 1, op.Type, op.Path.c_str(), error);
+        inode_counter = saved_inodes;
+        dir_counter = saved_dirs;
+        free_blocks = saved_free;
+        return false;
+    }
+
+    /**- Write every inode block, then every dirblock, once */
+    for(map<uint32_t, Block>::iterator it = inodes.begin(); it != inodes.end(); it++) {
+        fs_disk->write(it->first, it->second.Data);
+    }
+    for(map<uint32_t, Block>::iterator it = dirs.begin(); it != dirs.end(); it++) {
+        fs_disk->write(it->first, it->second.Data);
+    }
+    curr_dir = load_dir(curr_dir.inum);
+
+    /**- Free the blocks of removed files, now that no inode points to them */
+    for(size_t j = 0; j < removed.size(); j++) release_inode(&removed[j]);
+    if(MetaData.Features & FEATURE_DEDUP) dedup_flush();
+    discard_flush();
+
+    return true;
+}
+
+bool FileSystem::touch_many(const vector<string> &paths) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Transaction batch;
+    for(size_t i = 0; i < paths.size(); i++) batch.touch(paths[i]);
+    return commit(batch);
+}
+
+bool FileSystem::rm_many(const vector<string> &paths) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Transaction batch;
+    for(size_t i = 0; i < paths.size(); i++) batch.rm(paths[i]);
+    return commit(batch);
+}
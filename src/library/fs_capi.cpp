@@ -0,0 +1,511 @@
+/**
+ * @file fs_capi.cpp
+ * @brief Implementation of the C interface of sfs.h
+ * @date 2026-10-18
+ *
+ * @details Each function checks what the FileSystem would print about, a
+ * missing name, a name taken or of the wrong type, before calling it, so the
+ * common errors come back as codes; a FileSystem call that still fails is
+ * out of space or out of order on disk. Exceptions of the Disk never cross
+ * the C boundary: they become SFS_EIO, or SFS_ENOMEM.
+ */
+
+#include "sfs/fs.h"
+#include "sfs/sfs.h"
+
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include <string.h>
+
+using namespace std;
+
+static_assert(SFS_FEATURE_COMPRESS == FileSystem::FEATURE_COMPRESS && SFS_FEATURE_DEDUP == FileSystem::FEATURE_DEDUP &&
+              SFS_FEATURE_ENCRYPT == FileSystem::FEATURE_ENCRYPT && SFS_FEATURE_CHECKSUM == FileSystem::FEATURE_CHECKSUM &&
+              SFS_FEATURE_LAZY == FileSystem::FEATURE_LAZY && SFS_FEATURE_DISCARD == FileSystem::FEATURE_DISCARD,
+              "SFS_FEATURE_* must match FileSystem::FEATURE_*");
+static_assert(SFS_NAME_MAX + 1 == FileSystem::NAMESIZE, "SFS_NAME_MAX must match FileSystem::NAMESIZE");
+
+const size_t SFS_OPEN_MAX = 1024;              // Files a handle may have open at once
+const size_t SFS_CHUNK = 1 << 20;              // Bytes per FileSystem::read() or write(), whose length is an int
+
+struct OpenFile {
+    bool     Open;          // Slot in use
+    uint32_t Inumber;       // Inode of the file
+    uint32_t Dir;           // Directory holding it, charged for what writes add
+    off_t    Offset;        // Where the next read or write starts
+};
+
+struct sfs {
+    Disk             disk;
+    FileSystem       fs;        // Declared after disk, so it goes first
+    bool             mounted;
+    vector<OpenFile> files;     // Indexed by file number
+};
+
+namespace {
+
+/* Runs an operation, turning what the Disk throws into error codes */
+template <typename Operation>
+ssize_t guarded(Operation operation) {
+    try {
+        return operation();
+    } catch (bad_alloc &) {
+        return SFS_ENOMEM;
+    } catch (exception &) {
+        return SFS_EIO;
+    }
+}
+
+/* Copies a name into the writable buffer the FileSystem takes */
+int copy_name(const char *name, char copy[FileSystem::NAMESIZE]) {
+    if(!name) return SFS_EINVAL;
+    size_t length = strlen(name);
+    if(length == 0 || length > SFS_NAME_MAX || strchr(name, '/')) return SFS_EINVAL;
+    memcpy(copy, name, length + 1);
+    return SFS_OK;
+}
+
+int ready(sfs_t *fs) {
+    if(!fs) return SFS_EINVAL;
+    return fs->mounted ? SFS_OK : SFS_ENOTMOUNTED;
+}
+
+OpenFile *open_file(sfs_t *fs, int file) {
+    if(!fs || file < 0 || (size_t)file >= fs->files.size() || !fs->files[file].Open) return NULL;
+    return &fs->files[file];
+}
+
+/* Whether a file of the curr_dir, or of a directory below it, is open; the curr_dir is left as it was */
+bool open_below(sfs_t *fs) {
+    char dot[] = ".", dotdot[] = "..";
+    vector<FileSystem::EntryAttr> found;
+    if(!fs->fs.readdir_plus(dot, &found)) return false;
+
+    for(size_t i = 0; i < found.size(); i++) {
+        if(found[i].type == SFS_TYPE_FILE) {
+            for(size_t j = 0; j < fs->files.size(); j++) {
+                if(fs->files[j].Open && fs->files[j].Inumber == found[i].inum) return true;
+            }
+        }
+        else if(strcmp(found[i].Name, ".") && strcmp(found[i].Name, "..")) {
+            if(!fs->fs.cd(found[i].Name)) continue;
+            bool busy = open_below(fs);
+            fs->fs.cd(dotdot);
+            if(busy) return true;
+        }
+    }
+    return false;
+}
+
+void fill_stat(const FileSystem::EntryAttr &attr, struct sfs_stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->inumber = attr.inum;
+    st->type = attr.type;
+    st->size = attr.Size;
+    st->blocks = attr.Blocks;
+}
+
+}
+
+int sfs_api_version(void) {
+    return SFS_API_VERSION;
+}
+
+const char *sfs_strerror(int error) {
+    switch(error) {
+        case SFS_OK:            return "Success";
+        case SFS_EINVAL:        return "Invalid argument";
+        case SFS_ENOENT:        return "No such file or directory";
+        case SFS_EEXIST:        return "File exists";
+        case SFS_ENOTDIR:       return "Not a directory";
+        case SFS_EISDIR:        return "Is a directory";
+        case SFS_ENOSPC:        return "No space left on device";
+        case SFS_EFBIG:         return "File too large";
+        case SFS_EBADF:         return "Bad file number";
+        case SFS_EMFILE:        return "Too many open files";
+        case SFS_EIO:           return "Input/output error";
+        case SFS_ENOTMOUNTED:   return "Not mounted";
+        case SFS_EBUSY:         return "Device or resource busy";
+        case SFS_EPERM:         return "Operation not permitted";
+        case SFS_ENOMEM:        return "Out of memory";
+        default:                return error >= 0 ? "Success" : "Unknown error";
+    }
+}
+
+int sfs_open_disk(const char *path, size_t blocks, sfs_t **fs) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!path || !blocks || !fs) return SFS_EINVAL;
+    *fs = NULL;
+
+    sfs_t *handle = new (nothrow) sfs_t;
+    if(!handle) return SFS_ENOMEM;
+    handle->mounted = false;
+    handle->disk.set_quiet(true);
+
+    ssize_t result = guarded([&]() -> ssize_t {
+        handle->disk.open(path, blocks);
+        return SFS_OK;
+    });
+    if(result != SFS_OK) {
+        delete handle;
+        return result;
+    }
+    *fs = handle;
+    return SFS_OK;
+}
+
+int sfs_close_disk(sfs_t *fs) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!fs) return SFS_OK;
+    int result = fs->mounted ? sfs_unmount(fs) : SFS_OK;
+
+    /**- The Disk writes back cached checksums and closes the image as it is destroyed */
+    delete fs;
+    return result;
+}
+
+int sfs_format(sfs_t *fs, uint32_t features) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!fs) return SFS_EINVAL;
+    if(fs->mounted) return SFS_EBUSY;
+
+    /**- Encryption asks for a password on the terminal */
+    if(features & SFS_FEATURE_ENCRYPT) return SFS_EPERM;
+
+    return guarded([&]() -> ssize_t {
+        return FileSystem::format(&fs->disk, features) ? SFS_OK : SFS_EIO;
+    });
+}
+
+int sfs_mount(sfs_t *fs) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!fs) return SFS_EINVAL;
+    if(fs->mounted) return SFS_EBUSY;
+
+    return guarded([&]() -> ssize_t {
+        /**- Unlocking a protected disk asks for its password on the terminal */
+        if(FileSystem::protected_disk(&fs->disk)) return SFS_EPERM;
+        if(!fs->fs.mount(&fs->disk)) return SFS_EIO;
+        fs->mounted = true;
+        return SFS_OK;
+    });
+}
+
+int sfs_unmount(sfs_t *fs) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    int result = ready(fs);
+    if(result != SFS_OK) return result;
+
+    fs->files.clear();
+    fs->mounted = false;
+    return guarded([&]() -> ssize_t {
+        fs->fs.exit();
+        return SFS_OK;
+    });
+}
+
+int sfs_mkdir(sfs_t *fs, const char *name) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+
+    return guarded([&]() -> ssize_t {
+        FileSystem::EntryAttr attr;
+        if(fs->fs.entry(copy, &attr)) return SFS_EEXIST;
+        return fs->fs.mkdir(copy) ? SFS_OK : SFS_ENOSPC;
+    });
+}
+
+int sfs_rmdir(sfs_t *fs, const char *name) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+    if(!strcmp(copy, ".") || !strcmp(copy, "..")) return SFS_EINVAL;
+
+    return guarded([&]() -> ssize_t {
+        FileSystem::EntryAttr attr;
+        if(!fs->fs.entry(copy, &attr)) return SFS_ENOENT;
+        if(attr.type != SFS_TYPE_DIR) return SFS_ENOTDIR;
+
+        /**- As for sfs_unlink(), no inode of an open file may be freed, however deep it is */
+        bool open = false;
+        for(size_t i = 0; i < fs->files.size() && !open; i++) open = fs->files[i].Open;
+        if(open) {
+            fs->fs.cd(copy);
+            bool busy = open_below(fs);
+            char dotdot[] = "..";
+            fs->fs.cd(dotdot);
+            if(busy) return SFS_EBUSY;
+        }
+
+        /**- rm() removes directories too, and keeps the current directory in step with the disk */
+        return fs->fs.rm(copy) ? SFS_OK : SFS_EIO;
+    });
+}
+
+int sfs_chdir(sfs_t *fs, const char *name) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+
+    return guarded([&]() -> ssize_t {
+        FileSystem::EntryAttr attr;
+        if(!fs->fs.entry(copy, &attr)) return SFS_ENOENT;
+        if(attr.type != SFS_TYPE_DIR) return SFS_ENOTDIR;
+        return fs->fs.cd(copy) ? SFS_OK : SFS_EIO;
+    });
+}
+
+int sfs_getcwd(sfs_t *fs, uint32_t *dir) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    int result = ready(fs);
+    if(result != SFS_OK) return result;
+    if(!dir) return SFS_EINVAL;
+    *dir = fs->fs.cwd();
+    return SFS_OK;
+}
+
+int sfs_setcwd(sfs_t *fs, uint32_t dir) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    int result = ready(fs);
+    if(result != SFS_OK) return result;
+
+    /**- The curr_dir in memory is the latest copy of its directory; others are read from their dirblock */
+    if(fs->fs.cwd() == dir) return SFS_OK;
+    return guarded([&]() -> ssize_t {
+        return fs->fs.set_cwd(dir) ? SFS_OK : SFS_ENOENT;
+    });
+}
+
+int sfs_unlink(sfs_t *fs, const char *name) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+
+    return guarded([&]() -> ssize_t {
+        FileSystem::EntryAttr attr;
+        if(!fs->fs.entry(copy, &attr)) return SFS_ENOENT;
+        if(attr.type != SFS_TYPE_FILE) return SFS_EISDIR;
+
+        /**- The inode of an open file must not be reused under it */
+        for(size_t i = 0; i < fs->files.size(); i++) {
+            if(fs->files[i].Open && fs->files[i].Inumber == attr.inum) return SFS_EBUSY;
+        }
+        return fs->fs.rm(copy) ? SFS_OK : SFS_EIO;
+    });
+}
+
+int sfs_stat(sfs_t *fs, const char *name, struct sfs_stat *st) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+    if(!st) return SFS_EINVAL;
+
+    return guarded([&]() -> ssize_t {
+        FileSystem::EntryAttr attr;
+        if(!fs->fs.entry(copy, &attr)) return SFS_ENOENT;
+        fill_stat(attr, st);
+        return SFS_OK;
+    });
+}
+
+ssize_t sfs_readdir(sfs_t *fs, const char *name, struct sfs_dirent *entries, size_t count) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+    if(!entries && count) return SFS_EINVAL;
+
+    return guarded([&]() -> ssize_t {
+        FileSystem::EntryAttr attr;
+        if(!fs->fs.entry(copy, &attr)) return SFS_ENOENT;
+        if(attr.type != SFS_TYPE_DIR) return SFS_ENOTDIR;
+
+        vector<FileSystem::EntryAttr> found;
+        if(!fs->fs.readdir_plus(copy, &found)) return SFS_EIO;
+        for(size_t i = 0; i < found.size() && i < count; i++) {
+            memcpy(entries[i].name, found[i].Name, sizeof(entries[i].name));
+            entries[i].name[SFS_NAME_MAX] = '\0';
+            fill_stat(found[i], &entries[i].stat);
+        }
+        return found.size();
+    });
+}
+
+int sfs_open(sfs_t *fs, const char *name, int flags) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char copy[FileSystem::NAMESIZE];
+    int result = ready(fs);
+    if(result == SFS_OK) result = copy_name(name, copy);
+    if(result != SFS_OK) return result;
+    if(flags & ~(SFS_O_CREAT | SFS_O_EXCL)) return SFS_EINVAL;
+
+    return guarded([&]() -> ssize_t {
+        /**- Find the file, creating it if asked to */
+        FileSystem::EntryAttr attr;
+        if(fs->fs.entry(copy, &attr)) {
+            if(attr.type != SFS_TYPE_FILE) return SFS_EISDIR;
+            if((flags & SFS_O_CREAT) && (flags & SFS_O_EXCL)) return SFS_EEXIST;
+        } else {
+            if(!(flags & SFS_O_CREAT)) return SFS_ENOENT;
+            if(!fs->fs.touch(copy) || !fs->fs.entry(copy, &attr)) return SFS_ENOSPC;
+        }
+
+        /**- Take the lowest free file number, like open(2) */
+        size_t file = 0;
+        while(file < fs->files.size() && fs->files[file].Open) file++;
+        if(file == SFS_OPEN_MAX) return SFS_EMFILE;
+        if(file == fs->files.size()) fs->files.push_back(OpenFile());
+
+        fs->files[file].Open = true;
+        fs->files[file].Inumber = attr.inum;
+        fs->files[file].Dir = fs->fs.cwd();
+        fs->files[file].Offset = 0;
+        return file;
+    });
+}
+
+int sfs_close(sfs_t *fs, int file) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    OpenFile *open = open_file(fs, file);
+    if(!open) return SFS_EBADF;
+    open->Open = false;
+    return SFS_OK;
+}
+
+ssize_t sfs_read(sfs_t *fs, int file, void *data, size_t length) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    int result = ready(fs);
+    if(result != SFS_OK) return result;
+    OpenFile *open = open_file(fs, file);
+    if(!open) return SFS_EBADF;
+    if(!data && length) return SFS_EINVAL;
+
+    return guarded([&]() -> ssize_t {
+        /**- Read in chunks until the request is met or the file ends */
+        char *ptr = (char *)data;
+        size_t done = 0;
+        while(done < length) {
+            int chunk = (int)min(length - done, SFS_CHUNK);
+            ssize_t read = fs->fs.read(open->Inumber, ptr + done, chunk, open->Offset);
+            if(read < 0) return done ? (ssize_t)done : SFS_EIO;
+            done += read;
+            open->Offset += read;
+            if(read < chunk) break;
+        }
+        return done;
+    });
+}
+
+ssize_t sfs_write(sfs_t *fs, int file, const void *data, size_t length) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    int result = ready(fs);
+    if(result != SFS_OK) return result;
+    OpenFile *open = open_file(fs, file);
+    if(!open) return SFS_EBADF;
+    if(!data && length) return SFS_EINVAL;
+
+    return guarded([&]() -> ssize_t {
+        /**- Write in chunks; a short one means the disk filled up, a failed one that the file would be too large */
+        char *ptr = (char *)data;
+        size_t done = 0;
+        while(done < length) {
+            int chunk = (int)min(length - done, SFS_CHUNK);
+            ssize_t written = fs->fs.write_charged(open->Dir, open->Inumber, ptr + done, chunk, open->Offset);
+            if(written < 0) return done ? (ssize_t)done : SFS_EFBIG;
+            done += written;
+            open->Offset += written;
+            if(written < chunk) return done ? (ssize_t)done : SFS_ENOSPC;
+        }
+        return done;
+    });
+}
+
+off_t sfs_seek(sfs_t *fs, int file, off_t offset, int whence) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    int result = ready(fs);
+    if(result != SFS_OK) return result;
+    OpenFile *open = open_file(fs, file);
+    if(!open) return SFS_EBADF;
+
+    return guarded([&]() -> ssize_t {
+        off_t base;
+        switch(whence) {
+            case SFS_SEEK_SET: base = 0; break;
+            case SFS_SEEK_CUR: base = open->Offset; break;
+            case SFS_SEEK_END: base = fs->fs.stat(open->Inumber); break;
+            default:           return SFS_EINVAL;
+        }
+        if(base < 0) return SFS_EIO;
+        if(base + offset < 0) return SFS_EINVAL;
+        open->Offset = base + offset;
+        return open->Offset;
+    });
+}
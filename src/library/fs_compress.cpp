@@ -0,0 +1,270 @@
+/**
+ * @file fs_compress.cpp
+ * @brief Implementation of fs.h compression functions
+ * @date 2026-10-18
+ *
+ * @details Used instead of read() and write() when the disk is formatted
+ * with FEATURE_COMPRESS. File data is handled in clusters of CLUSTER_BLOCKS
+ * logical blocks. A cluster is stored in the first K pointer slots that
+ * belong to it and the remaining slots of the cluster stay 0.
+ * With N the number of logical blocks of the cluster within the file size:
+ *  - K == 0 : the cluster is a hole and reads back as zeros
+ *  - K <  N : the cluster is LZ4 compressed, prefixed by its compressed length
+ *  - K >= N : the cluster is stored raw, one logical block per slot
+ */
+
+#include "sfs/fs.h"
+#include "sfs/lz4.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+
+namespace {
+    const uint32_t CLUSTER_BYTES = FileSystem::CLUSTER_BLOCKS * Disk::BLOCK_SIZE;
+
+    /**- CPU time of the calling thread in nanoseconds */
+    uint64_t cpu_nanos() {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    bool all_zero(const char *data, size_t length) {
+        for(size_t i = 0; i < length; i++) {
+            if(data[i]) return false;
+        }
+        return true;
+    }
+}
+
+uint32_t FileSystem::cluster_blocks(uint32_t size, uint32_t cluster) {
+    uint32_t nblocks = (size + Disk::BLOCK_SIZE - 1) / Disk::BLOCK_SIZE;
+    uint32_t first = cluster * CLUSTER_BLOCKS;
+
+    if(nblocks <= first) return 0;
+    return min((uint32_t)CLUSTER_BLOCKS, nblocks - first);
+}
+
+bool FileSystem::load_cluster(Inode *node, Block *indirect, uint32_t cluster, uint32_t size, char *buffer) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("load_cluster", "step");
+
+    memset(buffer, 0, CLUSTER_BYTES);
+
+    /**- count the blocks the cluster occupies; they are packed at its first slots */
+    uint32_t n = cluster_blocks(size, cluster);
+    uint32_t slot = cluster * CLUSTER_BLOCKS;
+    uint32_t k = 0;
+    while(k < CLUSTER_BLOCKS && get_slot(node, indirect, slot + k)) k++;
+
+    /**- hole */
+    if(n == 0 || k == 0) return true;
+
+    /**- stored raw */
+    if(k >= n) {
+        for(uint32_t i = 0; i < n; i++) {
+            fs_disk->read(get_slot(node, indirect, slot + i), buffer + i * Disk::BLOCK_SIZE);
+        }
+        return true;
+    }
+
+    /**- stored compressed */
+    char packed[CLUSTER_BYTES];
+    for(uint32_t i = 0; i < k; i++) {
+        fs_disk->read(get_slot(node, indirect, slot + i), packed + i * Disk::BLOCK_SIZE);
+    }
+
+    uint32_t length;
+    memcpy(&length, packed, sizeof(length));
+    if(length > k * Disk::BLOCK_SIZE - sizeof(length)) return false;
+
+    uint64_t start = cpu_nanos();
+    int result = LZ4::decompress(packed + sizeof(length), length, buffer, CLUSTER_BYTES);
+    compression.DecompressNanos += cpu_nanos() - start;
+
+    return result >= 0;
+}
+
+bool FileSystem::store_cluster(Inode *node, Block *indirect, bool *indirect_dirty, uint32_t cluster, uint32_t size, char *buffer) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("store_cluster", "step");
+
+    uint32_t n = cluster_blocks(size, cluster);
+    uint32_t slot = cluster * CLUSTER_BLOCKS;
+    uint32_t last_slot = POINTERS_PER_INODE + POINTERS_PER_BLOCK;
+
+    /**- choose the representation: hole, compressed if it saves a block, raw otherwise */
+    char packed[CLUSTER_BYTES];
+    char *payload = buffer;
+    uint32_t k = n;
+
+    if(all_zero(buffer, n * Disk::BLOCK_SIZE)) k = 0;
+    else if(n > 1) {
+        uint64_t start = cpu_nanos();
+        uint32_t length = LZ4::compress(buffer, n * Disk::BLOCK_SIZE, packed + sizeof(uint32_t), (n - 1) * Disk::BLOCK_SIZE - sizeof(uint32_t));
+        compression.CompressNanos += cpu_nanos() - start;
+
+        if(length) {
+            memcpy(packed, &length, sizeof(length));
+            k = (length + sizeof(length) + Disk::BLOCK_SIZE - 1) / Disk::BLOCK_SIZE;
+            memset(packed + sizeof(length) + length, 0, k * Disk::BLOCK_SIZE - sizeof(length) - length);
+            payload = packed;
+        }
+    }
+
+    /**- allocate the indirect block if the cluster needs one of its slots */
+    if(k && slot + k > POINTERS_PER_INODE && !node->Indirect) {
+        uint32_t blocknum = allocate_block();
+        if(!blocknum) return false;
+        node->Indirect = blocknum;
+        memset(indirect->Data, 0, Disk::BLOCK_SIZE);
+        *indirect_dirty = true;
+    }
+
+    /**- reuse the blocks the cluster already holds; allocate the rest */
+    uint32_t blocks[CLUSTER_BLOCKS];
+    for(uint32_t i = 0; i < k; i++) {
+        blocks[i] = get_slot(node, indirect, slot + i);
+        if(!blocks[i]) {
+            blocks[i] = allocate_block();
+            if(!blocks[i]) {
+                /**- disk full: give back what was taken for this cluster */
+                for(uint32_t j = 0; j < i; j++) {
+                    if(!get_slot(node, indirect, slot + j)) free_block(blocks[j]);
+                }
+                return false;
+            }
+        }
+    }
+
+    /**- write the payload and update the pointer slots */
+    for(uint32_t i = 0; i < CLUSTER_BLOCKS && slot + i < last_slot; i++) {
+        uint32_t old = get_slot(node, indirect, slot + i);
+        uint32_t now = (i < k) ? blocks[i] : 0;
+
+        if(i < k) fs_disk->write(now, payload + i * Disk::BLOCK_SIZE);
+        else release_block(old);
+
+        if(old != now) set_slot(node, indirect, indirect_dirty, slot + i, now);
+    }
+
+    compression.Clusters++;
+    compression.LogicalBytes += n * Disk::BLOCK_SIZE;
+    compression.StoredBytes += k * Disk::BLOCK_SIZE;
+
+    return true;
+}
+
+ssize_t FileSystem::read_compressed(size_t inumber, char *data, int length, size_t offset) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- sanity check */
+    if(!mounted) return -1;
+
+    Inode node;
+    Block indirect;
+    if(!load_inode(inumber, &node)) return -1;
+
+    /**- clamp the request to the size of the inode */
+    if(offset >= node.Size) return 0;
+    if(length + offset > node.Size) length = node.Size - offset;
+    if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    /**- decode every cluster the request touches and copy the wanted bytes */
+    char buffer[CLUSTER_BYTES];
+    int done = 0;
+    while(done < length) {
+        size_t position = offset + done;
+        uint32_t within = position % CLUSTER_BYTES;
+        int chunk = min((int)(CLUSTER_BYTES - within), length - done);
+
+        if(!load_cluster(&node, &indirect, position / CLUSTER_BYTES, node.Size, buffer)) {
+            fprintf(stderr, "corrupt cluster %lu in inode %lu\n", position / CLUSTER_BYTES, inumber);
+            return done ? done : -1;
+        }
+        memcpy(data + done, buffer + within, chunk);
+        done += chunk;
+    }
+
+    return done;
+}
+
+ssize_t FileSystem::write_compressed(size_t inumber, char *data, int length, size_t offset) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- sanity check */
+    if(!mounted) return -1;
+    if(length + offset > (POINTERS_PER_BLOCK + POINTERS_PER_INODE) * Disk::BLOCK_SIZE) return -1;
+
+    Inode node;
+    Block indirect;
+    bool indirect_dirty = false;
+
+    /**- if the inode is invalid, allocate inode; it is written back by write_ret() */
+    if(!load_inode(inumber, &node)) {
+        node.Valid = true;
+        node.Size = 0;
+        for(uint32_t ii = 0; ii < POINTERS_PER_INODE; ii++) {
+            node.Direct[ii] = 0;
+        }
+        node.Indirect = 0;
+        inode_counter[inumber / INODES_PER_BLOCK]++;
+        free_blocks[inumber / INODES_PER_BLOCK + 1] = true;
+    }
+    else if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    if(length <= 0) return write_ret(inumber, &node, 0);
+
+    uint32_t old_size = node.Size;
+    uint32_t new_size = max((uint32_t)(offset + length), old_size);
+    uint32_t first = offset / CLUSTER_BYTES;
+    uint32_t last = (offset + length - 1) / CLUSTER_BYTES;
+    char buffer[CLUSTER_BYTES];
+
+    /**- the old last cluster gains blocks when the file grows past it; re-encode it for the new size */
+    if(old_size && new_size > old_size) {
+        uint32_t tail = (old_size - 1) / CLUSTER_BYTES;
+        if(tail < first && cluster_blocks(old_size, tail) != cluster_blocks(new_size, tail)) {
+            if(!load_cluster(&node, &indirect, tail, old_size, buffer) ||
+               !store_cluster(&node, &indirect, &indirect_dirty, tail, new_size, buffer)) {
+                if(indirect_dirty) fs_disk->write(node.Indirect, indirect.Data, REGION_INDIRECT);
+                return write_ret(inumber, &node, 0);
+            }
+        }
+    }
+
+    /**- read-modify-write every cluster the request touches */
+    int written = 0;
+    for(uint32_t cluster = first; cluster <= last; cluster++) {
+        size_t start = (size_t)cluster * CLUSTER_BYTES;
+        size_t from = max(offset, start) - start;
+        size_t to = min(offset + length, start + CLUSTER_BYTES) - start;
+
+        bool whole = (from == 0) && (to >= cluster_blocks(new_size, cluster) * Disk::BLOCK_SIZE);
+        if(whole) memset(buffer, 0, CLUSTER_BYTES);
+        else if(!load_cluster(&node, &indirect, cluster, old_size, buffer)) break;
+
+        memcpy(buffer + from, data + (start + from - offset), to - from);
+        if(!store_cluster(&node, &indirect, &indirect_dirty, cluster, new_size, buffer)) break;
+
+        written = start + to - offset;
+    }
+
+    /**- size only covers what was stored; write back the indirect block and the inode */
+    node.Size = max(old_size, (uint32_t)(offset + written));
+    if(indirect_dirty) fs_disk->write(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    return write_ret(inumber, &node, written);
+}
@@ -0,0 +1,669 @@
+/**
+ * @file fs_copy.cpp
+ * @brief Implementation of fs.h copy functions
+ * @date 2026-10-18
+ *
+ * @details On disks that store file blocks as they are (no compression,
+ * encryption or checksums) copyin and copyout do not pass the data through
+ * a buffer. Blocks whose numbers are consecutive on the disk form a run,
+ * and every run is copied between the host file and the image with one
+ * Disk::copy_in() or Disk::copy_out(), which uses copy_file_range.
+ *
+ * copyin_parallel() reserves all blocks of a file up front and then lets
+ * several threads copy disjoint ranges of it at once; this works on
+ * encrypted and checksummed disks too, where each thread seals its own
+ * blocks. Only the threads touch the disk until they are done, and the
+ * inode and indirect block are written once at the end.
+ *
+ * import() loads a host directory tree the same way, one file per thread.
+ * Inodes and directories are claimed in blocks kept in memory, and every
+ * inode and directory block is written once, after the file data.
+ */
+
+#include "sfs/fs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+    /**- what the threads of one copy share */
+    struct CopyJob {
+        Disk   *disk;
+        uint8_t caller;     /** Tag of the operation, for the block I/O of the threads */
+        bool    direct;     /** Blocks are stored as they are, so the kernel can copy them */
+        mutex   lock;
+        string  error;      /** First error of any thread */
+
+        void    fail(const string &what) {
+            lock_guard<mutex> guard(lock);
+            if(error.empty()) error = what;
+        }
+    };
+
+    /**- a host file and the disk blocks reserved for it */
+    struct CopyFile {
+        string           path;
+        int              fd;
+        size_t           size;          /** Bytes of the host file that are copied */
+        bool             buffered;      /** Copied by copyin_file() instead of the threads */
+        uint32_t         inum;
+        uint32_t         indirect;
+        vector<uint32_t> blocks;        /** Disk block of every block of the file */
+    };
+
+    /**- a host directory of an import and its entries, in the order they are added */
+    struct ImportEntry {
+        bool    dir;
+        size_t  index;      /** Index into the directories or the files */
+        string  name;
+    };
+
+    struct ImportDir {
+        string              path;
+        string              name;
+        size_t              parent;
+        uint32_t            inum;
+        vector<ImportEntry> entries;
+    };
+
+    /**- copies the blocks [begin, end) of a file */
+    void copy_range(CopyJob *job, const CopyFile *file, uint32_t begin, uint32_t end) {
+        Disk::Caller tag(job->caller);
+        const vector<uint32_t> &blocks = file->blocks;
+        vector<char> buffer;
+
+        try {
+            for(uint32_t slot = begin; slot < end; ) {
+                size_t position = (size_t)slot * Disk::BLOCK_SIZE;
+
+                /**- whole blocks that are consecutive on the disk are copied by the kernel in one go */
+                if(job->direct && position + Disk::BLOCK_SIZE <= file->size) {
+                    uint32_t count = 1;
+                    while(slot + count < end && blocks[slot + count] == blocks[slot] + count &&
+                          position + (size_t)(count + 1) * Disk::BLOCK_SIZE <= file->size) count++;
+                    job->disk->copy_in(file->fd, position, blocks[slot], count);
+                    slot += count;
+                    continue;
+                }
+
+                /**- otherwise through a buffer; the last block is padded with zeros */
+                uint32_t count = min(end - slot, (uint32_t)FileSystem::COPY_BLOCKS);
+                size_t length = min((size_t)count * Disk::BLOCK_SIZE, file->size - position);
+                buffer.assign((size_t)count * Disk::BLOCK_SIZE, 0);
+                errno = 0;
+                if(pread(file->fd, buffer.data(), length, position) != (ssize_t)length) {
+                    throw runtime_error("Unable to read " + file->path + ": " + (errno ? strerror(errno) : "file changed"));
+                }
+                for(uint32_t i = 0; i < count; i++) {
+                    job->disk->write(blocks[slot + i], &buffer[(size_t)i * Disk::BLOCK_SIZE]);
+                }
+                slot += count;
+            }
+        } catch(exception &e) {
+            job->fail(e.what());
+        }
+    }
+
+    /**- copies whole files, taking the next one until none is left */
+    void copy_files(CopyJob *job, vector<CopyFile> *files, atomic<size_t> *next) {
+        Disk::Caller tag(job->caller);
+        for(size_t i = (*next)++; i < files->size(); i = (*next)++) {
+            CopyFile &file = (*files)[i];
+            if(file.buffered) continue;
+
+            file.fd = open(file.path.c_str(), O_RDONLY);
+            if(file.fd < 0) {
+                job->fail("Unable to open " + file.path + ": " + strerror(errno));
+                continue;
+            }
+            copy_range(job, &file, 0, file.blocks.size());
+            close(file.fd);
+        }
+    }
+
+    /**- lists a host tree, directories first in breadth-first order; entries that do not fit are skipped */
+    bool scan_tree(const char *path, const char *name, vector<ImportDir> *dirs, vector<CopyFile> *files) {
+        ImportDir root;
+        root.path = path;
+        root.name = name;
+        root.parent = 0;
+        dirs->push_back(root);
+
+        for(size_t d = 0; d < dirs->size(); d++) {
+            struct dirent **list;
+            int count = scandir((*dirs)[d].path.c_str(), &list, NULL, alphasort);
+            if(count < 0) {
+                fprintf(stderr, "Unable to open %s: %s\n", (*dirs)[d].path.c_str(), strerror(errno));
+                if(d == 0) return false;
+                continue;
+            }
+
+            for(int i = 0; i < count; i++) {
+                string child = (*dirs)[d].path + "/" + list[i]->d_name;
+                struct stat info;
+                bool dot = !strcmp(list[i]->d_name, ".") || !strcmp(list[i]->d_name, "..");
+                if(dot || lstat(child.c_str(), &info) < 0) {}
+                else if(strlen(list[i]->d_name) >= FileSystem::NAMESIZE) fprintf(stderr, "Skipping %s: name too long\n", child.c_str());
+                else if(!S_ISDIR(info.st_mode) && !S_ISREG(info.st_mode)) fprintf(stderr, "Skipping %s: not a file or directory\n", child.c_str());
+                else if((*dirs)[d].entries.size() + 2 >= FileSystem::ENTRIES_PER_DIR) fprintf(stderr, "Skipping %s: directory full\n", child.c_str());
+                else if(S_ISDIR(info.st_mode)) {
+                    ImportDir dir;
+                    dir.path = child;
+                    dir.name = list[i]->d_name;
+                    dir.parent = d;
+                    ImportEntry entry = {true, dirs->size(), dir.name};
+                    (*dirs)[d].entries.push_back(entry);
+                    dirs->push_back(dir);
+                }
+                else {
+                    /**- holes of sparse files are kept by copyin_file() */
+                    CopyFile file;
+                    file.path = child;
+                    file.fd = -1;
+                    file.size = info.st_size;
+                    file.buffered = (off_t)info.st_blocks * 512 < info.st_size;
+                    file.indirect = 0;
+                    ImportEntry entry = {false, files->size(), list[i]->d_name};
+                    (*dirs)[d].entries.push_back(entry);
+                    files->push_back(file);
+                }
+                free(list[i]);
+            }
+            free(list);
+        }
+        return true;
+    }
+}
+
+ssize_t FileSystem::export_blocks(size_t inumber, int fd) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- sanity check; skipping holes needs a host file that can seek */
+    if(!mounted) return -1;
+    struct stat info;
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) return -1;
+
+    Inode node;
+    Block indirect;
+    if(!load_inode(inumber, &node)) return -1;
+    if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    /**- copy every run of consecutive blocks at once; holes are skipped */
+    uint32_t nblocks = (node.Size + Disk::BLOCK_SIZE - 1) / Disk::BLOCK_SIZE;
+    for(uint32_t slot = 0; slot < nblocks; ) {
+        uint32_t first = get_slot(&node, &indirect, slot);
+        if(!first) {
+            slot++;
+            continue;
+        }
+
+        uint32_t count = 1;
+        while(slot + count < nblocks && get_slot(&node, &indirect, slot + count) == first + count) count++;
+
+        size_t start = (size_t)slot * Disk::BLOCK_SIZE;
+        fs_disk->copy_out(first, min((size_t)count * Disk::BLOCK_SIZE, node.Size - start), fd, start);
+        slot += count;
+    }
+
+    return node.Size;
+}
+
+ssize_t FileSystem::import_blocks(size_t inumber, int fd, size_t offset, size_t length) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- sanity check */
+    if(!mounted) return -1;
+    if(offset % Disk::BLOCK_SIZE || length % Disk::BLOCK_SIZE) return -1;
+    if(length + offset > (POINTERS_PER_BLOCK + POINTERS_PER_INODE) * Disk::BLOCK_SIZE) return -1;
+
+    Inode node;
+    Block indirect;
+    bool indirect_dirty = false;
+
+    /**- if the inode is invalid, allocate inode; it is written back by write_ret() */
+    if(!load_inode(inumber, &node)) {
+        node.Valid = true;
+        node.Size = 0;
+        for(uint32_t ii = 0; ii < POINTERS_PER_INODE; ii++) {
+            node.Direct[ii] = 0;
+        }
+        node.Indirect = 0;
+        inode_counter[inumber / INODES_PER_BLOCK]++;
+        free_blocks[inumber / INODES_PER_BLOCK + 1] = true;
+    }
+    else if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    /**- find or allocate all blocks first; free blocks are handed out in order, so new ones form runs */
+    vector<uint32_t> blocks;
+    for(uint32_t slot = offset / Disk::BLOCK_SIZE; slot < (offset + length) / Disk::BLOCK_SIZE; slot++) {
+        uint32_t blocknum = get_slot(&node, &indirect, slot);
+        if(!blocknum) {
+            if(slot >= POINTERS_PER_INODE && !node.Indirect) {
+                node.Indirect = allocate_block();
+                if(!node.Indirect) break;
+                memset(indirect.Data, 0, Disk::BLOCK_SIZE);
+                indirect_dirty = true;
+            }
+            blocknum = allocate_block();
+            if(!blocknum) break;
+            set_slot(&node, &indirect, &indirect_dirty, slot, blocknum);
+        }
+        blocks.push_back(blocknum);
+    }
+
+    /**- then copy one run at a time */
+    for(size_t i = 0; i < blocks.size(); ) {
+        size_t count = 1;
+        while(i + count < blocks.size() && blocks[i + count] == blocks[i] + count) count++;
+        fs_disk->copy_in(fd, offset + i * Disk::BLOCK_SIZE, blocks[i], count);
+        i += count;
+    }
+
+    /**- size only covers what was stored; write back the indirect block and the inode */
+    size_t stored = blocks.size() * Disk::BLOCK_SIZE;
+    node.Size = max((size_t)node.Size, offset + stored);
+    if(indirect_dirty) fs_disk->write(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    return write_ret(inumber, &node, stored);
+}
+
+void FileSystem::reserve_extent(uint32_t count, vector<uint32_t> *blocks) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- first fit of the whole extent; the blocks below free_hint are in use */
+    uint32_t first = max(MetaData.InodeBlocks + 1, free_hint), run = 0, i;
+    for(i = first; i < MetaData.Blocks && run < count; i++) {
+        run = free_blocks[i] ? 0 : run + 1;
+    }
+
+    if(run == count) {
+        for(uint32_t j = i - count; j < i; j++) {
+            free_blocks[j] = true;
+            discard_pending.erase(j);
+            blocks->push_back(j);
+        }
+        if(i - count == first) free_hint = i;
+        return;
+    }
+
+    /**- otherwise block by block, wherever free blocks are left */
+    while(blocks->size() < count) {
+        uint32_t blocknum = allocate_block();
+        if(!blocknum) break;
+        blocks->push_back(blocknum);
+    }
+}
+
+bool FileSystem::copyin_parallel(const char *path, char name[], unsigned threads) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_PCOPYIN, path, name, 0, 0, threads);
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+
+    /**- Open File for reading */
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        if(fd >= 0) close(fd);
+        return false;
+    }
+    trace.Record.Arg = info.st_size;
+
+    /**- Compressed and deduplicated blocks depend on each other, and holes of sparse files are kept by copyin */
+    if((MetaData.Features & (FEATURE_COMPRESS | FEATURE_DEDUP)) || (off_t)info.st_blocks * 512 < info.st_size) {
+        close(fd);
+        return copyin(path, name);
+    }
+
+    /**- Check if file exists. Else create one */
+    touch(name);
+    int offset = dir_lookup(curr_dir, name);
+    if(offset == -1 || curr_dir.Table[offset].type == 0) {
+        close(fd);
+        return false;
+    }
+    uint32_t inum = curr_dir.Table[offset].inum;
+
+    /**- An existing file is emptied first */
+    DiskUsage before, after;
+    inode_usage(inum, &before);
+    truncate(inum);
+
+    Inode node;
+    Block indirect;
+    bool indirect_dirty = false;
+    if(!load_inode(inum, &node)) {
+        close(fd);
+        return false;
+    }
+
+    /**- Reserve every block up front, then the indirect block */
+    size_t size = info.st_size;
+    uint32_t nblocks = min((size + Disk::BLOCK_SIZE - 1) / Disk::BLOCK_SIZE, (size_t)(POINTERS_PER_INODE + POINTERS_PER_BLOCK));
+    CopyFile file;
+    vector<uint32_t> &blocks = file.blocks;
+    reserve_extent(nblocks, &blocks);
+    if(blocks.size() > POINTERS_PER_INODE) {
+        node.Indirect = allocate_block();
+        if(!node.Indirect) {
+            while(blocks.size() > POINTERS_PER_INODE) {
+                free_block(blocks.back());
+                blocks.pop_back();
+            }
+        }
+        memset(indirect.Data, 0, Disk::BLOCK_SIZE);
+    }
+    for(uint32_t slot = 0; slot < blocks.size(); slot++) {
+        set_slot(&node, &indirect, &indirect_dirty, slot, blocks[slot]);
+    }
+
+    /**- Split the blocks into one range per thread */
+    CopyJob job;
+    job.disk = fs_disk;
+    job.caller = Disk::caller();
+    job.direct = !(MetaData.Features & (FEATURE_ENCRYPT | FEATURE_CHECKSUM));
+    file.path = path;
+    file.fd = fd;
+    file.size = min(size, blocks.size() * Disk::BLOCK_SIZE);
+
+    if(!threads) threads = COPY_THREADS;
+    threads = max(1U, min(threads, (unsigned)(blocks.size() / THREAD_BLOCKS)));
+    vector<thread> workers;
+    for(unsigned t = 0; t < threads; t++) {
+        uint32_t begin = blocks.size() * t / threads, end = blocks.size() * (t + 1) / threads;
+        workers.push_back(thread(copy_range, &job, &file, begin, end));
+    }
+    for(unsigned t = 0; t < threads; t++) workers[t].join();
+    close(fd);
+
+    /**- Commit the indirect block and the inode once; on errors the file is emptied again */
+    node.Size = file.size;
+    if(indirect_dirty) fs_disk->write(node.Indirect, indirect.Data, REGION_INDIRECT);
+    write_ret(inum, &node, 0);
+    if(!job.error.empty()) {
+        fprintf(stderr, "%s\n", job.error.c_str());
+        truncate(inum);
+    }
+    inode_usage(inum, &after);
+    charge(curr_dir.inum, before, after);
+    if(!job.error.empty()) return false;
+
+    /**- Endings */
+    if(file.size != size) {
+        fprintf(stderr, "fs.write only wrote %ld bytes, not %ld bytes\n", (long)file.size, (long)size);
+    }
+    printf("%ld bytes copied\n", (long)file.size);
+    return true;
+}
+
+ssize_t FileSystem::claim_inode(map<uint32_t, Block> *inodes) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- locate free inode in inode table, skipping full inode blocks */
+    for(uint32_t i = 1; i <= MetaData.InodeBlocks; i++) {
+        if(inode_counter[i-1] == INODES_PER_BLOCK) continue;
+
+        /**- read each inode block once */
+        if(!inodes->count(i)) {
+            init_group(i);
+            fs_disk->read(i, (*inodes)[i].Data);
+        }
+        Block &block = (*inodes)[i];
+
+        for(uint32_t j = 0; j < INODES_PER_BLOCK; j++) {
+            if(!block.Inodes[j].Valid) {
+                memset(&block.Inodes[j], 0, sizeof(Inode));
+                block.Inodes[j].Valid = true;
+                free_blocks[i] = true;
+                inode_counter[i-1]++;
+                return ((i-1) * INODES_PER_BLOCK) + j;
+            }
+        }
+    }
+
+    return -1;
+}
+
+ssize_t FileSystem::claim_dir(map<uint32_t, Block> *dirs) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- find a dirblock with room, as mkdir() does */
+    for(uint32_t block_idx = 0; block_idx < MetaData.DirBlocks; block_idx++) {
+        if(dir_counter[block_idx] >= DIR_PER_BLOCK) continue;
+
+        /**- read each dirblock once */
+        uint32_t blocknum = MetaData.Blocks - 1 - block_idx;
+        if(!dirs->count(blocknum)) {
+            init_group(blocknum);
+            fs_disk->read(blocknum, (*dirs)[blocknum].Data);
+        }
+        Block &block = (*dirs)[blocknum];
+
+        for(uint32_t offset = 0; offset < DIR_PER_BLOCK; offset++) {
+            if(block.Directories[offset].Valid == 0) {
+                block.Directories[offset].Valid = 1;
+                dir_counter[block_idx]++;
+                return block_idx * DIR_PER_BLOCK + offset;
+            }
+        }
+    }
+
+    return -1;
+}
+
+bool FileSystem::import(const char *path, char name[]) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_IMPORT, path, name);
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+    if(strlen(name) >= NAMESIZE) {
+        printf("Name too long\n");
+        return false;
+    }
+    if(dir_lookup(curr_dir, name) != -1) {
+        printf("File already exists\n");
+        return false;
+    }
+    Directory parent = add_dir_entry(curr_dir, 0, 0, name);
+    if(parent.Valid == 0) return false;
+
+    /**- List the host tree */
+    vector<ImportDir> dirs;
+    vector<CopyFile> files;
+    if(!scan_tree(path, name, &dirs, &files)) return false;
+
+    /**- Save the counters, so a failed import can be undone */
+    vector<int> saved_inodes = inode_counter;
+    vector<uint32_t> saved_dirs = dir_counter;
+    vector<bool> saved_free = free_blocks;
+
+    /**- Claim every directory and inode in blocks kept in memory */
+    map<uint32_t, Block> dir_blocks, inode_blocks;
+    bool failed = false;
+    for(size_t d = 0; d < dirs.size(); d++) {
+        ssize_t inum = claim_dir(&dir_blocks);
+        if(inum < 0) {
+            printf("Directory limit reached\n");
+            failed = true;
+            break;
+        }
+        dirs[d].inum = inum;
+    }
+    for(size_t f = 0; !failed && f < files.size(); f++) {
+        ssize_t inum = claim_inode(&inode_blocks);
+        if(inum < 0) {
+            printf("Error creating new inode\n");
+            failed = true;
+            break;
+        }
+        files[f].inum = inum;
+    }
+
+    /**- Reserve the blocks of each file as one extent, and write its indirect block; encoded data is written later */
+    bool encoded = MetaData.Features & (FEATURE_COMPRESS | FEATURE_DEDUP);
+    for(size_t f = 0; !failed && f < files.size(); f++) {
+        CopyFile &file = files[f];
+        Inode &node = inode_blocks[file.inum / INODES_PER_BLOCK + 1].Inodes[file.inum % INODES_PER_BLOCK];
+        if(encoded || file.buffered) {
+            file.buffered = true;
+            continue;
+        }
+
+        uint32_t nblocks = (file.size + Disk::BLOCK_SIZE - 1) / Disk::BLOCK_SIZE;
+        if(nblocks > POINTERS_PER_INODE + POINTERS_PER_BLOCK) {
+            fprintf(stderr, "Skipping the end of %s: file too large\n", file.path.c_str());
+            nblocks = POINTERS_PER_INODE + POINTERS_PER_BLOCK;
+            file.size = (size_t)nblocks * Disk::BLOCK_SIZE;
+        }
+        reserve_extent(nblocks, &file.blocks);
+        if(file.blocks.size() > POINTERS_PER_INODE) file.indirect = allocate_block();
+        if(file.blocks.size() < nblocks || (nblocks > POINTERS_PER_INODE && !file.indirect)) {
+            printf("Disk full\n");
+            failed = true;
+            break;
+        }
+
+        Block indirect;
+        bool indirect_dirty = false;
+        memset(indirect.Data, 0, Disk::BLOCK_SIZE);
+        node.Indirect = file.indirect;
+        for(uint32_t slot = 0; slot < nblocks; slot++) {
+            set_slot(&node, &indirect, &indirect_dirty, slot, file.blocks[slot]);
+        }
+        if(indirect_dirty) fs_disk->write(file.indirect, indirect.Data, REGION_INDIRECT);
+        node.Size = file.size;
+    }
+
+    /**- Copy the files, several at once */
+    if(!failed) {
+        CopyJob job;
+        job.disk = fs_disk;
+        job.caller = Disk::caller();
+        job.direct = !(MetaData.Features & (FEATURE_ENCRYPT | FEATURE_CHECKSUM));
+        atomic<size_t> next(0);
+
+        size_t threads = max((size_t)1, min((size_t)COPY_THREADS, files.size()));
+        vector<thread> workers;
+        for(size_t t = 0; t < threads; t++) workers.push_back(thread(copy_files, &job, &files, &next));
+        for(size_t t = 0; t < threads; t++) workers[t].join();
+
+        if(!job.error.empty()) {
+            fprintf(stderr, "%s\n", job.error.c_str());
+            failed = true;
+        }
+    }
+
+    /**- On errors nothing was written but data; put the counters back, and queue the written blocks for discard */
+    if(failed) {
+        inode_counter = saved_inodes;
+        dir_counter = saved_dirs;
+        free_blocks = saved_free;
+        for(size_t f = 0; f < files.size(); f++) {
+            for(size_t b = 0; b < files[f].blocks.size(); b++) free_block(files[f].blocks[b]);
+            if(files[f].indirect) free_block(files[f].indirect);
+        }
+        discard_flush();
+        return false;
+    }
+
+    /**- Write every inode block once */
+    for(map<uint32_t, Block>::iterator it = inode_blocks.begin(); it != inode_blocks.end(); it++) {
+        fs_disk->write(it->first, it->second.Data);
+    }
+
+    /**- Encoded and sparse files are written as copyin writes them */
+    size_t bytes = 0;
+    vector<DiskUsage> usage(files.size());
+    for(size_t f = 0; f < files.size(); f++) {
+        if(files[f].buffered) {
+            int fd = open(files[f].path.c_str(), O_RDONLY);
+            if(fd < 0 || !copyin_file(fd, files[f].inum, files[f].size)) {
+                fprintf(stderr, "Unable to copy %s\n", files[f].path.c_str());
+                failed = true;
+            }
+            if(fd >= 0) close(fd);
+            if(failed) break;
+            inode_usage(files[f].inum, &usage[f]);
+        }
+        else {
+            usage[f].Bytes = files[f].size;
+            usage[f].Blocks = files[f].blocks.size() + (files[f].indirect ? 1 : 0);
+        }
+        bytes += usage[f].Bytes;
+    }
+
+    /**- The tree is not linked in yet; on errors remove every file, and give the directories back */
+    if(failed) {
+        for(size_t f = 0; f < files.size(); f++) remove(files[f].inum);
+        dir_counter = saved_dirs;
+        return false;
+    }
+
+    /**- Fill in the directories and write every dirblock once */
+    for(size_t d = 0; d < dirs.size(); d++) {
+        Directory &dir = dir_blocks[MetaData.Blocks - 1 - dirs[d].inum / DIR_PER_BLOCK].Directories[dirs[d].inum % DIR_PER_BLOCK];
+        memset(&dir, 0, sizeof(Directory));
+        dir.inum = dirs[d].inum;
+        dir.Valid = 1;
+        strcpy(dir.Name, dirs[d].name.c_str());
+
+        char entry[NAMESIZE], dot[] = ".", dotdot[] = "..";
+        dir = add_dir_entry(dir, dir.inum, 0, dot);
+        dir = add_dir_entry(dir, d ? dirs[dirs[d].parent].inum : curr_dir.inum, 0, dotdot);
+        for(size_t e = 0; e < dirs[d].entries.size(); e++) {
+            const ImportEntry &child = dirs[d].entries[e];
+            strcpy(entry, child.name.c_str());
+            dir = add_dir_entry(dir, child.dir ? dirs[child.index].inum : files[child.index].inum, child.dir ? 0 : 1, entry);
+        }
+    }
+
+    /**- Charge every file to the directories above it, the curr_dir and its parents included */
+    for(size_t d = 0; d < dirs.size(); d++) {
+        for(size_t e = 0; e < dirs[d].entries.size(); e++) {
+            const ImportEntry &child = dirs[d].entries[e];
+            if(child.dir) continue;
+            charge_dirs(&dir_blocks, dirs[d].inum, usage[child.index].Bytes, usage[child.index].Blocks);
+        }
+    }
+    for(map<uint32_t, Block>::iterator it = dir_blocks.begin(); it != dir_blocks.end(); it++) {
+        fs_disk->write(it->first, it->second.Data);
+    }
+
+    /**- Finally link the tree into the curr_dir */
+    curr_dir = add_dir_entry(curr_dir, dirs[0].inum, 0, name);
+    write_dir_back(curr_dir);
+
+    printf("%lu directories and %lu files imported, %lu bytes\n", dirs.size(), files.size(), bytes);
+    return true;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file fs_crypt.cpp
+ * @brief Implementation of fs.h encryption functions
+ * @date 2026-10-18
+ *
+ * @details Disks formatted with FEATURE_ENCRYPT store every block except the
+ * superblock AES-128-XTS encrypted (see Disk::set_key()). The disk key is
+ * random and chosen at format time. The superblock keeps it wrapped with a
+ * key derived from the password by PBKDF2-HMAC-SHA256, so changing the
+ * password rewrites the superblock only.
+ */
+
+#include "sfs/fs.h"
+#include "sfs/aes.h"
+#include "sfs/sha256.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+    /**- HMAC-SHA256 with the key already absorbed into inner and outer */
+    void hmac(const SHA256 &inner, const SHA256 &outer, const uint8_t *data, size_t length, uint8_t out[SHA256::HashBytes]) {
+        SHA256 in = inner, out_hasher = outer;
+        in.add(data, length);
+        in.getHash(out);
+        out_hasher.add(out, SHA256::HashBytes);
+        out_hasher.getHash(out);
+    }
+
+    /**- PBKDF2-HMAC-SHA256 with one output block, i.e. 32 bytes */
+    void pbkdf2(const char *pass, const uint8_t *salt, size_t salt_length, uint32_t rounds, uint8_t key[SHA256::HashBytes]) {
+        uint8_t block[SHA256::BlockSize] = {0}, pad[SHA256::BlockSize];
+        size_t length = strlen(pass);
+
+        /**- long passwords are hashed first */
+        if(length > SHA256::BlockSize) {
+            SHA256 hasher;
+            hasher.add(pass, length);
+            hasher.getHash(block);
+        }
+        else memcpy(block, pass, length);
+
+        SHA256 inner, outer;
+        for(size_t i = 0; i < SHA256::BlockSize; i++) pad[i] = block[i] ^ 0x36;
+        inner.add(pad, SHA256::BlockSize);
+        for(size_t i = 0; i < SHA256::BlockSize; i++) pad[i] = block[i] ^ 0x5c;
+        outer.add(pad, SHA256::BlockSize);
+
+        /**- U1 = HMAC(salt || 1), Ui = HMAC(Ui-1), key = U1 ^ ... ^ Un */
+        uint8_t u[SHA256::HashBytes], first[64];
+        memcpy(first, salt, salt_length);
+        memcpy(first + salt_length, "\0\0\0\1", 4);
+        hmac(inner, outer, first, salt_length + 4, u);
+        memcpy(key, u, SHA256::HashBytes);
+
+        for(uint32_t r = 1; r < rounds; r++) {
+            hmac(inner, outer, u, SHA256::HashBytes, u);
+            for(size_t i = 0; i < SHA256::HashBytes; i++) key[i] ^= u[i];
+        }
+    }
+
+    bool random_bytes(uint8_t *data, size_t length) {
+        FILE *stream = fopen("/dev/urandom", "r");
+        if(stream == nullptr) return false;
+        bool ok = fread(data, 1, length, stream) == length;
+        fclose(stream);
+        return ok;
+    }
+
+    void key_check(const uint8_t *key, uint8_t *check, size_t length) {
+        uint8_t hash[SHA256::HashBytes];
+        SHA256 hasher;
+        hasher.add(key, XTS::KEY_SIZE);
+        hasher.getHash(hash);
+        memcpy(check, hash, length);
+    }
+}
+
+bool FileSystem::read_password(const char *prompt, char *pass) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char line[1000];
+    printf("%s", prompt);
+    if (fgets(line, sizeof(line), stdin) == NULL) return false;
+
+    pass[0] = 0;
+    sscanf(line, "%s", pass);
+    return true;
+}
+
+bool FileSystem::create_key(SuperBlock *super, const char *pass, uint8_t *key) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!random_bytes(key, XTS::KEY_SIZE)) return false;
+    return wrap_key(super, pass, key);
+}
+
+bool FileSystem::wrap_key(SuperBlock *super, const char *pass, const uint8_t *key) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- derive the key encryption key from the password and a fresh salt */
+    uint8_t kek[XTS::KEY_SIZE];
+    if(!random_bytes(super->KeySalt, sizeof(super->KeySalt))) return false;
+    super->KdfRounds = KDF_ROUNDS;
+    pbkdf2(pass, super->KeySalt, sizeof(super->KeySalt), super->KdfRounds, kek);
+
+    /**- encrypt the disk key with it and remember how to recognise the disk key */
+    XTS wrapper(kek);
+    wrapper.encrypt(0, (const char *)key, (char *)super->WrappedKey, XTS::KEY_SIZE);
+    key_check(key, super->KeyCheck, sizeof(super->KeyCheck));
+
+    memset(kek, 0, sizeof(kek));
+    return true;
+}
+
+bool FileSystem::unwrap_key(const SuperBlock *super, const char *pass, uint8_t *key) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint8_t kek[XTS::KEY_SIZE], check[sizeof(super->KeyCheck)];
+    pbkdf2(pass, super->KeySalt, sizeof(super->KeySalt), super->KdfRounds, kek);
+
+    XTS wrapper(kek);
+    wrapper.decrypt(0, (const char *)super->WrappedKey, (char *)key, XTS::KEY_SIZE);
+    memset(kek, 0, sizeof(kek));
+
+    /**- a wrong password yields a different key */
+    key_check(key, check, sizeof(check));
+    return memcmp(check, super->KeyCheck, sizeof(check)) == 0;
+}
+
+bool FileSystem::change_key() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    char pass[1000];
+    uint8_t key[XTS::KEY_SIZE];
+    Block block;
+
+    /**- the current password must unwrap the disk key */
+    if(!read_password("Enter current password: ", pass)) return false;
+    if(!unwrap_key(&MetaData, pass, key)) {
+        printf("Old password incorrect.\n");
+        return false;
+    }
+
+    /**- wrap the same key with the new password */
+    if(!read_password("Enter new password: ", pass)) return false;
+    bool ok = wrap_key(&MetaData, pass, key);
+    memset(key, 0, sizeof(key));
+    if(!ok) return false;
+
+    memset(&block, 0, sizeof(block));
+    block.Super = MetaData;
+    fs_disk->write(0, block.Data);
+    printf("New password set.\n");
+    return true;
+}
@@ -0,0 +1,327 @@
+/**
+ * @file fs_dedup.cpp
+ * @brief Implementation of fs.h deduplication functions
+ * @date 2026-10-18
+ *
+ * @details Used instead of write() when the disk is formatted with FEATURE_DEDUP.
+ * Every data block written is fingerprinted with SHA256. The fingerprint index
+ * is a hash table of DedupBlocks blocks placed right after the inode blocks;
+ * a fingerprint lives in the block chosen by its first word, or in one of the
+ * following blocks when that one is full.
+ * Reference counts are stored next to the fingerprints and cached in memory
+ * together with a Bloom filter, so a block that is seen for the first time
+ * is recognised without reading the index.
+ */
+
+#include "sfs/fs.h"
+#include "sfs/sha256.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+namespace {
+    const uint32_t FILTER_BITS_PER_BLOCK = 16;     /** Bloom filter size per data block */
+    const uint32_t FILTER_HASHES         = 3;      /** Bloom filter probes per fingerprint */
+
+    uint32_t hash_word(const uint8_t *hash, uint32_t index) {
+        uint32_t word;
+        memcpy(&word, hash + index * sizeof(word), sizeof(word));
+        return word;
+    }
+}
+
+void FileSystem::dedup_mount() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    memset(&dedup, 0, sizeof(dedup));
+    dedup_cache.clear();
+    dedup_dirty.clear();
+    dedup_refs.assign(MetaData.Blocks, 0);
+    dedup_bucket.assign(MetaData.Blocks, 0);
+    dedup_spill.assign(MetaData.DedupBlocks, false);
+
+    /**- size the pre-filter as a power of two for the data blocks */
+    size_t bits = 64;
+    while(bits < (size_t)MetaData.Blocks * FILTER_BITS_PER_BLOCK) bits <<= 1;
+    dedup_filter.assign(bits / 64, 0);
+
+    /**- read the index once: reserve its blocks, load reference counts and fill the filter */
+    Block block;
+    for(uint32_t bucket = 0; bucket < MetaData.DedupBlocks; bucket++) {
+        free_blocks[MetaData.InodeBlocks + 1 + bucket] = true;
+        fs_disk->read(MetaData.InodeBlocks + 1 + bucket, block.Data);
+
+        for(uint32_t i = 0; i < FINGERPRINTS_PER_BLOCK; i++) {
+            Fingerprint &entry = block.Fingerprints[i];
+            if(!entry.Refs || entry.Block >= MetaData.Blocks) continue;
+
+            dedup_refs[entry.Block] = entry.Refs;
+            dedup_bucket[entry.Block] = bucket;
+            for(uint32_t h = 1; h <= FILTER_HASHES; h++) {
+                size_t bit = hash_word(entry.Hash, h) & (bits - 1);
+                dedup_filter[bit / 64] |= (1ULL << (bit % 64));
+            }
+
+            /**- every block between the home block and this one has overflowed */
+            for(uint32_t b = hash_word(entry.Hash, 0) % MetaData.DedupBlocks; b != bucket; b = (b + 1) % MetaData.DedupBlocks) {
+                dedup_spill[b] = true;
+            }
+        }
+    }
+}
+
+FileSystem::Block* FileSystem::dedup_index_block(uint32_t bucket) {
+    map<uint32_t, Block>::iterator it = dedup_cache.find(bucket);
+    if(it != dedup_cache.end()) {
+        dedup.IndexHits++;
+        return &it->second;
+    }
+
+    dedup.IndexMisses++;
+    Block *block = &dedup_cache[bucket];
+    fs_disk->read(MetaData.InodeBlocks + 1 + bucket, block->Data);
+    return block;
+}
+
+void FileSystem::dedup_flush() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("dedup_flush", "step");
+
+    /**- each changed index block is written once per operation */
+    for(set<uint32_t>::iterator it = dedup_dirty.begin(); it != dedup_dirty.end(); it++) {
+        fs_disk->write(MetaData.InodeBlocks + 1 + *it, dedup_cache[*it].Data);
+    }
+    dedup_dirty.clear();
+    dedup_cache.clear();
+}
+
+uint32_t FileSystem::dedup_lookup(const uint8_t *hash) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- pre-filter: a clear bit proves the content was never indexed */
+    size_t bits = dedup_filter.size() * 64;
+    for(uint32_t h = 1; h <= FILTER_HASHES; h++) {
+        size_t bit = hash_word(hash, h) & (bits - 1);
+        if(!(dedup_filter[bit / 64] & (1ULL << (bit % 64)))) {
+            dedup.FilterSkips++;
+            return 0;
+        }
+    }
+
+    /**- probe the home block and the blocks it overflowed into */
+    uint32_t bucket = hash_word(hash, 0) % MetaData.DedupBlocks;
+    for(uint32_t n = 0; n < MetaData.DedupBlocks; n++) {
+        Block *block = dedup_index_block(bucket);
+        dedup.Probes++;
+
+        for(uint32_t i = 0; i < FINGERPRINTS_PER_BLOCK; i++) {
+            Fingerprint &entry = block->Fingerprints[i];
+            if(entry.Refs && !memcmp(entry.Hash, hash, sizeof(entry.Hash))) return entry.Block;
+        }
+
+        if(!dedup_spill[bucket]) break;
+        bucket = (bucket + 1) % MetaData.DedupBlocks;
+    }
+
+    return 0;
+}
+
+void FileSystem::dedup_insert(const uint8_t *hash, uint32_t blocknum) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint32_t bucket = hash_word(hash, 0) % MetaData.DedupBlocks;
+    for(uint32_t n = 0; n < MetaData.DedupBlocks; n++) {
+        Block *block = dedup_index_block(bucket);
+
+        /**- take the first free entry */
+        for(uint32_t i = 0; i < FINGERPRINTS_PER_BLOCK; i++) {
+            Fingerprint &entry = block->Fingerprints[i];
+            if(entry.Refs) continue;
+
+            memcpy(entry.Hash, hash, sizeof(entry.Hash));
+            entry.Block = blocknum;
+            entry.Refs = 1;
+            dedup_dirty.insert(bucket);
+            dedup_refs[blocknum] = 1;
+            dedup_bucket[blocknum] = bucket;
+
+            size_t bits = dedup_filter.size() * 64;
+            for(uint32_t h = 1; h <= FILTER_HASHES; h++) {
+                size_t bit = hash_word(hash, h) & (bits - 1);
+                dedup_filter[bit / 64] |= (1ULL << (bit % 64));
+            }
+            return;
+        }
+
+        /**- block is full; lookups have to continue past it from now on */
+        dedup_spill[bucket] = true;
+        bucket = (bucket + 1) % MetaData.DedupBlocks;
+    }
+}
+
+void FileSystem::dedup_adjust(uint32_t blocknum, int delta) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint32_t bucket = dedup_bucket[blocknum];
+    Block *block = dedup_index_block(bucket);
+
+    for(uint32_t i = 0; i < FINGERPRINTS_PER_BLOCK; i++) {
+        Fingerprint &entry = block->Fingerprints[i];
+        if(!entry.Refs || entry.Block != blocknum) continue;
+
+        entry.Refs += delta;
+        dedup_refs[blocknum] = entry.Refs;
+        dedup_dirty.insert(bucket);
+
+        /**- last reference gone: drop the entry and free the block */
+        if(!entry.Refs) {
+            memset(&entry, 0, sizeof(entry));
+            free_block(blocknum);
+        }
+        return;
+    }
+}
+
+bool FileSystem::dedup_store(Inode *node, Block *indirect, bool *indirect_dirty, uint32_t slot, char *data, const uint8_t *hash) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- allocate the indirect block on first use */
+    if(slot >= POINTERS_PER_INODE && !node->Indirect) {
+        uint32_t blocknum = allocate_block();
+        if(!blocknum) return false;
+        node->Indirect = blocknum;
+        memset(indirect->Data, 0, Disk::BLOCK_SIZE);
+        *indirect_dirty = true;
+    }
+
+    uint32_t old = get_slot(node, indirect, slot);
+    dedup.Blocks++;
+
+    /**- identical content exists: point at it instead of writing */
+    uint32_t shared = dedup_lookup(hash);
+    if(shared) {
+        if(shared != old) {
+            dedup_adjust(shared, 1);
+            release_block(old);
+            set_slot(node, indirect, indirect_dirty, slot, shared);
+        }
+        dedup.Duplicates++;
+        return true;
+    }
+
+    /**- new content: overwrite a private block in place, otherwise copy on write */
+    uint32_t blocknum = old;
+    if(!old || dedup_refs[old] > 1) {
+        blocknum = allocate_block();
+        if(!blocknum) return false;
+    }
+    else if(dedup_refs[old] == 1) {
+        /**- the old content of the block leaves the index; take the block back before discard punches it */
+        dedup_adjust(old, -1);
+        free_blocks[old] = true;
+        discard_pending.erase(old);
+    }
+
+    fs_disk->write(blocknum, data);
+    dedup_insert(hash, blocknum);
+
+    if(blocknum != old) {
+        release_block(old);
+        set_slot(node, indirect, indirect_dirty, slot, blocknum);
+    }
+    return true;
+}
+
+ssize_t FileSystem::write_dedup(size_t inumber, char *data, int length, size_t offset) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- sanity check */
+    if(!mounted) return -1;
+    if(length + offset > (POINTERS_PER_BLOCK + POINTERS_PER_INODE) * Disk::BLOCK_SIZE) return -1;
+
+    Inode node;
+    Block indirect;
+    bool indirect_dirty = false;
+
+    /**- if the inode is invalid, allocate inode; it is written back by write_ret() */
+    if(!load_inode(inumber, &node)) {
+        node.Valid = true;
+        node.Size = 0;
+        for(uint32_t ii = 0; ii < POINTERS_PER_INODE; ii++) {
+            node.Direct[ii] = 0;
+        }
+        node.Indirect = 0;
+        inode_counter[inumber / INODES_PER_BLOCK]++;
+        free_blocks[inumber / INODES_PER_BLOCK + 1] = true;
+    }
+    else if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    if(length <= 0) return write_ret(inumber, &node, 0);
+
+    /**- blocks between the old end and offset are left as holes */
+    size_t end = offset + length;
+    uint32_t first = offset / Disk::BLOCK_SIZE;
+    uint32_t last = (end - 1) / Disk::BLOCK_SIZE;
+    size_t stored = offset;
+
+    char buffers[DEDUP_BATCH][Disk::BLOCK_SIZE];
+    uint8_t hashes[DEDUP_BATCH][SHA256::HashBytes];
+    bool full = false;
+
+    for(uint32_t base = first; base <= last && !full; base += DEDUP_BATCH) {
+        uint32_t count = min((uint32_t)DEDUP_BATCH, last - base + 1);
+
+        /**- assemble the new content of a batch of blocks; partial writes keep the rest of an existing block */
+        for(uint32_t i = 0; i < count; i++) {
+            size_t start = (size_t)(base + i) * Disk::BLOCK_SIZE;
+            size_t from = max(offset, start) - start;
+            size_t to = min(end, start + Disk::BLOCK_SIZE) - start;
+            uint32_t old = get_slot(&node, &indirect, base + i);
+
+            if((from > 0 || to < Disk::BLOCK_SIZE) && old) fs_disk->read(old, buffers[i]);
+            else memset(buffers[i], 0, Disk::BLOCK_SIZE);
+            memcpy(buffers[i] + from, data + (start + from - offset), to - from);
+        }
+
+        /**- fingerprint the batch in one call so the blocks are hashed side by side */
+        const void *pending[DEDUP_BATCH];
+        for(uint32_t i = 0; i < count; i++) {
+            pending[i] = buffers[i];
+        }
+        SHA256::hashMany(pending, Disk::BLOCK_SIZE, count, hashes);
+
+        /**- store the blocks; on a full disk the size only covers what was stored */
+        for(uint32_t i = 0; i < count; i++) {
+            if(!dedup_store(&node, &indirect, &indirect_dirty, base + i, buffers[i], hashes[i])) {
+                full = true;
+                break;
+            }
+            stored = min(end, (size_t)(base + i + 1) * Disk::BLOCK_SIZE);
+        }
+    }
+
+    /**- write back the index, the indirect block and the inode */
+    int written = stored > offset ? stored - offset : 0;
+    node.Size = max((size_t)node.Size, stored);
+    dedup_flush();
+    if(indirect_dirty) fs_disk->write(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    return write_ret(inumber, &node, written);
+}
@@ -11,6 +11,7 @@
  */
 
 #include "sfs/fs.h"
+#include "sfs/aes.h"
 #include "sfs/sha256.h"
 
 #include <algorithm>
@@ -48,10 +49,23 @@ void FileSystem::debug(Disk *disk) {
     printf("    %u inode blocks\n"   , block.Super.InodeBlocks);
     printf("    %u inodes\n"         , block.Super.Inodes);
 
+    /**- the other blocks cannot be read before mount() set the key */
+    if((block.Super.Features & FEATURE_ENCRYPT) && !disk->encrypted()) {
+        printf("    blocks are encrypted, mount to inspect them\n");
+        return;
+    }
+
     /**- reading the inode blocks */
     int ii = 0;
 
-    for(uint32_t i = 1; i <= block.Super.InodeBlocks; i++) {
+    /**- keep the superblock, block is reused for the inode blocks */
+    SuperBlock super = block.Super;
+    for(uint32_t i = 1; i <= super.InodeBlocks; i++) {
+        /**- uninitialized inode blocks of lazy disks hold no inodes */
+        if(uninitialized(super, i)) {
+            ii += INODES_PER_BLOCK;
+            continue;
+        }
         disk->read(i, block.Data); /**-  array of inodes */
         for(uint32_t j = 0; j < INODES_PER_BLOCK; j++) {
             /**- iterating through INODES_PER_BLOCK inodes */
@@ -70,7 +84,7 @@ void FileSystem::debug(Disk *disk) {
                 if(block.Inodes[j].Indirect){
                     printf("    indirect block: %u\n    indirect data blocks:",block.Inodes[j].Indirect);
                     Block IndirectBlock;
-                    disk->read(block.Inodes[j].Indirect,IndirectBlock.Data);
+                    disk->read(block.Inodes[j].Indirect,IndirectBlock.Data, REGION_INDIRECT);
                     for(uint32_t k = 0; k < POINTERS_PER_BLOCK; k++) {
                         if(IndirectBlock.Pointers[k]) printf(" %u", IndirectBlock.Pointers[k]);
                     }
@@ -85,7 +99,7 @@ void FileSystem::debug(Disk *disk) {
     return;
 }
 
-bool FileSystem::format(Disk *disk) {
+bool FileSystem::format(Disk *disk, uint32_t features) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
@@ -101,55 +115,56 @@ bool FileSystem::format(Disk *disk) {
     block.Super.InodeBlocks = (uint32_t)std::ceil((int(block.Super.Blocks) * 1.00)/10);
     block.Super.Inodes = block.Super.InodeBlocks * (FileSystem::INODES_PER_BLOCK);
     block.Super.DirBlocks = (uint32_t)std::ceil((int(block.Super.Blocks) * 1.00)/100);
+    block.Super.Features = features | FEATURE_USAGE;
+
+    /**- compression and deduplication cannot be combined */
+    if((features & FEATURE_COMPRESS) && (features & FEATURE_DEDUP)) return false;
+
+    /**- reserve the fingerprint index right after the inode blocks */
+    if(features & FEATURE_DEDUP)
+        block.Super.DedupBlocks = (uint32_t)std::ceil((int(block.Super.Blocks) * 1.00)/DEDUP_RATIO);
+
+    /**- the checksum table follows the fingerprint index */
+    if(features & FEATURE_CHECKSUM)
+        block.Super.ChecksumBlocks = (block.Super.Blocks + CHECKSUMS_PER_BLOCK - 1) / CHECKSUMS_PER_BLOCK;
+
+    /**- encrypted disks get a random key, wrapped with the password; the blocks below are written encrypted */
+    uint8_t key[XTS::KEY_SIZE];
+    if(features & FEATURE_ENCRYPT) {
+        char pass[1000];
+        if(!read_password("Enter new password: ", pass)) return false;
+        if(!create_key(&block.Super, pass, key)) return false;
+        block.Super.Protected = 1;
+    }
+
+    /**- lazy disks start as a sparse image with the inode and directory groups flagged uninitialized */
+    if(features & FEATURE_LAZY) {
+        disk->clear();
+        lazy_groups(&block.Super);
+    }
 
+    disk->set_layout(block.Super.InodeBlocks, block.Super.DedupBlocks, block.Super.ChecksumBlocks, block.Super.DirBlocks);
     disk->write(0,block.Data);
+    disk->set_key((features & FEATURE_ENCRYPT) ? key : NULL);
+    memset(key, 0, sizeof(key));
+    disk->set_checksums(block.Super.InodeBlocks + 1 + block.Super.DedupBlocks, block.Super.ChecksumBlocks, true);
     
     /**- Reinitialising password protection */
     block.Super.Protected = 0;
     memset(block.Super.PasswordHash,0,257);
 
-    /**- clear all other blocks */
-    for(uint32_t i = 1; i <= block.Super.InodeBlocks; i++){
-        Block inodeblock;
-
-        /**- clear individual Inodes */
-        for(uint32_t j = 0; j < FileSystem::INODES_PER_BLOCK; j++){
-            inodeblock.Inodes[j].Valid = false;
-            inodeblock.Inodes[j].Size = 0;
-
-            /**- clear all direct Pointers */
-            for(uint32_t k = 0; k < FileSystem::POINTERS_PER_INODE; k++)   
-                inodeblock.Inodes[j].Direct[k] = 0;
-    
-            /**- clear indirect Pointer */
-            inodeblock.Inodes[j].Indirect = 0;
-        }
-
-        disk->write(i,inodeblock.Data);
-    }
-
-     /**- Free Data Blocks */
-    for(uint32_t i = (block.Super.InodeBlocks) + 1; i < block.Super.Blocks - block.Super.DirBlocks; i++){
-        Block DataBlock;
-        memset(DataBlock.Data, 0, Disk::BLOCK_SIZE);
-        disk->write(i, DataBlock.Data);
-    }
-
-    /**- Free Directory Blocks */
-    for(uint32_t i = block.Super.Blocks - block.Super.DirBlocks; i < block.Super.Blocks; i++){
-        Block DataBlock;
-        Directory dir;
-        dir.inum = -1;
-        dir.Valid = 0;
-        memset(dir.Table,0,sizeof(Dirent)*ENTRIES_PER_DIR);
-        for(uint32_t j=0; j<FileSystem::DIR_PER_BLOCK; j++){
-            DataBlock.Directories[j] = dir;
-        }
-        disk->write(i, DataBlock.Data);
+    /**- clear all other blocks; lazy disks only need the fingerprint index and the group of the root directory */
+    if(features & FEATURE_LAZY) {
+        uint32_t from, to;
+        lazy_group(block.Super, block.Super.Blocks - 1, &from, &to);
+        clear_blocks(disk, block.Super, block.Super.InodeBlocks + 1, block.Super.InodeBlocks + 1 + block.Super.DedupBlocks);
+        clear_blocks(disk, block.Super, from, to);
     }
+    else clear_blocks(disk, block.Super, 1, block.Super.Blocks);
 
     /**-  Create Root directory */
     struct Directory root;
+    memset(&root, 0, sizeof(root));
     strcpy(root.Name,"/");
     root.inum = 0;
     root.Valid = 1;
@@ -167,11 +182,16 @@ bool FileSystem::format(Disk *disk) {
     strcpy(temp.Name,tstr2);
     memcpy(&(root.Table[1]),&temp,sizeof(Dirent));
 
-    /**-  Empty the directories */
+    /**-  Empty the directories, and their usage */
     Block Dirblock;
+    memset(&Dirblock, 0, sizeof(Block));
     memcpy(&(Dirblock.Directories[0]),&root,sizeof(root));
     disk->write(block.Super.Blocks -1, Dirblock.Data);
 
+    /**- write the checksum table; checksums and the key are set again by mount() */
+    disk->set_checksums(0, 0, false);
+    disk->set_key(NULL);
+
     return true;
 }
 
@@ -191,18 +211,18 @@ bool FileSystem::mount(Disk *disk) {
     if(block.Super.Inodes != (block.Super.InodeBlocks * INODES_PER_BLOCK)) return false;
     if(block.Super.DirBlocks != (uint32_t)std::ceil((int(block.Super.Blocks) * 1.00)/100)) return false;
 
-    /**- Handle Password Protection */
+    /**- Handle Password Protection; encrypted disks check it by unwrapping the disk key */
+    uint8_t key[XTS::KEY_SIZE];
     if(block.Super.Protected){
-        char pass[1000], line[1000];
-    	printf("Enter password: ");
-        if (fgets(line, BUFSIZ, stdin) == NULL) {
+        char pass[1000];
+        if(!read_password("Enter password: ", pass)) {
     	    return false;
     	}
-        sscanf(line, "%s", pass);
         SHA256 hasher;
-        if(hasher(pass) == string(block.Super.PasswordHash)){
+        bool unlocked = (block.Super.Features & FEATURE_ENCRYPT) ?
+            unwrap_key(&block.Super, pass, key) : hasher(pass) == string(block.Super.PasswordHash);
+        if(unlocked){
             printf("Disk Unlocked\n");
-            return true;
         }
         else{
             printf("Password Failed. Exiting...\n");
@@ -212,21 +232,52 @@ bool FileSystem::mount(Disk *disk) {
 
     disk->mount();
     fs_disk = disk;
+    if(block.Super.Features & FEATURE_ENCRYPT) {
+        disk->set_key(key);
+        memset(key, 0, sizeof(key));
+    }
+    if(block.Super.Features & FEATURE_CHECKSUM) {
+        disk->set_checksums(block.Super.InodeBlocks + 1 + block.Super.DedupBlocks, block.Super.ChecksumBlocks, false);
+
+        /**- the table is only written back by exit(); after a crash it is rebuilt from the blocks as they are */
+        if(block.Super.Dirty) {
+            printf("Disk was not unmounted cleanly, rebuilding checksums\n");
+            disk->rebuild_checksums();
+        }
+    }
 
     /**- copy metadata */
     MetaData = block.Super;
+    disk->set_layout(MetaData.InodeBlocks, MetaData.DedupBlocks, MetaData.ChecksumBlocks, MetaData.DirBlocks);
+    memset(&compression, 0, sizeof(compression));
+    for(uint32_t i = 0; i < TRACE_OPS; i++) op_latency[i] = Histogram();
 
     /**- allocate free block bitmap */ 
-    free_blocks.resize(MetaData.Blocks, false);
+    free_blocks.assign(MetaData.Blocks, false);
+    free_hint = 0;
 
     /**- allocate inode counter */
-    inode_counter.resize(MetaData.InodeBlocks, 0);
+    inode_counter.assign(MetaData.InodeBlocks, 0);
 
     /**- setting free bit map node 0 to true for superblock */
     free_blocks[0] = true;
 
-    /**- read inode blocks */
+    /**- reserve and load the fingerprint index */
+    if(MetaData.Features & FEATURE_DEDUP) dedup_mount();
+
+    /**- reserve the checksum table */
+    for(uint32_t i = 0; i < MetaData.ChecksumBlocks; i++) {
+        free_blocks[MetaData.InodeBlocks + 1 + MetaData.DedupBlocks + i] = true;
+    }
+
+    /**- reserve the directory blocks, which may not be written yet on lazy disks */
+    for(uint32_t i = 0; i < MetaData.DirBlocks; i++) {
+        free_blocks[MetaData.Blocks - 1 - i] = true;
+    }
+
+    /**- read inode blocks; uninitialized ones are empty */
     for(uint32_t i = 1; i <= MetaData.InodeBlocks; i++) {
+        if(uninitialized(MetaData, i)) continue;
         disk->read(i, block.Data);
 
         for(uint32_t j = 0; j < INODES_PER_BLOCK; j++) {
@@ -251,7 +302,7 @@ bool FileSystem::mount(Disk *disk) {
                     if(block.Inodes[j].Indirect < MetaData.Blocks) {
                         free_blocks[block.Inodes[j].Indirect] = true;
                         Block indirect;
-                        fs_disk->read(block.Inodes[j].Indirect, indirect.Data);
+                        fs_disk->read(block.Inodes[j].Indirect, indirect.Data, REGION_INDIRECT);
                         for(uint32_t k = 0; k < POINTERS_PER_BLOCK; k++) {
                             if(indirect.Pointers[k] < MetaData.Blocks) {
                                 free_blocks[indirect.Pointers[k]] = true;
@@ -267,10 +318,11 @@ bool FileSystem::mount(Disk *disk) {
     }
 
     /**- Allocate dir_counter */
-    dir_counter.resize(MetaData.DirBlocks,0);
+    dir_counter.assign(MetaData.DirBlocks,0);
 
     Block dirblock;
     for(uint32_t dirs = 0; dirs < MetaData.DirBlocks; dirs++){
+        if(uninitialized(MetaData, MetaData.Blocks-1-dirs)) continue;
         disk->read(MetaData.Blocks-1-dirs, dirblock.Data);
         for(uint32_t offset = 0; offset < FileSystem::DIR_PER_BLOCK; offset++){
             if(dirblock.Directories[offset].Valid == 1){
@@ -282,17 +334,37 @@ bool FileSystem::mount(Disk *disk) {
         }
     }
 
+    /**- mark the table stale on disk until exit() writes it back */
+    if(MetaData.Features & FEATURE_CHECKSUM) {
+        MetaData.Dirty = 1;
+        memset(&block, 0, sizeof(Block));
+        block.Super = MetaData;
+        disk->write(0, block.Data);
+    }
+
     mounted = true;
 
     return true;
 }
 
+bool FileSystem::protected_disk(Disk *disk) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Block block;
+    disk->read(0, block.Data);
+    return block.Super.MagicNumber == MAGIC_NUMBER && block.Super.Protected;
+}
+
 
 ssize_t FileSystem::create() {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_CREATE, NULL, NULL, (uint64_t)-1);
+
     /**- sanity check */
     if(!mounted) return false;
 
@@ -304,7 +376,8 @@ ssize_t FileSystem::create() {
     for(uint32_t i = 1; i <= MetaData.InodeBlocks; i++) {
         /**- check if inode block is full */
         if(inode_counter[i-1] == INODES_PER_BLOCK) continue;
-        else fs_disk->read(i, block.Data);
+        init_group(i);
+        fs_disk->read(i, block.Data);
         
         /**- find the first empty inode */
         for(uint32_t j = 0; j < INODES_PER_BLOCK; j++) {
@@ -321,6 +394,7 @@ ssize_t FileSystem::create() {
 
                 fs_disk->write(i, block.Data);
 
+                trace.Record.Arg = ((i-1) * INODES_PER_BLOCK) + j;
                 return (((i-1) * INODES_PER_BLOCK) + j);
             }
         }
@@ -334,10 +408,11 @@ bool FileSystem::load_inode(size_t inumber, Inode *node) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN("load_inode", "step");
 
     /**- sanity check */
     if(!mounted) return false;
-    if((inumber > MetaData.Inodes) || (inumber < 1)){return false;}
+    if(inumber >= MetaData.Inodes){return false;}
 
     Block block;
 
@@ -363,6 +438,8 @@ bool FileSystem::remove(size_t inumber) {
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_REMOVE, NULL, NULL, inumber);
+
     /**- sanity check */
     if(!mounted) return false;
 
@@ -379,29 +456,20 @@ bool FileSystem::remove(size_t inumber) {
             free_blocks[inumber / INODES_PER_BLOCK + 1] = false;
         }
 
-        /**- free direct blocks */
-        for(uint32_t i = 0; i < POINTERS_PER_INODE; i++) {
-            free_blocks[node.Direct[i]] = false;
-            node.Direct[i] = 0;
-        }
-
-        /**- free indirect blocks */
-        if(node.Indirect) {
-            Block indirect;
-            fs_disk->read(node.Indirect, indirect.Data);
-            free_blocks[node.Indirect] = false;
-            node.Indirect = 0;
-
-            for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
-                if(indirect.Pointers[i]) free_blocks[indirect.Pointers[i]] = false;
-            }
-        }
+        /**- free direct and indirect blocks */
+        release_inode(&node);
 
         Block block;
         fs_disk->read(inumber / INODES_PER_BLOCK + 1, block.Data);
         block.Inodes[inumber % INODES_PER_BLOCK] = node;
         fs_disk->write(inumber / INODES_PER_BLOCK + 1, block.Data);
 
+        /**- write back reference counts changed by the release */
+        if(MetaData.Features & FEATURE_DEDUP) dedup_flush();
+
+        /**- give the freed blocks back to the host */
+        discard_flush();
+
         return true;
     }
     
@@ -409,11 +477,62 @@ bool FileSystem::remove(size_t inumber) {
 }
 
 
+bool FileSystem::truncate(size_t inumber) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- sanity check */
+    if(!mounted) return false;
+
+    Inode node;
+    if(!load_inode(inumber, &node)) return false;
+    if(!node.Size) return true;
+
+    /**- free direct and indirect blocks, and store the emptied inode in one write */
+    release_inode(&node);
+    node.Size = 0;
+    write_ret(inumber, &node, 0);
+
+    /**- write back reference counts changed by the release; the blocks may be reused before they are discarded */
+    if(MetaData.Features & FEATURE_DEDUP) dedup_flush();
+
+    return true;
+}
+
+
+void FileSystem::release_inode(Inode *node) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- free direct blocks */
+    for(uint32_t i = 0; i < POINTERS_PER_INODE; i++) {
+        release_block(node->Direct[i]);
+        node->Direct[i] = 0;
+    }
+
+    /**- free indirect blocks */
+    if(node->Indirect) {
+        Block indirect;
+        fs_disk->read(node->Indirect, indirect.Data, REGION_INDIRECT);
+        free_block(node->Indirect);
+        node->Indirect = 0;
+
+        for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+            release_block(indirect.Pointers[i]);
+        }
+    }
+}
+
+
 ssize_t FileSystem::stat(size_t inumber) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_STAT, NULL, NULL, inumber);
+
     /**- sanity check */
     if(!mounted) return -1;
 
@@ -429,12 +548,23 @@ void FileSystem::read_helper(uint32_t blocknum, int offset, int *length, char **
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN_BLOCK("read_helper", "step", blocknum);
+
+    /**- whole blocks are read straight into the buffer */
+    if(offset == 0 && *length >= (int)Disk::BLOCK_SIZE) {
+        fs_disk->read(blocknum, *ptr);
+        *ptr += Disk::BLOCK_SIZE;
+        *length -= Disk::BLOCK_SIZE;
+        return;
+    }
 
-    /**- read the block from disk and change the pointers accordingly */
-    fs_disk->read(blocknum, *ptr);
-    *data += offset;
-    *ptr += Disk::BLOCK_SIZE;
-    *length -= (Disk::BLOCK_SIZE - offset);
+    /**- otherwise only the requested part of the block is copied */
+    Block block;
+    int chunk = min((int)Disk::BLOCK_SIZE - offset, *length);
+    fs_disk->read(blocknum, block.Data);
+    memcpy(*ptr, block.Data + offset, chunk);
+    *ptr += chunk;
+    *length -= chunk;
 
     return;
 }
@@ -445,121 +575,50 @@ ssize_t FileSystem::read(size_t inumber, char *data, int length, size_t offset)
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_READ, NULL, NULL, inumber, offset, length);
+
     /**- sanity check */
     if(!mounted) return -1;
 
-    /**- IMPORTANT: start reading from index = offset */
-    int size_inode = stat(inumber);
-    
+    /**- compressed disks store data in clusters */
+    if(MetaData.Features & FEATURE_COMPRESS) return read_compressed(inumber, data, length, offset);
+
+    Inode node;
+    Block indirect;
+
+    /**- load inode; if invalid, return error */
+    if(!load_inode(inumber, &node)) return -1;
+
     /**- if offset is greater than size of inode, then no data can be read 
      * if length + offset exceeds the size of inode, adjust length accordingly
     */
-    if((int)offset >= size_inode) return 0;
-    else if(length + (int)offset > size_inode) length = size_inode - offset;
+    if(offset >= node.Size) return 0;
+    if(length + offset > node.Size) length = node.Size - offset;
 
-    Inode node;    
+    /**- the indirect block is only needed when the request reaches past the direct pointers */
+    if(node.Indirect && offset + length > POINTERS_PER_INODE * Disk::BLOCK_SIZE)
+        fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
 
     /**- data is head; ptr is tail */
-    char *ptr = data;     
-    int to_read = length;
-
-    /**- load inode; if invalid, return error */
-    if(load_inode(inumber, &node)) {
-        /**- the offset is within direct pointers */
-        if(offset < POINTERS_PER_INODE * Disk::BLOCK_SIZE) {
-            /**- calculate the node to start reading from */
-            uint32_t direct_node = offset / Disk::BLOCK_SIZE;
-            offset %= Disk::BLOCK_SIZE;
-
-            /**- check if the direct node is valid */ 
-            if(node.Direct[direct_node]) {
-                read_helper(node.Direct[direct_node++], offset, &length, &data, &ptr);
-                /**- read the direct blocks */
-                while(length > 0 && direct_node < POINTERS_PER_INODE && node.Direct[direct_node]) {
-                    read_helper(node.Direct[direct_node++], 0, &length, &data, &ptr);
-                }
-
-                /**- if length <= 0, then enough data has been read */
-                if(length <= 0) return to_read;
-                else {
-                    /**- more data is to be read */
+    char *ptr = data;
+    int remaining = length;
 
-                    /**- check if all the direct nodes have been read completely 
-                     *  and if the indirect pointer is valid
-                    */
-                    if(direct_node == POINTERS_PER_INODE && node.Indirect) {
-                        Block indirect;
-                        fs_disk->read(node.Indirect, indirect.Data);
-
-                        /**- read the indirect nodes */
-                        for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
-                            if(indirect.Pointers[i] && length > 0) {
-                                read_helper(indirect.Pointers[i], 0, &length, &data, &ptr);
-                            }
-                            else break;
-                        }
+    /**- read block by block; holes read as zeros without any disk I/O */
+    while(remaining > 0) {
+        size_t position = offset + (ptr - data);
+        uint32_t blocknum = get_slot(&node, &indirect, position / Disk::BLOCK_SIZE);
+        int within = position % Disk::BLOCK_SIZE;
 
-                        /**- if length <= 0, then enough data has been read */
-                        if(length <= 0) return to_read;
-                        else {
-                            /**- data exhausted but the length requested was more */
-                            /**- logically, this should never print */
-                            return (to_read - length);
-                        }
-                    }
-                    else {
-                        /**- data exhausted but the length requested was more */
-                        /**- logically, this should never print */
-                        return (to_read - length);
-                    }
-                }
-            }
-            else {
-                /**- inode has no stored data */
-                return 0;
-            }
-        }
+        if(blocknum) read_helper(blocknum, within, &remaining, &data, &ptr);
         else {
-            /**- offset begins in the indirect block */
-            /**- check if the indirect node is valid */
-            if(node.Indirect) {
-                /**- change offset accordingly and find the indirect node to start reading from */
-                offset -= (POINTERS_PER_INODE * Disk::BLOCK_SIZE);
-                uint32_t indirect_node = offset / Disk::BLOCK_SIZE;
-                offset %= Disk::BLOCK_SIZE;
-
-                Block indirect;
-                fs_disk->read(node.Indirect, indirect.Data);
-
-                if(indirect.Pointers[indirect_node] && length > 0) {
-                    read_helper(indirect.Pointers[indirect_node++], offset, &length, &data, &ptr);
-                }
-
-                /**- iterate through the indirect nodes */
-                for(uint32_t i = indirect_node; i < POINTERS_PER_BLOCK; i++) {
-                    if(indirect.Pointers[i] && length > 0) {
-                        read_helper(indirect.Pointers[i], 0, &length, &data, &ptr);
-                    }
-                    else break;
-                }
-                
-                /**- if length <= 0, then enough data has been read */
-                if(length <= 0) return to_read;
-                else {
-                    /**- data exhausted but the length requested was more */
-                    /**- logically, this should never print */
-                    return (to_read - length);
-                }
-            }
-            else {
-                /**- the indirect node is invalid */
-                return 0;
-            }
+            int chunk = min((int)Disk::BLOCK_SIZE - within, remaining);
+            memset(ptr, 0, chunk);
+            ptr += chunk;
+            remaining -= chunk;
         }
     }
-    
-    /**- inode is invalid */
-    return -1;
+
+    return length;
 }
 
 
@@ -567,91 +626,121 @@ uint32_t FileSystem::allocate_block() {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN("allocate_block", "step");
 
     /**- sanity check */
     if(!mounted) return 0;
 
-    /**- iterate through the free bit map and allocate the first free block */
-    for(uint32_t i = MetaData.InodeBlocks + 1; i < MetaData.Blocks; i++) {
+    /**- iterate through the free bit map and allocate the first free block; the blocks below free_hint are in use */
+    for(uint32_t i = max(MetaData.InodeBlocks + 1, free_hint); i < MetaData.Blocks; i++) {
         if(free_blocks[i] == 0) {
             free_blocks[i] = true;
+            free_hint = i + 1;
+            discard_pending.erase(i);
             return (uint32_t)i;
         }
     }
+    free_hint = MetaData.Blocks;
 
     /**- disk is full */
     return 0;
 }
 
 
-ssize_t FileSystem::write_ret(size_t inumber, Inode* node, int ret) {
+void FileSystem::release_block(uint32_t blocknum) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
-    /**- sanity check */
-    if(!mounted) return -1;
+    if(!blocknum) return;
 
-    /**- find index of inode in the inode table */
-    int i = inumber / INODES_PER_BLOCK;
-    int j = inumber % INODES_PER_BLOCK;
-
-    /**- store the node into the block */
-    Block block;
-    fs_disk->read(i+1, block.Data);
-    block.Inodes[j] = *node;
-    fs_disk->write(i+1, block.Data);
+    /**- blocks in the fingerprint index are freed when their last reference goes */
+    if((MetaData.Features & FEATURE_DEDUP) && dedup_refs[blocknum]) {
+        dedup_adjust(blocknum, -1);
+        return;
+    }
 
-    /**- return ret */
-    return (ssize_t)ret;
+    free_block(blocknum);
 }
 
 
-void FileSystem::read_buffer(int offset, int *read, int length, char *data, uint32_t blocknum) {
+void FileSystem::free_block(uint32_t blocknum) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
-    /**- sanity check */
-    if(!mounted) return;
-    
-    /**- allocate memory to ptr which acts as buffer for reading from disk */
-    char* ptr = (char *)calloc(Disk::BLOCK_SIZE, sizeof(char));
+    free_blocks[blocknum] = false;
+    free_hint = min(free_hint, blocknum);
+    if(!(MetaData.Features & FEATURE_DISCARD)) return;
 
-    /**- read data into ptr and change pointers accordingly */ 
-    for(int i = offset; i < (int)Disk::BLOCK_SIZE && *read < length; i++) {
-        ptr[i] = data[*read];
-        *read = *read + 1;
+    /**- queue the block; runs are punched together once the batch is full */
+    discard_pending.insert(blocknum);
+    if(discard_pending.size() >= DISCARD_BATCH) discard_flush();
+}
+
+
+void FileSystem::discard_flush() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("discard_flush", "step");
+
+    /**- the set is sorted, so consecutive blocks form a run */
+    set<uint32_t>::iterator it = discard_pending.begin();
+    while(it != discard_pending.end()) {
+        uint32_t start = *it, count = 0;
+        while(it != discard_pending.end() && *it == start + count) {
+            count++;
+            it++;
+        }
+
+        /**- stop when the host cannot punch holes; the blocks simply stay allocated */
+        if(!fs_disk->discard(start, count)) break;
     }
-    fs_disk->write(blocknum, ptr);
 
-    /**- free the allocated memory */
-    free(ptr);
+    discard_pending.clear();
+}
 
-    return;
+
+uint32_t FileSystem::get_slot(Inode *node, Block *indirect, uint32_t slot) {
+    if(slot < POINTERS_PER_INODE) return node->Direct[slot];
+    if(!node->Indirect || slot >= POINTERS_PER_INODE + POINTERS_PER_BLOCK) return 0;
+    return indirect->Pointers[slot - POINTERS_PER_INODE];
+}
+
+
+void FileSystem::set_slot(Inode *node, Block *indirect, bool *indirect_dirty, uint32_t slot, uint32_t blocknum) {
+    if(slot < POINTERS_PER_INODE) {
+        node->Direct[slot] = blocknum;
+        return;
+    }
+    indirect->Pointers[slot - POINTERS_PER_INODE] = blocknum;
+    *indirect_dirty = true;
 }
 
 
-bool FileSystem::check_allocation(Inode* node, int read, int orig_offset, uint32_t &blocknum, bool write_indirect, Block indirect) {
+ssize_t FileSystem::write_ret(size_t inumber, Inode* node, int ret) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
-    
+    SFS_TRACE_SPAN("write_ret", "step");
+
     /**- sanity check */
-    if(!mounted) return false;
-    
-    /**- if blocknum is 0, then allocate a new block */
-    if(!blocknum) {
-        blocknum = allocate_block();
-        /**- set size of node and write back to disk if it is an indirect node */
-        if(!blocknum) {
-            node->Size = read + orig_offset;
-            if(write_indirect) fs_disk->write(node->Indirect, indirect.Data);
-            return false;
-        }
-    }
+    if(!mounted) return -1;
 
-    return true;
+    /**- find index of inode in the inode table */
+    int i = inumber / INODES_PER_BLOCK;
+    int j = inumber % INODES_PER_BLOCK;
+
+    /**- store the node into the block, writing its group first on lazy disks */
+    Block block;
+    init_group(i+1);
+    fs_disk->read(i+1, block.Data);
+    block.Inodes[j] = *node;
+    fs_disk->write(i+1, block.Data);
+
+    /**- return ret */
+    return (ssize_t)ret;
 }
 
 
@@ -660,13 +749,23 @@ ssize_t FileSystem::write(size_t inumber, char *data, int length, size_t offset)
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_WRITE, NULL, NULL, inumber, offset, length);
+
     /**- sanity check */
     if(!mounted) return -1;
+
+    /**- compressed disks store data in clusters, deduplicated disks share blocks with identical content;
+     * both may free blocks they no longer need, which are discarded right away */
+    if(MetaData.Features & (FEATURE_COMPRESS | FEATURE_DEDUP)) {
+        ssize_t written = (MetaData.Features & FEATURE_COMPRESS) ?
+            write_compressed(inumber, data, length, offset) : write_dedup(inumber, data, length, offset);
+        discard_flush();
+        return written;
+    }
     
     Inode node;
     Block indirect;
-    int read = 0;
-    int orig_offset = offset;
+    bool indirect_dirty = false;
 
     /**- insufficient size */
     if(length + offset > (POINTERS_PER_BLOCK + POINTERS_PER_INODE) * Disk::BLOCK_SIZE) {
@@ -678,7 +777,7 @@ ssize_t FileSystem::write(size_t inumber, char *data, int length, size_t offset)
      */
     if(!load_inode(inumber, &node)) {
         node.Valid = true;
-        node.Size = length + offset;
+        node.Size = 0;
         for(uint32_t ii = 0; ii < POINTERS_PER_INODE; ii++) {
             node.Direct[ii] = 0;
         }
@@ -686,133 +785,45 @@ ssize_t FileSystem::write(size_t inumber, char *data, int length, size_t offset)
         inode_counter[inumber / INODES_PER_BLOCK]++;
         free_blocks[inumber / INODES_PER_BLOCK + 1] = true;
     }
-    else {
-        /**- set size of the node */
-        node.Size = max((int)node.Size, length + (int)offset);
-    }
-
-    /**- check if the offset is within direct pointers */
-    if(offset < POINTERS_PER_INODE * Disk::BLOCK_SIZE) {
-        /**- find the first node to start writing at and change offset accordingly */
-        int direct_node = offset / Disk::BLOCK_SIZE;
-        offset %= Disk::BLOCK_SIZE;
-
-        /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-        if(!check_allocation(&node, read, orig_offset, node.Direct[direct_node], false, indirect)) { 
-            return write_ret(inumber, &node, read);
-        }
-        /**- read from data buffer */       
-        read_buffer(offset, &read, length, data, node.Direct[direct_node++]);
-
-        /**- enough data has been read from data buffer */
-        if(read == length) return write_ret(inumber, &node, length);
-        /**- store in direct pointers till either one of the two things happen:
-        * 1. all the data is stored in the direct pointers
-        * 2. the data is stored in indirect pointers
-        */
-        else {
-            /**- start writing into direct nodes */
-            for(int i = direct_node; i < (int)POINTERS_PER_INODE; i++) {
-                /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-                if(!check_allocation(&node, read, orig_offset, node.Direct[direct_node], false, indirect)) { 
-                    return write_ret(inumber, &node, read);
-                }
-                read_buffer(0, &read, length, data, node.Direct[direct_node++]);
-
-                /**- enough data has been read from data buffer */
-                if(read == length) return write_ret(inumber, &node, length);
-            }
-
-            /**- check if the indirect node is valid */
-            if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data);
-            else {
-                /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-                if(!check_allocation(&node, read, orig_offset, node.Indirect, false, indirect)) { 
-                    return write_ret(inumber, &node, read);
-                }
-                fs_disk->read(node.Indirect, indirect.Data);
+    else if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data, REGION_INDIRECT);
 
-                /**- initialise the indirect nodes */
-                for(int i = 0; i < (int)POINTERS_PER_BLOCK; i++) {
-                    indirect.Pointers[i] = 0;
-                }
-            }
-            
-            /**- write into indirect nodes */
-            for(int j = 0; j < (int)POINTERS_PER_BLOCK; j++) {
-                /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-                if(!check_allocation(&node, read, orig_offset, indirect.Pointers[j], true, indirect)) { 
-                    return write_ret(inumber, &node, read);
-                }
-                read_buffer(0, &read, length, data, indirect.Pointers[j]);
+    if(length <= 0) return write_ret(inumber, &node, 0);
 
-                /**- enough data has been read from data buffer */
-                if(read == length) {
-                    fs_disk->write(node.Indirect, indirect.Data);
-                    return write_ret(inumber, &node, length);
-                }
-            }
+    /**- write block by block; blocks between the old end and offset are left as holes */
+    size_t end = offset + length;
+    int written = 0;
+    for(uint32_t slot = offset / Disk::BLOCK_SIZE; slot <= (end - 1) / Disk::BLOCK_SIZE; slot++) {
+        size_t start = (size_t)slot * Disk::BLOCK_SIZE;
+        size_t from = max(offset, start) - start;
+        size_t to = min(end, start + Disk::BLOCK_SIZE) - start;
+        uint32_t blocknum = get_slot(&node, &indirect, slot);
 
-            /**- space exhausted */
-            fs_disk->write(node.Indirect, indirect.Data);
-            return write_ret(inumber, &node, read);
-        }
-    }
-    /**- offset begins in indirect blocks */
-    else {
-        /**- find the first indirect node to write into and change offset accordingly */
-        offset -= (Disk::BLOCK_SIZE * POINTERS_PER_INODE);
-        int indirect_node = offset / Disk::BLOCK_SIZE;
-        offset %= Disk::BLOCK_SIZE;
-
-        /**- check if the indirect node is valid */
-        if(node.Indirect) fs_disk->read(node.Indirect, indirect.Data);
-        else {
-            /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-            if(!check_allocation(&node, read, orig_offset, node.Indirect, false, indirect)) { 
-                return write_ret(inumber, &node, read);
-            }
-            fs_disk->read(node.Indirect, indirect.Data);
+        /**- a partial write keeps the rest of an existing block */
+        Block block;
+        if(blocknum && (from > 0 || to < Disk::BLOCK_SIZE)) fs_disk->read(blocknum, block.Data);
+        else memset(block.Data, 0, Disk::BLOCK_SIZE);
 
-            /**- initialise the indirect nodes */
-            for(int i = 0; i < (int)POINTERS_PER_BLOCK; i++) {
-                indirect.Pointers[i] = 0;
+        /**- allocate the block, and the indirect block with the first slot that needs it; stop when the disk is full */
+        if(!blocknum) {
+            if(slot >= POINTERS_PER_INODE && !node.Indirect) {
+                node.Indirect = allocate_block();
+                if(!node.Indirect) break;
+                memset(indirect.Data, 0, Disk::BLOCK_SIZE);
+                indirect_dirty = true;
             }
+            blocknum = allocate_block();
+            if(!blocknum) break;
+            set_slot(&node, &indirect, &indirect_dirty, slot, blocknum);
         }
 
-        /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-        if(!check_allocation(&node, read, orig_offset, indirect.Pointers[indirect_node], true, indirect)) { 
-            return write_ret(inumber, &node, read);
-        }
-        read_buffer(offset, &read, length, data, indirect.Pointers[indirect_node++]);
-
-        /**- enough data has been read from data buffer */
-        if(read == length) {
-            fs_disk->write(node.Indirect, indirect.Data);
-            return write_ret(inumber, &node, length);
-        }
-        /**- write into indirect nodes */
-        else {
-            for(int j = indirect_node; j < (int)POINTERS_PER_BLOCK; j++) {
-                /**- check if the node is valid; if invalid; allocates a block and if no block is available, returns false */
-                if(!check_allocation(&node, read, orig_offset, indirect.Pointers[j], true, indirect)) { 
-                    return write_ret(inumber, &node, read);
-                }
-                read_buffer(0, &read, length, data, indirect.Pointers[j]);
-
-                /**- enough data has been read from data buffer */
-                if(read == length) {
-                    fs_disk->write(node.Indirect, indirect.Data);
-                    return write_ret(inumber, &node, length);
-                }
-            }
-
-            /**- space exhausted */
-            fs_disk->write(node.Indirect, indirect.Data);
-            return write_ret(inumber, &node, read);
-        }
+        memcpy(block.Data + from, data + (start + from - offset), to - from);
+        fs_disk->write(blocknum, block.Data);
+        written = start + to - offset;
     }
 
-    /**- error */   
-    return -1;
-}
\ No newline at end of file
+    /**- size only covers what was stored; write back the indirect block and the inode */
+    node.Size = max((size_t)node.Size, offset + written);
+    if(indirect_dirty) fs_disk->write(node.Indirect, indirect.Data, REGION_INDIRECT);
+
+    return write_ret(inumber, &node, written);
+}
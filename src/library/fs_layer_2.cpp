@@ -10,6 +10,8 @@
  */
 
 #include "sfs/fs.h"
+#include "sfs/aes.h"
+#include "sfs/crc32c.h"
 #include "sfs/sha256.h"
 
 #include <algorithm>
@@ -19,6 +21,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #define streq(a, b) (strcmp((a), (b)) == 0)
 
@@ -61,6 +67,7 @@ bool FileSystem::change_password(){
 
     /**- Sanity Checks */
     if(!mounted){return false;}
+    if(MetaData.Features & FEATURE_ENCRYPT) return change_key();
 
     if(MetaData.Protected){
         /**-  Initializations  */
@@ -91,6 +98,12 @@ bool FileSystem::remove_password(){
 
     if(!mounted){return false;}
 
+    /**- The key of an encrypted disk is only stored wrapped with the password */
+    if(MetaData.Features & FEATURE_ENCRYPT){
+        printf("Password of an encrypted disk cannot be removed.\n");
+        return false;
+    }
+
     if(MetaData.Protected){
         /**-  Initializations  */
         char pass[1000], line[1000];
@@ -155,6 +168,7 @@ FileSystem::Directory FileSystem::read_dir_from_offset(uint32_t offset){
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN("read_dir_from_offset", "step");
 
     /**-   Sanity Check  */
     if(
@@ -179,6 +193,7 @@ void FileSystem::write_dir_back(Directory dir){
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN("write_dir_back", "step");
 
     /**-   Get block offset and index  */
     uint32_t block_idx = (dir.inum / FileSystem::DIR_PER_BLOCK) ;
@@ -197,6 +212,7 @@ int FileSystem::dir_lookup(Directory dir,char name[]){
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
+    SFS_TRACE_SPAN("dir_lookup", "step");
 
     /**-   Search the curr_dir.Table for name  */
     uint32_t offset = 0;
@@ -218,6 +234,8 @@ bool FileSystem::ls_dir(char name[]){
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_LS, name);
+
     if(!mounted){return false;}
 
     /**-   Get the directory entry offset   */
@@ -242,11 +260,125 @@ bool FileSystem::ls_dir(char name[]){
     return true;
 }
 
+bool FileSystem::readdir_plus(char name[], vector<EntryAttr> *entries){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_READDIR, name);
+
+    if(!mounted){return false;}
+
+    /**-   Get the directory entry offset   */
+    int offset = dir_lookup(curr_dir,name);
+    if(offset == -1){printf("No such Directory\n"); return false;}
+
+    /**-   Read directory from block  */
+    FileSystem::Directory dir = read_dir_from_offset(offset);
+    if(dir.Valid == 0){printf("Directory Invalid\n"); return false;}
+
+    /**-   Copy the valid entries; files are queued by inumber  */
+    entries->clear();
+    vector<pair<uint32_t, size_t> > files;
+    for(uint32_t idx=0; idx<FileSystem::ENTRIES_PER_DIR; idx++){
+        struct Dirent temp = dir.Table[idx];
+        if(temp.valid == 0) continue;
+
+        EntryAttr attr;
+        memset(&attr, 0, sizeof(attr));
+        strcpy(attr.Name, temp.Name);
+        attr.type = temp.type;
+        attr.inum = temp.inum;
+        if(temp.type == 1) files.push_back(make_pair(temp.inum, entries->size()));
+        entries->push_back(attr);
+    }
+
+    /**-   Sorted by inumber, entries sharing an inode block are adjacent: read each block once  */
+    sort(files.begin(), files.end());
+    Block block;
+    uint32_t loaded = 0;
+    for(size_t i = 0; i < files.size(); i++){
+        uint32_t blocknum = files[i].first / INODES_PER_BLOCK + 1;
+        if(blocknum != loaded){
+            fs_disk->read(blocknum, block.Data);
+            loaded = blocknum;
+        }
+
+        /**-   Only files with an indirect block cost another read, to count its pointers  */
+        DiskUsage usage;
+        count_usage(&block.Inodes[files[i].first % INODES_PER_BLOCK], &usage);
+        (*entries)[files[i].second].Size = usage.Bytes;
+        (*entries)[files[i].second].Blocks = usage.Blocks;
+    }
+    return true;
+}
+
+bool FileSystem::entry(char name[], EntryAttr *attr){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!mounted){return false;}
+
+    int offset = dir_lookup(curr_dir,name);
+    if(offset == -1){return false;}
+
+    const Dirent &found = curr_dir.Table[offset];
+    memset(attr, 0, sizeof(EntryAttr));
+    strcpy(attr->Name, found.Name);
+    attr->type = found.type;
+    attr->inum = found.inum;
+
+    /**-   Only files have an inode to count  */
+    if(found.type == 1){
+        DiskUsage usage;
+        inode_usage(found.inum, &usage);
+        attr->Size = usage.Bytes;
+        attr->Blocks = usage.Blocks;
+    }
+    return true;
+}
+
+ssize_t FileSystem::write_charged(uint32_t dirnum, size_t inumber, char *data, int length, size_t offset){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!mounted){return -1;}
+
+    /**-   Write, and charge the difference to the directories, as copyin does  */
+    DiskUsage before, after;
+    inode_usage(inumber, &before);
+    ssize_t written = write(inumber, data, length, offset);
+    inode_usage(inumber, &after);
+    charge(dirnum, before, after);
+    return written;
+}
+
+bool FileSystem::ls_long(char name[]){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    vector<EntryAttr> entries;
+    if(!readdir_plus(name, &entries)){return false;}
+
+    /**-   Print Directory Data with attributes  */
+    printf("   inum    |       name       | type  |    size    | blocks\n");
+    for(size_t idx=0; idx<entries.size(); idx++){
+        EntryAttr *temp = &entries[idx];
+        printf("%-10u | %-16s | %-5s | %10u | %u\n",temp->inum,temp->Name,temp->type == 1 ? "file" : "dir",temp->Size,temp->Blocks);
+    }
+    return true;
+}
+
 bool FileSystem::mkdir(char name[FileSystem::NAMESIZE]){
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_MKDIR, name);
+
     if(!mounted){return false;}
 
     /**-   Find empty dirblock  */
@@ -257,8 +389,9 @@ bool FileSystem::mkdir(char name[FileSystem::NAMESIZE]){
 
     if(block_idx == MetaData.DirBlocks){printf("Directory limit reached\n"); return false;}
 
-    /**-   Read empty dirblock  */
+    /**-   Read empty dirblock, writing its group first on lazy disks  */
     Block block;
+    init_group(MetaData.Blocks - 1 - block_idx);
     fs_disk->read(MetaData.Blocks - 1 - block_idx, block.Data);
 
 
@@ -380,16 +513,18 @@ FileSystem::Directory FileSystem::rm_helper(Directory dir, char name[FileSystem:
     /**-   Get inumber  */
     uint32_t inum = dir.Table[offset].inum;
 
-    printf("%u\n",inum);
-
     /**-   Remove the inode  */
+    DiskUsage before, after;
+    inode_usage(inum, &before);
     if(!remove(inum)){printf("Failed to remove Inode\n"); dir.Valid = 0; return dir;}
 
     /**-   Remove the entry  */
     dir.Table[offset].valid = 0;
 
-    /**-   Write back the changes  */
+    /**-   Write back the changes, then take the file off the usage of the directories above  */
     write_dir_back(dir);
+    memset(&after, 0, sizeof(after));
+    charge(dir.inum, before, after);
 
     return dir;
 }
@@ -399,6 +534,8 @@ bool FileSystem::rmdir(char name[FileSystem::NAMESIZE]){
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_RMDIR, name);
+
     Directory temp = rmdir_helper(curr_dir,name);
     if(temp.Valid == 0){
         curr_dir = temp;
@@ -412,6 +549,8 @@ bool FileSystem::touch(char name[FileSystem::NAMESIZE]){
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_TOUCH, name);
+
     if(!mounted){return false;}
 
     /**-   Check if such file exists  */
@@ -443,6 +582,8 @@ bool FileSystem::cd(char name[FileSystem::NAMESIZE]){
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_CD, name);
+
     if(!mounted){return false;}
 
     int offset = dir_lookup(curr_dir,name);
@@ -458,6 +599,37 @@ bool FileSystem::cd(char name[FileSystem::NAMESIZE]){
     return true;
 }
 
+bool FileSystem::set_cwd(uint32_t dirnum){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!mounted || dirnum >= MetaData.DirBlocks * DIR_PER_BLOCK){return false;}
+
+    /**-   Read the dirblock from the disk; the copy in curr_dir may be of another directory  */
+    Block blk;
+    fs_disk->read(MetaData.Blocks - 1 - dirnum / DIR_PER_BLOCK, blk.Data);
+    Directory dir = blk.Directories[dirnum % DIR_PER_BLOCK];
+    if(dir.Valid == 0 || dir.inum != dirnum){return false;}
+    curr_dir = dir;
+    return true;
+}
+
+ssize_t FileSystem::lookup(char name[]){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_LOOKUP, name, NULL, (uint64_t)-1);
+
+    if(!mounted){return -1;}
+
+    int offset = dir_lookup(curr_dir,name);
+    if((offset == -1) || (curr_dir.Table[offset].type != 1)){return -1;}
+    trace.Record.Arg = curr_dir.Table[offset].inum;
+    return curr_dir.Table[offset].inum;
+}
+
 bool FileSystem::ls(){
     if(!mounted){return false;}
 
@@ -466,6 +638,8 @@ bool FileSystem::ls(){
 }
 
 bool FileSystem::rm(char name[]){
+    TraceScope trace(this, TRACE_RM, name);
+
     Directory temp = rm_helper(curr_dir,name);
     if(temp.Valid == 1){
         curr_dir = temp;
@@ -474,10 +648,39 @@ bool FileSystem::rm(char name[]){
     return false;
 }
 
+FileSystem::~FileSystem(){
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- Programs that end without exit() still unmount, so the disk is left clean */
+    try {
+        exit();
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what());
+    }
+    trace_stop();
+}
+
 void FileSystem::exit(){
     if(!mounted){return;}
 
+    trace_stop();
+    discard_flush();
+    if(!metrics_path.empty()) export_metrics_now(clock_ns());
+    metrics_path.clear();
     fs_disk->unmount();
+    fs_disk->set_checksums(0, 0, false);
+
+    /**- the table is written back, so the next mount can trust it */
+    if(MetaData.Features & FEATURE_CHECKSUM) {
+        Block block;
+        memset(&block, 0, sizeof(Block));
+        MetaData.Dirty = 0;
+        block.Super = MetaData;
+        fs_disk->write(0, block.Data);
+    }
+    if(MetaData.Features & FEATURE_ENCRYPT) fs_disk->set_key(NULL);
     mounted = false;
     fs_disk = nullptr;
 }
@@ -487,6 +690,8 @@ bool FileSystem::copyout(char name[],const char *path) {
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_COPYOUT, name, path);
+
     /**- Sanity Checks */
     if(!mounted){return false;}
 
@@ -499,82 +704,290 @@ bool FileSystem::copyout(char name[],const char *path) {
     uint32_t inum = curr_dir.Table[offset].inum;
 
     /**- Open File for copyout */
-    FILE *stream = fopen(path, "w");
-    if (stream == nullptr) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
     	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
     	return false;
     }
 
-    /**- Read from the inode and write it to the File */
-    char buffer[4*BUFSIZ] = {0};
-    offset = 0;
-    while (true) {
-    	ssize_t result = read(inum, buffer, sizeof(buffer), offset);
-    	if (result <= 0) {
-    	    break;
-		}
-		fwrite(buffer, 1, result, stream);
-		offset += result;
+    /**- Copy the data; the File is closed before what the Disk throws goes on */
+    ssize_t copied;
+    try {
+    	copied = copyout_file(inum, fd, path);
+    } catch (...) {
+    	close(fd);
+    	throw;
     }
-    
+    if (copied < 0) {
+    	close(fd);
+    	return false;
+    }
+
     /**- Endings */
-    printf("%d bytes copied\n", offset);
-    fclose(stream);
+    printf("%zd bytes copied\n", copied);
+    close(fd);
     return true;
 }
 
+ssize_t FileSystem::copyout_file(uint32_t inum, int fd, const char *path) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("copyout_file", "step");
+
+    /**- Only regular files can seek past holes and be truncated to size */
+    struct stat info;
+    bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+
+    /**- Blocks stored as they are go from the image to the File in the kernel */
+    bool direct = regular && !(MetaData.Features & (FEATURE_COMPRESS | FEATURE_ENCRYPT | FEATURE_CHECKSUM));
+    ssize_t offset = direct ? export_blocks(inum, fd) : 0;
+    if (offset < 0) {
+    	return -1;
+    }
+
+    /**- Otherwise read from the inode and write it to the File; into a regular File zero blocks are skipped so holes stay holes */
+    static const char zeros[Disk::BLOCK_SIZE] = {0};
+    vector<char> copy(COPY_BLOCKS * Disk::BLOCK_SIZE);
+    char *buffer = copy.data();
+    while (!direct) {
+    	ssize_t result = read(inum, buffer, copy.size(), offset);
+    	if (result < 0) {
+    	    return -1;
+    	}
+    	if (result == 0) {
+    	    break;
+    	}
+    	for (ssize_t done = 0; done < result; ) {
+    	    size_t chunk = min((size_t)(result - done), (size_t)Disk::BLOCK_SIZE);
+    	    ssize_t wrote = chunk;
+    	    if (!regular) wrote = ::write(fd, buffer + done, result - done);
+    	    else if (memcmp(buffer + done, zeros, chunk) != 0) wrote = pwrite(fd, buffer + done, chunk, offset + done);
+    	    if (wrote <= 0 || (regular && wrote != (ssize_t)chunk)) {
+    	        fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+    	        return -1;
+    	    }
+    	    done += wrote;
+    	}
+    	offset += result;
+    }
+
+    /**- The size of a regular File also covers a trailing hole */
+    if (regular && ftruncate(fd, offset) < 0) {
+    	fprintf(stderr, "Unable to truncate %s: %s\n", path, strerror(errno));
+    }
+    return offset;
+}
+
+bool FileSystem::copyin_file(int fd, uint32_t inum, off_t size) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("copyin_file", "step");
+
+    /**- Copy the data regions of the File only; SEEK_DATA and SEEK_HOLE find them in sparse files.
+     * Whole blocks go from the File to the image in the kernel when blocks are stored as they are */
+    bool direct = !(MetaData.Features & (FEATURE_COMPRESS | FEATURE_DEDUP | FEATURE_ENCRYPT | FEATURE_CHECKSUM));
+    vector<char> copy(COPY_BLOCKS * Disk::BLOCK_SIZE);
+    char *buffer = copy.data();
+    off_t position = 0;
+    bool failed = false;
+    while (position < size && !failed) {
+    	off_t data = lseek(fd, position, SEEK_DATA);
+    	if (data < 0 && errno == ENXIO) {
+    	    break;
+    	}
+    	/**- Without hole support everything left is data */
+    	off_t hole = (data < 0) ? size : lseek(fd, data, SEEK_HOLE);
+    	if (data < 0) data = position;
+    	if (hole < 0) hole = size;
+
+    	for (position = data; position < hole; ) {
+    	    off_t length = min((off_t)copy.size(), hole - position);
+    	    ssize_t result, actual;
+
+    	    /**- Save the file */
+    	    if (direct && position % Disk::BLOCK_SIZE == 0 && length >= (off_t)Disk::BLOCK_SIZE) {
+    	        result = length - length % Disk::BLOCK_SIZE;
+    	        actual = import_blocks(inum, fd, position, result);
+    	    }
+    	    else {
+    	        /**- Only up to the next block boundary, after which the blocks are whole again */
+    	        if (direct) length = min(length, (off_t)(Disk::BLOCK_SIZE - position % Disk::BLOCK_SIZE));
+    	        result = pread(fd, buffer, length, position);
+    	        if (result <= 0) {
+    	            failed = true;
+    	            break;
+    	        }
+    	        actual = write(inum, buffer, result, position);
+    	    }
+    	    if (actual < 0) {
+    	        fprintf(stderr, "fs.write returned invalid result %ld\n", actual);
+    	        failed = true;
+    	        break;
+    	    }
+
+    	    /**- Checks to ensure proper write */
+    	    position += actual;
+    	    if (actual != result) {
+    	        fprintf(stderr, "fs.write only wrote %ld bytes, not %ld bytes\n", actual, result);
+    	        failed = true;
+    	        break;
+    	    }
+    	}
+    }
+
+    /**- A trailing hole is kept by storing the last byte of the file */
+    if (!failed && size > 0 && stat(inum) < size) {
+    	char zero = 0;
+    	ssize_t actual = write(inum, &zero, 1, size - 1);
+    	if (actual != 1) {
+    	    fprintf(stderr, "fs.write only wrote %ld bytes, not 1 bytes\n", actual);
+    	    failed = true;
+    	}
+    }
+
+    return !failed;
+}
+
+ssize_t FileSystem::copyin_stream(int fd, uint32_t inum) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+    SFS_TRACE_SPAN("copyin_stream", "step");
+
+    /**- Read the File in order until its end; its size is not known ahead, and it has no holes to find */
+    vector<char> copy(COPY_BLOCKS * Disk::BLOCK_SIZE);
+    char *buffer = copy.data();
+    ssize_t position = 0;
+    while (true) {
+    	ssize_t result = ::read(fd, buffer, copy.size());
+    	if (result < 0 && errno == EINTR) {
+    	    continue;
+    	}
+    	if (result < 0) {
+    	    fprintf(stderr, "Unable to read: %s\n", strerror(errno));
+    	    return -1;
+    	}
+    	if (result == 0) {
+    	    break;
+    	}
+
+    	/**- Checks to ensure proper write */
+    	ssize_t actual = write(inum, buffer, result, position);
+    	if (actual != result) {
+    	    fprintf(stderr, "fs.write only wrote %ld bytes, not %ld bytes\n", actual, result);
+    	    return -1;
+    	}
+    	position += actual;
+    }
+    return position;
+}
+
 bool FileSystem::copyin(const char *path, char name[]) {
     /** <dl class="section implementation"> */
     /** <dt> Implementation details </dt>*/
     /** </dl> */
 
+    TraceScope trace(this, TRACE_COPYIN, path, name);
+
     /**- Sanity Checks */
     if(!mounted){return false;}
 
+    /**- Open File for reading */
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0) {
+    	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+    	if (fd >= 0) close(fd);
+    	return false;
+    }
+
     /**- Check if file exists. Else create one */
     touch(name);
     int offset = dir_lookup(curr_dir,name);
-    if(offset == -1){return false;}
-
-    if(curr_dir.Table[offset].type == 0){return false;}
+    if(offset == -1 || curr_dir.Table[offset].type == 0){close(fd); return false;}
 
     /**- Get inode of the created file */
     uint32_t inum = curr_dir.Table[offset].inum;
 
-    /**- Open File for reading */
-	FILE *stream = fopen(path, "r");
-    if (stream == nullptr) {
-    	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
-    	return false;
+    /**- An existing file is emptied first, so its old data cannot show through holes */
+    DiskUsage before, after;
+    inode_usage(inum, &before);
+    truncate(inum);
+
+    /**- Copy the data, and charge the difference to the directories; only regular files know their size ahead */
+    off_t size = info.st_size;
+    bool failed;
+    if (S_ISREG(info.st_mode)) {
+    	failed = !copyin_file(fd, inum, size);
     }
+    else {
+    	size = copyin_stream(fd, inum);
+    	failed = size < 0;
+    }
+    trace.Record.Arg = failed ? stat(inum) : size;
+    inode_usage(inum, &after);
+    charge(curr_dir.inum, before, after);
+
+    /**- Endings */
+    printf("%ld bytes copied\n", failed ? stat(inum) : size);
+    close(fd);
+    return true;
+}
+
+bool FileSystem::hash(char name[], bool blocks) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_HASH, name, NULL, blocks);
+
+    /**- Sanity Checks */
+    if(!mounted){return false;}
+
+    int offset = dir_lookup(curr_dir,name);
+    if(offset == -1){return false;}
+    if(curr_dir.Table[offset].type == 0){return false;}
+
+    uint32_t inum = curr_dir.Table[offset].inum;
+
+    /**- Stream the file a batch of blocks at a time */
+    char buffer[HASH_BATCH * Disk::BLOCK_SIZE];
+    const void *pointers[HASH_BATCH];
+    uint8_t fingerprints[HASH_BATCH][SHA256::HashBytes];
+    SHA256 hasher;
+    size_t done = 0;
 
-    /**- Read File and get the Data */
-    char buffer[4*BUFSIZ] = {0};
-    offset = 0;
     while (true) {
-    	ssize_t result = fread(buffer, 1, sizeof(buffer), stream);
-    	if (result <= 0) {
-    	    break;
-	}
-
-    /**- Save the file */
-	ssize_t actual = write(inum, buffer, result, offset);
-	if (actual < 0) {
-	    fprintf(stderr, "fs.write returned invalid result %ld\n", actual);
-	    break;
-	}
-
-    /**- Checks to ensure proper write */
-	offset += actual;
-	if (actual != result) {
-	    fprintf(stderr, "fs.write only wrote %ld bytes, not %ld bytes\n", actual, result);
-	    break;
-	}
+        ssize_t result = read(inum, buffer, sizeof(buffer), done);
+        if (result <= 0) {
+            break;
+        }
+        hasher.add(buffer, result);
+
+        /**- Fingerprint the blocks of the batch side by side */
+        if (blocks) {
+            uint32_t count = (result + Disk::BLOCK_SIZE - 1) / Disk::BLOCK_SIZE;
+            memset(buffer + result, 0, count * Disk::BLOCK_SIZE - result);
+            for (uint32_t i = 0; i < count; i++) {
+                pointers[i] = buffer + i * Disk::BLOCK_SIZE;
+            }
+            SHA256::hashMany(pointers, Disk::BLOCK_SIZE, count, fingerprints);
+
+            for (uint32_t i = 0; i < count; i++) {
+                printf("block %lu ", done / Disk::BLOCK_SIZE + i);
+                for (uint32_t j = 0; j < SHA256::HashBytes; j++) {
+                    printf("%02x", fingerprints[i][j]);
+                }
+                printf("\n");
+            }
+        }
+        done += result;
     }
-    
+
     /**- Endings */
-    printf("%d bytes copied\n", offset);
-    fclose(stream);
+    printf("%s  %s\n", hasher.getHash().c_str(), name);
     return true;
 }
 
@@ -595,7 +1008,38 @@ void FileSystem::stat() {
     printf("Total Directory Blocks : %u\n",blk.Super.DirBlocks);
     printf("Total Inode Blocks : %u\n",blk.Super.InodeBlocks);
     printf("Total Inode : %u\n",blk.Super.Inodes);
-    printf("Password protected : %u\n\n",blk.Super.Protected);
+    printf("Password protected : %u\n",blk.Super.Protected);
+    printf("Features : 0x%x\n",blk.Super.Features);
+    if(blk.Super.Features & FEATURE_ENCRYPT)
+        printf("Encryption : AES-128-XTS (%s)\n",XTS::implementation());
+    if(blk.Super.Features & FEATURE_CHECKSUM)
+        printf("Checksums : CRC32C (%s), %lu reads verified\n",CRC32C::implementation(),fs_disk->verified());
+    if(blk.Super.Features & FEATURE_DISCARD)
+        printf("Discarded blocks : %lu\n",fs_disk->discarded());
+    printf("\n");
+
+    /**- Print compression counters */
+    if(MetaData.Features & FEATURE_COMPRESS){
+        double ratio = compression.StoredBytes ? (double)compression.LogicalBytes / compression.StoredBytes : 0;
+        printf("Compressed clusters written : %lu\n",compression.Clusters);
+        printf("Compression ratio : %.2f\n",ratio);
+        printf("Compression CPU time : %.3f ms\n",compression.CompressNanos / 1e6);
+        printf("Decompression CPU time : %.3f ms\n\n",compression.DecompressNanos / 1e6);
+    }
+
+    /**- Print deduplication counters and sharing on disk */
+    if(MetaData.Features & FEATURE_DEDUP){
+        uint64_t unique = 0, references = 0;
+        for(uint32_t i = 0; i < MetaData.Blocks; i++){
+            if(dedup_refs[i]){ unique++; references += dedup_refs[i]; }
+        }
+        printf("Indexed blocks : %lu\n",unique);
+        printf("Block references : %lu\n",references);
+        printf("Blocks fingerprinted : %lu\n",dedup.Blocks);
+        printf("Duplicate blocks shared : %lu\n",dedup.Duplicates);
+        printf("Index probes : %lu\n",dedup.Probes);
+        printf("Probes skipped by pre-filter : %lu\n\n",dedup.FilterSkips);
+    }
 
     printf("Max Directories per block : %u\n",DIR_PER_BLOCK);
     printf("Max Namsize : %u\n",NAMESIZE);
@@ -604,8 +1048,9 @@ void FileSystem::stat() {
 
     /**- Read directory blocks */
     for(uint32_t blk_idx=0; blk_idx<MetaData.DirBlocks; blk_idx++){
-        fs_disk->read(MetaData.Blocks - 1- blk_idx,blk.Data);
         printf("Block %u\n",blk_idx);
+        if(uninitialized(MetaData, MetaData.Blocks - 1 - blk_idx)) continue;
+        fs_disk->read(MetaData.Blocks - 1- blk_idx,blk.Data);
 
         /**- Read Directoreis in each directory block */
         for(uint32_t offset=0; offset<DIR_PER_BLOCK; offset++){
@@ -0,0 +1,126 @@
+/**
+ * @file fs_lazy.cpp
+ * @brief Implementation of fs.h lazy format functions
+ * @date 2026-10-18
+ *
+ * @details format() of a disk with FEATURE_LAZY does not write the disk: it
+ * turns the image into a sparse file and writes the superblock, the root
+ * directory and the allocation metadata (fingerprint index, checksum table).
+ * Inode and directory blocks are split into groups of GroupBlocks blocks; a
+ * bit per group in the superblock says that the group was never written.
+ * Such blocks are known to be empty, so mount() skips them, and the group is
+ * written on its first use. This also keeps encrypted disks correct, where
+ * a hole does not decrypt to zeros. Data blocks are only read after they
+ * were written, so they need no flags.
+ */
+
+#include "sfs/fs.h"
+
+#include <string.h>
+
+using namespace std;
+
+namespace {
+    uint32_t groups_of(uint32_t blocks, uint32_t group_blocks) {
+        return (blocks + group_blocks - 1) / group_blocks;
+    }
+}
+
+void FileSystem::clear_blocks(Disk *disk, const SuperBlock &super, uint32_t from, uint32_t to) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- empty inodes and data blocks are all zeros */
+    Block empty, dirs;
+    memset(&empty, 0, sizeof(Block));
+
+    /**- empty directories are invalid and have no inum */
+    Directory dir;
+    memset(&dir, 0, sizeof(Directory));
+    dir.inum = -1;
+    for(uint32_t j = 0; j < DIR_PER_BLOCK; j++) dirs.Directories[j] = dir;
+
+    for(uint32_t i = from; i < to; i++) {
+        disk->write(i, (i >= super.Blocks - super.DirBlocks) ? dirs.Data : empty.Data);
+    }
+}
+
+ssize_t FileSystem::lazy_group(const SuperBlock &super, uint32_t blocknum, uint32_t *from, uint32_t *to) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!(super.Features & FEATURE_LAZY) || !super.GroupBlocks) return -1;
+
+    uint32_t size = super.GroupBlocks;
+    uint32_t first, last;
+    ssize_t group;
+
+    /**- inode groups count from block 1 upwards */
+    if(blocknum >= 1 && blocknum <= super.InodeBlocks) {
+        group = (blocknum - 1) / size;
+        first = 1 + group * size;
+        last = min(first + size, super.InodeBlocks + 1);
+    }
+    /**- directory groups count from the last block downwards, as directory blocks do */
+    else if(blocknum < super.Blocks && blocknum >= super.Blocks - super.DirBlocks) {
+        uint32_t index = (super.Blocks - 1 - blocknum) / size;
+        group = groups_of(super.InodeBlocks, size) + index;
+        last = super.Blocks - index * size;
+        first = super.Blocks - min((index + 1) * size, super.DirBlocks);
+    }
+    else return -1;
+
+    if(from) *from = first;
+    if(to) *to = last;
+    return group;
+}
+
+bool FileSystem::uninitialized(const SuperBlock &super, uint32_t blocknum) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    ssize_t group = lazy_group(super, blocknum);
+    return group >= 0 && (super.Uninit[group / 32] >> (group % 32)) & 1;
+}
+
+void FileSystem::lazy_groups(SuperBlock *super) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- grow the groups until the bitmap covers all of them */
+    super->GroupBlocks = LAZY_GROUP_BLOCKS;
+    while(groups_of(super->InodeBlocks, super->GroupBlocks) + groups_of(super->DirBlocks, super->GroupBlocks) > UNINIT_WORDS * 32)
+        super->GroupBlocks *= 2;
+
+    uint32_t groups = groups_of(super->InodeBlocks, super->GroupBlocks) + groups_of(super->DirBlocks, super->GroupBlocks);
+    memset(super->Uninit, 0, sizeof(super->Uninit));
+    for(uint32_t group = 0; group < groups; group++) super->Uninit[group / 32] |= 1U << (group % 32);
+
+    /**- the root directory is written by format() */
+    ssize_t root = lazy_group(*super, super->Blocks - 1);
+    super->Uninit[root / 32] &= ~(1U << (root % 32));
+}
+
+void FileSystem::init_group(uint32_t blocknum) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!uninitialized(MetaData, blocknum)) return;
+
+    /**- write the whole group as format() would have */
+    uint32_t from, to;
+    ssize_t group = lazy_group(MetaData, blocknum, &from, &to);
+    clear_blocks(fs_disk, MetaData, from, to);
+
+    /**- only then record it, so a crash in between leaves the group uninitialized */
+    MetaData.Uninit[group / 32] &= ~(1U << (group % 32));
+    Block block;
+    memset(&block, 0, sizeof(Block));
+    block.Super = MetaData;
+    fs_disk->write(0, block.Data);
+}
@@ -0,0 +1,207 @@
+/**
+ * @file fs_metrics.cpp
+ * @brief Implementation of fs.h metrics functions
+ * @date 2026-10-18
+ *
+ * @details metrics() gathers what the file system already counts: the
+ * latency of every public operation, timed by its TraceScope, the blocks
+ * the Disk read and wrote in every region, the fingerprint index cache and
+ * pre-filter of dedup disks, and the allocator bitmaps and counters. The
+ * Prometheus export names everything sfs_*, with power of two latency
+ * buckets, which the histogram counts exactly.
+ */
+
+#include "sfs/fs.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+    const unsigned LATENCY_BUCKETS = 23;        /** Prometheus buckets from 2^10 ns (1 us) to 2^32 ns (4.3 s) */
+
+    /**- share of a total, guarded against empty totals */
+    double share(uint64_t part, uint64_t total) {
+        return total ? (double)part / total : 0;
+    }
+}
+
+bool FileSystem::metrics(Metrics *metrics) const {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+
+    for(uint32_t op = 0; op < TRACE_OPS; op++) metrics->Latency[op] = op_latency[op];
+    for(uint8_t r = 0; r < IO_REGIONS; r++) {
+        metrics->RegionReads[r] = fs_disk->region_reads(r);
+        metrics->RegionWrites[r] = fs_disk->region_writes(r);
+    }
+    metrics->IndexHits = dedup.IndexHits;
+    metrics->IndexMisses = dedup.IndexMisses;
+    metrics->FilterSkips = dedup.FilterSkips;
+    metrics->Probes = dedup.Probes;
+
+    /**- The data region lies between the checksum table and the directory blocks */
+    uint32_t first = MetaData.InodeBlocks + 1 + MetaData.DedupBlocks + MetaData.ChecksumBlocks;
+    uint32_t last = MetaData.Blocks - MetaData.DirBlocks;
+    metrics->Blocks = MetaData.Blocks;
+    metrics->DataBlocks = last - first;
+    metrics->FreeBlocks = 0;
+    for(uint32_t i = first; i < last; i++) {
+        if(!free_blocks[i]) metrics->FreeBlocks++;
+    }
+    metrics->FreeHint = max(first, free_hint);
+    metrics->DiscardPending = discard_pending.size();
+
+    /**- Inodes and directories in use are counted per block already */
+    metrics->Inodes = MetaData.InodeBlocks * INODES_PER_BLOCK;
+    metrics->FreeInodes = metrics->Inodes;
+    for(size_t i = 0; i < inode_counter.size(); i++) metrics->FreeInodes -= inode_counter[i];
+    metrics->Directories = MetaData.DirBlocks * DIR_PER_BLOCK;
+    metrics->FreeDirectories = metrics->Directories;
+    for(size_t i = 0; i < dir_counter.size(); i++) metrics->FreeDirectories -= dir_counter[i];
+    return true;
+}
+
+bool FileSystem::print_metrics(FILE *out, bool prometheus) const {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Metrics snapshot, *m = &snapshot;
+    if(!metrics(m)) return false;
+    uint64_t reads = 0, writes = 0;
+    for(uint8_t r = 0; r < IO_REGIONS; r++) {
+        reads += m->RegionReads[r];
+        writes += m->RegionWrites[r];
+    }
+
+    if(!prometheus) {
+        /**- Operations that ran, with their latency percentiles */
+        fprintf(out, "%-10s %10s %10s %10s %10s %10s %10s\n", "operation", "count", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+        for(uint32_t op = 1; op < TRACE_OPS; op++) {
+            const Histogram &h = m->Latency[op];
+            if(!h.count()) continue;
+            fprintf(out, "%-10s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f\n", trace_op_name(op), (unsigned long)h.count(),
+                    h.sum() / 1e3 / h.count(), h.percentile(50) / 1e3, h.percentile(90) / 1e3, h.percentile(99) / 1e3, h.max() / 1e3);
+        }
+
+        fprintf(out, "\n%-10s %10s %10s %8s\n", "region", "reads", "writes", "share");
+        for(uint8_t r = 0; r < IO_REGIONS; r++) {
+            if(!m->RegionReads[r] && !m->RegionWrites[r]) continue;
+            fprintf(out, "%-10s %10lu %10lu %7.1f%%\n", io_region_name(r), (unsigned long)m->RegionReads[r],
+                    (unsigned long)m->RegionWrites[r], 100 * share(m->RegionReads[r] + m->RegionWrites[r], reads + writes));
+        }
+
+        fprintf(out, "\n");
+        if(MetaData.Features & FEATURE_DEDUP) {
+            fprintf(out, "Index cache hit ratio : %.3f (%lu hits, %lu misses)\n", share(m->IndexHits, m->IndexHits + m->IndexMisses),
+                    (unsigned long)m->IndexHits, (unsigned long)m->IndexMisses);
+            fprintf(out, "Pre-filter skip ratio : %.3f (%lu skips, %lu probes)\n", share(m->FilterSkips, m->FilterSkips + m->Probes),
+                    (unsigned long)m->FilterSkips, (unsigned long)m->Probes);
+        }
+        fprintf(out, "Free data blocks : %u of %u (%.1f%%), %lu bytes\n", m->FreeBlocks, m->DataBlocks,
+                100 * share(m->FreeBlocks, m->DataBlocks), (unsigned long)m->FreeBlocks * Disk::BLOCK_SIZE);
+        fprintf(out, "Allocator hint : block %u\n", m->FreeHint);
+        fprintf(out, "Discards pending : %u blocks\n", m->DiscardPending);
+        fprintf(out, "Free inodes : %u of %u\n", m->FreeInodes, m->Inodes);
+        fprintf(out, "Free directories : %u of %u\n", m->FreeDirectories, m->Directories);
+        return true;
+    }
+
+    /**- Latency histograms, in seconds as Prometheus has it */
+    fprintf(out, "# HELP sfs_operation_duration_seconds Latency of file system operations since mount.\n");
+    fprintf(out, "# TYPE sfs_operation_duration_seconds histogram\n");
+    for(uint32_t op = 1; op < TRACE_OPS; op++) {
+        const Histogram &h = m->Latency[op];
+        if(!h.count()) continue;
+        for(unsigned b = 0; b < LATENCY_BUCKETS; b++) {
+            uint64_t bound = 1ULL << (10 + b);
+            fprintf(out, "sfs_operation_duration_seconds_bucket{op=\"%s\",le=\"%.10g\"} %lu\n", trace_op_name(op),
+                    bound / 1e9, (unsigned long)h.count_below(bound));
+        }
+        fprintf(out, "sfs_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %lu\n", trace_op_name(op), (unsigned long)h.count());
+        fprintf(out, "sfs_operation_duration_seconds_sum{op=\"%s\"} %.9f\n", trace_op_name(op), h.sum() / 1e9);
+        fprintf(out, "sfs_operation_duration_seconds_count{op=\"%s\"} %lu\n", trace_op_name(op), (unsigned long)h.count());
+    }
+
+    fprintf(out, "# HELP sfs_block_io_total Blocks read and written since the disk was opened.\n");
+    fprintf(out, "# TYPE sfs_block_io_total counter\n");
+    for(uint8_t r = 0; r < IO_REGIONS; r++) {
+        if(!m->RegionReads[r] && !m->RegionWrites[r]) continue;
+        fprintf(out, "sfs_block_io_total{region=\"%s\",op=\"read\"} %lu\n", io_region_name(r), (unsigned long)m->RegionReads[r]);
+        fprintf(out, "sfs_block_io_total{region=\"%s\",op=\"write\"} %lu\n", io_region_name(r), (unsigned long)m->RegionWrites[r]);
+    }
+
+    if(MetaData.Features & FEATURE_DEDUP) {
+        fprintf(out, "# HELP sfs_cache_lookups_total Lookups of the dedup caches since mount.\n");
+        fprintf(out, "# TYPE sfs_cache_lookups_total counter\n");
+        fprintf(out, "sfs_cache_lookups_total{cache=\"index\",result=\"hit\"} %lu\n", (unsigned long)m->IndexHits);
+        fprintf(out, "sfs_cache_lookups_total{cache=\"index\",result=\"miss\"} %lu\n", (unsigned long)m->IndexMisses);
+        fprintf(out, "sfs_cache_lookups_total{cache=\"filter\",result=\"hit\"} %lu\n", (unsigned long)m->FilterSkips);
+        fprintf(out, "sfs_cache_lookups_total{cache=\"filter\",result=\"miss\"} %lu\n", (unsigned long)m->Probes);
+    }
+
+    fprintf(out, "# HELP sfs_blocks Blocks of the data region.\n");
+    fprintf(out, "# TYPE sfs_blocks gauge\n");
+    fprintf(out, "sfs_blocks{state=\"free\"} %u\n", m->FreeBlocks);
+    fprintf(out, "sfs_blocks{state=\"used\"} %u\n", m->DataBlocks - m->FreeBlocks);
+    fprintf(out, "sfs_blocks{state=\"discard_pending\"} %u\n", m->DiscardPending);
+    fprintf(out, "# HELP sfs_free_bytes Bytes of the free data blocks.\n");
+    fprintf(out, "# TYPE sfs_free_bytes gauge\n");
+    fprintf(out, "sfs_free_bytes %lu\n", (unsigned long)m->FreeBlocks * Disk::BLOCK_SIZE);
+    fprintf(out, "# HELP sfs_allocator_hint_block Block the allocator looks at first.\n");
+    fprintf(out, "# TYPE sfs_allocator_hint_block gauge\n");
+    fprintf(out, "sfs_allocator_hint_block %u\n", m->FreeHint);
+    fprintf(out, "# HELP sfs_inodes Inodes of the disk.\n");
+    fprintf(out, "# TYPE sfs_inodes gauge\n");
+    fprintf(out, "sfs_inodes{state=\"free\"} %u\n", m->FreeInodes);
+    fprintf(out, "sfs_inodes{state=\"used\"} %u\n", m->Inodes - m->FreeInodes);
+    fprintf(out, "# HELP sfs_directories Directories of the disk.\n");
+    fprintf(out, "# TYPE sfs_directories gauge\n");
+    fprintf(out, "sfs_directories{state=\"free\"} %u\n", m->FreeDirectories);
+    fprintf(out, "sfs_directories{state=\"used\"} %u\n", m->Directories - m->FreeDirectories);
+    return true;
+}
+
+void FileSystem::export_metrics_now(uint64_t now) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    metrics_next = now + metrics_period;
+
+    /**- Written aside and renamed over the old file, so readers see all of it or none */
+    string temp = metrics_path + ".tmp";
+    FILE *out = fopen(temp.c_str(), "w");
+    if(!out) return;
+    bool written = print_metrics(out, true);
+    if(fclose(out) == 0 && written) rename(temp.c_str(), metrics_path.c_str());
+    else unlink(temp.c_str());
+}
+
+bool FileSystem::export_metrics(const char *path, unsigned seconds) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- Sanity Checks */
+    metrics_path.clear();
+    if(!path) return true;
+    if(!mounted || !seconds) return false;
+
+    metrics_path = path;
+    metrics_period = (uint64_t)seconds * 1000000000ull;
+    export_metrics_now(clock_ns());
+    if(access(path, F_OK) < 0) {
+        printf("Unable to export to %s\n", path);
+        metrics_path.clear();
+        return false;
+    }
+    return true;
+}
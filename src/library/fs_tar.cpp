@@ -0,0 +1,390 @@
+/**
+ * @file fs_tar.cpp
+ * @brief Implementation of fs.h tar functions
+ * @date 2026-10-18
+ *
+ * @details tar_in() and tar_out() stream a POSIX (ustar) archive into or out
+ * of the file system, from or to a host file or stdin/stdout, without
+ * unpacking it on the host. File data moves in COPY_BLOCKS sized chunks and
+ * is written in order, so each file is written front to back with large
+ * writes. Only regular files and directories are kept; the archive metadata
+ * that SimpleFS has no room for (owners, modes, times, links) is dropped on
+ * the way in and filled with defaults on the way out.
+ */
+
+#include "sfs/fs.h"
+
+#include <algorithm>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define streq(a, b) (strcmp((a), (b)) == 0)
+
+namespace {
+    const size_t TAR_BLOCK = 512;                   /** Bytes of a header and the unit of data */
+    const size_t TAR_RECORD = 20 * TAR_BLOCK;       /** Archives are padded to whole records, as tar does */
+
+    /**- reads a numeric header field: octal, or base-256 when the high bit is set */
+    size_t tar_number(const char *field, size_t length) {
+        size_t value = 0;
+        if((unsigned char)field[0] & 0x80) {
+            for(size_t i = 1; i < length; i++) value = (value << 8) | (unsigned char)field[i];
+            return value;
+        }
+        for(size_t i = 0; i < length && field[i]; i++) {
+            if(field[i] >= '0' && field[i] <= '7') value = value * 8 + (field[i] - '0');
+        }
+        return value;
+    }
+
+    /**- checks for a block of zeros */
+    bool tar_zero(const char *block) {
+        for(size_t i = 0; i < TAR_BLOCK; i++) {
+            if(block[i]) return false;
+        }
+        return true;
+    }
+
+    /**- sum of the header bytes, with the checksum field counted as spaces */
+    unsigned tar_checksum(const char *header) {
+        unsigned sum = 0;
+        for(size_t i = 0; i < TAR_BLOCK; i++) {
+            sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)header[i];
+        }
+        return sum;
+    }
+
+    /**- fills a ustar header; false if the path does not fit into name and prefix */
+    bool tar_header(char *header, const string &path, char type, size_t size, time_t mtime) {
+        memset(header, 0, TAR_BLOCK);
+
+        /**- long paths are split at a slash into prefix (155 bytes) and name (100 bytes) */
+        size_t split = 0;
+        if(path.size() > 100) {
+            split = path.find('/', path.size() - 101);
+            if(split == string::npos || split > 155 || split == 0) return false;
+            memcpy(header + 345, path.data(), split);
+            split++;
+        }
+        memcpy(header, path.data() + split, path.size() - split);
+
+        snprintf(header + 100, 8, "%07o", type == '5' ? 0755 : 0644);
+        snprintf(header + 108, 8, "%07o", 0);
+        snprintf(header + 116, 8, "%07o", 0);
+        snprintf(header + 124, 12, "%011lo", (unsigned long)size);
+        snprintf(header + 136, 12, "%011lo", (unsigned long)mtime);
+        header[156] = type;
+        memcpy(header + 257, "ustar", 6);
+        memcpy(header + 263, "00", 2);
+
+        /**- six octal digits, a NUL and a space */
+        snprintf(header + 148, 8, "%06o", tar_checksum(header));
+        header[155] = ' ';
+        return true;
+    }
+
+    /**- output of tar_out(), collected into large writes */
+    struct TarStream {
+        int          fd;
+        vector<char> buffer;
+        size_t       used;
+        size_t       total;
+
+        bool flush() {
+            for(size_t done = 0; done < used; ) {
+                ssize_t result = ::write(fd, buffer.data() + done, used - done);
+                if(result < 0 && errno == EINTR) continue;
+                if(result <= 0) return false;
+                done += result;
+            }
+            total += used;
+            used = 0;
+            return true;
+        }
+
+        /**- appends data, padded with zeros to whole tar blocks if pad is set */
+        bool put(const char *data, size_t length, bool pad) {
+            size_t padded = pad ? (length + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK : length;
+            while(padded > 0) {
+                if(used == buffer.size() && !flush()) return false;
+                size_t chunk = min(padded, buffer.size() - used);
+                size_t copied = min(chunk, length);
+                memcpy(buffer.data() + used, data, copied);
+                memset(buffer.data() + used + copied, 0, chunk - copied);
+                used += chunk;
+                data += copied;
+                length -= copied;
+                padded -= chunk;
+            }
+            return true;
+        }
+    };
+}
+
+FileSystem::Directory FileSystem::load_dir(uint32_t inum) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Block block;
+    fs_disk->read(MetaData.Blocks - 1 - inum / DIR_PER_BLOCK, block.Data);
+    return block.Directories[inum % DIR_PER_BLOCK];
+}
+
+bool FileSystem::tar_in(const char *path) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_TAR_IN, path);
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+
+    /**- Open the archive; stdin is read through its FILE, so later commands stay in its buffer */
+    bool from_stdin = streq(path, "-");
+    FILE *in = from_stdin ? stdin : fopen(path, "rb");
+    if(!in) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    uint32_t base = curr_dir.inum;
+    vector<char> copy(COPY_BLOCKS * Disk::BLOCK_SIZE);
+    char header[TAR_BLOCK];
+    size_t blocks = 0, files = 0, dirs = 0, bytes = 0;
+    int zeros = 0;
+    bool ended = false, failed = false;
+
+    while(fread(header, 1, TAR_BLOCK, in) == TAR_BLOCK) {
+        blocks++;
+
+        /**- Two zero blocks end the archive */
+        if(tar_zero(header)) {
+            if(++zeros == 2) {
+                ended = true;
+                break;
+            }
+            continue;
+        }
+        zeros = 0;
+
+        if(tar_checksum(header) != tar_number(header + 148, 8)) {
+            fprintf(stderr, "Bad tar header in %s\n", path);
+            failed = true;
+            break;
+        }
+
+        /**- The path is the prefix, if any, and the name */
+        string name(header, strnlen(header, 100));
+        if(!memcmp(header + 257, "ustar", 5) && header[345]) {
+            name = string(header + 345, strnlen(header + 345, 155)) + "/" + name;
+        }
+        size_t size = tar_number(header + 124, 12);
+        char type = header[156];
+
+        /**- Split the path; empty and "." components are dropped, ".." is refused */
+        vector<string> parts;
+        bool skip = (type != '0' && type != '\0' && type != '5');
+        for(size_t start = 0; start <= name.size(); ) {
+            size_t slash = min(name.find('/', start), name.size());
+            string part = name.substr(start, slash - start);
+            if(part == "..") skip = true;
+            else if(part.size() >= NAMESIZE && !skip) {
+                fprintf(stderr, "Skipping %s: name too long\n", name.c_str());
+                skip = true;
+            }
+            else if(!part.empty() && part != ".") parts.push_back(part);
+            start = slash + 1;
+        }
+        if(parts.empty()) skip = true;
+
+        /**- Walk down from the starting directory, creating directories that are missing */
+        ssize_t inum = -1, target = -1;
+        curr_dir = load_dir(base);
+        size_t depth = (type == '5') ? parts.size() : parts.size() - 1;
+        for(size_t i = 0; !skip && i < depth; i++) {
+            char part[NAMESIZE];
+            strcpy(part, parts[i].c_str());
+            int offset = dir_lookup(curr_dir, part);
+            if(offset == -1) {
+                if(!mkdir(part)) skip = true;
+                else dirs++;
+                offset = dir_lookup(curr_dir, part);
+            }
+            if(!skip && (offset == -1 || curr_dir.Table[offset].type != 0 || !cd(part))) {
+                fprintf(stderr, "Skipping %s: %s is not a directory\n", name.c_str(), part);
+                skip = true;
+            }
+        }
+
+        /**- Files are created, or emptied when they exist */
+        DiskUsage before, after;
+        if(!skip && type != '5') {
+            char part[NAMESIZE];
+            strcpy(part, parts.back().c_str());
+            int offset = dir_lookup(curr_dir, part);
+            if(offset == -1 && touch(part)) offset = dir_lookup(curr_dir, part);
+            if(offset == -1 || curr_dir.Table[offset].type != 1) {
+                fprintf(stderr, "Skipping %s: cannot create it\n", name.c_str());
+                skip = true;
+            }
+            else {
+                inum = target = curr_dir.Table[offset].inum;
+                inode_usage(inum, &before);
+                truncate(inum);
+                files++;
+            }
+        }
+
+        /**- Stream the data, and its padding, in large chunks; skipped entries are read and dropped */
+        size_t padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        for(size_t offset = 0; offset < padded; ) {
+            size_t chunk = min(padded - offset, copy.size());
+            if(fread(copy.data(), 1, chunk, in) != chunk) {
+                failed = true;
+                break;
+            }
+            size_t length = (offset < size) ? min(chunk, size - offset) : 0;
+            if(inum >= 0 && length > 0) {
+                ssize_t actual = write(inum, copy.data(), length, offset);
+                if(actual != (ssize_t)length) {
+                    fprintf(stderr, "fs.write only wrote %ld bytes, not %ld bytes\n", (long)max(actual, (ssize_t)0), (long)length);
+                    inum = -1;
+                }
+                else bytes += length;
+            }
+            offset += chunk;
+        }
+        blocks += padded / TAR_BLOCK;
+
+        /**- Charge what the file gained to its directory and the ones above */
+        if(target >= 0) {
+            inode_usage(target, &after);
+            charge(curr_dir.inum, before, after);
+        }
+        if(failed) {
+            fprintf(stderr, "Unexpected end of %s\n", path);
+            break;
+        }
+    }
+
+    /**- The zeros that pad the last record are part of the archive too */
+    if(ended) {
+        int c;
+        while(blocks % (TAR_RECORD / TAR_BLOCK) && (c = getc(in)) != EOF) {
+            ungetc(c, in);
+            if(c != 0 || fread(header, 1, TAR_BLOCK, in) != TAR_BLOCK) break;
+            blocks++;
+        }
+    }
+    if(!ended && !failed && ferror(in)) {
+        fprintf(stderr, "Unable to read %s: %s\n", path, strerror(errno));
+        failed = true;
+    }
+    if(!from_stdin) fclose(in);
+
+    /**- Back to the starting directory, which may have changed */
+    curr_dir = load_dir(base);
+
+    printf("%lu files and %lu directories extracted, %lu bytes\n", files, dirs, bytes);
+    return !failed;
+}
+
+bool FileSystem::tar_out(char name[], const char *path) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_TAR_OUT, name, path);
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+    int offset = dir_lookup(curr_dir, name);
+    if(offset == -1) {
+        printf("No such file or directory\n");
+        return false;
+    }
+
+    /**- Open the archive; stdout gets what was printed so far first */
+    bool to_stdout = streq(path, "-");
+    if(to_stdout) fflush(stdout);
+    TarStream out;
+    out.fd = to_stdout ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(out.fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    out.buffer.resize(COPY_BLOCKS * Disk::BLOCK_SIZE);
+    out.used = 0;
+    out.total = 0;
+
+    /**- Directories are archived depth first, each followed by its files */
+    vector<pair<Dirent, string> > pending;
+    pending.push_back(make_pair(curr_dir.Table[offset], string(name)));
+    vector<char> copy(COPY_BLOCKS * Disk::BLOCK_SIZE);
+    time_t now = time(NULL);
+    char header[TAR_BLOCK];
+    bool failed = false;
+
+    while(!pending.empty() && !failed) {
+        Dirent entry = pending.back().first;
+        string entry_path = pending.back().second;
+        pending.pop_back();
+
+        if(entry.type == 0) {
+            if(!tar_header(header, entry_path + "/", '5', 0, now)) {
+                fprintf(stderr, "Skipping %s: path too long\n", entry_path.c_str());
+                continue;
+            }
+            failed = !out.put(header, TAR_BLOCK, false);
+
+            /**- Children go onto the stack backwards, so they come out in table order */
+            Directory dir = load_dir(entry.inum);
+            for(int i = ENTRIES_PER_DIR - 1; i >= 0; i--) {
+                if(!dir.Table[i].valid || streq(dir.Table[i].Name, ".") || streq(dir.Table[i].Name, "..")) continue;
+                pending.push_back(make_pair(dir.Table[i], entry_path + "/" + dir.Table[i].Name));
+            }
+            continue;
+        }
+
+        ssize_t size = stat(entry.inum);
+        if(size < 0 || !tar_header(header, entry_path, '0', size, now)) {
+            fprintf(stderr, "Skipping %s: path too long\n", entry_path.c_str());
+            continue;
+        }
+        failed = !out.put(header, TAR_BLOCK, false);
+
+        /**- File data in large reads, padded to whole tar blocks */
+        for(ssize_t position = 0; position < size && !failed; ) {
+            ssize_t result = read(entry.inum, copy.data(), min((size_t)(size - position), copy.size()), position);
+            if(result <= 0) {
+                fprintf(stderr, "Unable to read %s\n", entry_path.c_str());
+                failed = true;
+                break;
+            }
+            position += result;
+            failed = !out.put(copy.data(), result, position == size);
+        }
+    }
+
+    /**- Two zero blocks end the archive, and zeros fill the last record */
+    if(!failed) {
+        memset(header, 0, TAR_BLOCK);
+        failed = !out.put(header, TAR_BLOCK, false) || !out.put(header, TAR_BLOCK, false);
+        while(!failed && (out.total + out.used) % TAR_RECORD) failed = !out.put(header, TAR_BLOCK, false);
+    }
+    if(!failed) failed = !out.flush();
+    if(failed) fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+    if(!to_stdout) close(out.fd);
+
+    if(!to_stdout) printf("%lu bytes archived\n", out.total);
+    return !failed;
+}
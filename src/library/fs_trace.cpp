@@ -0,0 +1,129 @@
+/**
+ * @file fs_trace.cpp
+ * @brief Implementation of fs.h trace functions
+ * @date 2026-10-18
+ *
+ * @details Every public operation declares a TraceScope first. The outermost
+ * scope times the operation for metrics(). While a trace is being recorded,
+ * it also notes the start time, the names and
+ * the sizes of the operation, and appends a TraceRecord to the trace when the
+ * operation returns; operations called from inside it, like the write()s of a
+ * copyin(), are part of it and are not recorded again. sfsreplay reads the
+ * trace back and runs the same operations on a fresh disk. Built with
+ * TRACING=1, every scope, nested ones included, is also a span of the Timeline.
+ */
+
+#include "sfs/fs.h"
+
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+
+uint64_t FileSystem::clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+const char *trace_op_name(uint8_t op) {
+    static const char *names[TRACE_OPS] = {
+        "unknown", "create", "remove", "stat", "read", "write", "lookup", "touch", "mkdir", "rmdir",
+        "cd", "rm", "ls", "readdir", "du", "hash", "copyin", "pcopyin", "copyout", "import",
+        "tar_in", "tar_out", "commit"
+    };
+    return op < TRACE_OPS ? names[op] : names[0];
+}
+
+bool FileSystem::trace_start(const char *path) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    /**- Sanity Checks: the header needs the geometry of a mounted disk */
+    if(!mounted) return false;
+    trace_stop();
+
+    FILE *out = fopen(path, "wb");
+    if(!out) {
+        printf("Unable to open %s\n", path);
+        return false;
+    }
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, "SFSTRACE", sizeof(header.Magic));
+    header.Version = TRACE_VERSION;
+    header.Blocks = MetaData.Blocks;
+    header.Features = MetaData.Features;
+    if(fwrite(&header, sizeof(header), 1, out) != 1) {
+        fclose(out);
+        return false;
+    }
+
+    trace_out = out;
+    trace_depth = 0;
+    trace_epoch = clock_ns();
+    return true;
+}
+
+void FileSystem::trace_stop() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!trace_out) return;
+    fclose(trace_out);
+    trace_out = NULL;
+}
+
+void FileSystem::TraceScope::begin(uint8_t op, const char *first, const char *second,
+                                   uint64_t arg, uint64_t offset, uint32_t length) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Record.Op = op;
+    Recording = Fs->trace_out != NULL;
+    if(Recording) {
+        Record.Reserved = 0;
+        Record.Arg = arg;
+        Record.Offset = offset;
+        Record.Length = length;
+        Record.Pad = 0;
+        if(first) Strings.append(first, strlen(first) + 1);
+        if(second) Strings.append(second, strlen(second) + 1);
+    }
+    Start = clock_ns();
+}
+
+void FileSystem::TraceScope::end() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    uint64_t now = clock_ns();
+    Fs->op_latency[Record.Op].record(now - Start);
+#ifdef SFS_TRACING
+    if(Timeline::active()) Timeline::emit(trace_op_name(Record.Op), "fs", Start, now);
+#endif
+
+    /**- The operation may have stopped the trace, exit() does */
+    if(Recording && Fs->trace_out) {
+        uint64_t duration = now - Start;
+        Record.Time = Start - Fs->trace_epoch;
+        Record.Duration = duration > UINT32_MAX ? UINT32_MAX : (uint32_t)duration;
+
+        /**- Keep whole strings only when they do not fit the 16 bit length */
+        if(Strings.size() > UINT16_MAX) {
+            Strings.resize(Strings.rfind('\0', UINT16_MAX - 1) + 1);
+        }
+        Record.Strings = Strings.size();
+
+        fwrite(&Record, sizeof(Record), 1, Fs->trace_out);
+        fwrite(Strings.data(), 1, Strings.size(), Fs->trace_out);
+    }
+
+    /**- Metrics are exported by the operation that ends past the period */
+    if(!Fs->metrics_path.empty() && now >= Fs->metrics_next) Fs->export_metrics_now(now);
+}
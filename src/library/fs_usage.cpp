@@ -0,0 +1,116 @@
+/**
+ * @file fs_usage.cpp
+ * @brief Implementation of fs.h usage functions
+ * @date 2026-10-18
+ *
+ * @details Every directory keeps the bytes and blocks of its whole subtree
+ * in the tail of its dirblock, which the eight directories leave unused.
+ * The layer 2 functions that change a file charge the difference to its
+ * directory and to every directory up the ".." chain, so du() reads one
+ * dirblock however large the tree is. A subtree removed file by file is
+ * charged down to zero, which keeps free directory slots at zero usage.
+ */
+
+#include "sfs/fs.h"
+
+#include <string.h>
+
+using namespace std;
+
+void FileSystem::count_usage(Inode *node, DiskUsage *usage) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    memset(usage, 0, sizeof(DiskUsage));
+    if(!node->Valid) return;
+    usage->Bytes = node->Size;
+
+    /**- Count the allocated pointers; holes have none */
+    for(uint32_t i = 0; i < POINTERS_PER_INODE; i++) {
+        if(node->Direct[i]) usage->Blocks++;
+    }
+    if(node->Indirect) {
+        Block indirect;
+        fs_disk->read(node->Indirect, indirect.Data, REGION_INDIRECT);
+        usage->Blocks++;
+        for(uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+            if(indirect.Pointers[i]) usage->Blocks++;
+        }
+    }
+}
+
+void FileSystem::inode_usage(size_t inumber, DiskUsage *usage) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    Inode node;
+    memset(&node, 0, sizeof(Inode));
+    load_inode(inumber, &node);
+    count_usage(&node, usage);
+}
+
+void FileSystem::charge_dirs(map<uint32_t, Block> *dirs, uint32_t inum, int64_t bytes, int64_t blocks) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    if(!(MetaData.Features & FEATURE_USAGE) || (!bytes && !blocks)) return;
+
+    /**- Walk up through ".." until the root, which is its own parent */
+    while(true) {
+        Directory *dir = batch_dir(dirs, inum);
+        DiskUsage &usage = (*dirs)[MetaData.Blocks - 1 - inum / DIR_PER_BLOCK].Dirs.Usage[inum % DIR_PER_BLOCK];
+        usage.Bytes += bytes;
+        usage.Blocks += blocks;
+
+        if(inum == 0 || !dir->Valid) break;
+        inum = dir->Table[1].inum;
+    }
+}
+
+void FileSystem::charge(uint32_t inum, const DiskUsage &before, const DiskUsage &after) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    map<uint32_t, Block> dirs;
+    charge_dirs(&dirs, inum, (int64_t)(after.Bytes - before.Bytes), (int64_t)(after.Blocks - before.Blocks));
+    for(map<uint32_t, Block>::iterator it = dirs.begin(); it != dirs.end(); it++) {
+        fs_disk->write(it->first, it->second.Data);
+    }
+}
+
+bool FileSystem::du(char name[], DiskUsage *usage) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    TraceScope trace(this, TRACE_DU, name);
+
+    /**- Sanity Checks */
+    if(!mounted) return false;
+    if(!(MetaData.Features & FEATURE_USAGE)) {
+        printf("Disk was formatted without usage accounting\n");
+        return false;
+    }
+
+    int offset = dir_lookup(curr_dir, name);
+    if(offset == -1) {
+        printf("No such file/directory\n");
+        return false;
+    }
+
+    /**- Files are counted from their inode, directories read their totals */
+    uint32_t inum = curr_dir.Table[offset].inum;
+    if(curr_dir.Table[offset].type == 1) {
+        inode_usage(inum, usage);
+        return true;
+    }
+
+    Block block;
+    fs_disk->read(MetaData.Blocks - 1 - inum / DIR_PER_BLOCK, block.Data);
+    *usage = block.Dirs.Usage[inum % DIR_PER_BLOCK];
+    return true;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file lz4.cpp
+ * @brief Implementation of lz4.h functions
+ * @date 2026-10-18
+ *
+ * @details Greedy single-pass compressor with a small hash table of recent
+ * positions, and a bounds checked decompressor. Output follows the LZ4
+ * block format, so data can be inspected with the reference tools.
+ */
+
+#include "sfs/lz4.h"
+
+#include <string.h>
+
+namespace {
+    const int MIN_MATCH     = 4;        /** Shortest match that is encoded */
+    const int LAST_LITERALS = 5;        /** Last bytes of a block are always literals */
+    const int MF_LIMIT      = 12;       /** Last match must start this many bytes before the end */
+    const int HASH_LOG      = 12;       /** log2 of the number of hash table entries */
+    const int MAX_DISTANCE  = 65535;    /** Largest offset that fits in a sequence */
+
+    inline uint32_t read32(const char *p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t hash(uint32_t v) {
+        return (v * 2654435761U) >> (32 - HASH_LOG);
+    }
+
+    inline char *write_length(char *op, int len) {
+        while(len >= 255) {
+            *op++ = (char)255;
+            len -= 255;
+        }
+        *op++ = (char)len;
+        return op;
+    }
+}
+
+int LZ4::compress(const char *src, int size, char *dst, int capacity) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    const char *ip = src, *anchor = src;
+    const char *iend = src + size;
+    const char *mflimit = iend - MF_LIMIT;
+    const char *matchlimit = iend - LAST_LITERALS;
+    char *op = dst, *oend = dst + capacity;
+
+    /**- hash table maps 4 byte sequences to their last position */
+    int table[1 << HASH_LOG];
+    for(int i = 0; i < (1 << HASH_LOG); i++) table[i] = -1;
+
+    while(size > MF_LIMIT && ip < mflimit) {
+        uint32_t seq = read32(ip);
+        uint32_t h = hash(seq);
+        int ref = table[h];
+        table[h] = (int)(ip - src);
+
+        /**- no usable match at this position; emit it as a literal later */
+        if(ref < 0 || (ip - src) - ref > MAX_DISTANCE || read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        /**- extend the match backwards over pending literals and then forwards */
+        const char *match = src + ref;
+        while(ip > anchor && match > src && ip[-1] == match[-1]) {
+            ip--;
+            match--;
+        }
+        const char *mp = ip + MIN_MATCH, *mm = match + MIN_MATCH;
+        while(mp < matchlimit && *mp == *mm) {
+            mp++;
+            mm++;
+        }
+
+        int litlen = (int)(ip - anchor);
+        int matchlen = (int)(mp - ip) - MIN_MATCH;
+
+        /**- give up if the sequence plus the trailing literals could overflow dst */
+        if(op + 1 + litlen / 255 + 1 + litlen + 2 + matchlen / 255 + 1 + LAST_LITERALS + 1 > oend) return 0;
+
+        /**- token, literal run, offset and match length */
+        char *token = op++;
+        if(litlen >= 15) {
+            *token = (char)(15 << 4);
+            op = write_length(op, litlen - 15);
+        }
+        else *token = (char)(litlen << 4);
+        memcpy(op, anchor, litlen);
+        op += litlen;
+
+        uint32_t offset = (uint32_t)(ip - match);
+        *op++ = (char)(offset & 0xff);
+        *op++ = (char)(offset >> 8);
+
+        if(matchlen >= 15) {
+            *token |= 15;
+            op = write_length(op, matchlen - 15);
+        }
+        else *token |= (char)matchlen;
+
+        ip = anchor = mp;
+
+        /**- seed the table inside the match to find overlapping repeats */
+        table[hash(read32(ip - 2))] = (int)(ip - 2 - src);
+    }
+
+    /**- flush the remaining bytes as a final literal run */
+    int litlen = (int)(iend - anchor);
+    if(op + 1 + litlen / 255 + 1 + litlen > oend) return 0;
+
+    char *token = op++;
+    if(litlen >= 15) {
+        *token = (char)(15 << 4);
+        op = write_length(op, litlen - 15);
+    }
+    else *token = (char)(litlen << 4);
+    memcpy(op, anchor, litlen);
+    op += litlen;
+
+    return (int)(op - dst);
+}
+
+int LZ4::decompress(const char *src, int size, char *dst, int capacity) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + size;
+    char *op = dst, *oend = dst + capacity;
+
+    while(ip < iend) {
+        unsigned token = *ip++;
+
+        /**- literal run */
+        size_t litlen = token >> 4;
+        if(litlen == 15) {
+            unsigned s;
+            do {
+                if(ip >= iend) return -1;
+                s = *ip++;
+                litlen += s;
+            } while(s == 255);
+        }
+        if((size_t)(iend - ip) < litlen || (size_t)(oend - op) < litlen) return -1;
+        memcpy(op, ip, litlen);
+        op += litlen;
+        ip += litlen;
+
+        /**- the last sequence carries literals only */
+        if(ip >= iend) break;
+
+        /**- match copy; offsets must point into already decoded output */
+        if(iend - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > (size_t)(op - dst)) return -1;
+
+        size_t matchlen = token & 15;
+        if(matchlen == 15) {
+            unsigned s;
+            do {
+                if(ip >= iend) return -1;
+                s = *ip++;
+                matchlen += s;
+            } while(s == 255);
+        }
+        matchlen += MIN_MATCH;
+        if((size_t)(oend - op) < matchlen) return -1;
+
+        const char *match = op - offset;
+        if(offset >= matchlen) memcpy(op, match, matchlen);
+        else for(size_t i = 0; i < matchlen; i++) op[i] = match[i];
+        op += matchlen;
+    }
+
+    return (int)(op - dst);
+}
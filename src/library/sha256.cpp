@@ -11,6 +11,14 @@
 #include <endian.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
 
 /// same as reset()
 SHA256::SHA256()
@@ -76,9 +84,308 @@ namespace
 }
 
 
+namespace
+{
+  /// round constants
+  const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  /// initial hash values
+  const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  /// number of messages hashed side by side by the AVX2 code
+  enum { Lanes = 8 };
+
+  /// process numBlocks consecutive 64 byte blocks
+  typedef void (*ProcessBlocks)(uint32_t hash[8], const uint8_t* data, size_t numBlocks);
+
+#ifdef SHA256_X86
+  /// SHA-NI: two rounds per sha256rnds2, state kept as ABEF/CDGH
+  __attribute__((target("sha,sse4.1")))
+  void processBlocksShaNi(uint32_t hash[8], const uint8_t* data, size_t numBlocks)
+  {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // DCBA, HGFE => ABEF, CDGH
+    __m128i tmp    = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &hash[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &hash[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; numBlocks > 0; numBlocks--, data += SHA256::BlockSize)
+    {
+      __m128i save0 = state0;
+      __m128i save1 = state1;
+      __m128i w[4];
+
+      // 16 times 4 rounds, the schedule keeps the last 16 words in w[]
+      for (int i = 0; i < 16; i++)
+      {
+        if (i < 4)
+          w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16 * i)), byteSwap);
+        else
+          w[i & 3] = _mm_sha256msg2_epu32(
+                       _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]),
+                                     _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4)),
+                       w[(i + 3) & 3]);
+
+        __m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*) &K[4 * i]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+      }
+
+      state0 = _mm_add_epi32(state0, save0);
+      state1 = _mm_add_epi32(state1, save1);
+    }
+
+    // ABEF, CDGH => DCBA, HGFE
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*) &hash[0], _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i*) &hash[4], _mm_alignr_epi8(state1, tmp, 8));
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i rotate8(__m256i x, int c)
+  {
+    return _mm256_or_si256(_mm256_srli_epi32(x, c), _mm256_slli_epi32(x, 32 - c));
+  }
+
+  /// load 32 bytes of each lane at offset and transpose, out[j] holds word j of every lane
+  __attribute__((target("avx2")))
+  inline void loadWords8(const uint8_t* const lanes[Lanes], size_t offset, __m256i out[8])
+  {
+    const __m256i byteSwap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+                                               0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m256i r[8], s[8];
+    for (int l = 0; l < Lanes; l++)
+      r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*) (lanes[l] + offset)), byteSwap);
+
+    for (int l = 0; l < Lanes; l += 2)
+    {
+      s[l]     = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+      s[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
+    }
+    for (int l = 0; l < Lanes; l += 4)
+    {
+      r[l]     = _mm256_unpacklo_epi64(s[l],     s[l + 2]);
+      r[l + 1] = _mm256_unpackhi_epi64(s[l],     s[l + 2]);
+      r[l + 2] = _mm256_unpacklo_epi64(s[l + 1], s[l + 3]);
+      r[l + 3] = _mm256_unpackhi_epi64(s[l + 1], s[l + 3]);
+    }
+    for (int j = 0; j < 4; j++)
+    {
+      out[j]     = _mm256_permute2x128_si256(r[j], r[j + 4], 0x20);
+      out[j + 4] = _mm256_permute2x128_si256(r[j], r[j + 4], 0x31);
+    }
+  }
+
+  /// AVX2: one 64 byte block of eight independent messages, lane l of state[] belongs to lanes[l]
+  __attribute__((target("avx2")))
+  void processBlock8(__m256i state[8], const uint8_t* const lanes[Lanes], size_t offset)
+  {
+    __m256i w[16];
+    loadWords8(lanes, offset,      w);
+    loadWords8(lanes, offset + 32, w + 8);
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+      if (i >= 16)
+      {
+        __m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotate8(w15, 7), rotate8(w15, 18)), _mm256_srli_epi32(w15, 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotate8(w2, 17), rotate8(w2, 19)), _mm256_srli_epi32(w2, 10));
+        w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
+      }
+
+      __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(rotate8(e, 6), rotate8(e, 11)), rotate8(e, 25));
+      __m256i ch   = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+      __m256i x    = _mm256_add_epi32(_mm256_add_epi32(h, sum1),
+                                      _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(K[i]), w[i & 15])));
+      __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(rotate8(a, 2), rotate8(a, 13)), rotate8(a, 22));
+      __m256i maj  = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+      __m256i y    = _mm256_add_epi32(sum0, maj);
+
+      h = g; g = f; f = e; e = _mm256_add_epi32(d, x);
+      d = c; c = b; b = a; a = _mm256_add_epi32(x, y);
+    }
+
+    state[0] = _mm256_add_epi32(state[0], a); state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c); state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e); state[5] = _mm256_add_epi32(state[5], f);
+    state[6] = _mm256_add_epi32(state[6], g); state[7] = _mm256_add_epi32(state[7], h);
+  }
+
+  /// AVX2: full blocks of eight messages of numBytes each, then their padding
+  __attribute__((target("avx2")))
+  void hash8(const uint8_t* const lanes[Lanes], size_t numBytes, unsigned char hashes[Lanes][SHA256::HashBytes])
+  {
+    __m256i state[8];
+    for (int j = 0; j < 8; j++)
+      state[j] = _mm256_set1_epi32(H0[j]);
+
+    size_t full = numBytes / SHA256::BlockSize * SHA256::BlockSize;
+    for (size_t offset = 0; offset < full; offset += SHA256::BlockSize)
+      processBlock8(state, lanes, offset);
+
+    // remaining bytes plus padding and length, one or two blocks per lane
+    size_t rest = numBytes - full;
+    size_t tailSize = (rest + 9 <= SHA256::BlockSize) ? SHA256::BlockSize : 2 * SHA256::BlockSize;
+    uint8_t tails[Lanes][2 * SHA256::BlockSize];
+    const uint8_t* tailLanes[Lanes];
+    uint64_t msgBits = 8 * (uint64_t) numBytes;
+    for (int l = 0; l < Lanes; l++)
+    {
+      memcpy(tails[l], lanes[l] + full, rest);
+      tails[l][rest] = 128;
+      memset(tails[l] + rest + 1, 0, tailSize - rest - 1);
+      for (int k = 0; k < 8; k++)
+        tails[l][tailSize - 1 - k] = (uint8_t) (msgBits >> (8 * k));
+      tailLanes[l] = tails[l];
+    }
+    for (size_t offset = 0; offset < tailSize; offset += SHA256::BlockSize)
+      processBlock8(state, tailLanes, offset);
+
+    // state[j] holds word j of every lane
+    uint32_t words[8][Lanes];
+    for (int j = 0; j < 8; j++)
+      _mm256_storeu_si256((__m256i*) words[j], state[j]);
+    for (int l = 0; l < Lanes; l++)
+      for (int j = 0; j < 8; j++)
+      {
+        hashes[l][4 * j    ] = (unsigned char) (words[j][l] >> 24);
+        hashes[l][4 * j + 1] = (unsigned char) (words[j][l] >> 16);
+        hashes[l][4 * j + 2] = (unsigned char) (words[j][l] >>  8);
+        hashes[l][4 * j + 3] = (unsigned char)  words[j][l];
+      }
+  }
+
+  __attribute__((target("xsave")))
+  bool ymmEnabled()
+  {
+    return (_xgetbv(0) & 6) == 6;
+  }
+#endif
+
+  /// code paths available on this CPU, picked once; processBlocks is NULL for the portable code
+  struct Dispatch
+  {
+    ProcessBlocks processBlocks;
+    bool          avx2;
+    const char*   name;
+
+    Dispatch() : processBlocks(NULL), avx2(false), name("portable")
+    {
+      const char* wanted = getenv("SFS_SHA256");
+#ifdef SHA256_X86
+      unsigned int eax, ebx, ecx, edx;
+      bool sse41 = false, ymm = false, sha = false, avx2Flag = false;
+      if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      {
+        sse41 = (ecx & bit_SSE4_1) != 0;
+        ymm   = (ecx & bit_OSXSAVE) && (ecx & bit_AVX) && ymmEnabled();
+      }
+      if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+      {
+        sha      = (ebx & bit_SHA) != 0;
+        avx2Flag = (ebx & bit_AVX2) != 0;
+      }
+
+      if (ymm && avx2Flag && (!wanted || strcmp(wanted, "portable") != 0))
+      {
+        avx2 = true;
+        name = "avx2";
+      }
+      if (sse41 && sha && (!wanted || strcmp(wanted, "sha-ni") == 0))
+      {
+        processBlocks = processBlocksShaNi;
+        name = "sha-ni";
+      }
+#else
+      (void) wanted;
+#endif
+    }
+  };
+
+  const Dispatch& dispatch()
+  {
+    static const Dispatch d;
+    return d;
+  }
+
+  /// one message with the single stream code path
+  void hashOne(const uint8_t* data, size_t numBytes, unsigned char hash[SHA256::HashBytes])
+  {
+    SHA256 sha256;
+    sha256.add(data, numBytes);
+    sha256.getHash(hash);
+  }
+}
+
+
+/// compute SHA256 of count buffers of numBytes each
+void SHA256::hashMany(const void* const data[], size_t numBytes, size_t count, unsigned char hashes[][HashBytes])
+{
+  const Dispatch& d = dispatch();
+  size_t i = 0;
+
+#ifdef SHA256_X86
+  // SHA-NI beats eight AVX2 lanes, those only help without it
+  if (d.avx2 && !d.processBlocks)
+  {
+    for (; i + Lanes <= count; i += Lanes)
+      hash8((const uint8_t* const*) data + i, numBytes, hashes + i);
+
+    // a partial group still pays off once half the lanes are used, the rest repeat lane 0
+    if (count - i >= Lanes / 2)
+    {
+      const uint8_t* lanes[Lanes];
+      unsigned char  result[Lanes][HashBytes];
+      for (size_t l = 0; l < Lanes; l++)
+        lanes[l] = (const uint8_t*) data[i + (i + l < count ? l : 0)];
+      hash8(lanes, numBytes, result);
+      memcpy(hashes + i, result, (count - i) * HashBytes);
+      i = count;
+    }
+  }
+#endif
+
+  for (; i < count; i++)
+    hashOne((const uint8_t*) data[i], numBytes, hashes[i]);
+}
+
+
+/// name of the code path used for full blocks
+const char* SHA256::implementation()
+{
+  return dispatch().name;
+}
+
+
 /// process 64 bytes
 void SHA256::processBlock(const void* data)
 {
+  // SHA-NI if available
+  ProcessBlocks processBlocks = dispatch().processBlocks;
+  if (processBlocks)
+  {
+    processBlocks(m_hash, (const uint8_t*) data, 1);
+    return;
+  }
+
   // get last hash
   uint32_t a = m_hash[0];
   uint32_t b = m_hash[1];
@@ -263,7 +570,16 @@ void SHA256::add(const void* data, size_t numBytes)
   if (numBytes == 0)
     return;
 
-  // process full blocks
+  // process full blocks, all at once if accelerated
+  ProcessBlocks processBlocks = dispatch().processBlocks;
+  if (processBlocks && numBytes >= BlockSize)
+  {
+    size_t numBlocks = numBytes / BlockSize;
+    processBlocks(m_hash, current, numBlocks);
+    current    += numBlocks * BlockSize;
+    m_numBytes += numBlocks * BlockSize;
+    numBytes   -= numBlocks * BlockSize;
+  }
   while (numBytes >= BlockSize)
   {
     processBlock(current);
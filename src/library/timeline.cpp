@@ -0,0 +1,119 @@
+/**
+ * @file timeline.cpp
+ * @brief Implementation of timeline.h
+ * @date 2026-10-18
+ *
+ * @details Events are formatted on the thread that ends the span and appended
+ * to a stdio stream under one mutex; the stream's buffer batches them into few
+ * writes. Times are microseconds from start(), with nanosecond decimals, and
+ * the thread id is the kernel's, so the copy threads of pcopyin() get lanes
+ * of their own. A timeline still open when the program exits is closed
+ * then, so the file is always a complete array.
+ */
+
+#ifdef SFS_TRACING
+
+#include "sfs/timeline.h"
+
+#include <atomic>
+#include <mutex>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+mutex           Lock;               // Guards Out
+FILE           *Out = NULL;         // Timeline being written
+uint64_t        Epoch = 0;          // now() at start()
+atomic<bool>    Active(false);      // Out is open; read without the lock on every span
+
+long thread_id() {
+    static thread_local long tid = syscall(SYS_gettid);
+    return tid;
+}
+
+// Starts the timeline named by SFS_TIMELINE, for programs without a command to, and ends it at exit
+struct Lifetime {
+    Lifetime() {
+        const char *path = getenv("SFS_TIMELINE");
+        if (path && *path) Timeline::start(path);
+    }
+    ~Lifetime() {
+        Timeline::stop();
+    }
+} Process;
+
+}
+
+uint64_t Timeline::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+bool Timeline::active() {
+    return Active.load(memory_order_relaxed);
+}
+
+bool Timeline::start(const char *path) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    stop();
+
+    FILE *out = fopen(path, "w");
+    if(!out) {
+        printf("Unable to open %s\n", path);
+        return false;
+    }
+
+    /**- Name the process so the viewer shows more than its pid; every event after it starts with a comma */
+    lock_guard<mutex> guard(Lock);
+    fprintf(out, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"sfs\"}}", (int)getpid());
+    Out = out;
+    Epoch = now();
+    Active = true;
+    return true;
+}
+
+void Timeline::stop() {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    lock_guard<mutex> guard(Lock);
+    if(!Out) return;
+    Active = false;
+    fprintf(Out, "\n]\n");
+    fclose(Out);
+    Out = NULL;
+}
+
+void Timeline::emit(const char *name, const char *category, uint64_t start, uint64_t end, int64_t arg) {
+    /** <dl class="section implementation"> */
+    /** <dt> Implementation details </dt>*/
+    /** </dl> */
+
+    lock_guard<mutex> guard(Lock);
+
+    /**- The timeline may have been stopped, or restarted, since the span began */
+    if(!Out || start < Epoch) return;
+
+    uint64_t ts = start - Epoch, dur = end > start ? end - start : 0;
+    fprintf(Out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lu.%03lu,\"dur\":%lu.%03lu,\"pid\":%d,\"tid\":%ld",
+            name, category,
+            (unsigned long)(ts / 1000), (unsigned long)(ts % 1000),
+            (unsigned long)(dur / 1000), (unsigned long)(dur % 1000),
+            (int)getpid(), thread_id());
+    if(arg >= 0) fprintf(Out, ",\"args\":{\"block\":%ld}", (long)arg);
+    fputc('}', Out);
+}
+
+#endif
@@ -0,0 +1,515 @@
+// sfsload.cpp: Simple file system workload generator
+
+#include "sfs/disk.h"
+#include "sfs/fs.h"
+#include "sfs/histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Macros
+
+#define streq(a, b) (strcmp((a), (b)) == 0)
+
+// Format features; encrypt is left out, it prompts for a password
+
+struct Feature {
+    const char *name;
+    uint32_t    flag;
+};
+
+const Feature FEATURES[] = {
+    {"compress", FileSystem::FEATURE_COMPRESS},
+    {"dedup",    FileSystem::FEATURE_DEDUP},
+    {"checksum", FileSystem::FEATURE_CHECKSUM},
+    {"lazy",     FileSystem::FEATURE_LAZY},
+    {"discard",  FileSystem::FEATURE_DISCARD},
+};
+
+const size_t   MAX_FILE_SIZE = (FileSystem::POINTERS_PER_INODE + FileSystem::POINTERS_PER_BLOCK) * Disk::BLOCK_SIZE;
+const uint32_t FILES_PER_DIR = FileSystem::ENTRIES_PER_DIR - 3;    // "." and ".." and the link to the next directory
+
+// Jobs
+
+struct Job {
+    string   name;          // Section name; also the directory the job works in
+    bool     random;        // Random offsets instead of sequential ones
+    int      read_mix;      // Percentage of reads
+    size_t   block_size;    // Bytes per read or write
+    size_t   min_size;      // Smallest file
+    size_t   max_size;      // Largest file; sizes are uniform in between
+    uint32_t files;         // Number of files
+    uint32_t dirs;          // Number of directories the files are spread over
+    uint32_t threads;       // Worker threads
+    uint32_t iodepth;       // Requests submitted together by a worker
+    double   runtime;       // Seconds to run
+    uint64_t ops;           // Requests per worker; 0 runs for runtime only
+    unsigned seed;          // Seed of the sizes and offsets
+};
+
+struct Config {
+    size_t      blocks;     // Blocks of the image
+    uint32_t    features;   // Format features
+    string      feature_list;
+    vector<Job> jobs;
+};
+
+struct Target {
+    ssize_t inumber;        // The file
+    size_t  size;           // Its size
+};
+
+struct Report {
+    Histogram reads;        // Latency of reads
+    Histogram writes;       // Latency of writes
+    uint64_t  read_bytes;
+    uint64_t  write_bytes;
+    uint64_t  errors;
+    double    seconds;      // Wall clock time of the job
+    size_t    disk_reads;   // Disk block reads during the job
+    size_t    disk_writes;  // Disk block writes during the job
+};
+
+// Functions
+
+bool parse_job_file(const char *path, Config *config);
+void layout(FileSystem &fs, const Job &job, vector<Target> *targets);
+void run_job(Disk &disk, FileSystem &fs, const Job &job, const vector<Target> &targets, Report *report);
+void print_text(FILE *out, const Job &job, const Report &report);
+void print_json(FILE *out, const Config &config, const vector<Report> &reports);
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-j] <jobfile> [image]\n", program);
+    fprintf(stderr, "    -j    print the reports as JSON\n");
+}
+
+int main(int argc, char *argv[]) {
+    bool json = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "jh")) != -1) {
+	switch (option) {
+	    case 'j': json = true; break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind >= argc || optind + 2 < argc) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    Config config;
+    if (!parse_job_file(argv[optind], &config)) return EXIT_FAILURE;
+
+    /* Scratch image unless one was named */
+    char image[] = "/tmp/sfsload.image.XXXXXX";
+    int image_fd = (optind + 1 < argc) ? -1 : mkstemp(image);
+    if (optind + 1 == argc && image_fd < 0) {
+	perror("mkstemp");
+	return EXIT_FAILURE;
+    }
+    if (image_fd >= 0) close(image_fd);
+    const char *image_path = (optind + 1 < argc) ? argv[optind + 1] : image;
+
+    /* The library reports on stdout; keep it for the reports and silence the rest */
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) {
+	perror("stdout");
+	return EXIT_FAILURE;
+    }
+
+    vector<Report> reports;
+    int status = EXIT_SUCCESS;
+    try {
+	Disk disk;
+	FileSystem fs;
+	disk.open(image_path, config.blocks);
+	if (!FileSystem::format(&disk, config.features) || !fs.mount(&disk)) {
+	    throw runtime_error("cannot format the image");
+	}
+
+	for (size_t j = 0; j < config.jobs.size(); j++) {
+	    const Job &job = config.jobs[j];
+	    vector<Target> targets;
+	    layout(fs, job, &targets);
+
+	    reports.push_back(Report());
+	    run_job(disk, fs, job, targets, &reports.back());
+	    if (!json) {
+		print_text(out, job, reports.back());
+		fflush(out);
+	    }
+	}
+	fs.exit();
+    } catch (runtime_error &e) {
+	fprintf(stderr, "Workload failed: %s\n", e.what());
+	status = EXIT_FAILURE;
+    }
+
+    if (json) print_json(out, config, reports);
+    fclose(out);
+    if (image_fd >= 0) unlink(image);
+    return status;
+}
+
+// Job file functions
+
+bool parse_size(const char *text, size_t *size) {
+    char *end;
+    double value = strtod(text, &end);
+    switch (tolower(*end)) {
+	case 'k': value *= 1024; end++; break;
+	case 'm': value *= 1024 * 1024; end++; break;
+	case 'g': value *= 1024.0 * 1024 * 1024; end++; break;
+    }
+    if (end == text || *end || value < 0) return false;
+    *size = (size_t)value;
+    return true;
+}
+
+bool parse_features(char *list, uint32_t *features) {
+    *features = 0;
+    if (streq(list, "none")) return true;
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+	size_t i = 0;
+	for (; i < sizeof(FEATURES) / sizeof(FEATURES[0]); i++) {
+	    if (streq(name, FEATURES[i].name)) break;
+	}
+	if (i == sizeof(FEATURES) / sizeof(FEATURES[0])) {
+	    fprintf(stderr, "Unknown feature: %s\n", name);
+	    return false;
+	}
+	*features |= FEATURES[i].flag;
+    }
+    return true;
+}
+
+bool set_option(Job *job, const char *key, char *value) {
+    size_t size;
+    if (streq(key, "rw")) {
+	if (streq(value, "read"))           { job->random = false; job->read_mix = 100; }
+	else if (streq(value, "write"))     { job->random = false; job->read_mix = 0; }
+	else if (streq(value, "rw"))        { job->random = false; }
+	else if (streq(value, "randread"))  { job->random = true;  job->read_mix = 100; }
+	else if (streq(value, "randwrite")) { job->random = true;  job->read_mix = 0; }
+	else if (streq(value, "randrw"))    { job->random = true; }
+	else return false;
+    }
+    else if (streq(key, "rwmixread"))   job->read_mix = atoi(value);
+    else if (streq(key, "bs"))          { if (!parse_size(value, &job->block_size)) return false; }
+    else if (streq(key, "filesize")) {
+	char *dash = strchr(value, '-');
+	if (dash) *dash = 0;
+	if (!parse_size(value, &job->min_size)) return false;
+	if (!parse_size(dash ? dash + 1 : value, &job->max_size)) return false;
+    }
+    else if (streq(key, "nrfiles"))     job->files = atoi(value);
+    else if (streq(key, "nrdirs"))      job->dirs = atoi(value);
+    else if (streq(key, "threads") || streq(key, "numjobs")) job->threads = atoi(value);
+    else if (streq(key, "iodepth"))     job->iodepth = atoi(value);
+    else if (streq(key, "runtime"))     job->runtime = atof(value);
+    else if (streq(key, "ops"))         { if (!parse_size(value, &size)) return false; job->ops = size; }
+    else if (streq(key, "seed"))        job->seed = atoi(value);
+    else return false;
+    return true;
+}
+
+bool check_job(const Job &job) {
+    const char *error = NULL;
+    if (job.name.empty() || job.name.size() >= FileSystem::NAMESIZE) error = "job names take 1 to 15 characters";
+    else if (job.read_mix < 0 || job.read_mix > 100) error = "rwmixread must be within 0 and 100";
+    else if (job.block_size == 0 || job.block_size > job.min_size) error = "bs must be within 1 and the smallest filesize";
+    else if (job.min_size > job.max_size || job.max_size > MAX_FILE_SIZE) error = "filesize must be a range below 4116k";
+    else if (job.files == 0 || job.dirs == 0 || job.files > job.dirs * FILES_PER_DIR) error = "every directory holds 1 to 4 files";
+    else if (job.threads == 0 || job.iodepth == 0) error = "threads and iodepth must be positive";
+    else if (job.runtime <= 0 && job.ops == 0) error = "runtime or ops must be set";
+    if (error) fprintf(stderr, "Job %s: %s\n", job.name.c_str(), error);
+    return !error;
+}
+
+bool parse_job_file(const char *path, Config *config) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+	return false;
+    }
+
+    Job defaults = {"", false, 50, 4096, 1048576, 1048576, 16, 4, 1, 1, 5, 0, 1};
+    Job *job = &defaults;
+    char line[BUFSIZ], features[BUFSIZ] = "none";
+    config->blocks = 20000;
+    int number = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, BUFSIZ, in)) {
+	number++;
+	char *text = line + strspn(line, " \t");
+	text[strcspn(text, "#;\r\n")] = 0;
+	for (size_t n = strlen(text); n && isspace(text[n - 1]); n--) text[n - 1] = 0;
+	if (!*text) continue;
+
+	/* Sections start jobs; [global] sets the defaults of the jobs after it */
+	if (*text == '[') {
+	    char *close = strchr(text, ']');
+	    if (!close) { ok = false; break; }
+	    *close = 0;
+	    if (streq(text + 1, "global")) job = &defaults;
+	    else {
+		config->jobs.push_back(defaults);
+		job = &config->jobs.back();
+		job->name = text + 1;
+	    }
+	    continue;
+	}
+
+	char *equals = strchr(text, '=');
+	if (!equals) { ok = false; break; }
+	*equals = 0;
+	char *key = text, *value = equals + 1;
+	for (size_t n = strlen(key); n && isspace(key[n - 1]); n--) key[n - 1] = 0;
+	value += strspn(value, " \t");
+
+	if (job == &defaults && streq(key, "blocks")) config->blocks = strtoul(value, NULL, 10);
+	else if (job == &defaults && streq(key, "features")) snprintf(features, sizeof(features), "%s", value);
+	else ok = set_option(job, key, value);
+    }
+    fclose(in);
+
+    if (!ok) {
+	fprintf(stderr, "%s:%d: cannot parse this line\n", path, number);
+	return false;
+    }
+    if (config->jobs.empty() || config->jobs.size() > FileSystem::ENTRIES_PER_DIR - 2) {
+	fprintf(stderr, "%s: 1 to %u jobs are needed\n", path, FileSystem::ENTRIES_PER_DIR - 2);
+	return false;
+    }
+    for (size_t j = 0; j < config->jobs.size(); j++) {
+	if (!check_job(config->jobs[j])) return false;
+    }
+    config->feature_list = features;
+    return parse_features(features, &config->features);
+}
+
+// Workload functions
+
+void layout(FileSystem &fs, const Job &job, vector<Target> *targets) {
+    char name[FileSystem::NAMESIZE], next[] = "next", up[] = "..";
+    unsigned seed = job.seed;
+    vector<char> data(MAX_FILE_SIZE);
+    for (size_t i = 0; i < data.size(); i++) data[i] = rand_r(&seed);
+
+    /* A chain of directories, with the files dealt out over them */
+    snprintf(name, sizeof(name), "%s", job.name.c_str());
+    if (!fs.mkdir(name) || !fs.cd(name)) throw runtime_error("cannot create the directory of job " + job.name);
+    for (uint32_t d = 0; d < job.dirs; d++) {
+	for (uint32_t f = d; f < job.files; f += job.dirs) {
+	    snprintf(name, sizeof(name), "f%u", f);
+	    Target target;
+	    target.size = job.min_size + (job.max_size > job.min_size ? rand_r(&seed) % (job.max_size - job.min_size + 1) : 0);
+	    if (!fs.touch(name) || (target.inumber = fs.lookup(name)) < 0 ||
+		fs.write(target.inumber, data.data(), target.size, 0) != (ssize_t)target.size) {
+		throw runtime_error("cannot lay out the files of job " + job.name + "; is the disk large enough?");
+	    }
+	    targets->push_back(target);
+	}
+	if (d + 1 < job.dirs && (!fs.mkdir(next) || !fs.cd(next))) {
+	    throw runtime_error("cannot create the directories of job " + job.name);
+	}
+    }
+    for (uint32_t d = 0; d < job.dirs; d++) fs.cd(up);
+}
+
+struct Worker {
+    const Job            *job;
+    const vector<Target> *targets;
+    FileSystem           *fs;
+    mutex                *lock;         // The library serves one call at a time
+    atomic<bool>         *stop;
+    atomic<uint32_t>     *running;
+    unsigned              seed;
+    Histogram             reads;
+    Histogram             writes;
+    uint64_t              read_bytes;
+    uint64_t              write_bytes;
+    uint64_t              errors;
+};
+
+struct Request {
+    bool     read;
+    size_t   file;
+    size_t   offset;
+};
+
+void work(Worker *worker) {
+    const Job &job = *worker->job;
+    const vector<Target> &targets = *worker->targets;
+    vector<char> buffer(job.block_size);
+    vector<size_t> cursors(targets.size(), 0);
+    vector<Request> requests(job.iodepth);
+    size_t file = worker->seed % targets.size();
+
+    for (uint64_t done = 0; !*worker->stop && (!job.ops || done < job.ops); ) {
+	/* Queue up to iodepth requests; sequential ones move on to the next file at its end */
+	size_t count = job.ops ? min((uint64_t)job.iodepth, job.ops - done) : job.iodepth;
+	for (size_t r = 0; r < count; r++) {
+	    Request &request = requests[r];
+	    request.read = (int)(rand_r(&worker->seed) % 100) < job.read_mix;
+	    if (job.random) {
+		request.file = rand_r(&worker->seed) % targets.size();
+		request.offset = (rand_r(&worker->seed) % (targets[request.file].size / job.block_size)) * job.block_size;
+	    }
+	    else {
+		if (cursors[file] + job.block_size > targets[file].size) {
+		    cursors[file] = 0;
+		    file = (file + 1) % targets.size();
+		}
+		request.file = file;
+		request.offset = cursors[file];
+		cursors[file] += job.block_size;
+	    }
+	}
+
+	/* Submit them together; each waits for the ones queued before it */
+	uint64_t submitted = now_ns();
+	lock_guard<mutex> guard(*worker->lock);
+	for (size_t r = 0; r < count; r++) {
+	    Request &request = requests[r];
+	    ssize_t inumber = targets[request.file].inumber;
+	    ssize_t length = request.read ?
+		worker->fs->read(inumber, buffer.data(), job.block_size, request.offset) :
+		worker->fs->write(inumber, buffer.data(), job.block_size, request.offset);
+	    uint64_t latency = now_ns() - submitted;
+
+	    if (length != (ssize_t)job.block_size) worker->errors++;
+	    if (request.read) {
+		worker->reads.record(latency);
+		worker->read_bytes += max(length, (ssize_t)0);
+	    }
+	    else {
+		worker->writes.record(latency);
+		worker->write_bytes += max(length, (ssize_t)0);
+	    }
+	}
+	done += count;
+    }
+    (*worker->running)--;
+}
+
+void run_job(Disk &disk, FileSystem &fs, const Job &job, const vector<Target> &targets, Report *report) {
+    mutex lock;
+    atomic<bool> stop(false);
+    atomic<uint32_t> running(job.threads);
+    vector<Worker> workers(job.threads);
+    for (uint32_t t = 0; t < job.threads; t++) {
+	Worker &worker = workers[t];
+	worker.job = &job;
+	worker.targets = &targets;
+	worker.fs = &fs;
+	worker.lock = &lock;
+	worker.stop = &stop;
+	worker.running = &running;
+	worker.seed = job.seed + t * 7919;
+	worker.read_bytes = worker.write_bytes = worker.errors = 0;
+    }
+
+    size_t reads = disk.reads(), writes = disk.writes();
+    uint64_t started = now_ns();
+    vector<thread> threads;
+    for (uint32_t t = 0; t < job.threads; t++) threads.push_back(thread(work, &workers[t]));
+
+    /* Stop the workers once the runtime is over, unless they finish their ops first */
+    if (job.runtime > 0) {
+	uint64_t deadline = started + (uint64_t)(job.runtime * 1e9);
+	while (running && now_ns() < deadline) usleep(1000);
+	stop = true;
+    }
+    for (uint32_t t = 0; t < job.threads; t++) threads[t].join();
+    report->seconds = (now_ns() - started) / 1e9;
+
+    report->read_bytes = report->write_bytes = report->errors = 0;
+    for (uint32_t t = 0; t < job.threads; t++) {
+	report->reads.merge(workers[t].reads);
+	report->writes.merge(workers[t].writes);
+	report->read_bytes += workers[t].read_bytes;
+	report->write_bytes += workers[t].write_bytes;
+	report->errors += workers[t].errors;
+    }
+    report->disk_reads = disk.reads() - reads;
+    report->disk_writes = disk.writes() - writes;
+}
+
+// Report functions
+
+void print_latency(FILE *out, const char *kind, const Histogram &histogram, uint64_t bytes, double seconds) {
+    if (!histogram.count()) return;
+    fprintf(out, "  %-5s: IOPS=%.0f, BW=%.2fMB/s, ios=%lu\n", kind,
+	    histogram.count() / seconds, bytes / seconds / 1e6, (unsigned long)histogram.count());
+    fprintf(out, "         lat (usec): p50=%.1f, p90=%.1f, p99=%.1f, p99.9=%.1f, max=%.1f\n",
+	    histogram.percentile(50) / 1e3, histogram.percentile(90) / 1e3, histogram.percentile(99) / 1e3,
+	    histogram.percentile(99.9) / 1e3, histogram.percentile(100) / 1e3);
+}
+
+void print_text(FILE *out, const Job &job, const Report &report) {
+    fprintf(out, "%s: rw=%s%s, rwmixread=%d, bs=%lu, filesize=%lu-%lu, nrfiles=%u, nrdirs=%u, threads=%u, iodepth=%u\n",
+	    job.name.c_str(), job.random ? "rand" : "seq", job.read_mix == 100 ? "read" : job.read_mix ? "rw" : "write",
+	    job.read_mix, (unsigned long)job.block_size, (unsigned long)job.min_size, (unsigned long)job.max_size,
+	    job.files, job.dirs, job.threads, job.iodepth);
+    print_latency(out, "read", report.reads, report.read_bytes, report.seconds);
+    print_latency(out, "write", report.writes, report.write_bytes, report.seconds);
+    uint64_t ios = report.reads.count() + report.writes.count();
+    fprintf(out, "  total: IOPS=%.0f, BW=%.2fMB/s, run=%.3fs, errors=%lu\n",
+	    ios / report.seconds, (report.read_bytes + report.write_bytes) / report.seconds / 1e6,
+	    report.seconds, (unsigned long)report.errors);
+    fprintf(out, "  disk : reads=%lu, writes=%lu, per io=%.2f/%.2f\n\n",
+	    (unsigned long)report.disk_reads, (unsigned long)report.disk_writes,
+	    ios ? (double)report.disk_reads / ios : 0, ios ? (double)report.disk_writes / ios : 0);
+}
+
+void print_json_latency(FILE *out, const char *kind, const Histogram &histogram, uint64_t bytes, double seconds) {
+    fprintf(out, "\"%s\": {\"ios\": %lu, \"bytes\": %lu, \"iops\": %.1f, \"mb_per_sec\": %.2f, ", kind,
+	    (unsigned long)histogram.count(), (unsigned long)bytes, histogram.count() / seconds, bytes / seconds / 1e6);
+    fprintf(out, "\"latency_ns\": {\"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu}}",
+	    (unsigned long)histogram.percentile(50), (unsigned long)histogram.percentile(90),
+	    (unsigned long)histogram.percentile(99), (unsigned long)histogram.percentile(99.9),
+	    (unsigned long)histogram.percentile(100));
+}
+
+void print_json(FILE *out, const Config &config, const vector<Report> &reports) {
+    fprintf(out, "{\n  \"tool\": \"sfsload\",\n  \"blocks\": %lu,\n  \"features\": \"%s\",\n  \"jobs\": [",
+	    (unsigned long)config.blocks, config.feature_list.c_str());
+    for (size_t j = 0; j < reports.size(); j++) {
+	const Job &job = config.jobs[j];
+	const Report &report = reports[j];
+	fprintf(out, "%s\n    {\"name\": \"%s\", \"random\": %s, \"rwmixread\": %d, \"bs\": %lu, \"threads\": %u, \"iodepth\": %u, ",
+		j ? "," : "", job.name.c_str(), job.random ? "true" : "false", job.read_mix,
+		(unsigned long)job.block_size, job.threads, job.iodepth);
+	fprintf(out, "\"seconds\": %.6f, \"errors\": %lu, \"disk_reads\": %lu, \"disk_writes\": %lu,\n      ",
+		report.seconds, (unsigned long)report.errors, (unsigned long)report.disk_reads, (unsigned long)report.disk_writes);
+	print_json_latency(out, "read", report.reads, report.read_bytes, report.seconds);
+	fprintf(out, ",\n      ");
+	print_json_latency(out, "write", report.writes, report.write_bytes, report.seconds);
+	fprintf(out, "}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
@@ -0,0 +1,340 @@
+// sfsreplay.cpp: Simple file system trace replayer
+
+#include "sfs/disk.h"
+#include "sfs/fs.h"
+#include "sfs/trace.h"
+
+#include <map>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Replay state
+
+struct Entry {
+    TraceRecord    record;
+    vector<string> strings;
+};
+
+struct OpTotals {
+    uint64_t count;
+    uint64_t recorded_ns;
+    uint64_t replayed_ns;
+    uint64_t skipped;
+};
+
+struct Replay {
+    Disk                  *disk;
+    FileSystem            *fs;
+    map<uint64_t, size_t>  inumbers;   // Recorded inumber to replayed inumber
+    vector<char>           data;       // Synthetic data written in place of the recorded data
+    string                 scratch;    // Directory for generated inputs and copied out files
+    OpTotals               totals[TRACE_OPS];
+};
+
+// Functions
+
+uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-t] [-k] <trace> [image]\n", program);
+    fprintf(stderr, "    -t    wait between operations as long as the recording did\n");
+    fprintf(stderr, "    -k    replay onto the image as it is instead of formatting it\n");
+}
+
+bool read_trace(const char *path, TraceHeader *header, vector<Entry> *entries) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+	return false;
+    }
+
+    if (fread(header, sizeof(TraceHeader), 1, in) != 1 || memcmp(header->Magic, "SFSTRACE", sizeof(header->Magic)) ||
+	header->Version != TRACE_VERSION) {
+	fprintf(stderr, "%s is not a trace\n", path);
+	fclose(in);
+	return false;
+    }
+
+    /* A record cut short by a crash ends the trace */
+    Entry entry;
+    while (fread(&entry.record, sizeof(TraceRecord), 1, in) == 1) {
+	string bytes(entry.record.Strings, '\0');
+	if (entry.record.Strings && fread(&bytes[0], 1, bytes.size(), in) != bytes.size()) break;
+
+	entry.strings.clear();
+	for (size_t start = 0; start < bytes.size(); ) {
+	    size_t end = bytes.find('\0', start);
+	    if (end == string::npos) end = bytes.size();
+	    entry.strings.push_back(bytes.substr(start, end - start));
+	    start = end + 1;
+	}
+	entries->push_back(entry);
+    }
+
+    fclose(in);
+    return true;
+}
+
+size_t inumber(Replay &replay, uint64_t recorded) {
+    map<uint64_t, size_t>::iterator it = replay.inumbers.find(recorded);
+    return it == replay.inumbers.end() ? recorded : it->second;
+}
+
+const char *input_file(Replay &replay, const string &path, uint64_t size) {
+    /* Host files still present are copied in as they are; the others are made up at the recorded size */
+    static string generated;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && (uint64_t)info.st_size == size) return path.c_str();
+
+    generated = replay.scratch + "/input";
+    FILE *out = fopen(generated.c_str(), "wb");
+    if (!out) return NULL;
+    for (uint64_t done = 0; done < size; ) {
+	size_t chunk = min<uint64_t>(size - done, replay.data.size());
+	fwrite(&replay.data[0], 1, chunk, out);
+	done += chunk;
+    }
+    fclose(out);
+    return generated.c_str();
+}
+
+bool replay_commit(Replay &replay, const vector<string> &strings) {
+    FileSystem::Transaction batch;
+    for (size_t i = 0; i < strings.size(); i++) {
+	if (strings[i].empty()) return false;
+	string path = strings[i].substr(1);
+	switch (strings[i][0]) {
+	    case 't': batch.touch(path); break;
+	    case 'd': batch.mkdir(path); break;
+	    case 'r': batch.rm(path); break;
+	    case 'm':
+		if (++i == strings.size()) return false;
+		batch.rename(path, strings[i]);
+		break;
+	    default:  return false;
+	}
+    }
+    return replay.fs->commit(batch);
+}
+
+/* Runs one operation; returns false if it could not be replayed */
+bool replay_entry(Replay &replay, const Entry &entry) {
+    FileSystem &fs = *replay.fs;
+    const TraceRecord &record = entry.record;
+    const vector<string> &strings = entry.strings;
+    char name[FileSystem::NAMESIZE * 4] = "";
+    if (!strings.empty()) strncpy(name, strings[0].c_str(), sizeof(name) - 1);
+    string out = replay.scratch + "/output";
+
+    switch (record.Op) {
+	case TRACE_CREATE: {
+	    ssize_t inum = fs.create();
+	    if (inum >= 0 && record.Arg != (uint64_t)-1) replay.inumbers[record.Arg] = inum;
+	    return true;
+	}
+	case TRACE_REMOVE:  fs.remove(inumber(replay, record.Arg)); return true;
+	case TRACE_STAT:    fs.stat(inumber(replay, record.Arg)); return true;
+	case TRACE_READ:
+	case TRACE_WRITE: {
+	    if (replay.data.size() < record.Length) return false;
+	    if (record.Op == TRACE_READ) {
+		vector<char> buffer(record.Length);
+		fs.read(inumber(replay, record.Arg), buffer.data(), record.Length, record.Offset);
+	    } else {
+		fs.write(inumber(replay, record.Arg), &replay.data[0], record.Length, record.Offset);
+	    }
+	    return true;
+	}
+	case TRACE_LOOKUP: {
+	    ssize_t inum = fs.lookup(name);
+	    if (inum >= 0 && record.Arg != (uint64_t)-1) replay.inumbers[record.Arg] = inum;
+	    return true;
+	}
+	case TRACE_TOUCH:   fs.touch(name); return true;
+	case TRACE_MKDIR:   fs.mkdir(name); return true;
+	case TRACE_RMDIR:   fs.rmdir(name); return true;
+	case TRACE_CD:      fs.cd(name); return true;
+	case TRACE_RM:      fs.rm(name); return true;
+	case TRACE_LS:      fs.ls_dir(name); return true;
+	case TRACE_READDIR: {
+	    vector<FileSystem::EntryAttr> entries;
+	    fs.readdir_plus(name, &entries);
+	    return true;
+	}
+	case TRACE_DU: {
+	    FileSystem::DiskUsage usage;
+	    fs.du(name, &usage);
+	    return true;
+	}
+	case TRACE_HASH:    fs.hash(name, record.Arg != 0); return true;
+	case TRACE_COPYIN:
+	case TRACE_PCOPYIN: {
+	    if (strings.size() != 2) return false;
+	    const char *path = input_file(replay, strings[0], record.Arg);
+	    if (!path) return false;
+	    strncpy(name, strings[1].c_str(), sizeof(name) - 1);
+	    if (record.Op == TRACE_COPYIN) fs.copyin(path, name);
+	    else fs.copyin_parallel(path, name, record.Length);
+	    return true;
+	}
+	case TRACE_COPYOUT:
+	    fs.copyout(name, out.c_str());
+	    return true;
+	case TRACE_TAR_OUT:
+	    fs.tar_out(name, out.c_str());
+	    return true;
+	case TRACE_IMPORT: {
+	    struct stat info;
+	    if (strings.size() != 2 || stat(strings[0].c_str(), &info) < 0 || !S_ISDIR(info.st_mode)) return false;
+	    strncpy(name, strings[1].c_str(), sizeof(name) - 1);
+	    fs.import(strings[0].c_str(), name);
+	    return true;
+	}
+	case TRACE_TAR_IN: {
+	    /* Archives read from stdin are gone; archives still present are read again */
+	    if (strings.empty() || strings[0] == "-" || access(strings[0].c_str(), R_OK) < 0) return false;
+	    fs.tar_in(strings[0].c_str());
+	    return true;
+	}
+	case TRACE_COMMIT:
+	    return replay_commit(replay, strings);
+	default:
+	    return false;
+    }
+}
+
+void print_report(FILE *out, const Replay &replay, size_t entries, uint64_t reads, uint64_t writes) {
+    fprintf(out, "%-10s %8s %8s %14s %14s\n", "op", "count", "skipped", "recorded ms", "replayed ms");
+    uint64_t recorded = 0, replayed = 0;
+    for (int op = 1; op < TRACE_OPS; op++) {
+	const OpTotals &totals = replay.totals[op];
+	if (!totals.count) continue;
+	fprintf(out, "%-10s %8lu %8lu %14.3f %14.3f\n", trace_op_name(op), (unsigned long)totals.count,
+		(unsigned long)totals.skipped, totals.recorded_ns / 1e6, totals.replayed_ns / 1e6);
+	recorded += totals.recorded_ns;
+	replayed += totals.replayed_ns;
+    }
+    fprintf(out, "%-10s %8lu %8s %14.3f %14.3f\n", "total", (unsigned long)entries, "", recorded / 1e6, replayed / 1e6);
+    fprintf(out, "%lu disk block reads\n", (unsigned long)reads);
+    fprintf(out, "%lu disk block writes\n", (unsigned long)writes);
+}
+
+// Main execution
+
+int main(int argc, char *argv[]) {
+    bool timed = false, keep = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "tkh")) != -1) {
+	switch (option) {
+	    case 't': timed = true; break;
+	    case 'k': keep = true; break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind >= argc || optind + 2 < argc || (keep && optind + 1 == argc)) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    TraceHeader header;
+    vector<Entry> entries;
+    if (!read_trace(argv[optind], &header, &entries)) return EXIT_FAILURE;
+    if (header.Features & FileSystem::FEATURE_ENCRYPT) {
+	fprintf(stderr, "Traces of encrypted disks cannot be replayed\n");
+	return EXIT_FAILURE;
+    }
+
+    /* Scratch directory for the image, made up inputs and copied out files */
+    char scratch[] = "/tmp/sfsreplay.XXXXXX";
+    if (!mkdtemp(scratch)) {
+	perror("mkdtemp");
+	return EXIT_FAILURE;
+    }
+    string image = (optind + 1 < argc) ? argv[optind + 1] : string(scratch) + "/image";
+
+    /* The library reports on stdout; keep it for the report and silence the rest */
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) {
+	perror("stdout");
+	return EXIT_FAILURE;
+    }
+
+    Replay replay;
+    memset(replay.totals, 0, sizeof(replay.totals));
+    replay.scratch = scratch;
+
+    /* The data written is made up, but the same on every replay */
+    size_t longest = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+	if (entries[i].record.Op == TRACE_WRITE || entries[i].record.Op == TRACE_READ) {
+	    longest = max<size_t>(longest, entries[i].record.Length);
+	}
+    }
+    replay.data.resize(max<size_t>(longest, 1 << 20));
+    uint32_t seed = 42;
+    for (size_t i = 0; i < replay.data.size(); i++) replay.data[i] = rand_r(&seed);
+
+    int status = EXIT_SUCCESS;
+    try {
+	Disk disk;
+	FileSystem fs;
+	disk.open(image.c_str(), header.Blocks);
+	if ((!keep && !FileSystem::format(&disk, header.Features)) || !fs.mount(&disk)) {
+	    throw runtime_error("cannot format or mount the image");
+	}
+	replay.disk = &disk;
+	replay.fs = &fs;
+
+	uint64_t reads = disk.reads(), writes = disk.writes();
+	uint64_t start = now();
+	for (size_t i = 0; i < entries.size(); i++) {
+	    const TraceRecord &record = entries[i].record;
+	    if (timed) {
+		uint64_t elapsed = now() - start;
+		if (record.Time > elapsed) {
+		    uint64_t wait = record.Time - elapsed;
+		    struct timespec ts = {(time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull)};
+		    nanosleep(&ts, NULL);
+		}
+	    }
+
+	    OpTotals &totals = replay.totals[record.Op < TRACE_OPS ? record.Op : 0];
+	    uint64_t begin = now();
+	    if (!replay_entry(replay, entries[i])) totals.skipped++;
+	    totals.replayed_ns += now() - begin;
+	    totals.recorded_ns += record.Duration;
+	    totals.count++;
+	}
+	reads = disk.reads() - reads;
+	writes = disk.writes() - writes;
+	fs.exit();
+
+	print_report(out, replay, entries.size(), reads, writes);
+    } catch (runtime_error &e) {
+	fprintf(stderr, "Replay failed: %s\n", e.what());
+	status = EXIT_FAILURE;
+    }
+
+    unlink((replay.scratch + "/input").c_str());
+    unlink((replay.scratch + "/output").c_str());
+    if (optind + 1 == argc) unlink(image.c_str());
+    rmdir(scratch);
+    fclose(out);
+    return status;
+}
@@ -7,14 +7,39 @@
 #include <string>
 #include <stdexcept>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 // Macros
 
 #define streq(a, b) (strcmp((a), (b)) == 0)
 
+// Format features
+
+struct Feature {
+    const char *name;
+    uint32_t    flag;
+};
+
+const Feature FEATURES[] = {
+    {"compress", FileSystem::FEATURE_COMPRESS},
+    {"dedup",    FileSystem::FEATURE_DEDUP},
+    {"encrypt",  FileSystem::FEATURE_ENCRYPT},
+    {"checksum", FileSystem::FEATURE_CHECKSUM},
+    {"lazy",     FileSystem::FEATURE_LAZY},
+    {"discard",  FileSystem::FEATURE_DISCARD},
+};
+
+bool parse_features(char *list, uint32_t *features);
+
+// Seconds between two metrics exports
+
+const unsigned METRICS_PERIOD = 10;
+
 // Command prototypes
 
 void do_debug(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
@@ -28,42 +53,125 @@ void do_touch(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
 void do_rm(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
 void do_file_copyout(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
 void do_file_copyin(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_file_pcopyin(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_import(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_tar_in(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_tar_out(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_batch(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_hash(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
 void do_cd(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
 void do_ls(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
 void do_stat(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_du(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_trace(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_iotrace(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_stats(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+void do_timeline(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2);
+
+
+// Command input: stdin, or the script of -c or -f, which is run without prompts
+
+FILE  *Input = stdin;
+bool   Prompt = true;
+size_t Lines = 0;       // Lines read from Input so far
+
+char *read_line(char *line) {
+    char *read = fgets(line, BUFSIZ, Input);
+    if (read) Lines++;
+    return read;
+}
+
+// Functions
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-c commands | -f script] <diskfile> <nblocks>\n", program);
+    fprintf(stderr, "    -c    run the commands, separated by ';' or newlines, and exit\n");
+    fprintf(stderr, "    -f    run the commands of a script file, or of stdin for -, and exit\n");
+    fprintf(stderr, "Scripts print one JSON object per command, with its output, wall time and\n");
+    fprintf(stderr, "disk block reads and writes, and a total at the end.\n");
+}
+
+bool run_command(Disk &disk, FileSystem &fs, char *line);
+bool run_script(Disk &disk, FileSystem &fs);
 
+// Main execution
 
 int main(int argc, char *argv[]) {
     Disk	disk;
     FileSystem	fs;
-
-    if (argc != 3) {
-    	fprintf(stderr, "Usage: %s <diskfile> <nblocks>\n", argv[0]);
-    	return EXIT_FAILURE;
+    const char *commands = NULL, *script = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "c:f:h")) != -1) {
+	switch (option) {
+	    case 'c': commands = optarg; break;
+	    case 'f': script = optarg; break;
+	    default:  usage(argv[0]); return EXIT_FAILURE;
+	}
+    }
+    if (optind + 2 != argc || (commands && script)) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
     }
 
     try {
-    	disk.open(argv[1], atoi(argv[2]));
+    	disk.open(argv[optind], atoi(argv[optind + 1]));
     } catch (std::runtime_error &e) {
-    	fprintf(stderr, "Unable to open disk %s: %s\n", argv[1], e.what());
+    	fprintf(stderr, "Unable to open disk %s: %s\n", argv[optind], e.what());
     	return EXIT_FAILURE;
     }
 
+    /* Scripts are read like a file either way; batch reads the operations that follow it from the same script */
+    std::string text;
+    if (commands) {
+	text = commands;
+	for (size_t i = 0; i < text.size(); i++) {
+	    if (text[i] == ';') text[i] = '\n';
+	}
+	Input = fmemopen(&text[0], text.size(), "r");
+    } else if (script) {
+	Input = streq(script, "-") ? stdin : fopen(script, "r");
+    }
+    if (!Input) {
+	fprintf(stderr, "Unable to open %s: %s\n", script ? script : "commands", strerror(errno));
+	return EXIT_FAILURE;
+    }
+    if (commands || script) {
+	Prompt = false;
+	bool ran = run_script(disk, fs);
+	if (Input != stdin) fclose(Input);
+	return ran ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     while (true) {
-	char line[BUFSIZ], cmd[BUFSIZ], arg1[BUFSIZ], arg2[BUFSIZ];
+	char line[BUFSIZ];
 
     	fprintf(stderr, "sfs> ");
     	fflush(stderr);
 
-    	if (fgets(line, BUFSIZ, stdin) == NULL) {
+    	if (read_line(line) == NULL) {
     	    break;
     	}
 
-    	int args = sscanf(line, "%s %s %s", cmd, arg1, arg2);
-    	if (args == 0) {
-    	    continue;
+	if (!run_command(disk, fs, line)) {
+	    break;
 	}
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Command dispatch
 
+bool run_command(Disk &disk, FileSystem &fs, char *line) {
+    char cmd[BUFSIZ], arg1[BUFSIZ], arg2[BUFSIZ];
+
+    int args = sscanf(line, "%s %s %s", cmd, arg1, arg2);
+    if (args <= 0) {
+	return true;
+    }
+
+    try {
 	if (streq(cmd, "debug")) {
 	    do_debug(disk, fs, args, arg1, arg2);
 	} else if (streq(cmd, "format")) {
@@ -88,20 +196,137 @@ int main(int argc, char *argv[]) {
 	    do_ls(disk, fs, args, arg1, arg2);
 	} else if (streq(cmd, "stat")) {
 	    do_stat(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "stats")) {
+	    do_stats(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "du")) {
+	    do_du(disk, fs, args, arg1, arg2);
 	} else if (streq(cmd, "copyout")) {
 	    do_file_copyout(disk, fs, args, arg1, arg2);
 	} else if (streq(cmd, "copyin")) {
 	    do_file_copyin(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "pcopyin")) {
+	    do_file_pcopyin(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "import")) {
+	    do_import(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "tar-in")) {
+	    do_tar_in(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "tar-out")) {
+	    do_tar_out(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "batch")) {
+	    do_batch(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "hash")) {
+	    do_hash(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "trace")) {
+	    do_trace(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "iotrace")) {
+	    do_iotrace(disk, fs, args, arg1, arg2);
+	} else if (streq(cmd, "timeline")) {
+	    do_timeline(disk, fs, args, arg1, arg2);
 	} else if (streq(cmd, "exit") || streq(cmd, "quit")) {
 	    fs.exit();
-		break;
+	    return false;
 	} else {
 	    printf("Unknown command: %s", line);
 	    printf("Type 'help' for a list of commands.\n");
 	}
+    } catch (std::runtime_error &e) {
+	printf("%s\n", e.what());
     }
 
-    return EXIT_SUCCESS;
+    return true;
+}
+
+// Script mode
+
+std::string json_string(const std::string &text) {
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+	unsigned char c = text[i];
+	if (c == '"' || c == '\\') {
+	    quoted += '\\';
+	    quoted += c;
+	} else if (c == '\n') {
+	    quoted += "\\n";
+	} else if (c == '\t') {
+	    quoted += "\\t";
+	} else if (c < 0x20) {
+	    char escaped[8];
+	    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+	    quoted += escaped;
+	} else {
+	    quoted += c;
+	}
+    }
+    return quoted + "\"";
+}
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+bool run_script(Disk &disk, FileSystem &fs) {
+    /* Each command prints into a scratch file, so its output goes into its JSON object */
+    FILE *capture = tmpfile();
+    int console = dup(STDOUT_FILENO);
+    if (!capture || console < 0) {
+	fprintf(stderr, "Unable to capture output: %s\n", strerror(errno));
+	return false;
+    }
+    int out = fileno(capture);
+    FILE *report = fdopen(console, "w");
+
+    char line[BUFSIZ];
+    size_t count = 0;
+    uint64_t total = 0, total_reads = 0, total_writes = 0;
+    bool more = true;
+    while (more && read_line(line) != NULL) {
+	/* batch reads its operations too, so the line is noted before the command runs */
+	size_t number = Lines;
+	char cmd[BUFSIZ];
+	if (sscanf(line, "%s", cmd) != 1 || cmd[0] == '#') {
+	    continue;
+	}
+
+	size_t reads = disk.reads(), writes = disk.writes();
+	fflush(stdout);
+	dup2(out, STDOUT_FILENO);
+	uint64_t start = now_ns();
+	more = run_command(disk, fs, line);
+	fflush(stdout);
+	uint64_t elapsed = now_ns() - start;
+	dup2(console, STDOUT_FILENO);
+	reads = disk.reads() - reads;
+	writes = disk.writes() - writes;
+
+	/* The scratch file shares its offset with stdout, so the offset is the length of the output */
+	std::string output(lseek(out, 0, SEEK_CUR), '\0');
+	if (!output.empty() && pread(out, &output[0], output.size(), 0) < 0) output.clear();
+	if (ftruncate(out, 0) < 0 || lseek(out, 0, SEEK_SET) < 0) {
+	    fprintf(stderr, "Unable to reset output: %s\n", strerror(errno));
+	    more = false;
+	}
+
+	const char *trimmed = line + strspn(line, " \t");
+	std::string command(trimmed, strcspn(trimmed, "\r\n"));
+	fprintf(report, "{\"line\":%lu,\"command\":%s,\"us\":%.3f,\"reads\":%lu,\"writes\":%lu,\"output\":%s}\n",
+		(unsigned long)number, json_string(command).c_str(), elapsed / 1e3,
+		(unsigned long)reads, (unsigned long)writes, json_string(output).c_str());
+	count++;
+	total += elapsed;
+	total_reads += reads;
+	total_writes += writes;
+    }
+
+    fprintf(report, "{\"commands\":%lu,\"us\":%.3f,\"reads\":%lu,\"writes\":%lu}\n",
+	    (unsigned long)count, total / 1e3, (unsigned long)total_reads, (unsigned long)total_writes);
+    fclose(report);
+    fclose(capture);
+
+    /* Keep the lines the Disk prints when it closes out of the report */
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return true;
 }
 
 // Command functions
@@ -115,13 +340,35 @@ void do_debug(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
     fs.debug(&disk);
 }
 
+bool parse_features(char *list, uint32_t *features) {
+    *features = 0;
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+	size_t i = 0;
+	for (; i < sizeof(FEATURES) / sizeof(FEATURES[0]); i++) {
+	    if (streq(name, FEATURES[i].name)) break;
+	}
+	if (i == sizeof(FEATURES) / sizeof(FEATURES[0])) {
+	    printf("Unknown feature: %s\n", name);
+	    return false;
+	}
+	*features |= FEATURES[i].flag;
+    }
+    return true;
+}
+
 void do_format(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
-    if (args != 1) {
-    	printf("Usage: format\n");
+    if (args != 1 && args != 2) {
+    	printf("Usage: format [feature,...]\n");
     	return;
     }
 
-    if (fs.format(&disk)) {
+    uint32_t features = 0;
+    if (args == 2 && !parse_features(arg1, &features)) {
+    	printf("format failed!\n");
+    	return;
+    }
+
+    if (fs.format(&disk, features)) {
     	printf("disk formatted.\n");
     } else {
     	printf("format failed!\n");
@@ -228,6 +475,110 @@ void do_file_copyin(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2
 	}
 }
 
+void do_file_pcopyin(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+	if (args != 3) {
+		printf("Usage: pcopyin <path> <filename>\n");
+		return;
+	}
+
+	if(!fs.copyin_parallel(arg1,arg2)){
+		printf("pcopyin failed\n");
+	}
+}
+
+void do_import(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+	if (args != 3) {
+		printf("Usage: import <hostdir> <dirname>\n");
+		return;
+	}
+
+	if(!fs.import(arg1,arg2)){
+		printf("import failed\n");
+	}
+}
+
+void do_tar_in(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+	if (args != 2) {
+		printf("Usage: tar-in <archive|->\n");
+		return;
+	}
+
+	if(!fs.tar_in(arg1)){
+		printf("tar-in failed\n");
+	}
+}
+
+void do_tar_out(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+	if (args != 3) {
+		printf("Usage: tar-out <name> <archive|->\n");
+		return;
+	}
+
+	if(!fs.tar_out(arg1,arg2)){
+		fprintf(stderr, "tar-out failed\n");
+	}
+}
+
+void do_batch(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (args != 1) {
+    	printf("Usage: batch\n");
+    	return;
+    }
+
+    /* Collect operations until commit or abort */
+    FileSystem::Transaction batch;
+    while (true) {
+	char line[BUFSIZ], op[BUFSIZ], path[BUFSIZ], target[BUFSIZ];
+
+	if (Prompt) {
+	    fprintf(stderr, "batch> ");
+	    fflush(stderr);
+	}
+
+    	if (read_line(line) == NULL) {
+    	    return;
+    	}
+
+    	int n = sscanf(line, "%s %s %s", op, path, target);
+    	if (n <= 0) {
+    	    continue;
+    	}
+
+	if (streq(op, "commit")) {
+	    if (fs.commit(batch)) {
+		printf("%lu operations committed\n", batch.size());
+	    } else {
+		printf("batch failed\n");
+	    }
+	    return;
+	} else if (streq(op, "abort")) {
+	    return;
+	} else if (streq(op, "touch") && n == 2) {
+	    batch.touch(path);
+	} else if (streq(op, "mkdir") && n == 2) {
+	    batch.mkdir(path);
+	} else if (streq(op, "rm") && n == 2) {
+	    batch.rm(path);
+	} else if (streq(op, "mv") && n == 3) {
+	    batch.rename(path, target);
+	} else {
+	    printf("Unknown batch operation: %s", line);
+	    printf("Batch operations are touch <path>, mkdir <path>, rm <path>, mv <path> <path>, commit and abort.\n");
+	}
+    }
+}
+
+void do_hash(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (!(args == 2 || (args == 3 && streq(arg2, "blocks")))) {
+    	printf("Usage: hash <filename> [blocks]\n");
+    	return;
+    }
+
+	if(!fs.hash(arg1, args == 3)){
+		printf("hash failed\n");
+	}
+}
+
 void do_cd(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
     if (args != 2) {
     	printf("Usage: cd <dirname>\n");
@@ -240,11 +591,17 @@ void do_cd(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
 }
 
 void do_ls(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
-    if (!((args == 1) || (args == 2))) {
-    	printf("Usage: ls <dirname>\n");
+    if (!((args == 1) || (args == 2) || (args == 3 && streq(arg1, "-l")))) {
+    	printf("Usage: ls [-l] <dirname>\n");
     	return;
     }
-	if(args == 1){
+	char dot[] = ".";
+	if(args >= 2 && streq(arg1, "-l")){
+		if(!fs.ls_long(args == 3 ? arg2 : dot)){
+			printf("ls failed\n");
+		}
+	}
+	else if(args == 1){
 		if(!fs.ls()){
 			printf("ls failed\n");
 		}
@@ -264,22 +621,128 @@ void do_stat(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
 	fs.stat();
 }
 
+void do_du(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (args > 2) {
+    	printf("Usage: du [name]\n");
+    	return;
+    }
+
+	char dot[] = ".";
+	FileSystem::DiskUsage usage;
+	if(!fs.du(args == 2 ? arg1 : dot, &usage)){
+		printf("du failed\n");
+		return;
+	}
+	printf("%lu bytes in %lu blocks\n", (unsigned long)usage.Bytes, (unsigned long)usage.Blocks);
+}
+
+void do_trace(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (!((args == 3 && streq(arg1, "start")) || (args == 2 && streq(arg1, "stop")))) {
+    	printf("Usage: trace <start <file>|stop>\n");
+    	return;
+    }
+
+	if(streq(arg1, "stop")){
+		fs.trace_stop();
+		printf("trace stopped\n");
+	} else if(fs.trace_start(arg2)){
+		printf("tracing to %s\n", arg2);
+	} else {
+		printf("trace failed\n");
+	}
+}
+
+void do_iotrace(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (!((args == 3 && streq(arg1, "start")) || (args == 2 && streq(arg1, "stop")))) {
+    	printf("Usage: iotrace <start <file>|stop>\n");
+    	return;
+    }
+
+	if(streq(arg1, "stop")){
+		disk.stop_trace();
+		printf("block trace stopped\n");
+		return;
+	}
+	try {
+		disk.start_trace(arg2);
+		printf("tracing block I/O to %s\n", arg2);
+	} catch (std::runtime_error &e) {
+		printf("%s\n", e.what());
+	}
+}
+
+void do_timeline(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (!((args == 3 && streq(arg1, "start")) || (args == 2 && streq(arg1, "stop")))) {
+    	printf("Usage: timeline <start <file>|stop>\n");
+    	return;
+    }
+
+#ifdef SFS_TRACING
+	if(streq(arg1, "stop")){
+		Timeline::stop();
+		printf("timeline stopped\n");
+		return;
+	}
+	if(Timeline::start(arg2)){
+		printf("writing timeline to %s\n", arg2);
+	}
+#else
+	printf("timeline not built in, rebuild with make TRACING=1\n");
+#endif
+}
+
+void do_stats(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
+    if (!(args == 1 || (args == 2 && streq(arg1, "prom")) || (args == 3 && streq(arg1, "export")))) {
+    	printf("Usage: stats [prom | export <file|off>]\n");
+    	return;
+    }
+
+	if(args == 3){
+		bool off = streq(arg2, "off");
+		if(fs.export_metrics(off ? NULL : arg2, METRICS_PERIOD)){
+			if(off) printf("metrics export stopped\n");
+			else printf("exporting metrics to %s every %u seconds\n", arg2, METRICS_PERIOD);
+		} else {
+			printf("stats failed\n");
+		}
+		return;
+	}
+	if(!fs.print_metrics(stdout, args == 2)){
+		printf("stats failed\n");
+	}
+}
+
 void do_help(Disk &disk, FileSystem &fs, int args, char *arg1, char *arg2) {
     printf("Commands are:\n");
-    printf("    format\n");
+    printf("    format [feature,...]\n");
     printf("    mount\n");
     printf("    debug\n");
 	printf("    password <change|set|remove>\n");
 	printf("    mkdir <dirname>\n");
 	printf("    rmdir <dirname>\n");
 	printf("    cd <dirname>\n");
-	printf("    ls <dirname>\n");
+	printf("    ls [-l] <dirname>\n");
 	printf("    stat\n");
+	printf("    du [name]\n");
+	printf("    stats [prom | export <file|off>]\n");
 	printf("    touch <filename>\n");
 	printf("    rm <name>\n");
 	printf("    copyout <filename> <path>\n");
 	printf("    copyin <path> <filename>\n");
+	printf("    pcopyin <path> <filename>\n");
+	printf("    import <hostdir> <dirname>\n");
+	printf("    tar-in <archive|->\n");
+	printf("    tar-out <name> <archive|->\n");
+	printf("    batch\n");
+	printf("    hash <filename> [blocks]\n");
+	printf("    trace <start <file>|stop>\n");
+	printf("    iotrace <start <file>|stop>\n");
+	printf("    timeline <start <file>|stop>\n");
     printf("    help\n");
     printf("    quit\n");
     printf("    exit\n");
+    printf("Features are:\n");
+    for (size_t i = 0; i < sizeof(FEATURES) / sizeof(FEATURES[0]); i++) {
+    	printf("    %s\n", FEATURES[i].name);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a batch is applied as a whole and survives a remount; a batch with a bad operation changes nothing
+
+test-input() {
+    cat <<EOF
+format
+mount
+batch
+mkdir a
+mkdir a/b
+touch a/one
+touch a/b/two
+touch three
+mv three a/b/four
+mv a/b c
+rm a/one
+commit
+batch
+touch a/five
+rm c
+commit
+EOF
+}
+
+remount-input() {
+    cat <<EOF
+mount
+ls
+cd a
+ls
+cd ..
+cd c
+ls
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+LISTING=$(remount-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+
+echo -n "Testing batch in $SCRATCH/image.200 ... "
+if echo "$OUTPUT" | grep -q "8 operations committed" &&
+   echo "$OUTPUT" | grep -q "batch operation 2 (r c) failed: directory not empty" &&
+   echo "$LISTING" | grep -q " c  " &&
+   echo "$LISTING" | grep -q " two  " &&
+   echo "$LISTING" | grep -q " four  " &&
+   ! echo "$LISTING" | grep -q " one \| three \| five \| b  "; then
+    echo "Success"
+else
+    echo "Failure"
+fi
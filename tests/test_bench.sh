@@ -0,0 +1,22 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: the benchmark runs every benchmark and reports each of them as JSON, on plain and checksummed disks
+
+for features in none lazy,checksum; do
+    ./bin/sfsbench -f $features -o $SCRATCH/bench.json $SCRATCH/image.20000 > /dev/null 2>&1
+    STATUS=$?
+
+    echo -n "Testing sfsbench ($features) in $SCRATCH/image.20000 ... "
+    if [ $STATUS = 0 ] &&
+       [ $(grep -c '"name": ' $SCRATCH/bench.json) = 23 ] &&
+       grep -q '"features": "'$features'"' $SCRATCH/bench.json &&
+       grep -q '"name": "copyout", "bytes": 4194304, "ops": 5,' $SCRATCH/bench.json &&
+       ! grep -q '"ops": 0,' $SCRATCH/bench.json; then
+        echo "Success"
+    else
+        echo "Failure"
+    fi
+done
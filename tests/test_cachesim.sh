@@ -0,0 +1,39 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: the LRU miss ratio never grows with the cache, and a cache holding every block only misses cold
+
+mkdir -p $SCRATCH/tree/sub
+for i in 1 2 3 4; do head -c $((i * 9000)) /dev/urandom > $SCRATCH/tree/f$i; done
+head -c 60000 /dev/urandom > $SCRATCH/tree/sub/g
+
+test-input() {
+    cat <<EOF
+format
+mount
+iotrace start $SCRATCH/io.trace
+import $SCRATCH/tree tree
+cd tree
+copyout f4 $SCRATCH/f4.out
+ls -l sub
+copyout f4 $SCRATCH/f4.out
+cd ..
+du tree
+iotrace stop
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.500 500 > /dev/null 2>&1
+OUTPUT=$(./bin/sfscachesim $SCRATCH/io.trace 2> /dev/null)
+
+echo -n "Testing cache simulation in $SCRATCH/image.500 ... "
+if echo "$OUTPUT" | awk '
+    NR == 1 { cold = $9 / $4 }
+    NR > 2  { if ($3 > last + 1e-9 && NR > 3) bad = 1; last = $3; row = $0; l = $3; c = $4; a = $5; q = $6 }
+    END     { if (bad || NR < 4 || l != c || l != a || l != q || (l - cold) > 1e-4 || (cold - l) > 1e-4) exit 1 }'; then
+    echo "Success"
+else
+    echo "Failure"
+fi
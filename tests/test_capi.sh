@@ -0,0 +1,111 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a C program linked with libsfs.so creates, writes, reads, lists and removes through sfs.h and gets error codes back;
+# its writes show in du, and directories with open files cannot be removed
+
+cat > $SCRATCH/capi.c <<EOF
+#include "sfs/sfs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(call, want) do { long got = (long)(call); if (got != (long)(want)) { \\
+    printf("%s returned %ld (%s), not %ld\\n", #call, got, sfs_strerror(got), (long)(want)); return 1; } } while (0)
+
+int main(int argc, char *argv[]) {
+    static char data[200000], back[200000];
+    struct sfs_stat st;
+    struct sfs_dirent entries[8];
+    sfs_t *fs;
+    int file;
+
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (char)(i * 7);
+
+    CHECK(sfs_open_disk(argv[1], 500, &fs), SFS_OK);
+    CHECK(sfs_mkdir(fs, "d"), SFS_ENOTMOUNTED);
+    CHECK(sfs_format(fs, SFS_FEATURE_CHECKSUM), SFS_OK);
+    CHECK(sfs_mount(fs), SFS_OK);
+    CHECK(sfs_format(fs, 0), SFS_EBUSY);
+    CHECK(sfs_mkdir(fs, "d"), SFS_OK);
+    CHECK(sfs_mkdir(fs, "d"), SFS_EEXIST);
+    CHECK(sfs_mkdir(fs, "a/b"), SFS_EINVAL);
+    CHECK(sfs_chdir(fs, "d"), SFS_OK);
+    CHECK(sfs_open(fs, "f", 0), SFS_ENOENT);
+    CHECK(file = sfs_open(fs, "f", SFS_O_CREAT), 0);
+    CHECK(sfs_open(fs, "f", SFS_O_CREAT | SFS_O_EXCL), SFS_EEXIST);
+    CHECK(sfs_write(fs, file, data, sizeof(data)), sizeof(data));
+    CHECK(sfs_seek(fs, file, 0, SFS_SEEK_END), sizeof(data));
+    CHECK(sfs_seek(fs, file, 0, SFS_SEEK_SET), 0);
+    CHECK(sfs_read(fs, file, back, sizeof(back)), sizeof(back));
+    CHECK(sfs_read(fs, file, back, sizeof(back)), 0);
+    CHECK(memcmp(data, back, sizeof(data)), 0);
+    CHECK(sfs_unlink(fs, "f"), SFS_EBUSY);
+    CHECK(sfs_close(fs, file), SFS_OK);
+    CHECK(sfs_close(fs, file), SFS_EBADF);
+    CHECK(sfs_stat(fs, "f", &st), SFS_OK);
+    CHECK(st.type == SFS_TYPE_FILE && st.size == sizeof(data), 1);
+    CHECK(sfs_readdir(fs, ".", entries, 8), 3);
+    CHECK(strcmp(entries[2].name, "f"), 0);
+    CHECK(sfs_chdir(fs, "f"), SFS_ENOTDIR);
+    CHECK(sfs_unmount(fs), SFS_OK);
+
+    /* The file is still there after mounting again */
+    CHECK(sfs_mount(fs), SFS_OK);
+    CHECK(sfs_chdir(fs, "d"), SFS_OK);
+    CHECK(file = sfs_open(fs, "f", 0), 0);
+    CHECK(sfs_read(fs, file, back, sizeof(back)), sizeof(back));
+    CHECK(memcmp(data, back, sizeof(data)), 0);
+    CHECK(sfs_close(fs, file), SFS_OK);
+    CHECK(sfs_unlink(fs, "f"), SFS_OK);
+    CHECK(sfs_stat(fs, "f", &st), SFS_ENOENT);
+    CHECK(sfs_chdir(fs, ".."), SFS_OK);
+    CHECK(sfs_rmdir(fs, "d"), SFS_OK);
+    CHECK(sfs_readdir(fs, ".", entries, 8), 2);
+
+    /* Writes are charged to the directory of the file, removals take back what they charged */
+    CHECK(sfs_mkdir(fs, "e"), SFS_OK);
+    CHECK(sfs_chdir(fs, "e"), SFS_OK);
+    CHECK(sfs_mkdir(fs, "k"), SFS_OK);
+    CHECK(sfs_chdir(fs, "k"), SFS_OK);
+    CHECK(file = sfs_open(fs, "l", SFS_O_CREAT), 0);
+    CHECK(sfs_chdir(fs, ".."), SFS_OK);
+    CHECK(sfs_chdir(fs, ".."), SFS_OK);
+    CHECK(sfs_rmdir(fs, "e"), SFS_EBUSY);
+    CHECK(sfs_close(fs, file), SFS_OK);
+    CHECK(sfs_chdir(fs, "e"), SFS_OK);
+    CHECK(sfs_rmdir(fs, "k"), SFS_OK);
+    CHECK(file = sfs_open(fs, "g", SFS_O_CREAT), 0);
+    CHECK(sfs_chdir(fs, ".."), SFS_OK);
+    CHECK(sfs_write(fs, file, data, 50000), 50000);
+    CHECK(sfs_close(fs, file), SFS_OK);
+    CHECK(sfs_chdir(fs, "e"), SFS_OK);
+    CHECK(file = sfs_open(fs, "h", SFS_O_CREAT), 0);
+    CHECK(sfs_write(fs, file, data, 10000), 10000);
+    CHECK(sfs_close(fs, file), SFS_OK);
+    CHECK(sfs_unlink(fs, "h"), SFS_OK);
+    CHECK(sfs_close_disk(fs), SFS_OK);
+    printf("ok\\n");
+    return 0;
+}
+EOF
+
+du-input() {
+    cat <<EOF
+mount
+du e
+cd e
+du g
+EOF
+}
+
+echo -n "Testing C interface in $SCRATCH/image.500 ... "
+if gcc -std=c99 -Wall -Iinclude -o $SCRATCH/capi $SCRATCH/capi.c -Llib -lsfs 2> $SCRATCH/cc.log &&
+   [ "$(LD_LIBRARY_PATH=lib $SCRATCH/capi $SCRATCH/image.500 2>&1)" = "ok" ] &&
+   [ "$(du-input | ./bin/sfssh $SCRATCH/image.500 500 2> /dev/null | grep -c "50000 bytes in 14 blocks")" = 2 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
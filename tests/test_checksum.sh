@@ -0,0 +1,88 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: checksummed image reads back clean data and reports a block corrupted behind its back
+
+yes "checksum marker" | head -c 50000 > $SCRATCH/data.txt
+head -c 20000 /dev/urandom > $SCRATCH/other.bin
+
+test-input() {
+    cat <<EOF
+format checksum
+mount
+copyin $SCRATCH/data.txt data
+copyin $SCRATCH/other.bin other
+EOF
+}
+
+remount-input() {
+    cat <<EOF
+mount
+copyout data $SCRATCH/data.copy
+copyout other $SCRATCH/other.copy
+stat
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.200 200 > /dev/null 2>&1
+CLEAN=$(remount-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+
+# flip one byte inside the first data block of the marker file
+OFFSET=$(grep -obUa "checksum marker" $SCRATCH/image.200 | head -n 1 | cut -d: -f1)
+printf 'X' | dd of=$SCRATCH/image.200 bs=1 seek=$((OFFSET + 100)) conv=notrunc 2> /dev/null
+rm -f $SCRATCH/other.copy
+CORRUPT=$(remount-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+
+echo -n "Testing checksum in $SCRATCH/image.200 ... "
+if echo "$CLEAN" | grep -q "Checksums : CRC32C" &&
+   ! echo "$CLEAN" | grep -q "Checksum mismatch" &&
+   echo "$CORRUPT" | grep -q "Checksum mismatch in block" &&
+   cmp -s $SCRATCH/other.bin $SCRATCH/other.copy; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: a shell killed while the image is mounted leaves a stale table, which the next mount rebuilds
+
+crash-input() {
+    cat <<EOF
+format checksum
+mount
+mkdir d
+cd d
+copyin $SCRATCH/other.bin other
+EOF
+}
+
+after-crash-input() {
+    cat <<EOF
+mount
+cd d
+copyout other $SCRATCH/crash.copy
+EOF
+}
+
+mkfifo $SCRATCH/commands
+./bin/sfssh $SCRATCH/crash.200 200 < $SCRATCH/commands > $SCRATCH/crash.log 2>&1 &
+SHELL_PID=$!
+exec 3> $SCRATCH/commands
+crash-input >&3
+for i in $(seq 50); do grep -q "bytes copied" $SCRATCH/crash.log && break; sleep 0.1; done
+kill -KILL $SHELL_PID
+wait $SHELL_PID 2> /dev/null
+exec 3>&-
+AFTER=$(after-crash-input | ./bin/sfssh $SCRATCH/crash.200 200 2> /dev/null)
+AGAIN=$(after-crash-input | ./bin/sfssh $SCRATCH/crash.200 200 2> /dev/null)
+
+echo -n "Testing checksum after a crash in $SCRATCH/crash.200 ... "
+if echo "$AFTER" | grep -q "not unmounted cleanly" &&
+   ! echo "$AFTER" | grep -q "Checksum mismatch" &&
+   ! echo "$AGAIN" | grep -q "not unmounted cleanly" &&
+   cmp -s $SCRATCH/other.bin $SCRATCH/crash.copy; then
+    echo "Success"
+else
+    echo "Failure"
+fi
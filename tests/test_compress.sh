@@ -0,0 +1,33 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: compressed image with a text file and a random file
+
+cat src/library/*.cpp include/sfs/*.h > $SCRATCH/text.txt
+head -c 100000 /dev/urandom > $SCRATCH/random.bin
+
+test-input() {
+    cat <<EOF
+format compress
+mount
+copyin $SCRATCH/text.txt text
+copyin $SCRATCH/random.bin random
+copyout text $SCRATCH/text.copy
+copyout random $SCRATCH/random.copy
+stat
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+RATIO=$(echo "$OUTPUT" | awk '/Compression ratio/ {print $4}')
+
+echo -n "Testing compress in $SCRATCH/image.200 ... "
+if cmp -s $SCRATCH/text.txt $SCRATCH/text.copy &&
+   cmp -s $SCRATCH/random.bin $SCRATCH/random.copy &&
+   [ -n "$RATIO" ] && awk "BEGIN {exit !($RATIO > 1.0)}"; then
+    echo "Success"
+else
+    echo "Failure"
+fi
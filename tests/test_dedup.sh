@@ -0,0 +1,65 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: deduplicated image with two copies of the same file
+
+head -c 60000 /dev/urandom > $SCRATCH/data.bin
+
+test-input() {
+    cat <<EOF
+format dedup
+mount
+copyin $SCRATCH/data.bin first
+copyin $SCRATCH/data.bin second
+rm first
+copyout second $SCRATCH/data.copy
+stat
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+SHARED=$(echo "$OUTPUT" | awk '/Duplicate blocks shared/ {print $5}')
+INDEXED=$(echo "$OUTPUT" | awk '/Indexed blocks/ {print $4}')
+
+echo -n "Testing dedup in $SCRATCH/image.200 ... "
+if cmp -s $SCRATCH/data.bin $SCRATCH/data.copy && [ "$SHARED" = 15 ] && [ "$INDEXED" = 15 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: overwriting a private block in place on a dedup,discard image keeps the new content
+
+cat > $SCRATCH/overwrite.c <<EOF
+#include "sfs/sfs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char *argv[]) {
+    static char a[4096], b[4096], back[4096];
+    sfs_t *fs;
+    int file;
+
+    memset(a, 'A', sizeof(a));
+    memset(b, 'B', sizeof(b));
+    if (sfs_open_disk(argv[1], 200, &fs) || sfs_format(fs, SFS_FEATURE_DEDUP | SFS_FEATURE_DISCARD) ||
+        sfs_mount(fs) || (file = sfs_open(fs, "f", SFS_O_CREAT)) < 0 ||
+        sfs_write(fs, file, a, sizeof(a)) != sizeof(a) || sfs_seek(fs, file, 0, SFS_SEEK_SET) ||
+        sfs_write(fs, file, b, sizeof(b)) != sizeof(b) || sfs_seek(fs, file, 0, SFS_SEEK_SET) ||
+        sfs_read(fs, file, back, sizeof(back)) != sizeof(back) || sfs_close(fs, file) || sfs_close_disk(fs))
+        return 1;
+    printf("%s\\n", memcmp(b, back, sizeof(b)) ? "lost" : "ok");
+    return 0;
+}
+EOF
+
+echo -n "Testing dedup overwrite in $SCRATCH/overwrite.200 ... "
+if gcc -std=c99 -Wall -Iinclude -o $SCRATCH/overwrite $SCRATCH/overwrite.c -Llib -lsfs 2> /dev/null &&
+   [ "$(LD_LIBRARY_PATH=lib $SCRATCH/overwrite $SCRATCH/overwrite.200)" = "ok" ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
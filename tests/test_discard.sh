@@ -0,0 +1,42 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: removing a file punches its blocks out of the image, other files stay intact
+
+head -c 3000000 /dev/urandom > $SCRATCH/first.bin
+head -c 100000 /dev/urandom > $SCRATCH/second.bin
+
+test-input() {
+    cat <<EOF
+format discard
+mount
+copyin $SCRATCH/first.bin first
+copyin $SCRATCH/second.bin second
+EOF
+}
+
+remove-input() {
+    cat <<EOF
+mount
+rm first
+copyout second $SCRATCH/second.copy
+stat
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.5000 5000 > /dev/null 2>&1
+BEFORE=$(du -k $SCRATCH/image.5000 | cut -f1)
+OUTPUT=$(remove-input | ./bin/sfssh $SCRATCH/image.5000 5000 2> /dev/null)
+AFTER=$(du -k $SCRATCH/image.5000 | cut -f1)
+DISCARDED=$(echo "$OUTPUT" | awk '/Discarded blocks/ {print $4}')
+
+echo -n "Testing discard in $SCRATCH/image.5000 ... "
+if cmp -s $SCRATCH/second.bin $SCRATCH/second.copy &&
+   [ "$DISCARDED" = 734 ] &&
+   [ $((BEFORE - AFTER)) -ge 2900 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
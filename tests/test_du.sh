@@ -0,0 +1,49 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: du follows copyin, import, moves and removals down the tree, and drops back to zero
+
+mkdir -p $SCRATCH/tree/docs/old
+head -c 30000 /dev/urandom > $SCRATCH/tree/a.bin
+head -c 5000 /dev/urandom > $SCRATCH/tree/docs/b.bin
+head -c 70000 /dev/urandom > $SCRATCH/tree/docs/old/c.bin
+head -c 100000 /dev/urandom > $SCRATCH/d.bin
+
+test-input() {
+    cat <<EOF
+format
+mount
+import $SCRATCH/tree tree
+du tree
+mkdir top
+cd top
+copyin $SCRATCH/d.bin d
+cd ..
+du top
+du
+batch
+mv tree/docs top/docs
+commit
+du tree
+du top
+rm tree
+rm top
+du
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.1000 1000 2> /dev/null | grep "bytes in")
+
+echo -n "Testing du in $SCRATCH/image.1000 ... "
+if [ "$OUTPUT" = "105000 bytes in 30 blocks
+100000 bytes in 26 blocks
+205000 bytes in 56 blocks
+30000 bytes in 9 blocks
+175000 bytes in 47 blocks
+0 bytes in 0 blocks" ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: encrypted image survives a remount and a password change, data is not stored in plaintext
+
+yes "plaintext marker" | head -c 50000 > $SCRATCH/data.txt
+
+test-input() {
+    cat <<EOF
+format encrypt
+secret
+mount
+secret
+copyin $SCRATCH/data.txt data
+password change
+secret
+changed
+EOF
+}
+
+remount-input() {
+    cat <<EOF
+mount
+secret
+mount
+changed
+copyout data $SCRATCH/data.copy
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.200 200 > /dev/null 2>&1
+OUTPUT=$(remount-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+
+echo -n "Testing encrypt in $SCRATCH/image.200 ... "
+if cmp -s $SCRATCH/data.txt $SCRATCH/data.copy &&
+   echo "$OUTPUT" | grep -q "Password Failed" &&
+   ! grep -q "plaintext marker" $SCRATCH/image.200; then
+    echo "Success"
+else
+    echo "Failure"
+fi
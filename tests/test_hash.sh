@@ -0,0 +1,31 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: hash of a file matches sha256sum with every SHA256 code path
+
+head -c 70000 /dev/urandom > $SCRATCH/data.bin
+EXPECTED=$(sha256sum < $SCRATCH/data.bin | awk '{print $1}')
+FIRST=$(head -c 4096 $SCRATCH/data.bin | sha256sum | awk '{print $1}')
+
+test-input() {
+    cat <<EOF
+format
+mount
+copyin $SCRATCH/data.bin data
+hash data blocks
+EOF
+}
+
+echo -n "Testing hash in $SCRATCH/image.200 ... "
+for IMPL in portable avx2 sha-ni; do
+    OUTPUT=$(test-input | SFS_SHA256=$IMPL ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+    DIGEST=$(echo "$OUTPUT" | awk '$2 == "data" {print $1}')
+    BLOCK0=$(echo "$OUTPUT" | awk '$1 == "block" && $2 == 0 {print $3}')
+    if [ "$DIGEST" != "$EXPECTED" ] || [ "$BLOCK0" != "$FIRST" ]; then
+        echo "Failure"
+        exit 0
+    fi
+done
+echo "Success"
@@ -0,0 +1,103 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a host tree is imported with its nested files intact; entries that do not fit are skipped
+
+mkdir -p $SCRATCH/tree/docs/old $SCRATCH/tree/empty $SCRATCH/tree/averyveryverylongname
+head -c 3000000 /dev/urandom > $SCRATCH/tree/large.bin
+head -c 5000 /dev/urandom > $SCRATCH/tree/docs/small.bin
+head -c 70000 /dev/urandom > $SCRATCH/tree/docs/old/medium.bin
+truncate -s 2000000 $SCRATCH/tree/docs/sparse.bin
+ln -s large.bin $SCRATCH/tree/link
+
+test-input() {
+    cat <<EOF
+format lazy
+mount
+import $SCRATCH/tree tree
+EOF
+}
+
+remount-input() {
+    cat <<EOF
+mount
+cd tree
+copyout large.bin $SCRATCH/large.copy
+cd docs
+copyout small.bin $SCRATCH/small.copy
+copyout sparse.bin $SCRATCH/sparse.copy
+cd old
+copyout medium.bin $SCRATCH/medium.copy
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.5000 5000 2>&1)
+remount-input | ./bin/sfssh $SCRATCH/image.5000 5000 > /dev/null 2>&1
+
+echo -n "Testing import in $SCRATCH/image.5000 ... "
+if cmp -s $SCRATCH/tree/large.bin $SCRATCH/large.copy &&
+   cmp -s $SCRATCH/tree/docs/small.bin $SCRATCH/small.copy &&
+   cmp -s $SCRATCH/tree/docs/sparse.bin $SCRATCH/sparse.copy &&
+   cmp -s $SCRATCH/tree/docs/old/medium.bin $SCRATCH/medium.copy &&
+   echo "$OUTPUT" | grep -q "4 directories and 4 files imported" &&
+   [ $(echo "$OUTPUT" | grep -c "Skipping") = 2 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: an import that fills a deduplicated disk fails, and leaves the disk as it was
+
+mkdir -p $SCRATCH/full/a
+for i in 1 2 3; do head -c 1500000 /dev/urandom > $SCRATCH/full/a/f$i; done
+
+full-input() {
+    cat <<EOF
+format dedup
+mount
+import $SCRATCH/full full
+ls
+stats
+EOF
+}
+
+OUTPUT=$(full-input | ./bin/sfssh $SCRATCH/full.1000 1000 2>&1)
+
+echo -n "Testing failed import in $SCRATCH/full.1000 ... "
+if echo "$OUTPUT" | grep -q "import failed" &&
+   ! echo "$OUTPUT" | grep -q "| full " &&
+   echo "$OUTPUT" | grep -q "Free data blocks : 873 of 873" &&
+   echo "$OUTPUT" | grep -q "Free inodes : 12800 of 12800" &&
+   echo "$OUTPUT" | grep -q "Free directories : 79 of 80"; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: blocks are copied between the disk and pipes, which cannot seek
+
+head -c 20480 /dev/urandom > $SCRATCH/blocks.bin
+
+cat > $SCRATCH/pipe.cpp <<EOF
+#include "sfs/disk.h"
+
+int main(int argc, char *argv[]) {
+    Disk disk;
+
+    disk.set_quiet(true);
+    disk.open(argv[1], 100);
+    disk.copy_in(0, 0, 10, 5);
+    disk.copy_out(10, 5 * Disk::BLOCK_SIZE, 1, 0);
+    return 0;
+}
+EOF
+
+echo -n "Testing pipe blocks in $SCRATCH/pipe.100 ... "
+if g++ -std=gnu++11 -pthread -Iinclude -o $SCRATCH/pipe $SCRATCH/pipe.cpp lib/libsfs.a 2> /dev/null &&
+   cat $SCRATCH/blocks.bin | $SCRATCH/pipe $SCRATCH/pipe.100 2> /dev/null | cmp -s - $SCRATCH/blocks.bin; then
+    echo "Success"
+else
+    echo "Failure"
+fi
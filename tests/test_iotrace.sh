@@ -0,0 +1,32 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: the block trace puts the I/O of a copy into the data and indirect regions, under the operations that did it
+
+head -c 100000 /dev/urandom > $SCRATCH/c.bin
+
+test-input() {
+    cat <<EOF
+format
+mount
+iotrace start $SCRATCH/io.trace
+copyin $SCRATCH/c.bin c
+copyout c $SCRATCH/c.out
+iotrace stop
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.500 500 > /dev/null 2>&1
+OUTPUT=$(./bin/sfsiostat $SCRATCH/io.trace 2> /dev/null | awk '$1 == "data" || $1 == "indirect" || $1 == "copyin" || $1 == "copyout" {print $1, $2, $3}')
+
+echo -n "Testing block trace in $SCRATCH/image.500 ... "
+if [ "$OUTPUT" = "data 25 25
+indirect 3 2
+copyin 14 32
+copyout 27 0" ] && cmp -s $SCRATCH/c.bin $SCRATCH/c.out; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,86 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: lazy format of a used image leaves a sparse image that works after remounts, encrypted and checksummed too
+
+head -c 30000 /dev/urandom > $SCRATCH/data.bin
+
+used-input() {
+    cat <<EOF
+format
+mount
+copyin $SCRATCH/data.bin old
+EOF
+}
+
+test-input() {
+    cat <<EOF
+format lazy,encrypt,checksum
+secret
+mount
+secret
+mkdir dir
+cd dir
+copyin $SCRATCH/data.bin data
+EOF
+}
+
+remount-input() {
+    cat <<EOF
+mount
+secret
+cd dir
+copyout data $SCRATCH/data.copy
+cd ..
+ls
+EOF
+}
+
+used-input | ./bin/sfssh $SCRATCH/image.20000 20000 > /dev/null 2>&1
+test-input | ./bin/sfssh $SCRATCH/image.20000 20000 > /dev/null 2>&1
+OUTPUT=$(remount-input | ./bin/sfssh $SCRATCH/image.20000 20000 2> /dev/null)
+ALLOCATED=$(du -k $SCRATCH/image.20000 | cut -f1)
+
+echo -n "Testing lazy in $SCRATCH/image.20000 ... "
+if cmp -s $SCRATCH/data.bin $SCRATCH/data.copy &&
+   echo "$OUTPUT" | grep -q " dir " &&
+   ! echo "$OUTPUT" | grep -q " old " &&
+   [ "$ALLOCATED" -lt 1024 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: writing an inode that was never created, in a group not written yet, keeps it after a remount
+
+cat > $SCRATCH/inode.cpp <<EOF
+#include "sfs/fs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char *argv[]) {
+    Disk disk;
+    FileSystem fs;
+    char data[] = "hello lazy", back[sizeof(data)];
+
+    disk.set_quiet(true);
+    disk.open(argv[1], 1000);
+    if (!FileSystem::format(&disk, FileSystem::FEATURE_LAZY) || !fs.mount(&disk) ||
+        fs.write(300, data, sizeof(data), 0) != (ssize_t)sizeof(data)) return 1;
+    fs.exit();
+    if (!fs.mount(&disk) || fs.read(300, back, sizeof(back), 0) != (ssize_t)sizeof(back)) return 1;
+    printf("%s\\n", memcmp(data, back, sizeof(data)) ? "lost" : "ok");
+    return 0;
+}
+EOF
+
+echo -n "Testing lazy inode writes in $SCRATCH/inode.1000 ... "
+if g++ -std=gnu++11 -pthread -Iinclude -o $SCRATCH/inode $SCRATCH/inode.cpp lib/libsfs.a 2> /dev/null &&
+   [ "$($SCRATCH/inode $SCRATCH/inode.1000)" = "ok" ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,39 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: ls -l reports the size and allocated blocks of every file, holes excluded, with one inode block read for all of them
+
+head -c 5000 /dev/urandom > $SCRATCH/small.bin
+head -c 100000 /dev/urandom > $SCRATCH/medium.bin
+truncate -s 50000 $SCRATCH/hole.bin
+
+test-input() {
+    cat <<EOF
+format
+mount
+copyin $SCRATCH/small.bin small
+copyin $SCRATCH/medium.bin medium
+copyin $SCRATCH/hole.bin hole
+touch empty
+mkdir sub
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.1000 1000 > /dev/null 2>&1
+LISTING=$(printf "mount\nls -l\n" | ./bin/sfssh $SCRATCH/image.1000 1000 2> /dev/null)
+BASE=$(printf "mount\n" | ./bin/sfssh $SCRATCH/image.1000 1000 2> /dev/null | awk '/disk block reads/ {print $1}')
+READS=$(echo "$LISTING" | awk '/disk block reads/ {print $1}')
+
+echo -n "Testing ls -l in $SCRATCH/image.1000 ... "
+if echo "$LISTING" | grep -q "small *| file  | *5000 | 2$" &&
+   echo "$LISTING" | grep -q "medium *| file  | *100000 | 26$" &&
+   echo "$LISTING" | grep -q "hole *| file  | *50000 | 2$" &&
+   echo "$LISTING" | grep -q "empty *| file  | *0 | 0$" &&
+   echo "$LISTING" | grep -q "sub *| dir " &&
+   [ $((READS - BASE)) = 4 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
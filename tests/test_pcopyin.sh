@@ -0,0 +1,36 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a file copied in by several threads reads back intact, plain and encrypted with checksums
+
+head -c 4000000 /dev/urandom > $SCRATCH/large.bin
+head -c 12345 /dev/urandom > $SCRATCH/small.bin
+
+test-input() {
+    cat <<EOF
+format $1
+secret
+mount
+secret
+copyin $SCRATCH/large.bin small
+pcopyin $SCRATCH/small.bin small
+pcopyin $SCRATCH/large.bin large
+copyout small $SCRATCH/small.copy
+copyout large $SCRATCH/large.copy
+EOF
+}
+
+for features in lazy encrypt,checksum; do
+    rm -f $SCRATCH/*.copy
+    test-input $features | ./bin/sfssh $SCRATCH/image.5000 5000 > /dev/null 2>&1
+
+    echo -n "Testing pcopyin ($features) in $SCRATCH/image.5000 ... "
+    if cmp -s $SCRATCH/large.bin $SCRATCH/large.copy &&
+       cmp -s $SCRATCH/small.bin $SCRATCH/small.copy; then
+        echo "Success"
+    else
+        echo "Failure"
+    fi
+done
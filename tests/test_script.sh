@@ -0,0 +1,36 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: -c and -f run without prompts and print one JSON object per command, with its output and disk I/O, and a total
+
+cat > $SCRATCH/script.sfs <<EOF
+# set up
+mount
+batch
+touch a
+mkdir b
+commit
+
+ls
+EOF
+
+./bin/sfssh -c "format; mount; mkdir d" $SCRATCH/image.100 100 > $SCRATCH/c.json 2> $SCRATCH/c.err
+./bin/sfssh -f $SCRATCH/script.sfs $SCRATCH/image.100 100 > $SCRATCH/f.json 2> /dev/null
+
+echo -n "Testing scripts in $SCRATCH/image.100 ... "
+if ! grep -q "sfs> " $SCRATCH/c.err &&
+   [ "$(sed 's/"us":[0-9.]*,//' $SCRATCH/c.json)" = '{"line":1,"command":"format","reads":0,"writes":101,"output":"disk formatted.\n"}
+{"line":2,"command":"mount","reads":12,"writes":0,"output":"disk mounted.\n"}
+{"line":3,"command":"mkdir d","reads":3,"writes":2,"output":""}
+{"commands":3,"reads":15,"writes":103}' ] &&
+   [ "$(grep -o '"line":[0-9]*,"command":"[^"]*"' $SCRATCH/f.json)" = '"line":2,"command":"mount"
+"line":3,"command":"batch"
+"line":8,"command":"ls"' ] &&
+   grep -q '"output":"2 operations committed\\n"' $SCRATCH/f.json &&
+   tail -n 1 $SCRATCH/f.json | grep -q '^{"commands":3,'; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,89 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "kill \$DAEMON 2> /dev/null; rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: clients of one sfsd work in directories of their own at the same time, and the files are on the image after it stops
+
+printf 'format\nexit\n' | ./bin/sfssh $SCRATCH/image.1000 1000 > /dev/null 2>&1
+./bin/sfsd -t 4 $SCRATCH/image.1000 1000 $SCRATCH/sfsd.sock > /dev/null 2>&1 &
+DAEMON=$!
+for i in $(seq 50); do [ -S $SCRATCH/sfsd.sock ] && break; sleep 0.1; done
+
+for c in 1 2 3 4; do
+    head -c $((50000 * c)) /dev/urandom > $SCRATCH/in.$c
+    printf 'mkdir d%s\ncd d%s\nput %s f\nget f %s\nstat f\n' $c $c $SCRATCH/in.$c $SCRATCH/out.$c |
+	./bin/sfsc $SCRATCH/sfsd.sock > $SCRATCH/client.$c &
+done
+wait $(jobs -p | grep -v $DAEMON)
+
+SECOND=$(./bin/sfsd $SCRATCH/image.1000 1000 $SCRATCH/other.sock 2>&1)
+kill $DAEMON
+wait $DAEMON
+STATUS=$?
+
+LISTING=$(printf 'mount\ncd d3\nls\n' | ./bin/sfssh $SCRATCH/image.1000 1000 2> /dev/null | awk '$3 == "f" {print $3}')
+
+echo -n "Testing sfsd in $SCRATCH/image.1000 ... "
+if [ $STATUS -eq 0 ] && echo "$SECOND" | grep -q "Unable to lock" && [ "$LISTING" = "f" ] &&
+   cmp -s $SCRATCH/in.1 $SCRATCH/out.1 && cmp -s $SCRATCH/in.2 $SCRATCH/out.2 &&
+   cmp -s $SCRATCH/in.3 $SCRATCH/out.3 && cmp -s $SCRATCH/in.4 $SCRATCH/out.4 &&
+   grep -q "f: file, inum [0-9]*, 200000 bytes" $SCRATCH/client.4; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: a client that stops reading its responses is hung up on, and does not keep the only worker from others
+
+cat > $SCRATCH/stuck.cpp <<EOF
+#include "sfs/sfsd.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) return 1;
+
+    /* Reads of the whole file, sent at once, and none of the responses read */
+    for (uint32_t id = 0; id < 8; id++) {
+	SfsdRequest request;
+	memset(&request, 0, sizeof(request));
+	request.Length = 2;
+	request.Id = id;
+	request.Op = SFSD_READ;
+	request.Count = 1 << 20;
+	if (write(fd, &request, sizeof(request)) != sizeof(request) || write(fd, "f", 2) != 2) return 1;
+    }
+    sleep(30);
+    return 0;
+}
+EOF
+
+head -c 1048576 /dev/urandom > $SCRATCH/big
+printf 'format\nexit\n' | ./bin/sfssh $SCRATCH/stuck.1000 1000 > /dev/null 2>&1
+./bin/sfsd -t 1 $SCRATCH/stuck.1000 1000 $SCRATCH/stuck.sock > /dev/null 2>&1 &
+DAEMON=$!
+for i in $(seq 50); do [ -S $SCRATCH/stuck.sock ] && break; sleep 0.1; done
+printf 'put %s f\n' $SCRATCH/big | ./bin/sfsc $SCRATCH/stuck.sock > /dev/null 2>&1
+
+echo -n "Testing sfsd stuck client in $SCRATCH/stuck.1000 ... "
+if g++ -std=gnu++11 -Iinclude -o $SCRATCH/stuck $SCRATCH/stuck.cpp 2> /dev/null; then
+    $SCRATCH/stuck $SCRATCH/stuck.sock &
+    STUCK=$!
+    sleep 1
+    OTHER=$(printf 'stat f\n' | timeout 20 ./bin/sfsc $SCRATCH/stuck.sock 2>&1)
+    kill $STUCK 2> /dev/null
+fi
+if echo "$OTHER" | grep -q "f: file, inum [0-9]*, 1048576 bytes"; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: sfsload runs every job of a job file for its op count, and rejects jobs that do not fit the directories
+
+cat > $SCRATCH/test.job <<JOB
+[global]
+blocks=5000
+nrfiles=6
+nrdirs=2
+filesize=64k-128k
+ops=100
+runtime=0
+
+[writes]
+rw=write
+bs=4k
+threads=2
+iodepth=3
+
+[mixed]
+rw=randrw
+bs=16k
+JOB
+
+cat > $SCRATCH/bad.job <<JOB
+[crowded]
+nrfiles=20
+nrdirs=2
+JOB
+
+OUTPUT=$(./bin/sfsload -j $SCRATCH/test.job $SCRATCH/image.5000 2> /dev/null)
+STATUS=$?
+ERROR=$(./bin/sfsload $SCRATCH/bad.job 2>&1)
+
+echo -n "Testing sfsload in $SCRATCH/image.5000 ... "
+if [ $STATUS = 0 ] &&
+   echo "$OUTPUT" | grep -q '"write": {"ios": 200, "bytes": 819200,' &&
+   [ $(echo "$OUTPUT" | grep -o '"ios": [0-9]*' | awk '{s += $2} END {print s}') = 300 ] &&
+   [ $(echo "$OUTPUT" | grep -c '"errors": 0,') = 2 ] &&
+   echo "$ERROR" | grep -q "every directory holds 1 to 4 files"; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: holes of a sparse file are neither written by copyin nor by copyout
+
+truncate -s 3000000 $SCRATCH/sparse.bin
+head -c 10000 /dev/urandom | dd of=$SCRATCH/sparse.bin bs=1 seek=1500000 conv=notrunc 2> /dev/null
+
+format-input() {
+    cat <<EOF
+format lazy
+EOF
+}
+
+test-input() {
+    cat <<EOF
+mount
+copyin $SCRATCH/sparse.bin sparse
+copyout sparse $SCRATCH/sparse.copy
+EOF
+}
+
+format-input | ./bin/sfssh $SCRATCH/image.1000 1000 > /dev/null 2>&1
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.1000 1000 2> /dev/null)
+WRITES=$(echo "$OUTPUT" | awk '/disk block writes/ {print $1}')
+ALLOCATED=$(du -k $SCRATCH/sparse.copy | cut -f1)
+
+echo -n "Testing sparse in $SCRATCH/image.1000 ... "
+if cmp -s $SCRATCH/sparse.bin $SCRATCH/sparse.copy &&
+   [ "$WRITES" -lt 40 ] &&
+   [ "$ALLOCATED" -lt 100 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
+
+# Test: pipes are copied in and out in order, without seeking
+
+mkfifo $SCRATCH/in.fifo $SCRATCH/out.fifo
+
+pipe-input() {
+    cat <<EOF
+mount
+copyin $SCRATCH/in.fifo piped
+copyout piped $SCRATCH/out.fifo
+EOF
+}
+
+cat $SCRATCH/sparse.bin > $SCRATCH/in.fifo &
+cat $SCRATCH/out.fifo > $SCRATCH/piped.copy &
+OUTPUT=$(pipe-input | ./bin/sfssh $SCRATCH/image.1000 1000 2>&1)
+wait
+
+echo -n "Testing sparse pipe in $SCRATCH/image.1000 ... "
+if cmp -s $SCRATCH/sparse.bin $SCRATCH/piped.copy &&
+   [ "$(echo "$OUTPUT" | grep -c "^3000000 bytes copied")" -eq 2 ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
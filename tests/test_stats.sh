@@ -0,0 +1,40 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: stats counts the operations and the free space, and the Prometheus export is written again on exit
+
+head -c 100000 /dev/urandom > $SCRATCH/c.bin
+
+test-input() {
+    cat <<EOF
+format
+mount
+stats export $SCRATCH/sfs.prom
+mkdir d
+cd d
+copyin $SCRATCH/c.bin c
+copyin $SCRATCH/c.bin c2
+cd ..
+stats
+exit
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.500 500 2> /dev/null | sed 's/sfs> //g' | grep -E "^(mkdir|cd|copyin) |^Free ")
+EXPORT=$(grep -E '^sfs_(inodes|directories)\{state="used"\}|^sfs_operation_duration_seconds_count\{op="copyin"\}' $SCRATCH/sfs.prom)
+
+echo -n "Testing stats in $SCRATCH/image.500 ... "
+if [ "$(echo "$OUTPUT" | awk '{print $1, $2}')" = "mkdir 1
+cd 2
+copyin 2
+Free data
+Free inodes
+Free directories" ] && echo "$OUTPUT" | grep -q "Free data blocks : 392 of 444" && [ "$EXPORT" = 'sfs_operation_duration_seconds_count{op="copyin"} 2
+sfs_inodes{state="used"} 2
+sfs_directories{state="used"} 2' ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,41 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a tar stream read from stdin comes back out of tar-out unchanged, and the shell reads on after it
+
+mkdir -p $SCRATCH/tree/docs/old $SCRATCH/tree/empty $SCRATCH/extract
+head -c 3000000 /dev/urandom > $SCRATCH/tree/large.bin
+head -c 5000 /dev/urandom > $SCRATCH/tree/docs/small.bin
+head -c 70000 /dev/urandom > $SCRATCH/tree/docs/old/medium.bin
+touch $SCRATCH/tree/docs/empty.bin
+tar -C $SCRATCH -cf $SCRATCH/in.tar tree
+
+test-input() {
+    cat <<EOF
+format
+mount
+mkdir in
+cd in
+tar-in -
+EOF
+    cat $SCRATCH/in.tar
+    cat <<EOF
+tar-out tree $SCRATCH/out.tar
+cd ..
+ls
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.5000 5000 2> /dev/null)
+tar -C $SCRATCH/extract -xf $SCRATCH/out.tar 2> /dev/null
+
+echo -n "Testing tar in $SCRATCH/image.5000 ... "
+if diff -r $SCRATCH/tree $SCRATCH/extract/tree > /dev/null &&
+   echo "$OUTPUT" | grep -q "4 files and 4 directories extracted" &&
+   echo "$OUTPUT" | grep -q " in "; then
+    echo "Success"
+else
+    echo "Failure"
+fi
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a timeline holds the spans of a copyin, its steps and its disk writes, and closes as a JSON array;
+# without make TRACING=1 the shell says it is not built in
+
+head -c 20000 /dev/urandom > $SCRATCH/t.bin
+
+test-input() {
+    cat <<EOF
+format
+mount
+timeline start $SCRATCH/timeline.json
+copyin $SCRATCH/t.bin t
+timeline stop
+EOF
+}
+
+OUTPUT=$(test-input | ./bin/sfssh $SCRATCH/image.200 200 2> /dev/null)
+
+echo -n "Testing timeline in $SCRATCH/image.200 ... "
+if echo "$OUTPUT" | grep -q "rebuild with make TRACING=1"; then
+    if [ ! -e $SCRATCH/timeline.json ]; then
+	echo "Success"
+    else
+	echo "Failure"
+    fi
+elif [ "$(head -n 1 $SCRATCH/timeline.json)" = "[" ] && [ "$(tail -n 1 $SCRATCH/timeline.json)" = "]" ] &&
+     grep -q '"name":"copyin","cat":"fs","ph":"X"' $SCRATCH/timeline.json &&
+     grep -q '"name":"allocate_block","cat":"step"' $SCRATCH/timeline.json &&
+     grep -q '"name":"disk_write","cat":"disk".*"args":{"block":' $SCRATCH/timeline.json; then
+    echo "Success"
+else
+    echo "Failure"
+fi
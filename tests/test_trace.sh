@@ -0,0 +1,51 @@
+#!/bin/bash
+
+SCRATCH=$(mktemp -d)
+trap "rm -fr $SCRATCH" INT QUIT TERM EXIT
+
+# Test: a recorded shell session replays onto a fresh image, host files gone or not
+
+head -c 30000 /dev/urandom > $SCRATCH/a.bin
+
+test-input() {
+    cat <<EOF
+format
+mount
+trace start $SCRATCH/session.trace
+mkdir d
+cd d
+copyin $SCRATCH/a.bin a
+touch e
+cd ..
+batch
+mkdir d/x
+mv d/e d/x/e
+commit
+du d
+trace stop
+mkdir untraced
+EOF
+}
+
+test-check() {
+    cat <<EOF
+mount
+du d
+cd d
+ls x
+du untraced
+EOF
+}
+
+test-input | ./bin/sfssh $SCRATCH/image.200 200 > /dev/null 2>&1
+rm -f $SCRATCH/a.bin
+REPORT=$(./bin/sfsreplay $SCRATCH/session.trace $SCRATCH/replay.200 2> /dev/null)
+OUTPUT=$(test-check | ./bin/sfssh $SCRATCH/replay.200 200 2> /dev/null | grep -E "bytes in|\| e  ")
+
+echo -n "Testing trace replay in $SCRATCH/replay.200 ... "
+if echo "$REPORT" | grep -qE "^total +7 " && echo "$REPORT" | grep -qE "^copyin +1 +0 " && [ "$OUTPUT" = "30000 bytes in 9 blocks
+1          | e                | file " ]; then
+    echo "Success"
+else
+    echo "Failure"
+fi